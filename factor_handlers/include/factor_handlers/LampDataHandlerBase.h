@@ -9,6 +9,7 @@
 
 // Includes
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 
 #include <geometry_utils/GeometryUtilsROS.h>
 #include <geometry_utils/Transform3.h>
@@ -36,6 +37,9 @@
 #include <lamp_utils/CommonStructs.h>
 #include <lamp_utils/CommonFunctions.h>
 
+#include <functional>
+#include <memory>
+
 namespace gu = geometry_utils;
 namespace gr = geometry_utils::ros;
 
@@ -47,6 +51,33 @@ class LampDataHandlerBase {
     ~LampDataHandlerBase();
 
     virtual std::shared_ptr<FactorData> GetData() = 0;
+
+    // Event driven mode: the handler hands new data to the callback (from its
+    // subscriber callbacks) as soon as it is ready instead of keeping it for
+    // GetData. The callback must not block.
+    typedef std::function<void(std::shared_ptr<FactorData>)> DataCallback;
+    inline void SetDataCallback(const DataCallback& callback) {
+      data_callback_ = callback;
+    }
+    inline bool IsEventDriven() const {
+      return static_cast<bool>(data_callback_);
+    }
+
+  protected:
+
+    DataCallback data_callback_;
+
+    // Own callback queue: the subscriptions made through CallbackNodeHandle
+    // are served by a spinner thread of the handler instead of the LAMP
+    // thread, so they do not wait behind the LAMP callbacks. Shared state
+    // must then be guarded by the handler.
+    ros::NodeHandle CallbackNodeHandle(const ros::NodeHandle& n);
+    void StartSpinner();
+    // Call first thing in the derived destructor
+    void StopSpinner();
+    bool b_own_callback_queue_;
+    ros::CallbackQueue callback_queue_;
+    std::unique_ptr<ros::AsyncSpinner> spinner_;
 };
 
 #endif
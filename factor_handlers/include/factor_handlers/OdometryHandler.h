@@ -15,14 +15,17 @@
 #include <std_msgs/Float64.h>
 #include <std_msgs/Float64MultiArray.h>
 #include <lamp_utils/CommonStructs.h>
+#include <lamp_utils/StampedRingBuffer.h>
+
+#include <mutex>
 
 // Typedefs
 typedef nav_msgs::Odometry Odometry;
 typedef geometry_msgs::PoseWithCovarianceStamped PoseCovStamped;
 typedef std::pair<PoseCovStamped, PoseCovStamped> PoseCovStampedPair;
-typedef std::map<double, PoseCovStamped> OdomPoseBuffer;
+typedef lamp_utils::StampedRingBuffer<PoseCovStamped> OdomPoseBuffer;
 typedef std::pair<ros::Time, ros::Time> TimeStampedPair;
-typedef std::map<double, PointCloud> PointCloudBuffer;
+typedef lamp_utils::StampedRingBuffer<PointCloudConstPtr> PointCloudBuffer;
 
 typedef struct {
   bool b_has_value;
@@ -63,8 +66,10 @@ public:
   std::shared_ptr<FactorData> GetData(bool check_threshold);
   bool GetOdomDelta(const ros::Time t_now, GtsamPosCov& delta_pose);
   bool GetOdomDeltaLatestTime(ros::Time& t_now, GtsamPosCov& delta_pose);
-  bool GetKeyedScanAtTime(const ros::Time& stamp, PointCloud::Ptr& msg);
-  void ClearPreviousPointCloudScans(const PointCloudBuffer::iterator& itrTime);
+  // The scan is shared with the buffer (not copied)
+  bool GetKeyedScanAtTime(const ros::Time& stamp, PointCloudConstPtr& msg);
+  // Drop the scans older than the one at index in the buffer
+  void ClearPreviousPointCloudScans(size_t index);
   GtsamPosCov GetFusedOdomDeltaBetweenTimes(const ros::Time t1,
                                             const ros::Time t2);
 
@@ -94,20 +99,23 @@ protected:
   // void PointCloudCallback(const sensor_msgs::PointCloud2::ConstPtr& msg);
   void PointCloudCallback(const PointCloudConstPtr& msg);
 
-  // Odometry Storages
+  // Odometry Storages (max_buffer_size_ samples each)
   OdomPoseBuffer lidar_odometry_buffer_;
   OdomPoseBuffer visual_odometry_buffer_;
   OdomPoseBuffer wheel_odometry_buffer_;
 
-  // Point Cloud Storage (Time stamp and point cloud)
+  // Point Cloud Storage (Time stamp and point cloud), holds the received
+  // clouds without copying them
   PointCloudBuffer point_cloud_buffer_;
 
   // Utilities
   void InitializePoseCovStampedMsgValue(PoseCovStamped& msg);
-  template <typename T1, typename T2>
-  int CheckBufferSize(const std::map<T1, T2>& x) {
-    return x.size();
-  }
+  // Pose (SLERP on the rotation, linear on the translation) and covariance
+  // interpolated between two odometry samples, alpha in [0, 1]
+  void InterpolatePoseCov(const PoseCovStamped& first,
+                          const PoseCovStamped& second,
+                          double alpha,
+                          PoseCovStamped& output) const;
 
   void InitializeOdomValueAtKey(const Odometry::ConstPtr& msg,
                                 const unsigned int odom_buffer_id);
@@ -127,6 +135,9 @@ protected:
   void SetOdomValuesAtKey(const ros::Time query);
 
   // Getters
+  // Pose at stamp, interpolated between the samples around it. Queries
+  // outside the buffer take the first or last sample. new_stamp is the stamp
+  // of the sample nearest to the query, as used for the node times.
   bool GetPoseAtTime(const ros::Time stamp,
                      const OdomPoseBuffer& odom_buffer,
                      PoseCovStamped& output) const;
@@ -167,6 +178,13 @@ protected:
 
   // Factor data
   OdomData factors_;
+  // Arrival of the latest lidar odometry message
+  ros::WallTime last_lidar_arrival_;
+
+  // The subscriber callbacks may run on the handler's own spinner thread,
+  // every public method holds this while it touches the buffers or the
+  // fusion state. Recursive since the public methods call each other.
+  mutable std::recursive_mutex mutex_;
 
   /*
   Corner case handling
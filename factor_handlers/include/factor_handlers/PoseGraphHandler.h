@@ -9,8 +9,12 @@
 
 // Includes
 #include <factor_handlers/LampDataHandlerBase.h>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <lamp_utils/BoundedQueue.h>
 #include <lamp_utils/PointCloudUtils.h>
 
 namespace pu = parameter_utils;
@@ -44,6 +48,12 @@ class PoseGraphHandler : public LampDataHandlerBase {
     void PoseGraphCallback(const pose_graph_msgs::PoseGraph::ConstPtr& msg);
     void KeyedScanCallback(const pose_graph_msgs::KeyedScan::ConstPtr& msg);
 
+    // Keyed scan ingestion: each worker deserializes a scan once, computes
+    // its normals, republishes it and stores the cloud for GetData
+    void StartScanWorkers();
+    void StopScanWorkers();
+    void ScanWorker(size_t index);
+
     // Publishers
     ros::Publisher keyed_scan_pub_;
 
@@ -56,6 +66,18 @@ class PoseGraphHandler : public LampDataHandlerBase {
 
     // Pose graphs and keyed scans received from robot
     PoseGraphData data_;
+    // Written by the callbacks and the scan workers
+    std::mutex data_mutex_;
+
+    // Keyed scans waiting for each worker (unbounded, nothing is dropped).
+    // All scans of a robot go to the same worker, so they are republished
+    // in the order they were received
+    typedef lamp_utils::BoundedQueue<pose_graph_msgs::KeyedScan::ConstPtr>
+        ScanQueue;
+    std::vector<std::unique_ptr<ScanQueue>> scan_queues_;
+    std::unordered_map<unsigned char, size_t> robot_scan_worker_;
+    std::vector<std::thread> scan_workers_;
+    int num_scan_workers_;
 
     // Robots that the base station subscribes to
     std::set<std::string> robot_names_;
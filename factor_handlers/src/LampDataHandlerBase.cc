@@ -15,10 +15,37 @@ namespace pu = parameter_utils;
 namespace gu = geometry_utils;
 
 // Constructor
-LampDataHandlerBase::LampDataHandlerBase() {}
+LampDataHandlerBase::LampDataHandlerBase() : b_own_callback_queue_(false) {}
 
 // Destructor
-LampDataHandlerBase::~LampDataHandlerBase() {}
+LampDataHandlerBase::~LampDataHandlerBase() {
+  StopSpinner();
+}
+
+ros::NodeHandle
+LampDataHandlerBase::CallbackNodeHandle(const ros::NodeHandle& n) {
+  ros::NodeHandle nl(n);
+  if (b_own_callback_queue_) {
+    nl.setCallbackQueue(&callback_queue_);
+  }
+  return nl;
+}
+
+void LampDataHandlerBase::StartSpinner() {
+  if (!b_own_callback_queue_ || spinner_) {
+    return;
+  }
+  spinner_.reset(new ros::AsyncSpinner(1, &callback_queue_));
+  spinner_->start();
+}
+
+void LampDataHandlerBase::StopSpinner() {
+  if (!spinner_) {
+    return;
+  }
+  spinner_->stop();
+  spinner_.reset();
+}
 
 // // Main interface call
 // FactorData* LampDataHandlerBase::GetData() {
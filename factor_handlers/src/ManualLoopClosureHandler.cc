@@ -95,6 +95,10 @@ void ManualLoopClosureHandler::ManualLoopClosureCallback(const pose_graph_msgs::
 
   // Record that new data was stored
   factors_.b_has_data = true;
+
+  if (IsEventDriven()) {
+    data_callback_(GetData());
+  }
 }
 
 void ManualLoopClosureHandler::SuggestLoopClosureCallback(const pose_graph_msgs::PoseGraph::ConstPtr& msg) {
@@ -110,7 +114,8 @@ void ManualLoopClosureHandler::ResetFactorData() {
 
 std::shared_ptr<FactorData> ManualLoopClosureHandler::GetData() {
 
-  std::shared_ptr<LoopClosureData> output_data = std::make_shared<LoopClosureData>(factors_);
+  std::shared_ptr<LoopClosureData> output_data =
+      std::make_shared<LoopClosureData>(std::move(factors_));
   ResetFactorData();
 
   return output_data;
@@ -9,6 +9,8 @@
 // Includes
 #include <factor_handlers/OdometryHandler.h>
 
+#include <Eigen/Geometry>
+
 namespace pu = parameter_utils;
 
 // Constructor & Destructors
@@ -29,9 +31,15 @@ OdometryHandler::OdometryHandler()
   InitializePoseCovStampedMsgValue(lidar_odom_value_at_key_);
   InitializePoseCovStampedMsgValue(visual_odom_value_at_key_);
   InitializePoseCovStampedMsgValue(wheel_odom_value_at_key_);
+  point_cloud_buffer_.SetCapacity(pc_buffer_size_limit_);
+  lidar_odometry_buffer_.SetCapacity(max_buffer_size_);
+  visual_odometry_buffer_.SetCapacity(max_buffer_size_);
+  wheel_odometry_buffer_.SetCapacity(max_buffer_size_);
 }
 
-OdometryHandler::~OdometryHandler() {}
+OdometryHandler::~OdometryHandler() {
+  StopSpinner();
+}
 
 // Initialize
 // -------------------------------------------------------------------------------------------
@@ -62,6 +70,7 @@ bool OdometryHandler::LoadParameters(const ros::NodeHandle& n) {
     return false;
   if (!pu::Get("pc_buffer_size_limit", pc_buffer_size_limit_))
     return false;
+  point_cloud_buffer_.SetCapacity(pc_buffer_size_limit_);
 
   // Timestamp threshold used in GetPoseAtTime method to return true to the
   // caller
@@ -71,6 +80,9 @@ bool OdometryHandler::LoadParameters(const ros::NodeHandle& n) {
   // Specify a maximum buffer size to store history of Odometric data stream
   if (!pu::Get("max_buffer_size", max_buffer_size_))
     return false;
+  lidar_odometry_buffer_.SetCapacity(max_buffer_size_);
+  visual_odometry_buffer_.SetCapacity(max_buffer_size_);
+  wheel_odometry_buffer_.SetCapacity(max_buffer_size_);
 
   if (!pu::Get("b_debug_pointcloud_buffer", b_debug_pointcloud_buffer_))
     return false;
@@ -83,6 +95,9 @@ bool OdometryHandler::LoadParameters(const ros::NodeHandle& n) {
   if (!pu::Get("subscriptions/b_register_wheel_sub", b_register_wheel_sub_))
     return false;
 
+  // Optional: serve the subscriptions on a spinner thread of the handler
+  pu::Get("callback_queues/separate", b_own_callback_queue_);
+
   return true;
 }
 
@@ -91,25 +106,26 @@ bool OdometryHandler::RegisterCallbacks(const ros::NodeHandle& n) {
            name_.c_str());
 
   ros::NodeHandle nl(n);
+  ros::NodeHandle nq = CallbackNodeHandle(n);
 
   // TODO - check what is a reasonable buffer size
 
   if (b_register_lidar_sub_) {
-    lidar_odom_sub_ = nl.subscribe(
+    lidar_odom_sub_ = nq.subscribe(
         "lio_odom", 10, &OdometryHandler::LidarOdometryCallback, this);
   }
   if (b_register_visual_sub_) {
-    visual_odom_sub_ = nl.subscribe(
+    visual_odom_sub_ = nq.subscribe(
         "vio_odom", 10, &OdometryHandler::VisualOdometryCallback, this);
   }
   if (b_register_wheel_sub_) {
-    wheel_odom_sub_ = nl.subscribe(
+    wheel_odom_sub_ = nq.subscribe(
         "wio_odom", 10, &OdometryHandler::WheelOdometryCallback, this);
   }
 
   // Point Cloud callback
   point_cloud_sub_ =
-      nl.subscribe("pcld", 10, &OdometryHandler::PointCloudCallback, this);
+      nq.subscribe("pcld", 10, &OdometryHandler::PointCloudCallback, this);
 
   // Publishers
   if (b_debug_pointcloud_buffer_) {
@@ -119,6 +135,8 @@ bool OdometryHandler::RegisterCallbacks(const ros::NodeHandle& n) {
   factor_times_pub_ = nl.advertise<std_msgs::Float64MultiArray>(
       "lamp_odom_factor_times", 10, false);
 
+  StartSpinner();
+
   return true;
 }
 
@@ -126,33 +144,36 @@ bool OdometryHandler::RegisterCallbacks(const ros::NodeHandle& n) {
 // --------------------------------------------------------------------------------------------
 
 void OdometryHandler::LidarOdometryCallback(const Odometry::ConstPtr& msg) {
+  // Before waiting for the lock, so the latency includes the wait
+  const ros::WallTime arrival = ros::WallTime::now();
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  last_lidar_arrival_ = arrival;
   // Initialize
   if (b_odom_value_initialized_.lidar == false) {
     InitializeOdomValueAtKey(msg, LIDAR_ODOM_BUFFER_ID);
   }
-  // CheckBufferSize
-  if (CheckBufferSize<double, PoseCovStamped>(lidar_odometry_buffer_) >
-      max_buffer_size_) {
-    lidar_odometry_buffer_.erase(lidar_odometry_buffer_.begin());
-  }
-  // InsertMsgInBuffer
+  // InsertMsgInBuffer (drops the oldest sample when the buffer is full)
   if (!InsertMsgInBuffer(msg, lidar_odometry_buffer_)) {
     ROS_WARN("OdometryHandler - LidarOdometryCallback - Unable to store "
              "message in buffer");
   }
+
+  // Event driven: hand a new factor over as soon as the threshold is crossed
+  if (IsEventDriven()) {
+    std::shared_ptr<FactorData> data = GetData(true);
+    if (data->b_has_data) {
+      data_callback_(std::move(data));
+    }
+  }
 }
 
 void OdometryHandler::VisualOdometryCallback(const Odometry::ConstPtr& msg) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
   // Initialize
   if (b_odom_value_initialized_.visual == false) {
     InitializeOdomValueAtKey(msg, VISUAL_ODOM_BUFFER_ID);
   }
-  // CheckBufferSize
-  if (CheckBufferSize<double, PoseCovStamped>(visual_odometry_buffer_) >
-      max_buffer_size_) {
-    visual_odometry_buffer_.erase(visual_odometry_buffer_.begin());
-  }
-  // InsertMsgInBuffer
+  // InsertMsgInBuffer (drops the oldest sample when the buffer is full)
   if (!InsertMsgInBuffer(msg, visual_odometry_buffer_)) {
     ROS_WARN("OdometryHandler - VisualOdometryCallback - Unable to store "
              "message in buffer");
@@ -160,16 +181,12 @@ void OdometryHandler::VisualOdometryCallback(const Odometry::ConstPtr& msg) {
 }
 
 void OdometryHandler::WheelOdometryCallback(const Odometry::ConstPtr& msg) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
   // Initialize
   if (b_odom_value_initialized_.wheel == false) {
     InitializeOdomValueAtKey(msg, WHEEL_ODOM_BUFFER_ID);
   }
-  // CheckBufferSize
-  if (CheckBufferSize<double, PoseCovStamped>(wheel_odometry_buffer_) >
-      max_buffer_size_) {
-    wheel_odometry_buffer_.erase(wheel_odometry_buffer_.begin());
-  }
-  // InsertMsgInBuffer
+  // InsertMsgInBuffer (drops the oldest sample when the buffer is full)
   if (!InsertMsgInBuffer(msg, wheel_odometry_buffer_)) {
     ROS_WARN("OdometryHandler - WheelOdometryCallback - Unable to store "
              "message in buffer");
@@ -190,19 +207,11 @@ void OdometryHandler::WheelOdometryCallback(const Odometry::ConstPtr& msg) {
 //}
 
 void OdometryHandler::PointCloudCallback(const PointCloudConstPtr& msg) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
   ros::Time current_timestamp;
   pcl_conversions::fromPCL(msg->header.stamp, current_timestamp);
-  point_cloud_buffer_.insert({current_timestamp.toSec(), *msg});
-
-  //  double current_timestamp = msg->header.stamp.toSec();
-  //  PointCloud current_pointcloud;
-  //  pcl::fromROSMsg(*msg, current_pointcloud);
-  //  point_cloud_buffer_.insert({current_timestamp, current_pointcloud});
-  // Clear start of buffer if buffer is too large
-  if (point_cloud_buffer_.size() > pc_buffer_size_limit_) {
-    // Clear the first entry in the buffer
-    point_cloud_buffer_.erase(point_cloud_buffer_.begin());
-  }
+  // Store the shared cloud, the oldest one is dropped if the buffer is full
+  point_cloud_buffer_.Insert(current_timestamp.toSec(), msg);
 }
 
 // Utilities
@@ -217,26 +226,55 @@ void OdometryHandler::InitializePoseCovStampedMsgValue(PoseCovStamped& msg) {
   msg.pose.pose.orientation.w = 1;
 }
 
+void OdometryHandler::InterpolatePoseCov(const PoseCovStamped& first,
+                                         const PoseCovStamped& second,
+                                         double alpha,
+                                         PoseCovStamped& output) const {
+  const geometry_msgs::Pose& p1 = first.pose.pose;
+  const geometry_msgs::Pose& p2 = second.pose.pose;
+
+  output.header = first.header;
+  output.pose.pose.position.x =
+      (1.0 - alpha) * p1.position.x + alpha * p2.position.x;
+  output.pose.pose.position.y =
+      (1.0 - alpha) * p1.position.y + alpha * p2.position.y;
+  output.pose.pose.position.z =
+      (1.0 - alpha) * p1.position.z + alpha * p2.position.z;
+
+  const Eigen::Quaterniond q1(p1.orientation.w,
+                              p1.orientation.x,
+                              p1.orientation.y,
+                              p1.orientation.z);
+  const Eigen::Quaterniond q2(p2.orientation.w,
+                              p2.orientation.x,
+                              p2.orientation.y,
+                              p2.orientation.z);
+  const Eigen::Quaterniond q =
+      q1.normalized().slerp(alpha, q2.normalized());
+  output.pose.pose.orientation.x = q.x();
+  output.pose.pose.orientation.y = q.y();
+  output.pose.pose.orientation.z = q.z();
+  output.pose.pose.orientation.w = q.w();
+
+  for (size_t i = 0; i < output.pose.covariance.size(); i++) {
+    output.pose.covariance[i] = (1.0 - alpha) * first.pose.covariance[i] +
+        alpha * second.pose.covariance[i];
+  }
+}
+
 bool OdometryHandler::InsertMsgInBuffer(const Odometry::ConstPtr& odom_msg,
                                         OdomPoseBuffer& buffer) {
-  auto initial_size = buffer.size();
   PoseCovStamped current_msg;
   current_msg.header = odom_msg->header;
   current_msg.pose = odom_msg->pose;
-  current_msg.pose.covariance = odom_msg->pose.covariance;
   auto current_time = odom_msg->header.stamp.toSec();
-  buffer.insert({current_time, current_msg});
-  auto final_size = buffer.size();
-  if (final_size == (initial_size + 1)) {
-    // Msg insertion was successful, return true to the caller
-    return true;
-  } else {
-    return false;
-  }
+  // Returns false for a repeated or too old stamp
+  return buffer.Insert(current_time, current_msg);
 }
 
 bool OdometryHandler::GetOdomDelta(const ros::Time t_now,
                                    GtsamPosCov& delta_pose) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
   // Check odometry buffer size - return false otherwise
   if (!CheckOdomSize()) {
     ROS_WARN_ONCE("Buffers are empty, returning no data (GetOdomDelta)");
@@ -249,7 +287,7 @@ bool OdometryHandler::GetOdomDelta(const ros::Time t_now,
   if (b_is_first_query_) {
     // Get the first time from the lidar scan
     if (lidar_odometry_buffer_.size() > 1) {
-      query_timestamp_first_.fromSec(lidar_odometry_buffer_.begin()->first);
+      query_timestamp_first_.fromSec(lidar_odometry_buffer_.Stamp(0));
     } else {
       query_timestamp_first_ = t_now;
     }
@@ -270,9 +308,10 @@ bool OdometryHandler::GetOdomDelta(const ros::Time t_now,
   if (!fused_odom_.b_has_value) {
     ROS_ERROR("No valid return from GetFusedOdomDelta");
     ROS_INFO_STREAM("Earliest timestamp in buffer is "
-                    << lidar_odometry_buffer_.begin()->first);
+                    << lidar_odometry_buffer_.Stamp(0));
     ROS_INFO_STREAM("Latest timestamp in buffer is "
-                    << lidar_odometry_buffer_.rbegin()->first);
+                    << lidar_odometry_buffer_.Stamp(
+                           lidar_odometry_buffer_.size() - 1));
     ROS_INFO_STREAM("Input times are " << query_timestamp_first_.toSec()
                                        << " and " << t_now.toSec());
     return false;
@@ -291,22 +330,28 @@ bool OdometryHandler::GetOdomDelta(const ros::Time t_now,
 // lidar timestamps Return the timestamp for use in LAMP
 bool OdometryHandler::GetOdomDeltaLatestTime(ros::Time& t_latest,
                                              GtsamPosCov& delta_pose) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
   if (!CheckOdomSize()) {
     ROS_WARN_ONCE(
         "Buffers are empty, returning no data (GetOdomDeltaLatestTime)");
     return false;
   }
-  // Get the latest time (rbegin is the last entry in the map)
-  t_latest.fromSec(lidar_odometry_buffer_.rbegin()->first);
+  // Get the latest time (last entry in the buffer)
+  t_latest.fromSec(
+      lidar_odometry_buffer_.Stamp(lidar_odometry_buffer_.size() - 1));
 
   // Get the delta as normal
   return GetOdomDelta(t_latest, delta_pose);
 }
 
 std::shared_ptr<FactorData> OdometryHandler::GetData(bool check_threshold) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
   // Main interface with lamp for getting factor information
-  std::shared_ptr<OdomData> output_data = std::make_shared<OdomData>(factors_);
+  std::shared_ptr<OdomData> output_data =
+      std::make_shared<OdomData>(std::move(factors_));
+  ResetFactorData();
   output_data->b_has_data = false;
+  output_data->arrival_time = last_lidar_arrival_;
 
   static bool empty_buffer = false;
   if (!CheckOdomSize()) {
@@ -322,7 +367,7 @@ std::shared_ptr<FactorData> OdometryHandler::GetData(bool check_threshold) {
 
   GtsamPosCov fused_odom_for_factor;
 
-  PointCloud::Ptr new_scan(new PointCloud);
+  PointCloudConstPtr new_scan;
   OdometryFactor new_odom;
 
   if (!check_threshold ||
@@ -333,7 +378,8 @@ std::shared_ptr<FactorData> OdometryHandler::GetData(bool check_threshold) {
     ros::Time t2;
     ros::Time t_odom;
 
-    t_odom.fromSec(lidar_odometry_buffer_.rbegin()->first);
+    t_odom.fromSec(
+        lidar_odometry_buffer_.Stamp(lidar_odometry_buffer_.size() - 1));
 
     // Get keyed scan from closest time to latest odom
     if (!GetKeyedScanAtTime(t_odom, new_scan)) {
@@ -400,22 +446,22 @@ std::shared_ptr<FactorData> OdometryHandler::GetData() {
 }
 
 bool OdometryHandler::GetKeyedScanAtTime(const ros::Time& stamp,
-                                         PointCloud::Ptr& msg) {
-  if (point_cloud_buffer_.size() == 0) {
+                                         PointCloudConstPtr& msg) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  if (point_cloud_buffer_.empty()) {
     ROS_WARN("Have no point clouds in buffer, not returning any keyed scan");
     return false;
   }
 
   // Search for lower-bound (first entry that is not less than the input
   // timestamp)
-  auto itrTime = point_cloud_buffer_.lower_bound(stamp.toSec());
-  auto time2 = itrTime->first;
+  size_t index = point_cloud_buffer_.LowerBound(stamp.toSec());
   double time_diff;
 
   // If this gives the start of the buffer, then take that point cloud
-  if (itrTime == point_cloud_buffer_.begin()) {
-    *msg = itrTime->second;
-    time_diff = itrTime->first - stamp.toSec();
+  if (index == 0) {
+    msg = point_cloud_buffer_.Value(index);
+    time_diff = point_cloud_buffer_.Stamp(index) - stamp.toSec();
     if (time_diff > keyed_scan_time_diff_limit_) {
       ROS_WARN(
           "Time diff between point cloud and node larger than threshold Using "
@@ -424,44 +470,42 @@ bool OdometryHandler::GetKeyedScanAtTime(const ros::Time& stamp,
                                  << " s. Time diff is: " << time_diff
                                  << ". [GetKeyedScanAtTime]");
     }
-  } else if (itrTime == point_cloud_buffer_.end()) {
+  } else if (index == point_cloud_buffer_.size()) {
     // Check if it is past the end of the buffer - if so, take the last point
     // cloud
-    itrTime--;
-    *msg = itrTime->second;
-    time_diff = stamp.toSec() - itrTime->first;
-    if (stamp.toSec() - itrTime->first > ts_threshold_) {
+    index--;
+    msg = point_cloud_buffer_.Value(index);
+    time_diff = stamp.toSec() - point_cloud_buffer_.Stamp(index);
+    if (time_diff > ts_threshold_) {
       if (b_debug_pointcloud_buffer_) {
         ROS_WARN(
             "Timestamp past the end of the point cloud buffer [GetKeyedScan]");
         ROS_WARN_STREAM("input time is "
                         << stamp.toSec() << "s, and latest time is "
-                        << itrTime->first << " s [GetKeyedScan]"
+                        << point_cloud_buffer_.Stamp(index)
+                        << " s [GetKeyedScan]"
                         << " diff is " << time_diff
                         << ". [GetKeyedScanAtTime]");
       }
     }
-    ClearPreviousPointCloudScans(itrTime);
+    ClearPreviousPointCloudScans(index);
   } else {
     // Otherwise, step back by 1 to get the time before the input time (t1,
     // stamp, t2)
-    double time1 = std::prev(itrTime, 1)->first;
-
-    PointCloudBuffer::iterator itrTimeReturned;
+    double time1 = point_cloud_buffer_.Stamp(index - 1);
+    double time2 = point_cloud_buffer_.Stamp(index);
 
     // If closer to time2, then use that
     if (time2 - stamp.toSec() < stamp.toSec() - time1) {
-      *msg = itrTime->second;
       time_diff = time2 - stamp.toSec();
-      itrTimeReturned = itrTime;
     } else {
       // Otherwise use time1
-      *msg = std::prev(itrTime)->second;
       time_diff = stamp.toSec() - time1;
-      itrTimeReturned = std::prev(itrTime);
+      index--;
     }
+    msg = point_cloud_buffer_.Value(index);
 
-    ClearPreviousPointCloudScans(itrTimeReturned);
+    ClearPreviousPointCloudScans(index);
   }
 
   // Check if the time difference is too large
@@ -482,10 +526,9 @@ bool OdometryHandler::GetKeyedScanAtTime(const ros::Time& stamp,
   return true;
 }
 
-void OdometryHandler::ClearPreviousPointCloudScans(
-    const PointCloudBuffer::iterator& itrTime) {
-  auto itrBegin = point_cloud_buffer_.begin();
-  point_cloud_buffer_.erase(itrBegin, itrTime);
+void OdometryHandler::ClearPreviousPointCloudScans(size_t index) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  point_cloud_buffer_.EraseOldest(index);
 }
 
 // Utilities
@@ -493,7 +536,8 @@ void OdometryHandler::ClearPreviousPointCloudScans(
 
 GtsamPosCov OdometryHandler::GetFusedOdomDeltaBetweenTimes(const ros::Time t1,
                                                            const ros::Time t2) {
-  // TODO - Interpolate here rather than just getting the closest times
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  // The poses at t1 and t2 are interpolated in the odometry buffers
   GtsamPosCov output_odom;
   output_odom.b_has_value = false;
 
@@ -659,56 +703,62 @@ bool OdometryHandler::GetPoseAtTime(const ros::Time stamp,
                                     PoseCovStamped& output,
                                     ros::Time* new_stamp) const {
   *new_stamp = stamp;
-  // If map is empty, return false to the caller
-  if (odom_buffer.size() == 0) {
+  // If buffer is empty, return false to the caller
+  if (odom_buffer.empty()) {
     return false;
   }
 
   // Given the input timestamp, search for lower bound (first entry that is not
   // less than the given timestamp)
-  auto itrTime = odom_buffer.lower_bound(stamp.toSec());
-  auto time2 = itrTime->first;
+  size_t index = odom_buffer.LowerBound(stamp.toSec());
   double time_diff;
 
   // If this gives the start of the buffer, then take that PosCovStamped
-  if (itrTime == odom_buffer.begin()) {
-    output = itrTime->second;
-    *new_stamp = ros::Time(itrTime->first);
-    time_diff = itrTime->first - stamp.toSec();
+  if (index == 0) {
+    output = odom_buffer.Value(index);
+    *new_stamp = ros::Time(odom_buffer.Stamp(index));
+    time_diff = odom_buffer.Stamp(index) - stamp.toSec();
     if (time_diff > ts_threshold_) {
       ROS_WARN("Timestamp before the start of the odometry buffer beyond "
                "threshold [GetPoseAtTime]");
       ROS_WARN_STREAM("time diff is: " << time_diff << ". [GetPoseAtTime]");
     }
-  } else if (itrTime == odom_buffer.end()) {
+  } else if (index == odom_buffer.size()) {
     // Check if it is past the end of the buffer - if so, then take the last
     // PosCovStamped
-    itrTime--;
-    output = itrTime->second;
-    *new_stamp = ros::Time(itrTime->first);
-    time_diff = stamp.toSec() - itrTime->first;
+    index--;
+    output = odom_buffer.Value(index);
+    *new_stamp = ros::Time(odom_buffer.Stamp(index));
+    time_diff = stamp.toSec() - odom_buffer.Stamp(index);
     if (time_diff > ts_threshold_) {
       ROS_WARN("Timestamp past the end of the odometry buffer and beyond "
                "threshold [GetPoseAtTime]");
       ROS_WARN_STREAM("input time is "
                       << stamp.toSec() << "s, and latest time is "
-                      << itrTime->first << " s"
+                      << odom_buffer.Stamp(index) << " s"
                       << " diff is " << time_diff << ". [GetPoseAtTime]");
     }
+  } else if (odom_buffer.Stamp(index) == stamp.toSec()) {
+    // Exact sample
+    output = odom_buffer.Value(index);
+    *new_stamp = ros::Time(odom_buffer.Stamp(index));
+    time_diff = 0.0;
   } else {
-    // Otherwise step back by 1 to get the time before the input time (time1,
-    // stamp, time2)
-    double time1 = std::prev(itrTime, 1)->first;
-
-    // If closer to time2, then use that
+    // Otherwise interpolate between the samples before and after the input
+    // time (time1, stamp, time2)
+    double time1 = odom_buffer.Stamp(index - 1);
+    double time2 = odom_buffer.Stamp(index);
+    InterpolatePoseCov(odom_buffer.Value(index - 1),
+                       odom_buffer.Value(index),
+                       (stamp.toSec() - time1) / (time2 - time1),
+                       output);
+    output.header.stamp = stamp;
+    // Distance to the closest sample, to reject queries in odometry gaps
     if (time2 - stamp.toSec() < stamp.toSec() - time1) {
-      output = itrTime->second;
-      *new_stamp = ros::Time(itrTime->first);
+      *new_stamp = ros::Time(time2);
       time_diff = time2 - stamp.toSec();
     } else {
-      // Otherwise use time1
-      output = std::prev(itrTime, 1)->second;
-      *new_stamp = ros::Time(std::prev(itrTime, 1)->first);
+      *new_stamp = ros::Time(time1);
       time_diff = stamp.toSec() - time1;
     }
   }
@@ -785,51 +835,50 @@ bool OdometryHandler::GetTransformBetweenTimes(
 
 bool OdometryHandler::GetClosestLidarTime(const ros::Time stamp,
                                           ros::Time& closest_stamp) const {
-  // Map based logic
-
-  // If map is empty, return false to the caller
-  if (lidar_odometry_buffer_.size() == 0) {
+  // If buffer is empty, return false to the caller
+  if (lidar_odometry_buffer_.empty()) {
     return false;
   }
 
   // Given the input timestamp, search for lower bound (first entry that is not
   // less than the given timestamp)
-  auto itrTime = lidar_odometry_buffer_.lower_bound(stamp.toSec());
-  auto time2 = itrTime->first;
+  size_t index = lidar_odometry_buffer_.LowerBound(stamp.toSec());
 
   // If this gives the start of the buffer, then take that PosCovStamped
-  if (itrTime == lidar_odometry_buffer_.begin()) {
-    closest_stamp.fromSec(itrTime->first);
+  if (index == 0) {
+    closest_stamp.fromSec(lidar_odometry_buffer_.Stamp(index));
     return true;
   }
 
   // Check if it is past the end of the buffer - if so, then take the last
   // PosCovStamped
-  if (itrTime == lidar_odometry_buffer_.end()) {
-    itrTime--;
-    closest_stamp.fromSec(itrTime->first);
+  if (index == lidar_odometry_buffer_.size()) {
+    index--;
+    closest_stamp.fromSec(lidar_odometry_buffer_.Stamp(index));
     if ((stamp - closest_stamp).toSec() > ts_threshold_) {
       ROS_WARN("Timestamp past the end of the lidar odometry buffer "
                "[GetClosestLidarTime]");
       ROS_WARN_STREAM("input time is "
                       << stamp.toSec() << "s, and latest time is "
-                      << itrTime->first << " s [GetClosestLidarTime]");
+                      << lidar_odometry_buffer_.Stamp(index)
+                      << " s [GetClosestLidarTime]");
     }
     return true;
   }
 
   // Otherwise step back by 1 to get the time before the input time (time1,
   // stamp, time2)
-  double time1 = std::prev(itrTime, 1)->first;
+  double time1 = lidar_odometry_buffer_.Stamp(index - 1);
+  double time2 = lidar_odometry_buffer_.Stamp(index);
   double time_diff;
 
   // If closer to time2, then use that
   if (time2 - stamp.toSec() < stamp.toSec() - time1) {
-    closest_stamp.fromSec(itrTime->first);
+    closest_stamp.fromSec(time2);
     time_diff = time2 - stamp.toSec();
   } else {
     // Otherwise use time1
-    closest_stamp.fromSec(std::prev(itrTime, 1)->first);
+    closest_stamp.fromSec(time1);
     time_diff = stamp.toSec() - time1;
   }
 
@@ -7,9 +7,16 @@
 // Includes
 #include <factor_handlers/PoseGraphHandler.h>
 
-PoseGraphHandler::PoseGraphHandler() { }
+#include <limits>
 
-PoseGraphHandler::~PoseGraphHandler() { }
+PoseGraphHandler::PoseGraphHandler()
+  : num_scan_workers_(2) { }
+
+PoseGraphHandler::~PoseGraphHandler() {
+  // No more scans for the workers
+  StopSpinner();
+  StopScanWorkers();
+}
 
 bool PoseGraphHandler::Initialize(const ros::NodeHandle& n, std::vector<std::string> robot_names) {
   name_ = ros::names::append(n.getNamespace(), "PoseGraphHandler");
@@ -34,6 +41,9 @@ bool PoseGraphHandler::Initialize(const ros::NodeHandle& n, std::vector<std::str
     return false;
   }
 
+  StartScanWorkers();
+  StartSpinner();
+
   return true;
 }
 
@@ -51,6 +61,26 @@ bool PoseGraphHandler::LoadParameters(const ros::NodeHandle& n) {
                normals_compute_params_.num_threads))
     return false;
 
+  // Optional
+  pu::Get("normals_computation/num_workers", num_scan_workers_);
+  pu::Get("callback_queues/separate", b_own_callback_queue_);
+
+  // Each worker runs num_threads normal estimation threads, keep the total
+  // within the hardware threads
+  const int hardware_threads =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  num_scan_workers_ =
+      std::min(std::max(1, num_scan_workers_), hardware_threads);
+  if (num_scan_workers_ * normals_compute_params_.num_threads >
+      hardware_threads) {
+    normals_compute_params_.num_threads =
+        std::max(1, hardware_threads / num_scan_workers_);
+    ROS_WARN_STREAM("PoseGraphHandler: Limiting normal estimation to "
+                    << normals_compute_params_.num_threads << " threads for "
+                    << num_scan_workers_ << " scan workers ("
+                    << hardware_threads << " hardware threads)");
+  }
+
   return true;
 }
 
@@ -71,7 +101,8 @@ bool PoseGraphHandler::RegisterCallbacks(const ros::NodeHandle& n) {
   ROS_INFO("%s: Registering callbacks in PoseGraphHandler",
            name_.c_str());
 
-  ros::NodeHandle nl(n);
+  // Served by the handler's spinner thread if it has its own queue
+  ros::NodeHandle nl = CallbackNodeHandle(n);
 
   ros::Subscriber pose_graph_sub;
   ros::Subscriber keyed_scan_sub;
@@ -111,10 +142,69 @@ bool PoseGraphHandler::CreatePublishers(const ros::NodeHandle& n) {
   return true;
 }
 
+void PoseGraphHandler::StartScanWorkers() {
+  StopScanWorkers();
+  if (scan_queues_.size() != static_cast<size_t>(num_scan_workers_)) {
+    scan_queues_.clear();
+    robot_scan_worker_.clear();
+    for (int i = 0; i < num_scan_workers_; i++) {
+      scan_queues_.emplace_back(
+          new ScanQueue(std::numeric_limits<size_t>::max()));
+    }
+  }
+  for (size_t i = 0; i < scan_queues_.size(); i++) {
+    scan_queues_[i]->Reopen();
+    scan_workers_.emplace_back(&PoseGraphHandler::ScanWorker, this, i);
+  }
+}
+
+void PoseGraphHandler::StopScanWorkers() {
+  // Workers finish the queued scans first
+  for (auto& queue : scan_queues_) {
+    queue->Close();
+  }
+  for (auto& worker : scan_workers_) {
+    worker.join();
+  }
+  scan_workers_.clear();
+}
+
+void PoseGraphHandler::ScanWorker(size_t index) {
+  pose_graph_msgs::KeyedScan::ConstPtr msg;
+  while (scan_queues_[index]->Pop(msg)) {
+    // Compute keyed scan normals
+    PointXyziCloud::Ptr msg_cloud(new PointXyziCloud);
+    PointCloud::Ptr cloud(new PointCloud);
+    pcl::fromROSMsg(msg->scan, *msg_cloud);
+    lamp_utils::AddNormals(msg_cloud, normals_compute_params_, cloud);
+
+    // Republish from base station
+    pose_graph_msgs::KeyedScan::Ptr new_pub_ks(new pose_graph_msgs::KeyedScan);
+    new_pub_ks->key = msg->key;
+    pcl::toROSMsg(*cloud, new_pub_ks->scan);
+    keyed_scan_pub_.publish(new_pub_ks);
+
+    // The same cloud goes to the pose graph
+    if (IsEventDriven()) {
+      std::shared_ptr<PoseGraphData> data = std::make_shared<PoseGraphData>();
+      data->b_has_data = true;
+      data->type = "posegraph";
+      data->clouds.emplace_back(gtsam::Symbol(msg->key), cloud);
+      data_callback_(std::move(data));
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(data_mutex_);
+    data_.b_has_data = true;
+    data_.clouds.emplace_back(gtsam::Symbol(msg->key), cloud);
+  }
+}
+
 std::shared_ptr<FactorData> PoseGraphHandler::GetData() {
+  std::lock_guard<std::mutex> lock(data_mutex_);
 
   // Main interface with lamp for getting new pose graphs
-  std::shared_ptr<PoseGraphData> output_data = std::make_shared<PoseGraphData>(data_);
+  std::shared_ptr<PoseGraphData> output_data =
+      std::make_shared<PoseGraphData>(std::move(data_));
 
   // Clear the stored data
   ResetGraphData();
@@ -126,13 +216,22 @@ void PoseGraphHandler::ResetGraphData() {
   data_.b_has_data = false; 
   data_.type = "posegraph";
   data_.graphs.clear();
-  data_.scans.clear();
+  data_.clouds.clear();
 }
 
 void PoseGraphHandler::PoseGraphCallback(const pose_graph_msgs::PoseGraph::ConstPtr& msg) {
 
-  data_.b_has_data = true;
-  data_.graphs.push_back(msg);
+  if (IsEventDriven()) {
+    std::shared_ptr<PoseGraphData> data = std::make_shared<PoseGraphData>();
+    data->b_has_data = true;
+    data->type = "posegraph";
+    data->graphs.push_back(msg);
+    data_callback_(std::move(data));
+  } else {
+    std::lock_guard<std::mutex> lock(data_mutex_);
+    data_.b_has_data = true;
+    data_.graphs.push_back(msg);
+  }
 
   std::unordered_set<uint64_t> repeated_keys;
   for (const auto& node : msg->nodes){
@@ -181,19 +280,23 @@ void PoseGraphHandler::PoseGraphCallback(const pose_graph_msgs::PoseGraph::Const
 
 void PoseGraphHandler::KeyedScanCallback(const pose_graph_msgs::KeyedScan::ConstPtr& msg) {
 
-  data_.b_has_data = true;
-  data_.scans.push_back(msg);
-
-  // Republish from base station
-  // Compute keyed scan normals
-  pose_graph_msgs::KeyedScan::Ptr new_pub_ks(
-      new pose_graph_msgs::KeyedScan(*msg));
-  PointXyziCloud::Ptr msg_cloud(new PointXyziCloud);
-  PointCloud::Ptr pub_cloud(new PointCloud);
-  pcl::fromROSMsg(msg->scan, *msg_cloud);
-  lamp_utils::AddNormals(msg_cloud, normals_compute_params_, pub_cloud);
-  pcl::toROSMsg(*pub_cloud, new_pub_ks->scan);
-  keyed_scan_pub_.publish(new_pub_ks);
+  // Normals, republishing and storage happen on the scan workers, one
+  // worker per robot (round robin) to keep each robot's scans in order
+  if (scan_queues_.empty()) {
+    ROS_WARN_STREAM("PoseGraphHandler: No scan workers, dropping keyed scan " << msg->key);
+    return;
+  }
+  const unsigned char robot = gtsam::Symbol(msg->key).chr();
+  auto worker = robot_scan_worker_.find(robot);
+  if (worker == robot_scan_worker_.end()) {
+    worker = robot_scan_worker_
+                 .emplace(robot, robot_scan_worker_.size() % scan_queues_.size())
+                 .first;
+  }
+  // Unbounded, never blocks
+  if (!scan_queues_[worker->second]->Push(msg)) {
+    ROS_WARN_STREAM("PoseGraphHandler: Scan workers stopped, dropping keyed scan " << msg->key);
+  }
   // Add scan
   if (keyed_scans_keys_.count(msg->key) > 0){
       ROS_DEBUG_STREAM("PoseGraphHandler: Repeated keyed Scan for key " << msg->key);
@@ -96,7 +96,8 @@ void RobotPoseHandler::ResetPoseData() {
 std::shared_ptr<FactorData> RobotPoseHandler::GetData() {
 
   // Main interface with lamp for getting new pose graphs
-  std::shared_ptr<RobotPoseData> output_data = std::make_shared<RobotPoseData>(data_);
+  std::shared_ptr<RobotPoseData> output_data =
+      std::make_shared<RobotPoseData>(std::move(data_));
   ResetPoseData();
 
   return output_data;
@@ -110,4 +111,8 @@ void RobotPoseHandler::PoseCallback(const geometry_msgs::PoseStamped::ConstPtr&
   // Overwrite previous data from this robot with the newest entry
   data_.poses[robot] = new_data;
   data_.b_has_data = true;
+
+  if (IsEventDriven()) {
+    data_callback_(GetData());
+  }
 }
\ No newline at end of file
@@ -96,6 +96,12 @@ protected:
                      PoseCovStamped& output) {
     return oh.GetPoseAtTime(stamp, odom_buffer, output);
   }
+  bool GetPoseAtTime(const ros::Time stamp,
+                     const OdomPoseBuffer& odom_buffer,
+                     PoseCovStamped& output,
+                     ros::Time* new_stamp) {
+    return oh.GetPoseAtTime(stamp, odom_buffer, output, new_stamp);
+  }
   /*
   bool GetPosesAtTimes(const ros::Time t1,
                        const ros::Time t2,
@@ -146,11 +152,11 @@ protected:
   double CalculatePoseDelta(const GtsamPosCov gtsam_pos_cov) {
     return oh.CalculatePoseDelta(gtsam_pos_cov);
   }
-  bool GetKeyedScanAtTime(const ros::Time& stamp, PointCloud::Ptr& msg) {
+  bool GetKeyedScanAtTime(const ros::Time& stamp, PointCloudConstPtr& msg) {
     return oh.GetKeyedScanAtTime(stamp, msg);
   }
-  void ClearPreviousPointCloudScans(const PointCloudBuffer::iterator& itrTime) {
-    return oh.ClearPreviousPointCloudScans(itrTime);
+  void ClearPreviousPointCloudScans(size_t index) {
+    return oh.ClearPreviousPointCloudScans(index);
   }
 
   PointCloudBuffer *GetPointCloudBuffer() {
@@ -287,10 +293,10 @@ TEST_F(OdometryHandlerTest, TestGetPoseAtTime) {
   // Create an output
   PoseCovStamped myOutput;
   // Create a buffer
-  OdomPoseBuffer myBuffer;
-  myBuffer[t1_ros.toSec()] = msg_first;
-  myBuffer[t2_ros.toSec()] = msg_second;
-  myBuffer[t3_ros.toSec()] = msg_third;
+  OdomPoseBuffer myBuffer(10);
+  myBuffer.Insert(t1_ros.toSec(), msg_first);
+  myBuffer.Insert(t2_ros.toSec(), msg_second);
+  myBuffer.Insert(t3_ros.toSec(), msg_third);
   bool result = GetPoseAtTime(t3_ros, myBuffer, myOutput);
   EXPECT_NEAR(
       msg_third.pose.pose.position.x, myOutput.pose.pose.position.x, 1e-5);
@@ -304,10 +310,10 @@ TEST_F(OdometryHandlerTest, TestGetPoseAtTimeFuture) {
   // Create an output
   PoseCovStamped myOutput;
   // Create a buffer
-  OdomPoseBuffer myBuffer;
-  myBuffer[t1_ros.toSec()] = msg_first;
-  myBuffer[t2_ros.toSec()] = msg_second;
-  myBuffer[t3_ros.toSec()] = msg_third;
+  OdomPoseBuffer myBuffer(10);
+  myBuffer.Insert(t1_ros.toSec(), msg_first);
+  myBuffer.Insert(t2_ros.toSec(), msg_second);
+  myBuffer.Insert(t3_ros.toSec(), msg_third);
   ros::Time query;
   query.fromSec(1.5);
   bool result = GetPoseAtTime(query, myBuffer, myOutput);
@@ -323,10 +329,10 @@ TEST_F(OdometryHandlerTest, TestGetPoseAtTimePast) {
   // Create an output
   PoseCovStamped myOutput;
   // Create a buffer
-  OdomPoseBuffer myBuffer;
-  myBuffer[t1_ros.toSec()] = msg_first;
-  myBuffer[t2_ros.toSec()] = msg_second;
-  myBuffer[t3_ros.toSec()] = msg_third;
+  OdomPoseBuffer myBuffer(10);
+  myBuffer.Insert(t1_ros.toSec(), msg_first);
+  myBuffer.Insert(t2_ros.toSec(), msg_second);
+  myBuffer.Insert(t3_ros.toSec(), msg_third);
   ros::Time query;
   query.fromSec(0.6);
   bool result = GetPoseAtTime(query, myBuffer, myOutput);
@@ -342,11 +348,11 @@ TEST_F(OdometryHandlerTest, TestGetPoseAtTimeOutOfRange) {
   // Create an output
   PoseCovStamped myOutput;
   // Create a buffer
-  OdomPoseBuffer myBuffer;
+  OdomPoseBuffer myBuffer(10);
 
-  myBuffer[t1_ros.toSec()] = msg_first;
-  myBuffer[t2_ros.toSec()] = msg_second;
-  myBuffer[t3_ros.toSec()] = msg_third;
+  myBuffer.Insert(t1_ros.toSec(), msg_first);
+  myBuffer.Insert(t2_ros.toSec(), msg_second);
+  myBuffer.Insert(t3_ros.toSec(), msg_third);
   ros::Time query;
   query.fromSec(5000);
   bool result = GetPoseAtTime(query, myBuffer, myOutput);
@@ -355,6 +361,46 @@ TEST_F(OdometryHandlerTest, TestGetPoseAtTimeOutOfRange) {
   EXPECT_FALSE(result);
 }
 
+TEST_F(OdometryHandlerTest, TestGetPoseAtTimeInterpolated) {
+  ros::NodeHandle nh("~");
+  system("rosparam set ts_threshold 0.6");
+  oh.Initialize(nh);
+  PoseCovStamped myOutput;
+  OdomPoseBuffer myBuffer(10);
+  // 90 degree yaw and 1 m in y between t3 and t4
+  PoseCovStamped third = msg_third;
+  PoseCovStamped fourth = msg_fourth;
+  fourth.pose.pose.orientation.z = sqrt(0.5);
+  fourth.pose.pose.orientation.w = sqrt(0.5);
+  for (size_t i = 0; i < 36; i++) {
+    third.pose.covariance[i] = 1;
+    fourth.pose.covariance[i] = 3;
+  }
+  myBuffer.Insert(t3_ros.toSec(), third);
+  myBuffer.Insert(t4_ros.toSec(), fourth);
+  ros::Time query;
+  query.fromSec(0.75 * t3 + 0.25 * t4);
+  ASSERT_TRUE(GetPoseAtTime(query, myBuffer, myOutput));
+  gtsam::Pose3 pose = lamp_utils::ToGtsam(myOutput.pose.pose);
+  EXPECT_NEAR(3, pose.x(), 1e-5);
+  EXPECT_NEAR(0.25, pose.y(), 1e-5);
+  EXPECT_NEAR(M_PI / 8.0, pose.rotation().yaw(), 1e-5);
+  EXPECT_NEAR(1.5, myOutput.pose.covariance[0], 1e-5);
+  EXPECT_NEAR(query.toSec(), myOutput.header.stamp.toSec(), 1e-6);
+  // Node time still snaps to the nearest odometry sample
+  ros::Time new_stamp;
+  ASSERT_TRUE(GetPoseAtTime(query, myBuffer, myOutput, &new_stamp));
+  EXPECT_NEAR(t3, new_stamp.toSec(), 1e-6);
+
+  // Buffer keeps the newest samples up to its capacity
+  OdomPoseBuffer small_buffer(2);
+  small_buffer.Insert(t1_ros.toSec(), msg_first);
+  small_buffer.Insert(t2_ros.toSec(), msg_second);
+  small_buffer.Insert(t3_ros.toSec(), msg_third);
+  ASSERT_EQ(2u, small_buffer.size());
+  EXPECT_NEAR(t2, small_buffer.Stamp(0), 1e-9);
+}
+
 TEST_F(OdometryHandlerTest, TestGetPoseBetweenTimesExact) {
   ros::NodeHandle nh("~");
   system("rosparam set ts_threshold 0.6");
@@ -362,10 +408,10 @@ TEST_F(OdometryHandlerTest, TestGetPoseBetweenTimesExact) {
   // Create an output
   GtsamPosCov myOutput;
   // Create a buffer
-  OdomPoseBuffer myBuffer;
-  myBuffer[t1_ros.toSec()] = msg_first;
-  myBuffer[t2_ros.toSec()] = msg_second;
-  myBuffer[t3_ros.toSec()] = msg_third;
+  OdomPoseBuffer myBuffer(10);
+  myBuffer.Insert(t1_ros.toSec(), msg_first);
+  myBuffer.Insert(t2_ros.toSec(), msg_second);
+  myBuffer.Insert(t3_ros.toSec(), msg_third);
   FillGtsamPosCovOdom(myBuffer, myOutput, t1_ros, t2_ros, LIDAR_ODOM_BUFFER_ID);
   EXPECT_NEAR(1, myOutput.pose.x(), 1e-5);
   EXPECT_TRUE(myOutput.b_has_value);
@@ -384,22 +430,23 @@ TEST_F(OdometryHandlerTest, TestGetPoseBetweenTimesOff) {
   // Create an output
   GtsamPosCov myOutput;
   // Create a buffer
-  OdomPoseBuffer myBuffer;
-  myBuffer[t1_ros.toSec()] = msg_first;
-  myBuffer[t2_ros.toSec()] = msg_second;
-  myBuffer[t3_ros.toSec()] = msg_third;
+  OdomPoseBuffer myBuffer(10);
+  myBuffer.Insert(t1_ros.toSec(), msg_first);
+  myBuffer.Insert(t2_ros.toSec(), msg_second);
+  myBuffer.Insert(t3_ros.toSec(), msg_third);
   ros::Time query1, query2, query3;
   query1.fromSec(1.01);
   query2.fromSec(1.04);
   query3.fromSec(1.08);
+  // Poses are interpolated: x = 1.2, 1.8 and 2.6
   FillGtsamPosCovOdom(myBuffer, myOutput, query1, query2, LIDAR_ODOM_BUFFER_ID);
-  EXPECT_NEAR(1, myOutput.pose.x(), 1e-5);
+  EXPECT_NEAR(0.6, myOutput.pose.x(), 1e-5);
   EXPECT_TRUE(myOutput.b_has_value);
   FillGtsamPosCovOdom(myBuffer, myOutput, query1, query3, LIDAR_ODOM_BUFFER_ID);
-  EXPECT_NEAR(2, myOutput.pose.x(), 1e-5);
+  EXPECT_NEAR(1.4, myOutput.pose.x(), 1e-5);
   EXPECT_TRUE(myOutput.b_has_value);
   FillGtsamPosCovOdom(myBuffer, myOutput, query2, query3, LIDAR_ODOM_BUFFER_ID);
-  EXPECT_NEAR(1, myOutput.pose.x(), 1e-5);
+  EXPECT_NEAR(0.8, myOutput.pose.x(), 1e-5);
   EXPECT_TRUE(myOutput.b_has_value);
 }
 
@@ -410,10 +457,10 @@ TEST_F(OdometryHandlerTest, TestGetPoseBetweenTimesOutOfRange) {
   // Create an output
   GtsamPosCov myOutput;
   // Create a buffer
-  OdomPoseBuffer myBuffer;
-  myBuffer[t1_ros.toSec()] = msg_first;
-  myBuffer[t2_ros.toSec()] = msg_second;
-  myBuffer[t3_ros.toSec()] = msg_third;
+  OdomPoseBuffer myBuffer(10);
+  myBuffer.Insert(t1_ros.toSec(), msg_first);
+  myBuffer.Insert(t2_ros.toSec(), msg_second);
+  myBuffer.Insert(t3_ros.toSec(), msg_third);
   ros::Time query1, query2, query3;
   query1.fromSec(0.7);
   query2.fromSec(1.3);
@@ -429,10 +476,10 @@ TEST_F(OdometryHandlerTest, TestGetPoseBetweenOutsideThreshold) {
   // Create an output
   GtsamPosCov myOutput;
   // Create a buffer
-  OdomPoseBuffer myBuffer;
-  myBuffer[t1_ros.toSec()] = msg_first;
-  myBuffer[t2_ros.toSec()] = msg_second;
-  myBuffer[t3_ros.toSec()] = msg_third;
+  OdomPoseBuffer myBuffer(10);
+  myBuffer.Insert(t1_ros.toSec(), msg_first);
+  myBuffer.Insert(t2_ros.toSec(), msg_second);
+  myBuffer.Insert(t3_ros.toSec(), msg_third);
   ros::Time query1, query2, query3;
   query1.fromSec(0.0);
   query2.fromSec(10.3);
@@ -449,12 +496,12 @@ TEST_F(OdometryHandlerTest, TestGetPoseBetweenTimesRotationOneStep90) {
   // Create an output
   GtsamPosCov myOutput;
   // Create a buffer
-  OdomPoseBuffer myBuffer;
-  myBuffer[t1_ros.toSec()] = msg_first;
-  myBuffer[t2_ros.toSec()] = msg_second;
-  myBuffer[t3_ros.toSec()] = msg_third;
-  myBuffer[t4_ros.toSec()] = msg_fourth;
-  myBuffer[t5_ros.toSec()] = msg_fifth;
+  OdomPoseBuffer myBuffer(10);
+  myBuffer.Insert(t1_ros.toSec(), msg_first);
+  myBuffer.Insert(t2_ros.toSec(), msg_second);
+  myBuffer.Insert(t3_ros.toSec(), msg_third);
+  myBuffer.Insert(t4_ros.toSec(), msg_fourth);
+  myBuffer.Insert(t5_ros.toSec(), msg_fifth);
   FillGtsamPosCovOdom(myBuffer, myOutput, t3_ros, t4_ros, LIDAR_ODOM_BUFFER_ID);
   EXPECT_NEAR(1, myOutput.pose.y(), 1e-5);
   EXPECT_NEAR(M_PI / 2.0f, myOutput.pose.rotation().yaw(), 1e-5);
@@ -469,12 +516,12 @@ TEST_F(OdometryHandlerTest, TestGetPoseBetweenTimesRotationCheckLocal) {
   // Create an output
   GtsamPosCov myOutput;
   // Create a buffer
-  OdomPoseBuffer myBuffer;
-  myBuffer[t1_ros.toSec()] = msg_first;
-  myBuffer[t2_ros.toSec()] = msg_second;
-  myBuffer[t3_ros.toSec()] = msg_third;
-  myBuffer[t4_ros.toSec()] = msg_fourth;
-  myBuffer[t5_ros.toSec()] = msg_fifth;
+  OdomPoseBuffer myBuffer(10);
+  myBuffer.Insert(t1_ros.toSec(), msg_first);
+  myBuffer.Insert(t2_ros.toSec(), msg_second);
+  myBuffer.Insert(t3_ros.toSec(), msg_third);
+  myBuffer.Insert(t4_ros.toSec(), msg_fourth);
+  myBuffer.Insert(t5_ros.toSec(), msg_fifth);
   FillGtsamPosCovOdom(myBuffer, myOutput, t4_ros, t5_ros, LIDAR_ODOM_BUFFER_ID);
   EXPECT_NEAR(1, myOutput.pose.y(), 1e-5);
   EXPECT_NEAR(M_PI / 2.0f, myOutput.pose.rotation().yaw(), 1e-5);
@@ -575,9 +622,9 @@ TEST_F(OdometryHandlerTest, TestGetFusedOdomDeltaOffExact) {
   EXPECT_NEAR(0.0, myOutput.pose.rotation().yaw(), 1e-5);
   EXPECT_TRUE(myOutput.b_has_value);
   EXPECT_TRUE(result);
-  // Expect a normal result
+  // Expect a normal result, interpolated at 1.04
   result = GetOdomDelta(query2, myOutput);
-  EXPECT_NEAR(1, myOutput.pose.x(), 1e-5);
+  EXPECT_NEAR(0.8, myOutput.pose.x(), 1e-5);
   EXPECT_NEAR(0.0, myOutput.pose.rotation().yaw(), 1e-5);
   EXPECT_TRUE(myOutput.b_has_value);
   EXPECT_TRUE(result);
@@ -968,12 +1015,12 @@ TEST_F(OdometryHandlerTest, TestGetRelativeDataOutOfRange) {
   EXPECT_FALSE(myOutput_1.b_has_value);
   // Corner case 2 (One query is out of range (ex) A robot stacks and stay at the same position for a while.)
   // query3 refers to the value of "lidar_odom_value_at_key_" because it's out of range
-  // query4 refers to the value associated with the time stamp t2 (=1.05)
+  // query4 is interpolated between t2 (=1.05) and t3 (=1.10)
   ros::Time query3, query4;
   query3.fromSec(0.0);
   query4.fromSec(1.07);
   myOutput_2 = GetFusedOdomDeltaBetweenTimes(query3, query4);
-  auto pose_expected_2 = gtsam::Pose3(gtsam::Rot3(1, 0, 0, 0), gtsam::Point3(1, 0, 0));
+  auto pose_expected_2 = gtsam::Pose3(gtsam::Rot3(1, 0, 0, 0), gtsam::Point3(1.4, 0, 0));
   EXPECT_TRUE((myOutput_2.pose).equals(pose_expected_2));
 }
 
@@ -1008,7 +1055,7 @@ TEST_F(OdometryHandlerTest, TestGetPosesAtTimes) {
   system("rosparam set ts_threshold 0.6");
   oh.Initialize(nh);
   // Create a buffer
-  OdomPoseBuffer myBuffer;
+  OdomPoseBuffer myBuffer(10);
   // Create an output
   PoseCovStampedPair myOutput;
   // Odometry-1
@@ -1056,10 +1103,11 @@ TEST_F(OdometryHandlerTest, TestGetKeyedScanAtTime) {
   PointCloudCallback(pc_ptr4);
   PointCloudCallback(pc_ptr5);
   // Create the keyed scan container to be filled by GetKeyedScanAtTime method
-  PointCloud point_cloud;
-  PointCloud::Ptr my_keyed_scan(new PointCloud(point_cloud));
+  PointCloudConstPtr my_keyed_scan;
   bool result = GetKeyedScanAtTime(t1_ros, my_keyed_scan);
   ASSERT_TRUE(result);
+  // The buffered cloud is returned, not a copy
+  EXPECT_EQ(pc_ptr1.get(), my_keyed_scan.get());
 }
 
 TEST_F(OdometryHandlerTest, TestGetKeyedScanAtTimeError) {
@@ -1090,8 +1138,7 @@ TEST_F(OdometryHandlerTest, TestGetKeyedScanAtTimeError) {
   PointCloudCallback(pc_ptr4);
   PointCloudCallback(pc_ptr5);
   // Create the keyed scan container to be filled by GetKeyedScanAtTime method
-  PointCloud point_cloud;
-  PointCloud::Ptr my_keyed_scan(new PointCloud(point_cloud));
+  PointCloudConstPtr my_keyed_scan;
   // Try past the end of the keyed scan buffer
   ros::Time t_test;
   t_test.fromSec(t5 + 5.0);
@@ -1124,10 +1171,40 @@ TEST_F(OdometryHandlerTest, TestClearPreviousPointCloudScans) {
   PointCloudCallback(pc_ptr3);
   auto ptr_buffer_2 = GetPointCloudBuffer();
   ASSERT_EQ(ptr_buffer_2->size(), 3);
-  auto itrTime_2 = ptr_buffer_2->lower_bound(t2);
-  ClearPreviousPointCloudScans(itrTime_2);
+  auto index_2 = ptr_buffer_2->LowerBound(t2);
+  ClearPreviousPointCloudScans(index_2);
   ASSERT_EQ(ptr_buffer_2->size(), 2);
-  ASSERT_EQ((ptr_buffer_2->rbegin())->first, t3);
+  ASSERT_EQ(ptr_buffer_2->Stamp(ptr_buffer_2->size() - 1), t3);
+}
+
+TEST_F(OdometryHandlerTest, TestPointCloudBufferCapacity) {
+  ros::NodeHandle nh("~");
+  system("rosparam set pc_buffer_size_limit 3");
+  oh.Initialize(nh);
+
+  // Clouds out of order, more than the buffer holds
+  std::vector<double> stamps = {t2, t1, t4, t3, t5};
+  std::vector<PointCloudConstPtr> clouds;
+  for (double t : stamps) {
+    PointCloud msg;
+    ros::Time stamp;
+    stamp.fromSec(t);
+    pcl_conversions::toPCL(stamp, msg.header.stamp);
+    clouds.push_back(PointCloudConstPtr(new PointCloud(msg)));
+    PointCloudCallback(clouds.back());
+  }
+
+  // The newest three, in time order, shared with the callers
+  auto buffer = GetPointCloudBuffer();
+  ASSERT_EQ(3u, buffer->size());
+  EXPECT_EQ(3u, buffer->capacity());
+  EXPECT_NEAR(t3, buffer->Stamp(0), 1e-6);
+  EXPECT_NEAR(t4, buffer->Stamp(1), 1e-6);
+  EXPECT_NEAR(t5, buffer->Stamp(2), 1e-6);
+  EXPECT_EQ(clouds[3].get(), buffer->Value(0).get());
+  EXPECT_EQ(clouds[4].get(), buffer->Value(2).get());
+  EXPECT_EQ(buffer->size(), buffer->LowerBound(t5 + 1.0));
+  EXPECT_EQ(1u, buffer->LowerBound(t4 - 1e-3));
 }
 
 /* TEST Utilities */
@@ -1181,7 +1258,7 @@ TEST_F(OdometryHandlerTest, InsertMsgInBuffer) {
   system("rosparam set keyed_scan_time_diff_limit 0.2");
   oh.Initialize(nh);
   // Create a buffer
-  OdomPoseBuffer myBuffer;
+  OdomPoseBuffer myBuffer(10);
   // Create a message
   Odometry odom_msg;
   odom_msg.pose = msg_first.pose;
@@ -1198,7 +1275,7 @@ TEST_F(OdometryHandlerTest, TestFillGtsamPosCovOdom) {
   system("rosparam set ts_threshold 0.6");
   system("rosparam set keyed_scan_time_diff_limit 0.2");
   oh.Initialize(nh);
-  OdomPoseBuffer odom_buffer;
+  OdomPoseBuffer odom_buffer(10);
   // Odometry-1
   Odometry odom_msg1;
   odom_msg1.pose = msg_first.pose;
@@ -1247,7 +1324,7 @@ TEST_F(OdometryHandlerTest, TestCalculatePoseDelta) {
   system("rosparam set ts_threshold 0.6");
   system("rosparam set keyed_scan_time_diff_limit 0.2");
   oh.Initialize(nh);
-  OdomPoseBuffer myBuffer;
+  OdomPoseBuffer myBuffer(10);
   GtsamPosCov my_fused_odom;
   my_fused_odom.pose = gtsam::Pose3();
   double delta = CalculatePoseDelta(my_fused_odom);
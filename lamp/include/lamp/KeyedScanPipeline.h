@@ -0,0 +1,95 @@
+/*
+ * Copyright Notes
+ *
+ * Authors: Benjamin Morrell    (benjamin.morrell@jpl.nasa.gov)
+ */
+
+#ifndef KEYED_SCAN_PIPELINE_H
+#define KEYED_SCAN_PIPELINE_H
+
+// Includes
+#include <ros/ros.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtsam/inference/Symbol.h>
+
+#include <lamp_utils/BoundedQueue.h>
+#include <lamp_utils/LampPcldFilter.h>
+#include <lamp_utils/PointCloudTypes.h>
+
+// Keyed scan preprocessing off the main LAMP loop. Scans go through two
+// worker threads connected by bounded queues:
+//   filter -> convert to xyzi, serialize and publish
+// Each stage is a single thread, so keyed scans are published in the order
+// they were added. The pose graph and the map belong to the caller, the
+// filtered scans are handed back with TakeFiltered to be inserted there.
+class KeyedScanPipeline {
+ public:
+  typedef std::pair<gtsam::Symbol, PointCloud::Ptr> FilteredScan;
+
+  KeyedScanPipeline();
+  ~KeyedScanPipeline();
+
+  // Start the workers. Scans are published on publisher. When queue_size
+  // scans are waiting for the filter, further scans are kept in a pending
+  // list that the filter worker drains, so adding never blocks.
+  bool Start(const LampPcldFilterParams& params,
+             const ros::Publisher& publisher,
+             int queue_size);
+
+  // Process what was added and join the workers
+  void Stop();
+
+  inline bool IsRunning() const { return !workers_.empty(); }
+
+  // Queue a scan (shared, never modified) taken at key. Does not wait for
+  // the filter (only for a running Flush or Stop).
+  bool Add(const gtsam::Symbol& key, const PointCloudConstPtr& scan);
+
+  // Filtered scans not taken yet, in the order they were added
+  std::vector<FilteredScan> TakeFiltered();
+
+  // Block until every scan added so far has been published
+  void Flush();
+
+ private:
+  typedef std::pair<gtsam::Symbol, PointCloudConstPtr> KeyedCloud;
+
+  void FilterLoop();
+  void PublishLoop();
+
+  // Move pending scans to the filter queue without waiting, returns the
+  // number still pending. pending_mutex_ must be held.
+  size_t PushPendingLocked();
+  // Move all pending scans to the filter queue, waiting for room
+  void PushAllPending();
+
+  LampPcldFilter filter_;
+  ros::Publisher publisher_;
+
+  lamp_utils::BoundedQueue<KeyedCloud> filter_queue_;
+  lamp_utils::BoundedQueue<KeyedCloud> publish_queue_;
+
+  // Scans added while the filter queue was full, in order
+  std::mutex pending_mutex_;
+  std::deque<KeyedCloud> pending_;
+  std::vector<std::thread> workers_;
+
+  // Output of the filter stage for the owner of the pose graph
+  std::mutex filtered_mutex_;
+  std::vector<FilteredScan> filtered_;
+
+  // Scans added / published, for Flush
+  std::mutex count_mutex_;
+  std::condition_variable published_condition_;
+  size_t num_added_;
+  size_t num_published_;
+};
+
+#endif
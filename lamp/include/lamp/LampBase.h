@@ -8,6 +8,7 @@
 #define LAMP_BASE_H
 
 // Includes
+#include <ros/callback_queue.h>
 #include <ros/ros.h>
 
 // GTSAM
@@ -27,6 +28,7 @@
 #include <pose_graph_msgs/PoseGraph.h>
 #include <pose_graph_msgs/PoseGraphEdge.h>
 #include <pose_graph_msgs/PoseGraphNode.h>
+#include <std_msgs/Bool.h>
 
 #include <geometry_utils/GeometryUtilsROS.h>
 #include <geometry_utils/Transform3.h>
@@ -42,10 +44,19 @@
 
 #include <lamp_utils/CommonFunctions.h>
 #include <lamp_utils/CommonStructs.h>
+#include <lamp_utils/KeyedScanTransfer.h>
+#include <lamp_utils/MpscQueue.h>
+#include <lamp_utils/PointCloudUtils.h>
 #include <lamp_utils/PoseGraph.h>
 #include <lamp_utils/PrefixHandling.h>
+#include <lamp_utils/Submaps.h>
 
+#include <algorithm>
+#include <atomic>
 #include <math.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 // Services
 
@@ -91,6 +102,33 @@ protected:
   // retrieve data from all handlers
   virtual bool CheckHandlers() = 0;
 
+  // Event driven handlers: they push their data to EnqueueFactorData as soon
+  // as it is ready, which wakes ProcessQueuedFactorData on the callback queue
+  // of the node handle given to EnableEventDrivenHandlers
+  void EnableEventDrivenHandlers(const ros::NodeHandle& n,
+                                 std::vector<LampDataHandlerBase*> handlers);
+  // Any thread, never blocks
+  void EnqueueFactorData(std::shared_ptr<FactorData> data);
+  // Takes everything queued and passes it to ProcessFactorData
+  void ProcessQueuedFactorData();
+  virtual void
+  ProcessFactorData(std::vector<std::shared_ptr<FactorData>>& data) = 0;
+  bool b_event_driven_;
+
+  // Heavy inputs (optimizer results, loop closures, graph maintenance) are
+  // served by a spinner thread on their own callback queue, so a long merge
+  // and map regeneration does not hold back the update timer and the handler
+  // data on the node's queue. Every callback touching the LAMP state holds
+  // lamp_mutex_.
+  ros::NodeHandle HeavyCallbackNodeHandle(const ros::NodeHandle& n);
+  void StartHeavySpinner();
+  // Call first thing in the derived destructor
+  void StopHeavySpinner();
+  bool b_separate_callback_queues_;
+  ros::CallbackQueue heavy_callback_queue_;
+  std::unique_ptr<ros::AsyncSpinner> heavy_spinner_;
+  std::mutex lamp_mutex_;
+
   // Callback for loop closures
   void LaserLoopClosureCallback(const pose_graph_msgs::PoseGraphConstPtr msg);
   void AddLoopClosureToGraph(const pose_graph_msgs::PoseGraphConstPtr msg);
@@ -103,8 +141,17 @@ protected:
   bool PublishPoseGraphForOptimizer();
 
   // Generate map from keyed scans
-  bool ReGenerateMapPointCloud();
-  bool CombineKeyedScansWorld(PointCloud* points);
+  void LoadMapRegenerationParameters();
+  // If given, lock (holding lamp_mutex_) is released while the keyed scans
+  // (or closed submaps) are transformed
+  bool ReGenerateMapPointCloud(std::unique_lock<std::mutex>* lock = nullptr);
+  // Re-transform only the keyed scans whose node moved and refill the mapper
+  // from the kept contributions
+  bool ReGenerateMapIncrementally(std::unique_lock<std::mutex>* lock);
+  // Publish new/grown submaps and the anchors that moved
+  void PublishSubmapUpdates(const std::vector<gtsam::Key>& moved_anchors);
+  bool CombineKeyedScansWorld(PointCloud* points,
+                              std::unique_lock<std::mutex>* lock = nullptr);
   bool GetTransformedPointCloudWorld(const gtsam::Symbol key,
                                      PointCloud* points);
   bool AddTransformedPointCloudToMap(const gtsam::Symbol key);
@@ -119,8 +166,13 @@ protected:
 
   // New pose graph values from optimizer
   void OptimizerUpdateCallback(const pose_graph_msgs::PoseGraphConstPtr& msg);
+  // msg is the full optimized graph or only its moved nodes (incremental)
   void MergeOptimizedGraph(const pose_graph_msgs::PoseGraphConstPtr& msg);
 
+  // Deltas from the optimizer are dropped (and a full graph requested) until
+  // a full optimized graph has been merged
+  bool b_received_full_optimized_graph_;
+
   void PublishAllKeyedScans();
 
   // Pose graph structure storing values, factors and meta data.
@@ -134,6 +186,12 @@ protected:
   ros::Publisher pose_graph_incremental_pub_;
   ros::Publisher pose_graph_to_optimize_pub_;
   ros::Publisher keyed_scan_pub_;
+  // Bulk re-sends of all keyed scans
+  bool b_batched_keyed_scan_transfer_;
+  lamp_utils::KeyedScanBatchPublisher keyed_scan_batch_pub_;
+  ros::Publisher request_full_optimized_graph_pub_;
+  ros::Publisher submap_pub_;
+  ros::Publisher submap_anchors_pub_;
 
   // Subscribers
   ros::Subscriber back_end_pose_graph_sub_;
@@ -149,6 +207,9 @@ protected:
   bool b_has_new_scan_;
   bool b_run_optimization_;
   bool b_received_optimizer_update_;
+  // Set whenever pose_graph_ changes, the base station only checkpoints a
+  // changed graph
+  bool b_pose_graph_changed_;
   bool b_use_fixed_covariances_;
   bool b_repub_values_after_optimization_;
   bool b_have_received_first_pg_{false};
@@ -162,6 +223,28 @@ protected:
   // Mapper
   IPointCloudMapper::Ptr mapper_;
 
+  // Incremental map regeneration: remember the world-frame points each keyed
+  // scan contributed to the map and the pose they were transformed with, so
+  // only scans whose node moved beyond the thresholds are re-transformed.
+  struct MapContribution {
+    gtsam::Pose3 pose;
+    PointCloud::ConstPtr points;
+  };
+  std::unordered_map<gtsam::Key, MapContribution> map_contributions_;
+  bool b_incremental_map_regeneration_;
+  double map_regeneration_translation_threshold_;
+  double map_regeneration_rotation_threshold_;
+
+  // Map as submaps anchored to pose graph nodes: after an optimization only
+  // the anchors move, the world map is composed from the submaps
+  bool b_use_submaps_;
+  lamp_utils::Submaps submaps_;
+
+  // Factor data pushed by the handlers, consumed on the LAMP thread
+  lamp_utils::MpscQueue<std::shared_ptr<FactorData>> factor_queue_;
+  std::atomic<bool> b_factor_queue_scheduled_;
+  ros::CallbackQueueInterface* factor_callback_queue_;
+
   // Precisions
   double attitude_sigma_;
   double position_sigma_;
@@ -13,6 +13,7 @@
 #include <factor_handlers/PoseGraphHandler.h>
 #include <factor_handlers/RobotPoseHandler.h>
 
+#include <boost/filesystem.hpp>
 #include <point_cloud_mapper/SimplePointCloudMapper.h>
 #include <std_msgs/Bool.h>
 #include <std_msgs/String.h>
@@ -50,12 +51,26 @@ protected:
   // Main update timer callback
   void ProcessTimerCallback(const ros::TimerEvent& ev) override;
 
+  // Data pushed by the event driven handlers
+  void
+  ProcessFactorData(std::vector<std::shared_ptr<FactorData>>& data) override;
+
+  // Publish the pose graph (and send it to the optimizer) if it changed.
+  // False if the graph is invalid.
+  bool PublishGraphUpdates();
+
   // Callback to remove a robot from the posegraph
   void RemoveRobotCallback(const std_msgs::String msg);
 
   // Callback for debugging - put any code inside this
   void DebugCallback(const std_msgs::String msg);
 
+  // Load a saved pose graph and republish graph, map and keyed scans
+  bool LoadPoseGraphFromFile(const std::string& filename);
+
+  // Periodically save the pose graph so a restart can resume from it
+  void CheckpointTimerCallback(const ros::TimerEvent& ev);
+
   // Process keyed scan candidates to add to the map
   void AddKeyedScanCandidatesToMap();
 
@@ -97,6 +112,11 @@ private:
   // Last pose graph publish time
   ros::Time last_pg_update_time_;
 
+  // Checkpointing (disabled if the path is empty)
+  std::string checkpoint_path_;
+  double checkpoint_period_;
+  ros::Timer checkpoint_timer_;
+
   // Test class fixtures
   friend class TestLampBase;
 };
@@ -8,6 +8,7 @@
 #define LAMP_ROBOT_H
 
 // Includes
+#include <lamp/KeyedScanPipeline.h>
 #include <lamp/LampBase.h>
 
 #include <factor_handlers/OdometryHandler.h>
@@ -52,6 +53,13 @@ class LampRobot : public LampBase {
   // Main update timer callback
   void ProcessTimerCallback(const ros::TimerEvent& ev) override;
 
+  // Data pushed by the event driven handlers
+  void
+  ProcessFactorData(std::vector<std::shared_ptr<FactorData>>& data) override;
+
+  // Publish the pose graph if there are new factors
+  void PublishNewFactors();
+
   // Initialization helper functions
   bool SetInitialPosition();
   bool SetInitialKey();
@@ -73,9 +81,13 @@ class LampRobot : public LampBase {
    bool InitializeGraph(gtsam::Pose3& pose,
                         gtsam::noiseModel::Diagonal::shared_ptr& covariance);
 
-   void AddKeyedScanAndPublish(PointCloud::Ptr new_scan,
+   void AddKeyedScanAndPublish(PointCloudConstPtr scan,
                                gtsam::Symbol current_key);
 
+   // Insert the scans filtered by the keyed scan pipeline in the pose graph
+   // and the map
+   void InsertFilteredScans();
+
    void HandleRelativePoseMeasurement(const ros::Time& time,
                                       const gtsam::Pose3& relative_pose,
                                       gtsam::Pose3& transform,
@@ -116,6 +128,17 @@ class LampRobot : public LampBase {
    // Point cloud filter
    LampPcldFilter filter_;
    LampPcldFilterParams filter_params_;
+
+   // Filter and publish keyed scans on worker threads
+   bool b_async_keyed_scans_;
+   int keyed_scan_queue_size_;
+   KeyedScanPipeline keyed_scan_pipeline_;
+
+   // Odometry arrival to node publication latency
+   ros::WallTime odom_arrival_time_;
+   int num_latency_samples_;
+   double latency_sum_;
+   double latency_max_;
 };
 
 #endif
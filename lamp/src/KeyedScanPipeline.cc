@@ -0,0 +1,148 @@
+/*
+ * Copyright Notes
+ *
+ * Authors: Benjamin Morrell    (benjamin.morrell@jpl.nasa.gov)
+ */
+
+#include <lamp/KeyedScanPipeline.h>
+
+#include <algorithm>
+
+#include <boost/make_shared.hpp>
+#include <pcl_conversions/pcl_conversions.h>
+#include <pose_graph_msgs/KeyedScan.h>
+
+#include <lamp_utils/PointCloudUtils.h>
+
+KeyedScanPipeline::KeyedScanPipeline() : num_added_(0), num_published_(0) {}
+
+KeyedScanPipeline::~KeyedScanPipeline() {
+  Stop();
+}
+
+bool KeyedScanPipeline::Start(const LampPcldFilterParams& params,
+                              const ros::Publisher& publisher,
+                              int queue_size) {
+  if (IsRunning()) {
+    ROS_WARN("KeyedScanPipeline: Already running");
+    return false;
+  }
+  filter_ = LampPcldFilter(params);
+  publisher_ = publisher;
+  filter_queue_.SetCapacity(std::max(1, queue_size));
+  publish_queue_.SetCapacity(std::max(1, queue_size));
+  filter_queue_.Reopen();
+  publish_queue_.Reopen();
+
+  workers_.emplace_back(&KeyedScanPipeline::FilterLoop, this);
+  workers_.emplace_back(&KeyedScanPipeline::PublishLoop, this);
+  return true;
+}
+
+void KeyedScanPipeline::Stop() {
+  if (!IsRunning()) {
+    return;
+  }
+  // The filter stage closes the publish queue when it is done
+  PushAllPending();
+  filter_queue_.Close();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+
+bool KeyedScanPipeline::Add(const gtsam::Symbol& key,
+                            const PointCloudConstPtr& scan) {
+  if (!IsRunning() || scan == nullptr) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(count_mutex_);
+    num_added_++;
+  }
+  // Behind the pending scans to keep the order
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  pending_.emplace_back(key, scan);
+  const size_t num_pending = PushPendingLocked();
+  if (num_pending > 0) {
+    ROS_WARN_STREAM_THROTTLE(1.0,
+                             "KeyedScanPipeline: Filter behind, "
+                                 << num_pending << " scans pending (latest "
+                                 << gtsam::DefaultKeyFormatter(key) << ")");
+  }
+  return true;
+}
+
+size_t KeyedScanPipeline::PushPendingLocked() {
+  while (!pending_.empty() && filter_queue_.TryPush(pending_.front())) {
+    pending_.pop_front();
+  }
+  return pending_.size();
+}
+
+void KeyedScanPipeline::PushAllPending() {
+  // The filter worker does not wait for pending_mutex_, so it keeps making
+  // room meanwhile
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  while (!pending_.empty() && filter_queue_.Push(pending_.front())) {
+    pending_.pop_front();
+  }
+}
+
+std::vector<KeyedScanPipeline::FilteredScan>
+KeyedScanPipeline::TakeFiltered() {
+  std::vector<FilteredScan> filtered;
+  std::lock_guard<std::mutex> lock(filtered_mutex_);
+  filtered.swap(filtered_);
+  return filtered;
+}
+
+void KeyedScanPipeline::Flush() {
+  PushAllPending();
+  std::unique_lock<std::mutex> lock(count_mutex_);
+  published_condition_.wait(
+      lock, [this] { return num_published_ >= num_added_; });
+}
+
+void KeyedScanPipeline::FilterLoop() {
+  KeyedCloud input;
+  while (filter_queue_.Pop(input)) {
+    // Room in the queue again (unless someone else is moving them already)
+    {
+      std::unique_lock<std::mutex> lock(pending_mutex_, std::try_to_lock);
+      if (lock.owns_lock()) {
+        PushPendingLocked();
+      }
+    }
+
+    PointCloud::Ptr filtered(new PointCloud);
+    filter_.Filter(*input.second, filtered);
+    {
+      std::lock_guard<std::mutex> lock(filtered_mutex_);
+      filtered_.emplace_back(input.first, filtered);
+    }
+    publish_queue_.Push(KeyedCloud(input.first, filtered));
+  }
+  publish_queue_.Close();
+}
+
+void KeyedScanPipeline::PublishLoop() {
+  KeyedCloud input;
+  while (publish_queue_.Pop(input)) {
+    // Publish the keyed scans without normals
+    pose_graph_msgs::KeyedScan::Ptr keyed_scan_msg =
+        boost::make_shared<pose_graph_msgs::KeyedScan>();
+    keyed_scan_msg->key = input.first;
+    PointXyziCloud::Ptr pub_scan(new PointXyziCloud);
+    lamp_utils::ConvertPointCloud(input.second, pub_scan);
+    pcl::toROSMsg(*pub_scan, keyed_scan_msg->scan);
+    publisher_.publish(keyed_scan_msg);
+
+    {
+      std::lock_guard<std::mutex> lock(count_mutex_);
+      num_published_++;
+    }
+    published_condition_.notify_all();
+  }
+}
@@ -7,6 +7,11 @@
 // Includes
 #include <lamp/LampBase.h>
 
+#include <boost/make_shared.hpp>
+#include <ros/callback_queue_interface.h>
+
+#include <unordered_set>
+
 // #include <math.h>
 // #include <ctime>
 
@@ -29,7 +34,18 @@ LampBase::LampBase()
     zero_noise_(0.0001),
     b_use_fixed_covariances_(false),
     b_repub_values_after_optimization_(false),
-    b_received_optimizer_update_(false) {
+    b_received_optimizer_update_(false),
+    b_received_full_optimized_graph_(false),
+    b_pose_graph_changed_(false),
+    b_incremental_map_regeneration_(false),
+    map_regeneration_translation_threshold_(0.05),
+    map_regeneration_rotation_threshold_(0.01),
+    b_use_submaps_(false),
+    b_batched_keyed_scan_transfer_(false),
+    b_event_driven_(false),
+    b_separate_callback_queues_(false),
+    b_factor_queue_scheduled_(false),
+    factor_callback_queue_(nullptr) {
   // any other things on construction
 
   // set up mapping function to get internal ID given gtsam::Symbol
@@ -37,7 +53,94 @@ LampBase::LampBase()
 }
 
 // Destructor
-LampBase::~LampBase() {}
+LampBase::~LampBase() {
+  StopHeavySpinner();
+
+  // Drop wake ups that are still queued
+  if (factor_callback_queue_ != nullptr) {
+    factor_callback_queue_->removeByID(reinterpret_cast<uint64_t>(this));
+  }
+}
+
+namespace {
+// Callback queue entry running a function
+class FunctionCallback : public ros::CallbackInterface {
+public:
+  explicit FunctionCallback(const std::function<void()>& function)
+    : function_(function) {}
+  CallResult call() override {
+    function_();
+    return Success;
+  }
+
+private:
+  std::function<void()> function_;
+};
+} // namespace
+
+void LampBase::EnableEventDrivenHandlers(
+    const ros::NodeHandle& n, std::vector<LampDataHandlerBase*> handlers) {
+  factor_callback_queue_ = n.getCallbackQueue();
+  for (LampDataHandlerBase* handler : handlers) {
+    handler->SetDataCallback(
+        [this](std::shared_ptr<FactorData> data) {
+          EnqueueFactorData(std::move(data));
+        });
+  }
+}
+
+void LampBase::EnqueueFactorData(std::shared_ptr<FactorData> data) {
+  factor_queue_.Push(std::move(data));
+  // One wake up at a time, it takes everything queued until it runs
+  if (!b_factor_queue_scheduled_.exchange(true)) {
+    factor_callback_queue_->addCallback(
+        boost::make_shared<FunctionCallback>([this]() {
+          std::lock_guard<std::mutex> lock(lamp_mutex_);
+          ProcessQueuedFactorData();
+        }),
+        reinterpret_cast<uint64_t>(this));
+  }
+}
+
+void LampBase::ProcessQueuedFactorData() {
+  // Data pushed from now on schedules a new wake up. A push caught half way
+  // is picked up by the next wake up or the update timer.
+  b_factor_queue_scheduled_.store(false);
+
+  std::vector<std::shared_ptr<FactorData>> data;
+  std::shared_ptr<FactorData> next;
+  while (factor_queue_.Pop(next)) {
+    data.push_back(std::move(next));
+  }
+  if (!data.empty()) {
+    ProcessFactorData(data);
+  }
+}
+
+ros::NodeHandle LampBase::HeavyCallbackNodeHandle(const ros::NodeHandle& n) {
+  ros::NodeHandle nl(n);
+  if (b_separate_callback_queues_) {
+    nl.setCallbackQueue(&heavy_callback_queue_);
+  }
+  return nl;
+}
+
+void LampBase::StartHeavySpinner() {
+  if (!b_separate_callback_queues_ || heavy_spinner_) {
+    return;
+  }
+  heavy_spinner_.reset(new ros::AsyncSpinner(1, &heavy_callback_queue_));
+  heavy_spinner_->start();
+}
+
+void LampBase::StopHeavySpinner() {
+  if (!heavy_spinner_) {
+    return;
+  }
+  // Waits for the callback in progress
+  heavy_spinner_->stop();
+  heavy_spinner_.reset();
+}
 
 bool LampBase::SetFactorPrecisions() {
   if (!pu::Get("attitude_sigma", attitude_sigma_))
@@ -80,6 +183,17 @@ bool LampBase::CreatePublishers(const ros::NodeHandle& n) {
   // Published keyed scans (for GT processing)
   keyed_scan_pub_ =
       nl.advertise<pose_graph_msgs::KeyedScan>("keyed_scans", 10, true);
+  keyed_scan_batch_pub_.Advertise(
+      nl, "keyed_scan_batches", keyed_scan_batch_pub_.GetParams());
+
+  // Ask the optimizer for a full graph when we cannot apply a delta
+  request_full_optimized_graph_pub_ =
+      nl.advertise<std_msgs::Bool>("request_full_optimized_graph", 1, false);
+
+  // Submaps (body frame of the anchor node) and moved anchor poses
+  submap_pub_ = nl.advertise<pose_graph_msgs::KeyedScan>("submaps", 100, false);
+  submap_anchors_pub_ =
+      nl.advertise<pose_graph_msgs::PoseGraph>("submap_anchors", 10, false);
 
   return true;
 }
@@ -88,6 +202,7 @@ void LampBase::OptimizerUpdateCallback(
     const pose_graph_msgs::PoseGraphConstPtr& msg) {
   ROS_WARN_STREAM("Received new pose graph from optimizer - merging now "
                   "-----------------------------------------------------");
+  std::unique_lock<std::mutex> lock(lamp_mutex_);
   b_received_optimizer_update_ = true;
 
   // ROS_INFO_STREAM("New pose graph nodes: ");
@@ -97,6 +212,18 @@ void LampBase::OptimizerUpdateCallback(
   //                   << ", " << n.pose.position.z << ")");
   // }
 
+  // The optimizer may only send the nodes that moved, which can only be
+  // merged on top of a full graph
+  if (!msg->incremental) {
+    b_received_full_optimized_graph_ = true;
+  } else if (!b_received_full_optimized_graph_) {
+    ROS_WARN("Received optimizer delta without a full graph, requesting one");
+    std_msgs::Bool request;
+    request.data = true;
+    request_full_optimized_graph_pub_.publish(request);
+    return;
+  }
+
   // Merge the optimizer result into the internal pose graph
   // and also update loop closure edges to reflect inliers
   MergeOptimizedGraph(msg);
@@ -104,31 +231,28 @@ void LampBase::OptimizerUpdateCallback(
   // Publish the pose graph and update the map
   PublishPoseGraph(false);
 
-  // Update the map (also publishes)
-  ReGenerateMapPointCloud();
+  // Update the map (also publishes). The LAMP thread may carry on while the
+  // scans are transformed.
+  ReGenerateMapPointCloud(&lock);
 }
 
 void LampBase::MergeOptimizedGraph(
     const pose_graph_msgs::PoseGraphConstPtr& msg) {
-  // Process the slow graph update
-  merger_.OnSlowGraphMsg(msg);
-
-  // Give merger the current graph (will likely have more nodes that the
-  // optimized)
-  merger_.OnFastGraphMsg(pose_graph_.ToMsg());
-
-  gtsam::Values new_values;
-  gtsam::Symbol key;
-
-  // Update the internal LAMP graph using the one stored by the merger
-  pose_graph_msgs::PoseGraphConstPtr fused_graph(
-      new pose_graph_msgs::PoseGraph(merger_.GetCurrentGraph()));
-
-  // update the LAMP internal values_ and factors
-  pose_graph_.UpdateFromMsg(fused_graph);
-
-  // prune outliers given optimized graph
-  pose_graph_.UpdateLoopClosures(msg);
+  // Merge the slow graph (full or only the moved nodes) into the current
+  // graph, which will likely have more nodes than the optimized one
+  std::vector<pose_graph_msgs::PoseGraphNode> merged_nodes =
+      merger_.MergeSlowDelta(*msg, pose_graph_);
+
+  // update the LAMP internal values_ and factors in place
+  pose_graph_.UpdateFromDelta(merged_nodes, msg->edges);
+  b_pose_graph_changed_ = true;
+  ROS_DEBUG_STREAM("Merged optimized graph: " << merged_nodes.size()
+                                              << " nodes changed");
+
+  // prune outliers given optimized graph (edges are unchanged in a delta)
+  if (!msg->incremental) {
+    pose_graph_.UpdateLoopClosures(msg);
+  }
 
   // ROS_DEBUG_STREAM("Pose graph after update: ");
   // for (auto n : pose_graph_.GetNodes()) {
@@ -148,6 +272,7 @@ void LampBase::LaserLoopClosureCallback(
     const pose_graph_msgs::PoseGraphConstPtr msg) {
   ROS_DEBUG_STREAM("Received laser loop closure message "
                   "--------------------------------------------------");
+  std::lock_guard<std::mutex> lock(lamp_mutex_);
 
   // Do things particular to loop closures from the laser
 
@@ -173,6 +298,7 @@ void LampBase::LaserLoopClosureCallback(
 void LampBase::AddLoopClosureToGraph(
     const pose_graph_msgs::PoseGraphConstPtr msg) {
   pose_graph_.UpdateFromMsg(msg);
+  b_pose_graph_changed_ = true;
 
   // Set flag to optimize
   b_run_optimization_ = true;
@@ -194,13 +320,122 @@ LampBase::ChangeCovarianceInMessage(pose_graph_msgs::PoseGraph msg,
 // Map generation functions
 //------------------------------------------------------------------------------------------
 
-bool LampBase::ReGenerateMapPointCloud() {
-  // Reset the map
-  mapper_->Reset();
+void LampBase::PublishSubmapUpdates(
+    const std::vector<gtsam::Key>& moved_anchors) {
+  // Each submap is sent once, when it closes
+  const std::vector<gtsam::Key> changed = submaps_.TakeClosedSubmaps();
+
+  for (const auto& anchor : changed) {
+    const lamp_utils::Submap* submap = submaps_.Find(anchor);
+    if (submap == nullptr) continue;
+    pose_graph_msgs::KeyedScan msg;
+    msg.key = anchor;
+    pcl::toROSMsg(*submap->points, msg.scan);
+    msg.scan.header.frame_id = gtsam::DefaultKeyFormatter(anchor);
+    submap_pub_.publish(msg);
+  }
+
+  // New submaps need their anchor as well
+  std::vector<gtsam::Key> anchors(moved_anchors);
+  anchors.insert(anchors.end(), changed.begin(), changed.end());
+  if (anchors.empty()) return;
+  std::sort(anchors.begin(), anchors.end());
+  anchors.erase(std::unique(anchors.begin(), anchors.end()), anchors.end());
+
+  pose_graph_msgs::PoseGraph anchors_msg;
+  anchors_msg.header.stamp = ros::Time::now();
+  anchors_msg.header.frame_id = pose_graph_.fixed_frame_id;
+  anchors_msg.incremental = true;
+  for (const auto& anchor : anchors) {
+    const lamp_utils::Submap* submap = submaps_.Find(anchor);
+    if (submap == nullptr) continue;
+    pose_graph_msgs::PoseGraphNode node;
+    node.key = anchor;
+    node.header.frame_id = pose_graph_.fixed_frame_id;
+    node.pose = lamp_utils::GtsamToRosMsg(submap->anchor_pose);
+    anchors_msg.nodes.push_back(node);
+  }
+  submap_anchors_pub_.publish(anchors_msg);
+}
+
+void LampBase::LoadMapRegenerationParameters() {
+  pu::Get("map_regeneration/incremental", b_incremental_map_regeneration_);
+  pu::Get("map_regeneration/translation_threshold",
+          map_regeneration_translation_threshold_);
+  pu::Get("map_regeneration/rotation_threshold",
+          map_regeneration_rotation_threshold_);
+  map_contributions_.clear();
+
+  lamp_utils::SubmapParams submap_params;
+  pu::Get("map_submaps/enabled", b_use_submaps_);
+  pu::Get("map_submaps/max_scans", submap_params.max_scans);
+  pu::Get("map_submaps/max_distance", submap_params.max_distance);
+  pu::Get("map_submaps/leaf_size", submap_params.leaf_size);
+  pu::Get("map_submaps/translation_threshold",
+          submap_params.translation_threshold);
+  pu::Get("map_submaps/rotation_threshold", submap_params.rotation_threshold);
+  submaps_.SetParams(submap_params);
+  submaps_.Clear();
+}
+
+bool LampBase::ReGenerateMapPointCloud(std::unique_lock<std::mutex>* lock) {
+  if (b_use_submaps_) {
+    // Moving the anchors and publishing them is O(number of submaps)
+    std::vector<gtsam::Key> moved = submaps_.UpdateAnchors(
+        pose_graph_.GetValues());
+    const bool b_new_submaps = submaps_.HasClosedSubmaps();
+    PublishSubmapUpdates(moved);
+    if (moved.empty() && !b_new_submaps) {
+      return true;
+    }
+
+    // The global map for consumers of the mapper output is still rebuilt
+    // from all the points. Closed submaps do not change, so they are
+    // composed with the graph free meanwhile.
+    std::vector<lamp_utils::PosedSubmap> closed =
+        submaps_.GetPosedSubmaps(true);
+    PointCloud::Ptr regenerated_map(new PointCloud);
+    if (lock != nullptr) lock->unlock();
+    lamp_utils::Submaps::BuildWorldMap(closed, regenerated_map.get());
+    if (lock != nullptr) lock->lock();
+
+    // Open submaps and the ones closed in the meantime. If a submap was
+    // removed in the meantime (robot removed), compose everything again.
+    std::unordered_set<gtsam::Key> composed;
+    for (const auto& submap : closed) {
+      composed.insert(submap.anchor);
+    }
+    std::vector<lamp_utils::PosedSubmap> remaining;
+    for (const auto& submap : submaps_.GetPosedSubmaps()) {
+      if (composed.erase(submap.anchor) == 0) {
+        remaining.push_back(submap);
+      }
+    }
+    if (!composed.empty()) {
+      regenerated_map->clear();
+      remaining = submaps_.GetPosedSubmaps();
+    }
+    PointCloud remaining_world;
+    lamp_utils::Submaps::BuildWorldMap(remaining, &remaining_world);
+    *regenerated_map += remaining_world;
+
+    mapper_->Reset();
+    PointCloud::Ptr unused(new PointCloud);
+    mapper_->InsertPoints(regenerated_map, unused.get());
+    mapper_->PublishMap();
+    return true;
+  }
+
+  if (b_incremental_map_regeneration_) {
+    return ReGenerateMapIncrementally(lock);
+  }
 
   // Combine the keyed scans with the latest node values
   PointCloud::Ptr regenerated_map(new PointCloud);
-  CombineKeyedScansWorld(regenerated_map.get());
+  CombineKeyedScansWorld(regenerated_map.get(), lock);
+
+  // Reset the map
+  mapper_->Reset();
 
   // Insert points into the map (publishes incremental point clouds)
   PointCloud::Ptr unused(new PointCloud);
@@ -211,26 +446,154 @@ bool LampBase::ReGenerateMapPointCloud() {
   return true;
 }
 
+bool LampBase::ReGenerateMapIncrementally(std::unique_lock<std::mutex>* lock) {
+  // Scans whose node moved beyond the thresholds, or not in the map yet
+  std::vector<gtsam::Key> changed_keys;
+  std::vector<PointCloud::ConstPtr> changed_scans;
+  std::vector<lamp_utils::PosedScan> posed_scans;
+  for (const auto& keyed_pose : pose_graph_.GetValues()) {
+    const gtsam::Symbol key = keyed_pose.key;
+    if (!pose_graph_.HasScan(key)) {
+      continue;
+    }
+    const gtsam::Pose3 pose = pose_graph_.GetPose(key);
+    auto it = map_contributions_.find(key);
+    if (it != map_contributions_.end()) {
+      const gtsam::Pose3 delta = it->second.pose.between(pose);
+      if (delta.translation().norm() <=
+              map_regeneration_translation_threshold_ &&
+          delta.rotation().axisAngle().second <=
+              map_regeneration_rotation_threshold_) {
+        continue;
+      }
+    }
+    // Hold on to the scan, the graph may only keep it decoded temporarily
+    PointCloud::ConstPtr scan = pose_graph_.keyed_scans.at(key);
+    if (!scan) {
+      continue;
+    }
+    changed_keys.push_back(key);
+    changed_scans.push_back(scan);
+    posed_scans.push_back(lamp_utils::PosedScan{scan.get(), pose});
+  }
+
+  // Drop scans of nodes that left the graph (e.g. removed robots)
+  size_t num_removed = 0;
+  for (auto it = map_contributions_.begin(); it != map_contributions_.end();) {
+    if (pose_graph_.HasKey(it->first)) {
+      ++it;
+    } else {
+      it = map_contributions_.erase(it);
+      num_removed++;
+    }
+  }
+  ROS_DEBUG_STREAM("Map regeneration: " << changed_keys.size() << " keyed scans"
+                                        << " moved, " << num_removed
+                                        << " removed");
+  if (changed_keys.empty() && num_removed == 0) {
+    return true;
+  }
+
+  // Transform the changed scans only, the graph is free meanwhile
+  PointCloud changed_world;
+  if (lock != nullptr) lock->unlock();
+  lamp_utils::TransformAndCombineScans(posed_scans, &changed_world);
+  if (lock != nullptr) lock->lock();
+
+  // Split back per scan (same order and sizes as the input)
+  size_t offset = 0;
+  for (size_t i = 0; i < changed_keys.size(); ++i) {
+    const size_t size = changed_scans[i]->size();
+    PointCloud::Ptr points(new PointCloud);
+    points->points.assign(changed_world.points.begin() + offset,
+                          changed_world.points.begin() + offset + size);
+    points->width = size;
+    points->height = 1;
+    offset += size;
+    // Skip nodes removed while the lock was released
+    if (pose_graph_.HasKey(changed_keys[i])) {
+      map_contributions_[changed_keys[i]] =
+          MapContribution{posed_scans[i].pose, points};
+    }
+  }
+
+  // The mapper cannot remove points, so it is refilled from the kept
+  // contributions without transforming the unchanged scans again
+  size_t num_points = 0;
+  for (const auto& contribution : map_contributions_) {
+    num_points += contribution.second.points->size();
+  }
+  PointCloud::Ptr regenerated_map(new PointCloud);
+  regenerated_map->points.reserve(num_points);
+  for (const auto& contribution : map_contributions_) {
+    regenerated_map->points.insert(regenerated_map->points.end(),
+                                   contribution.second.points->begin(),
+                                   contribution.second.points->end());
+  }
+  regenerated_map->width = regenerated_map->points.size();
+  regenerated_map->height = 1;
+
+  mapper_->Reset();
+  PointCloud::Ptr unused(new PointCloud);
+  mapper_->InsertPoints(regenerated_map, unused.get());
+  mapper_->PublishMap();
+  return true;
+}
+
 // For combining all the scans together
-bool LampBase::CombineKeyedScansWorld(PointCloud* points) {
+bool LampBase::CombineKeyedScansWorld(PointCloud* points,
+                                      std::unique_lock<std::mutex>* lock) {
   if (points == NULL) {
     ROS_ERROR("%s: Output point cloud container is null.", name_.c_str());
     return false;
   }
   points->points.clear();
 
-  // Iterate over poses in the graph, transforming their corresponding laser
-  // scans into world frame and appending them to the output.
+  // Collect the poses in the graph with their laser scans, then transform
+  // them all into world frame in parallel.
+  std::vector<PointCloud::ConstPtr> scans;
+  std::vector<lamp_utils::PosedScan> posed_scans;
+  std::unordered_set<gtsam::Key> combined_keys;
+  scans.reserve(pose_graph_.keyed_scans.size());
+  posed_scans.reserve(pose_graph_.keyed_scans.size());
   for (const auto& keyed_pose : pose_graph_.GetValues()) {
     const gtsam::Symbol key = keyed_pose.key;
+    if (!pose_graph_.HasScan(key)) {
+      continue;
+    }
+    // Hold on to the scan, the graph may only keep it decoded temporarily
+    scans.push_back(pose_graph_.keyed_scans.at(key));
+    if (!scans.back()) {
+      scans.pop_back();
+      continue;
+    }
+    posed_scans.push_back(lamp_utils::PosedScan{
+        scans.back().get(), pose_graph_.GetPose(key)});
+    combined_keys.insert(key);
+  }
 
-    PointCloud::Ptr scan_world(new PointCloud);
-
-    // Transform the body-frame scan into world frame.
-    GetTransformedPointCloudWorld(key, scan_world.get());
-
-    // Append the world-frame point cloud to the output.
-    *points += *scan_world;
+  if (lock == nullptr) {
+    lamp_utils::TransformAndCombineScans(posed_scans, points);
+  } else {
+    // The scans and poses are copies, the graph is free meanwhile
+    lock->unlock();
+    lamp_utils::TransformAndCombineScans(posed_scans, points);
+    lock->lock();
+
+    // Scans added in the meantime
+    PointCloud scan_world;
+    for (const auto& keyed_pose : pose_graph_.GetValues()) {
+      const gtsam::Symbol key = keyed_pose.key;
+      if (combined_keys.count(key) > 0 || !pose_graph_.HasScan(key)) {
+        continue;
+      }
+      GetTransformedPointCloudWorld(key, &scan_world);
+      points->points.insert(points->points.end(),
+                            scan_world.points.begin(),
+                            scan_world.points.end());
+    }
+    points->width = points->points.size();
+    points->height = 1;
   }
   ROS_DEBUG_STREAM("Points size is: " << points->points.size()
                                       << ", in CombineKeyedScansWorld");
@@ -276,7 +639,7 @@ bool LampBase::GetTransformedPointCloudWorld(const gtsam::Symbol key,
   // ", ", "\n", "[", "]"); ROS_INFO_STREAM("\n" << b2w.format(CleanFmt));
 
   // Transform the body-frame scan into world frame.
-  pcl::transformPointCloud(*pose_graph_.keyed_scans[key], *points, b2w);
+  pcl::transformPointCloud(*pose_graph_.keyed_scans.at(key), *points, b2w);
 
   // ROS_INFO_STREAM("Points size is: " << points->points.size()
   //                                    << ", in
@@ -293,6 +656,17 @@ bool LampBase::AddTransformedPointCloudToMap(const gtsam::Symbol key) {
   ROS_DEBUG_STREAM("Points size is: " << points->points.size()
                                      << ", in AddTransformedPointCloudToMap");
 
+  if (b_incremental_map_regeneration_ && pose_graph_.HasKey(key)) {
+    map_contributions_[key] =
+        MapContribution{pose_graph_.GetPose(key), points};
+  }
+
+  if (b_use_submaps_ && pose_graph_.HasScan(key) && pose_graph_.HasKey(key)) {
+    submaps_.AddScan(
+        key, pose_graph_.GetPose(key), *pose_graph_.keyed_scans.at(key));
+    PublishSubmapUpdates(std::vector<gtsam::Key>());
+  }
+
   // Add to the map
   PointCloud::Ptr unused(new PointCloud);
   mapper_->InsertPoints(points, unused.get());
@@ -419,6 +793,15 @@ void LampBase::PublishAllKeyedScans() {
     return;
   }
 
+  if (b_batched_keyed_scan_transfer_) {
+    // Batched, paced by the receivers' acknowledgements. The transfer runs on
+    // the publisher's thread from a copy of the scans, so the caller does not
+    // hold lamp_mutex_ while waiting for the receivers.
+    ROS_INFO("Publishing Keyed Scans in batches in the background");
+    keyed_scan_batch_pub_.PublishAsync(pose_graph_.keyed_scans);
+    return;
+  }
+
   // ROS_INFO("Publishing All Keyed Scans");
   pose_graph_msgs::KeyedScan keyed_scan_msg;
 
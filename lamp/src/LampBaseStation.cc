@@ -7,6 +7,8 @@
 // Includes
 #include <lamp/LampBaseStation.h>
 
+#include <iterator>
+
 // #include <math.h>
 // #include <ctime>
 
@@ -15,7 +17,9 @@ namespace gu = geometry_utils;
 
 // Constructor (if there is override)
 LampBaseStation::LampBaseStation()
-  : b_published_initial_node_(false), last_pg_update_time_(ros::Time::now()) {
+  : b_published_initial_node_(false),
+    last_pg_update_time_(ros::Time::now()),
+    checkpoint_period_(300.0) {
   // On base station LAMP, republish values after optimization
   b_repub_values_after_optimization_ = true;
   keyed_scan_candidates_.clear();
@@ -23,7 +27,9 @@ LampBaseStation::LampBaseStation()
 }
 
 // Destructor
-LampBaseStation::~LampBaseStation() {}
+LampBaseStation::~LampBaseStation() {
+  StopHeavySpinner();
+}
 
 // Initialization - override for Base Station Setup
 bool LampBaseStation::Initialize(const ros::NodeHandle& n) {
@@ -58,6 +64,19 @@ bool LampBaseStation::Initialize(const ros::NodeHandle& n) {
     ROS_ERROR("%s: Failed to initialize handlers.", name_.c_str());
     return false;
   }
+
+  // Resume from the last checkpoint after a restart
+  if (!checkpoint_path_.empty() &&
+      boost::filesystem::exists(checkpoint_path_)) {
+    ros::WallTime start = ros::WallTime::now();
+    if (LoadPoseGraphFromFile(checkpoint_path_)) {
+      b_pose_graph_changed_ = false;  // same as the checkpoint
+      ROS_INFO_STREAM("Restored base station checkpoint in "
+                      << (ros::WallTime::now() - start).toSec() << " s");
+    }
+  }
+
+  StartHeavySpinner();
   return true;
 }
 
@@ -76,6 +95,38 @@ bool LampBaseStation::LoadParameters(const ros::NodeHandle& n) {
   if (!pu::Get("rate/update_rate", update_rate_))
     return false;
 
+  // Process the robots' data when it arrives rather than on the update timer
+  // (optional)
+  pu::Get("base/event_driven", b_event_driven_);
+
+  // Optimizer results, loop closures and graph maintenance on their own
+  // thread (optional)
+  pu::Get("callback_queues/separate", b_separate_callback_queues_);
+
+  // Checkpointing of the pose graph (optional)
+  pu::Get("base/checkpoint_path", checkpoint_path_);
+  pu::Get("base/checkpoint_period", checkpoint_period_);
+
+  // Compressed storage of the keyed scans (optional)
+  KeyedScanCompressionParams compression;
+  int scan_cache_size = compression.cache_size;
+  pu::Get("base/keyed_scan_compression/enabled", compression.enabled);
+  pu::Get("base/keyed_scan_compression/entropy_coding",
+          compression.entropy_coding);
+  pu::Get("base/keyed_scan_compression/cache_size", scan_cache_size);
+  compression.cache_size = std::max(1, scan_cache_size);
+  pose_graph_.keyed_scans.SetCompression(compression);
+
+  // Bulk re-send of the keyed scans (e.g. after loading a pose graph)
+  lamp_utils::KeyedScanTransferParams transfer;
+  pu::Get("base/keyed_scan_transfer/batched", b_batched_keyed_scan_transfer_);
+  pu::Get("base/keyed_scan_transfer/batch_size", transfer.batch_size);
+  pu::Get("base/keyed_scan_transfer/compressed", transfer.compressed);
+  pu::Get("base/keyed_scan_transfer/entropy_coding", transfer.entropy_coding);
+  pu::Get("base/keyed_scan_transfer/window", transfer.window);
+  pu::Get("base/keyed_scan_transfer/ack_timeout", transfer.ack_timeout);
+  keyed_scan_batch_pub_.SetParams(transfer);
+
   // Fixed precisions
   // TODO - eventually remove the need to use this
   if (!SetFactorPrecisions()) {
@@ -83,6 +134,8 @@ bool LampBaseStation::LoadParameters(const ros::NodeHandle& n) {
     return false;
   }
 
+  LoadMapRegenerationParameters();
+
   // Initialize frame IDs
   pose_graph_.fixed_frame_id = "world";
 
@@ -103,25 +156,35 @@ bool LampBaseStation::RegisterCallbacks(const ros::NodeHandle& n) {
   update_timer_ = nl.createTimer(
       update_rate_, &LampBaseStation::ProcessTimerCallback, this);
 
+  // Heavy inputs and graph maintenance, kept away from the robot data
+  ros::NodeHandle nh = HeavyCallbackNodeHandle(n);
+
   back_end_pose_graph_sub_ =
-      nl.subscribe("optimized_values",
+      nh.subscribe("optimized_values",
                    1,
                    &LampBaseStation::OptimizerUpdateCallback,
                    dynamic_cast<LampBase*>(this));
 
   laser_loop_closure_sub_ =
-      nl.subscribe("laser_loop_closures",
+      nh.subscribe("laser_loop_closures",
                    1,
                    &LampBaseStation::LaserLoopClosureCallback,
                    dynamic_cast<LampBase*>(this));
 
-  remove_robot_sub_ = nl.subscribe("remove_robot_from_graph",
+  remove_robot_sub_ = nh.subscribe("remove_robot_from_graph",
                                    1,
                                    &LampBaseStation::RemoveRobotCallback,
                                    this);
 
   // Uncomment when needed for debugging
-  debug_sub_ = nl.subscribe("debug", 1, &LampBaseStation::DebugCallback, this);
+  debug_sub_ = nh.subscribe("debug", 1, &LampBaseStation::DebugCallback, this);
+
+  if (!checkpoint_path_.empty() && checkpoint_period_ > 0) {
+    checkpoint_timer_ =
+        nh.createTimer(ros::Duration(checkpoint_period_),
+                       &LampBaseStation::CheckpointTimerCallback,
+                       this);
+  }
 
   return true;
 }
@@ -171,20 +234,81 @@ bool LampBaseStation::InitializeHandlers(const ros::NodeHandle& n) {
     return false;
   }
 
+  if (b_event_driven_) {
+    EnableEventDrivenHandlers(n,
+                              {&manual_loop_closure_handler_,
+                               &pose_graph_handler_,
+                               &robot_pose_handler_});
+  }
+
   return true;
 }
 
 void LampBaseStation::ProcessTimerCallback(const ros::TimerEvent& ev) {
+  std::lock_guard<std::mutex> lock(lamp_mutex_);
+
   // Check the handlers
-  CheckHandlers();
+  if (b_event_driven_) {
+    // Normally processed as soon as the handlers push it
+    ProcessQueuedFactorData();
+  } else {
+    CheckHandlers();
+  }
+
+  if (!PublishGraphUpdates()) {
+    return;
+  }
 
+  if (b_has_new_scan_) {
+    mapper_->PublishMapInfo();
+    mapper_->PublishMap();
+
+    b_has_new_scan_ = false;
+  }
+
+  // Publish anything that is needed
+}
+
+void LampBaseStation::ProcessFactorData(
+    std::vector<std::shared_ptr<FactorData>>& data) {
+  // Graphs and scans of all robots go in one update, as when polled
+  std::shared_ptr<PoseGraphData> pose_graph_data =
+      std::make_shared<PoseGraphData>();
+  pose_graph_data->type = "posegraph";
+  for (auto& factor_data : data) {
+    if (factor_data->type == "posegraph") {
+      std::shared_ptr<PoseGraphData> graph_data =
+          std::dynamic_pointer_cast<PoseGraphData>(factor_data);
+      pose_graph_data->b_has_data |= graph_data->b_has_data;
+      std::move(graph_data->graphs.begin(),
+                graph_data->graphs.end(),
+                std::back_inserter(pose_graph_data->graphs));
+      std::move(graph_data->clouds.begin(),
+                graph_data->clouds.end(),
+                std::back_inserter(pose_graph_data->clouds));
+    } else if (factor_data->type == "manualloopclosure") {
+      ProcessManualLoopClosureData(factor_data);
+    } else if (factor_data->type == "pose") {
+      ProcessRobotPoseData(factor_data);
+    } else {
+      ROS_WARN_STREAM(name_ << ": Unexpected " << factor_data->type
+                            << " data from the handlers");
+    }
+  }
+  ProcessPoseGraphData(pose_graph_data);
+
+  // The map is published by the update timer
+  PublishGraphUpdates();
+}
+
+bool LampBaseStation::PublishGraphUpdates() {
   if (!pose_graph_.CheckGraphValid()) {
     double time_since_last_update =
         (ros::Time::now() - last_pg_update_time_).toSec();
     ROS_ERROR("Invalid pose graph on base. Not publishing and updating. Time "
               "since last successful update: %f s. ",
               time_since_last_update);
-    return;
+    return false;
   }
   // Send data to optimizer - pose graph and map publishing happens in
   // callback when data is received back from optimizer
@@ -201,15 +325,8 @@ void LampBaseStation::ProcessTimerCallback(const ros::TimerEvent& ev) {
     b_has_new_factor_ = false;
   }
 
-  if (b_has_new_scan_) {
-    mapper_->PublishMapInfo();
-    mapper_->PublishMap();
-
-    b_has_new_scan_ = false;
-  }
-
   last_pg_update_time_ = ros::Time::now();
-  // Publish anything that is needed
+  return true;
 }
 
 bool LampBaseStation::ProcessPoseGraphData(std::shared_ptr<FactorData> data) {
@@ -226,33 +343,37 @@ bool LampBaseStation::ProcessPoseGraphData(std::shared_ptr<FactorData> data) {
 
   ROS_DEBUG_STREAM("New data received at base: "
                   << pose_graph_data->graphs.size() << " graphs, "
-                  << pose_graph_data->scans.size() << " scans ");
+                  << pose_graph_data->clouds.size() << " scans ");
   b_has_new_factor_ = true;
 
-  pose_graph_msgs::PoseGraph::Ptr graph_ptr;
-
-  gtsam::Values new_values;
+  // Combine the queued increments into one per robot (many are queued when
+  // robots reconnect after a comms blackout), so each robot is merged and
+  // applied once per update
+  ros::WallTime start = ros::WallTime::now();
+  std::vector<pose_graph_msgs::PoseGraph> robot_graphs =
+      Merger::CombineFastDeltas(pose_graph_data->graphs);
 
-  for (auto g : pose_graph_data->graphs) {
+  std::vector<pose_graph_msgs::PoseGraphNode> merged_nodes;
+  std::vector<pose_graph_msgs::PoseGraphEdge> merged_edges;
+  for (const pose_graph_msgs::PoseGraph& g : robot_graphs) {
     ROS_DEBUG_STREAM("LampBase new graph with "
-                     << g->nodes.size() << " nodes and " << g->edges.size()
+                     << g.nodes.size() << " nodes and " << g.edges.size()
                      << " edges");
 
     // Register new data - this will cause pose graph to publish
     b_has_new_factor_ = true;
 
-    // Merge the current (slow) graph before processing incoming graphs
-    merger_.OnSlowGraphMsg(pose_graph_.ToMsg());
-    merger_.OnFastGraphMsg(g);
-
-    // Update the internal pose graph using the merger output
-    pose_graph_msgs::PoseGraphConstPtr fused_graph(
-        new pose_graph_msgs::PoseGraph(merger_.GetCurrentGraph()));
-    // ROS_INFO_STREAM("Fused Graph: UpdateFromMsg");
-    pose_graph_.UpdateFromMsg(fused_graph);
+    // Merge the incoming (fast) increment onto the current (slow) graph. The
+    // robots' increments are independent, so they are merged against the
+    // same graph and applied together
+    std::vector<pose_graph_msgs::PoseGraphNode> robot_nodes =
+        merger_.MergeFastDelta(g, pose_graph_);
+    merged_nodes.insert(
+        merged_nodes.end(), robot_nodes.begin(), robot_nodes.end());
+    merged_edges.insert(merged_edges.end(), g.edges.begin(), g.edges.end());
 
     // Check for new loop closure edges
-    for (pose_graph_msgs::PoseGraphEdge e : g->edges) {
+    for (const pose_graph_msgs::PoseGraphEdge& e : g.edges) {
       // Optimize on loop closures, IMU factors and artifact loop closures
       if (e.type == pose_graph_msgs::PoseGraphEdge::LOOPCLOSE) {
         // Run optimization to update the base station graph afterwards
@@ -265,7 +386,7 @@ bool LampBaseStation::ProcessPoseGraphData(std::shared_ptr<FactorData> data) {
     }
 
     // Store the pose at the most recent node for each robot
-    for (pose_graph_msgs::PoseGraphNode n : g->nodes) {
+    for (const pose_graph_msgs::PoseGraphNode& n : g.nodes) {
       char prefix = gtsam::Symbol(n.key).chr();
       if (!lamp_utils::IsRobotPrefix(prefix))
         continue;
@@ -280,31 +401,32 @@ bool LampBaseStation::ProcessPoseGraphData(std::shared_ptr<FactorData> data) {
             std::make_pair(n.key, lamp_utils::ToGtsam(n.pose));
       }
     }
-
-    ROS_DEBUG_STREAM("Added new pose graph");
+  }
+  pose_graph_.UpdateFromDelta(merged_nodes, merged_edges);
+  b_pose_graph_changed_ = true;
+
+  if (pose_graph_data->graphs.size() > robot_graphs.size()) {
+    ROS_INFO_STREAM("Ingested " << pose_graph_data->graphs.size()
+                                << " queued graphs from "
+                                << robot_graphs.size() << " robots in "
+                                << (ros::WallTime::now() - start).toSec() * 1e3
+                                << " ms");
   }
 
   ROS_DEBUG_STREAM("Keyed stamps: " << pose_graph_.keyed_stamps.size());
 
-  // Update from stored keyed scans
-  for (auto s : pose_graph_data->scans) {
+  // Keyed scans deserialized by the handler (shared with its republisher)
+  for (const auto& cloud : pose_graph_data->clouds) {
     // Register new data - this will cause map to publish
     b_has_new_scan_ = true;
 
-    // Create new PCL pointer
-    PointCloud::Ptr scan_ptr(new PointCloud);
-
-    // Copy from ROS to PCL
-    pcl::fromROSMsg(s->scan, *scan_ptr);
-
-    pose_graph_.InsertKeyedScan(s->key,
-                                scan_ptr); // TODO: add overloaded function
+    pose_graph_.InsertKeyedScan(cloud.first, cloud.second);
 
     // Add key to the list of scan candidates to add to the map
-    keyed_scan_candidates_.push_back(s->key);
+    keyed_scan_candidates_.push_back(cloud.first);
 
-    ROS_DEBUG_STREAM("Added new point cloud to map, " << scan_ptr->points.size()
-                                                     << " points");
+    ROS_DEBUG_STREAM("Added new point cloud to map, "
+                     << cloud.second->points.size() << " points");
   }
 
   // Go through the candidates to add to the map'
@@ -389,6 +511,7 @@ bool LampBaseStation::ProcessManualLoopClosureData(
                             factor.covariance);
 
     b_run_optimization_ = true;
+    b_pose_graph_changed_ = true;
   }
 
   return true;
@@ -410,14 +533,17 @@ bool LampBaseStation::CheckHandlers() {
 
 void LampBaseStation::RemoveRobotCallback(const std_msgs::String msg) {
   ROS_INFO_STREAM("Recieved remove robot message for robot " << msg.data);
+  std::lock_guard<std::mutex> lock(lamp_mutex_);
 
   // Remove the pose graph
   pose_graph_.RemoveRobotFromGraph(msg.data);
+  b_pose_graph_changed_ = true;
 
   // Erase latest_node_pose_
   latest_node_pose_.erase(lamp_utils::GetRobotPrefix(msg.data));
 
   // Send reset to lamp_pgo
+  b_received_full_optimized_graph_ = false;
   std_msgs::Bool signal;
   signal.data = true;
   lamp_pgo_reset_pub_.publish(signal);
@@ -429,6 +555,7 @@ void LampBaseStation::RemoveRobotCallback(const std_msgs::String msg) {
 
 void LampBaseStation::DebugCallback(const std_msgs::String msg) {
   ROS_INFO_STREAM("Debug message received: " << msg.data);
+  std::lock_guard<std::mutex> lock(lamp_mutex_);
 
   // Split message data into a vector of space-separated strings
   std::vector<std::string> data;
@@ -449,7 +576,7 @@ void LampBaseStation::DebugCallback(const std_msgs::String msg) {
   else if (cmd == "save") {
     ROS_INFO_STREAM("Saving the pose graph");
 
-    // Use filename if provided
+    // Use filename if provided (a .pga filename saves an indexed archive)
     if (data.size() >= 2) {
       pose_graph_.Save(data[1]);
     } else {
@@ -463,19 +590,10 @@ void LampBaseStation::DebugCallback(const std_msgs::String msg) {
 
     // Use filename if provided
     if (data.size() >= 2) {
-      pose_graph_.Load(data[1]);
+      LoadPoseGraphFromFile(data[1]);
     } else {
-      pose_graph_.Load("saved_pose_graph.zip");
+      LoadPoseGraphFromFile("saved_pose_graph.zip");
     }
-
-    PublishPoseGraph();
-    ROS_INFO_STREAM("Done Loading pose graph");
-    ReGenerateMapPointCloud();
-    ROS_INFO_STREAM("Done regenerating Map Pointcloud");
-
-    PublishAllKeyedScans(); // So the loop closure module has all the keyed
-                            // scans
-    ROS_INFO_STREAM("Done publishing keyed scans");
   }
 
   else if (msg.data == "optimize") {
@@ -487,3 +605,62 @@ void LampBaseStation::DebugCallback(const std_msgs::String msg) {
     ROS_WARN_STREAM("Debug message not recognized");
   }
 }
+
+bool LampBaseStation::LoadPoseGraphFromFile(const std::string& filename) {
+  if (!pose_graph_.Load(filename)) {
+    ROS_ERROR_STREAM("Failed to load pose graph from " << filename);
+    return false;
+  }
+  b_pose_graph_changed_ = true;
+
+  PublishPoseGraph();
+  ROS_INFO_STREAM("Done Loading pose graph");
+  // Scans may have been replaced, transform them all again
+  map_contributions_.clear();
+  if (b_use_submaps_) {
+    submaps_.Clear();
+    for (const auto& keyed_pose : pose_graph_.GetValues()) {
+      const gtsam::Symbol key = keyed_pose.key;
+      if (!pose_graph_.HasScan(key)) continue;
+      submaps_.AddScan(
+          key, pose_graph_.GetPose(key), *pose_graph_.keyed_scans.at(key));
+    }
+  }
+  ReGenerateMapPointCloud();
+  ROS_INFO_STREAM("Done regenerating Map Pointcloud");
+
+  PublishAllKeyedScans(); // So the loop closure module has all the keyed
+                          // scans
+  ROS_INFO_STREAM("Done publishing keyed scans");
+  return true;
+}
+
+void LampBaseStation::CheckpointTimerCallback(const ros::TimerEvent& ev) {
+  // Snapshot under the lock (the keyed scans are shared, not copied) and
+  // write it without holding up the graph updates
+  PoseGraph snapshot;
+  {
+    std::lock_guard<std::mutex> lock(lamp_mutex_);
+
+    // Only save if the graph changed since the last checkpoint
+    if (!b_pose_graph_changed_ || pose_graph_.GetValues().empty()) {
+      return;
+    }
+    snapshot = pose_graph_;
+    b_pose_graph_changed_ = false;
+  }
+
+  // Save writes archives through a temporary file, so a crash never leaves a
+  // partial checkpoint behind
+  ros::WallTime start = ros::WallTime::now();
+  if (!snapshot.Save(checkpoint_path_)) {
+    ROS_WARN_STREAM("Failed to write base station checkpoint "
+                    << checkpoint_path_);
+    // Try again next period
+    std::lock_guard<std::mutex> lock(lamp_mutex_);
+    b_pose_graph_changed_ = true;
+    return;
+  }
+  ROS_DEBUG_STREAM("Wrote base station checkpoint in "
+                   << (ros::WallTime::now() - start).toSec() << " s");
+}
@@ -34,13 +34,25 @@ using gtsam::Values;
 using gtsam::Vector3;
 
 // Constructor
-LampRobot::LampRobot() : b_init_pg_pub_(false), init_count_(0) {
+LampRobot::LampRobot()
+  : b_init_pg_pub_(false),
+    init_count_(0),
+    b_async_keyed_scans_(false),
+    keyed_scan_queue_size_(10),
+    num_latency_samples_(0),
+    latency_sum_(0.0),
+    latency_max_(0.0) {
   b_run_optimization_ = false;
   mapper_ = std::make_shared<PointCloudMapper>();
 }
 
 // Destructor
-LampRobot::~LampRobot() {}
+LampRobot::~LampRobot() {
+  StopHeavySpinner();
+
+  // Publish what is still in the pipeline
+  keyed_scan_pipeline_.Stop();
+}
 
 // Initialization - override for robot specific setup
 bool LampRobot::Initialize(const ros::NodeHandle& n) {
@@ -76,6 +88,8 @@ bool LampRobot::Initialize(const ros::NodeHandle& n) {
     return false;
   }
 
+  StartHeavySpinner();
+
   return true;
 }
 
@@ -124,6 +138,9 @@ bool LampRobot::LoadParameters(const ros::NodeHandle& n) {
                filter_params_.decimate_percentage))
     return false;
 
+  // Optional: single pass filter (default on)
+  pu::Get("filtering/fused_filter", filter_params_.fused_filter);
+
   // Cap to [0.0, 1.0].
   filter_params_.decimate_percentage =
       std::min(1.0, std::max(0.0, filter_params_.decimate_percentage));
@@ -131,6 +148,17 @@ bool LampRobot::LoadParameters(const ros::NodeHandle& n) {
   // Initialize Filter
   filter_ = LampPcldFilter(filter_params_);
 
+  // Optional: create nodes when the odometry handler has a factor rather
+  // than on the update timer
+  pu::Get("event_driven", b_event_driven_);
+
+  // Optional: optimizer results and loop closures on their own thread
+  pu::Get("callback_queues/separate", b_separate_callback_queues_);
+
+  // Optional: keyed scan preprocessing on worker threads
+  pu::Get("keyed_scan_pipeline/enabled", b_async_keyed_scans_);
+  pu::Get("keyed_scan_pipeline/queue_size", keyed_scan_queue_size_);
+
   // Set Precisions
   // TODO - eventually remove the need to use this
   if (!SetFactorPrecisions()) {
@@ -138,6 +166,8 @@ bool LampRobot::LoadParameters(const ros::NodeHandle& n) {
     return false;
   }
 
+  LoadMapRegenerationParameters();
+
   // Set the initial key - to get the right symbol
   if (!SetInitialKey()) {
     ROS_ERROR("SetInitialKey failed");
@@ -180,12 +210,15 @@ bool LampRobot::RegisterCallbacks(const ros::NodeHandle& n) {
   update_timer_ =
       nl.createTimer(update_rate_, &LampRobot::ProcessTimerCallback, this);
 
-  back_end_pose_graph_sub_ = nl.subscribe("optimized_values",
+  // Heavy inputs, kept away from odometry
+  ros::NodeHandle nh = HeavyCallbackNodeHandle(n);
+
+  back_end_pose_graph_sub_ = nh.subscribe("optimized_values",
                                           1,
                                           &LampRobot::OptimizerUpdateCallback,
                                           dynamic_cast<LampBase*>(this));
 
-  laser_loop_closure_sub_ = nl.subscribe("laser_loop_closures",
+  laser_loop_closure_sub_ = nh.subscribe("laser_loop_closures",
                                          1,
                                          &LampRobot::LaserLoopClosureCallback,
                                          dynamic_cast<LampBase*>(this));
@@ -206,6 +239,12 @@ bool LampRobot::CreatePublishers(const ros::NodeHandle& n) {
   keyed_scan_pub_ =
       nl.advertise<pose_graph_msgs::KeyedScan>("keyed_scans", 10, true);
 
+  if (b_async_keyed_scans_) {
+    keyed_scan_pipeline_.Stop();
+    keyed_scan_pipeline_.Start(
+        filter_params_, keyed_scan_pub_, keyed_scan_queue_size_);
+  }
+
   // Publishers
   pose_pub_ = nl.advertise<geometry_msgs::PoseStamped>("lamp_pose", 10, false);
 
@@ -324,6 +363,11 @@ bool LampRobot::InitializeHandlers(const ros::NodeHandle& n) {
     return false;
   }
 
+  // The stationary handler stays polled, it depends on the odometry keys
+  if (b_event_driven_) {
+    EnableEventDrivenHandlers(n, {&odometry_handler_});
+  }
+
   return true;
 }
 
@@ -332,11 +376,13 @@ bool LampRobot::CheckHandlers() {
   // b_has_new_factor_ will be set to true if there is a new factor
   // b_run_optimization_ will be set to true if there is a new loop closure
 
-  bool b_have_odom_factors;
-  // bool b_have_loop_closure;
-
   // Check the odom for adding new poses
-  b_have_odom_factors = ProcessOdomData(odometry_handler_.GetData());
+  if (b_event_driven_) {
+    // Normally processed as soon as the handler pushes it
+    ProcessQueuedFactorData();
+  } else {
+    ProcessOdomData(odometry_handler_.GetData());
+  }
 
   if (b_add_imu_factors_ && stationary_handler_.has_data_) {
     // Check if we have moved since the last stationary factor
@@ -352,6 +398,8 @@ bool LampRobot::CheckHandlers() {
 }
 
 void LampRobot::ProcessTimerCallback(const ros::TimerEvent& ev) {
+  std::lock_guard<std::mutex> lock(lamp_mutex_);
+
   // Print some debug messages
   // ROS_INFO_STREAM("Checking for new data");
 
@@ -364,7 +412,7 @@ void LampRobot::ProcessTimerCallback(const ros::TimerEvent& ev) {
         PublishPoseGraph(true);
 
         // Get a keyed scan
-        PointCloud::Ptr new_scan(new PointCloud);
+        PointCloudConstPtr new_scan;
         // Take away 0.1 from ros::Time::now() so the delay in getting point
         // clouds is accounted for
         if (odometry_handler_.GetKeyedScanAtTime(
@@ -382,7 +430,7 @@ void LampRobot::ProcessTimerCallback(const ros::TimerEvent& ev) {
       PublishPoseGraph(true);
 
       // Publish first point cloud
-      PointCloud::Ptr new_scan(new PointCloud);
+      PointCloudConstPtr new_scan;
       // Take away 0.1 from ros::Time::now() so the delay in getting point
       // clouds is accounted for
       if (odometry_handler_.GetKeyedScanAtTime(
@@ -402,25 +450,14 @@ void LampRobot::ProcessTimerCallback(const ros::TimerEvent& ev) {
   // Publish odom
   UpdateAndPublishOdom();
 
+  // Scans filtered since the last update go into the graph and map
+  InsertFilteredScans();
+
   // Check the handlers
   CheckHandlers();
 
   // Publish the pose graph
-  if (b_has_new_factor_) {
-    ROS_DEBUG("Have new factor, publishing pose-graph");
-    PublishPoseGraph();
-
-    // Publish the full map (for debug)
-    mapper_->PublishMap();
-
-    b_has_new_factor_ = false;
-    if (!b_init_pg_pub_) {
-      b_init_pg_pub_ = true;
-    }
-    if (!b_have_received_first_pg_) {
-      b_have_received_first_pg_ = true;
-    }
-  }
+  PublishNewFactors();
 
   // Start optimize, if needed
   if (b_run_optimization_) {
@@ -442,6 +479,62 @@ void LampRobot::ProcessTimerCallback(const ros::TimerEvent& ev) {
   // Publish anything that is needed
 }
 
+void LampRobot::ProcessFactorData(
+    std::vector<std::shared_ptr<FactorData>>& data) {
+  for (const auto& factor_data : data) {
+    if (factor_data->type == "odom") {
+      ProcessOdomData(factor_data);
+    } else {
+      ROS_WARN_STREAM(name_ << ": Unexpected " << factor_data->type
+                            << " data from the handlers");
+    }
+  }
+
+  // Publish the new node straight away
+  PublishNewFactors();
+}
+
+void LampRobot::PublishNewFactors() {
+  if (!b_has_new_factor_) {
+    return;
+  }
+  ROS_DEBUG("Have new factor, publishing pose-graph");
+  PublishPoseGraph();
+
+  // Odometry arrival to node publication
+  if (!odom_arrival_time_.isZero()) {
+    const double latency =
+        (ros::WallTime::now() - odom_arrival_time_).toSec();
+    odom_arrival_time_ = ros::WallTime();
+    num_latency_samples_++;
+    latency_sum_ += latency;
+    latency_max_ = std::max(latency_max_, latency);
+    ROS_DEBUG_STREAM("Odometry to node latency: " << latency * 1e3 << " ms");
+    if (num_latency_samples_ == 100) {
+      ROS_INFO_STREAM(name_ << ": Odometry to node latency over "
+                            << num_latency_samples_ << " nodes: mean "
+                            << latency_sum_ / num_latency_samples_ * 1e3
+                            << " ms, max " << latency_max_ * 1e3 << " ms ("
+                            << (b_event_driven_ ? "event driven" : "polled")
+                            << ")");
+      num_latency_samples_ = 0;
+      latency_sum_ = 0.0;
+      latency_max_ = 0.0;
+    }
+  }
+
+  // Publish the full map (for debug)
+  mapper_->PublishMap();
+
+  b_has_new_factor_ = false;
+  if (!b_init_pg_pub_) {
+    b_init_pg_pub_ = true;
+  }
+  if (!b_have_received_first_pg_) {
+    b_have_received_first_pg_ = true;
+  }
+}
+
 //-------------------------------------------------------------------
 
 // Handler Wrappers
@@ -466,6 +559,9 @@ bool LampRobot::ProcessOdomData(std::shared_ptr<FactorData> data) {
   // Record new factor being added - need to publish pose graph(
   ROS_DEBUG("Have Odom Factor");
   b_has_new_factor_ = true;
+  if (odom_arrival_time_.isZero()) {
+    odom_arrival_time_ = odom_data->arrival_time;
+  }
 
   // process data for each new factor
   for (auto odom_factor : odom_data->factors) {
@@ -517,15 +613,12 @@ bool LampRobot::ProcessOdomData(std::shared_ptr<FactorData> data) {
     pose_graph_.TrackFactor(prev_key, current_key, type, transform, covariance);
 
     // Get keyed scan from odom handler
-    PointCloud::Ptr new_scan(new PointCloud);
-
     if (odom_factor.b_has_point_cloud) {
       // Store the keyed scan and add it to the map
-      // Copy input scan.
-      new_scan = odom_factor.point_cloud;
+      // Shared with the odometry handler, not copied
+      PointCloudConstPtr new_scan = odom_factor.point_cloud;
 
-      if (!new_scan->points.empty() && new_scan != NULL ||
-          new_scan->size() != 0) {
+      if (new_scan != NULL && !new_scan->points.empty()) {
         // Add to keyed scans and publish
         AddKeyedScanAndPublish(new_scan, current_key);
       } else {
@@ -537,10 +630,18 @@ bool LampRobot::ProcessOdomData(std::shared_ptr<FactorData> data) {
   return true;
 }
 
-void LampRobot::AddKeyedScanAndPublish(PointCloud::Ptr new_scan,
+void LampRobot::AddKeyedScanAndPublish(PointCloudConstPtr scan,
                                        gtsam::Symbol current_key) {
-  // Filter and publish scan
-  filter_.Filter(*new_scan, new_scan);
+  if (keyed_scan_pipeline_.IsRunning()) {
+    // Filtered and published in order on the pipeline threads, inserted in
+    // the graph and map by InsertFilteredScans
+    keyed_scan_pipeline_.Add(current_key, scan);
+    return;
+  }
+
+  // Filter and publish scan (the input is shared with the odometry handler)
+  PointCloud::Ptr new_scan(new PointCloud);
+  filter_.Filter(*scan, new_scan);
 
   pose_graph_.InsertKeyedScan(current_key, new_scan);
 
@@ -556,6 +657,16 @@ void LampRobot::AddKeyedScanAndPublish(PointCloud::Ptr new_scan,
   keyed_scan_pub_.publish(keyed_scan_msg);
 }
 
+void LampRobot::InsertFilteredScans() {
+  if (!keyed_scan_pipeline_.IsRunning()) {
+    return;
+  }
+  for (const auto& filtered : keyed_scan_pipeline_.TakeFiltered()) {
+    pose_graph_.InsertKeyedScan(filtered.first, filtered.second);
+    AddTransformedPointCloudToMap(filtered.first);
+  }
+}
+
 // Odometry update
 void LampRobot::UpdateAndPublishOdom() {
   // Get the pose at the last key
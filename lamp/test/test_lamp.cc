@@ -117,9 +117,21 @@ public:
   bool ReGenerateMapPointCloud() {
     lr.ReGenerateMapPointCloud();
   }
+  // As from the optimizer callback, true if the lock is held again after
+  bool ReGenerateMapPointCloudReleasingLock() {
+    std::unique_lock<std::mutex> lock(lr.lamp_mutex_);
+    lr.ReGenerateMapPointCloud(&lock);
+    return lock.owns_lock();
+  }
   bool AddTransformedPointCloudToMap(const gtsam::Symbol key) {
     lr.AddTransformedPointCloudToMap(key);
   }
+  void SetIncrementalMapRegeneration(bool incremental) {
+    lr.b_incremental_map_regeneration_ = incremental;
+  }
+  size_t NumMapContributions() const {
+    return lr.map_contributions_.size();
+  }
 
   // Other utilities
   bool GetOptFlag() {
@@ -795,6 +807,50 @@ TEST_F(TestLampRobot, TestPointCloudTransform) {
   }
 }
 
+TEST_F(TestLampRobot, TestPointCloudTransformReleasingLock) {
+  ros::NodeHandle nh, pnh("~");
+  lr.Initialize(nh);
+
+  gtsam::Symbol key = gtsam::Symbol('a', 1);
+  AddToKeyScans(key, data);
+  InsertValues(key, gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(0.0, 5.0, 0.0)));
+
+  EXPECT_TRUE(ReGenerateMapPointCloudReleasingLock());
+
+  PointCloud::Ptr pc_out = GetMapPC();
+  ASSERT_GE(pc_out->size(), data->size());
+  for (int i = 0; i < 4; i++) {
+    EXPECT_NEAR(data->at(i).x, pc_out->at(i).x, tolerance_);
+    EXPECT_NEAR(data->at(i).y + 5.0, pc_out->at(i).y, tolerance_);
+    EXPECT_NEAR(data->at(i).z, pc_out->at(i).z, tolerance_);
+  }
+}
+
+TEST_F(TestLampRobot, TestPointCloudTransformIncremental) {
+  ros::NodeHandle nh, pnh("~");
+  lr.Initialize(nh);
+  SetIncrementalMapRegeneration(true);
+
+  gtsam::Symbol key = gtsam::Symbol('a', 1);
+  AddToKeyScans(key, data);
+  InsertValues(key, gtsam::Pose3());
+  EXPECT_TRUE(ReGenerateMapPointCloudReleasingLock());
+  EXPECT_EQ(NumMapContributions(), 1u);
+
+  // Move the node, the scan is transformed again
+  InsertValues(key, gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(10.0, 0.0, 0.0)));
+  EXPECT_TRUE(ReGenerateMapPointCloudReleasingLock());
+  EXPECT_EQ(NumMapContributions(), 1u);
+
+  PointCloud::Ptr pc_out = GetMapPC();
+  ASSERT_GE(pc_out->size(), data->size());
+  for (int i = 0; i < 4; i++) {
+    EXPECT_NEAR(data->at(i).x + 10.0, pc_out->at(i).x, tolerance_);
+    EXPECT_NEAR(data->at(i).y, pc_out->at(i).y, tolerance_);
+    EXPECT_NEAR(data->at(i).z, pc_out->at(i).z, tolerance_);
+  }
+}
+
 TEST_F(TestLampRobot, TestPointCloudTransformSingle) {
   // Add the scan and values to the graph
   ros::NodeHandle nh, pnh("~");
@@ -832,6 +888,56 @@ TEST_F(TestLampRobot, TestPointCloudTransformSingle) {
   }
 }
 
+TEST_F(TestLampRobot, KeyedScanPipelineKeepsOrder) {
+  ros::NodeHandle nh("~");
+  ros::Publisher pub =
+      nh.advertise<pose_graph_msgs::KeyedScan>("pipeline_scans", 100, false);
+  std::vector<gtsam::Key> published;
+  ros::Subscriber sub = nh.subscribe<pose_graph_msgs::KeyedScan>(
+      "pipeline_scans",
+      100,
+      [&published](const pose_graph_msgs::KeyedScan::ConstPtr& msg) {
+        published.push_back(msg->key);
+      });
+  ros::Duration(0.5).sleep();
+
+  LampPcldFilterParams params;
+  params.random_filter = false;
+  KeyedScanPipeline pipeline;
+  ASSERT_TRUE(pipeline.Start(params, pub, 2));
+
+  // More scans than the queues hold, the rest wait in the pending list
+  // without blocking Add
+  std::vector<gtsam::Symbol> keys;
+  for (int i = 0; i < 20; i++) {
+    keys.push_back(gtsam::Symbol('a', i));
+    EXPECT_TRUE(pipeline.Add(keys.back(), data));
+  }
+  pipeline.Flush();
+
+  std::vector<KeyedScanPipeline::FilteredScan> filtered =
+      pipeline.TakeFiltered();
+  ASSERT_EQ(keys.size(), filtered.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(keys[i], filtered[i].first);
+    EXPECT_EQ(data->size(), filtered[i].second->size());
+  }
+  EXPECT_TRUE(pipeline.TakeFiltered().empty());
+
+  for (int i = 0; i < 20 && published.size() < keys.size(); i++) {
+    ros::Duration(0.05).sleep();
+    ros::spinOnce();
+  }
+  ASSERT_EQ(keys.size(), published.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(keys[i].key(), published[i]);
+  }
+
+  pipeline.Stop();
+  EXPECT_FALSE(pipeline.IsRunning());
+  EXPECT_FALSE(pipeline.Add(keys.front(), data));
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   ros::init(argc, argv, "test_lamp_robot");
@@ -102,37 +102,28 @@ TEST_F(TestLampBase, AddScansBeforePoseNodes) {
   ros::NodeHandle nh, pnh("~");
   lb.Initialize(pnh);
 
-  // Add keyed scans to map
+  // Keyed scan as deserialized by the pose graph handler
   init_key_ = gtsam::Symbol('a', 0);
-  // Make keyed scan
-  scan_msg_.key = init_key_;
-  pcl::toROSMsg(*scan_, scan_msg_.scan);
-
+  PointCloud::ConstPtr cloud(new PointCloud(*scan_));
   data_.b_has_data = true;
+  data_.clouds.emplace_back(init_key_, cloud);
 
-  pose_graph_msgs::KeyedScan::ConstPtr msg_ptr(
-      new pose_graph_msgs::KeyedScan(scan_msg_));
-  data_.scans.push_back(msg_ptr);
-
-  // Process data
   std::shared_ptr<PoseGraphData> data_shared =
       std::make_shared<PoseGraphData>(data_);
   ProcessPoseGraphData(data_shared);
 
   // Add graph data
   graph_.nodes.push_back(n0);
-  data_.scans.clear();
+  data_.clouds.clear();
   data_.b_has_data = true;
+  data_.graphs.push_back(pose_graph_msgs::PoseGraph::ConstPtr(
+      new pose_graph_msgs::PoseGraph(graph_)));
 
-  pose_graph_msgs::PoseGraph::ConstPtr msg_ptr2(
-      new pose_graph_msgs::PoseGraph(graph_));
-  data_.graphs.push_back(msg_ptr2);
-
-  // Process data
   data_shared = std::make_shared<PoseGraphData>(data_);
   ProcessPoseGraphData(data_shared);
 
-  // Check map
+  // The pose graph holds the handler's cloud, not a copy
+  EXPECT_EQ(cloud, lb.graph().keyed_scans.at(init_key_));
   EXPECT_TRUE(GetMapDataSize() > 0);
 }
 
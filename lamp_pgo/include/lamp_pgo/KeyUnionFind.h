@@ -0,0 +1,42 @@
+/*
+KeyUnionFind.h
+Author: Yun Chang
+Union-find over gtsam keys to track connected components of a factor graph
+*/
+
+#ifndef KEY_UNION_FIND_H_
+#define KEY_UNION_FIND_H_
+
+#include <unordered_map>
+
+#include <gtsam/inference/Key.h>
+
+class KeyUnionFind {
+ public:
+  KeyUnionFind();
+  ~KeyUnionFind();
+
+  // Add key as its own component (no-op if it already exists)
+  void AddKey(const gtsam::Key& key);
+
+  // Merge the components of the two keys (adds keys if needed)
+  void Union(const gtsam::Key& a, const gtsam::Key& b);
+
+  // Representative key of the component containing key
+  gtsam::Key Find(const gtsam::Key& key);
+
+  inline bool HasKey(const gtsam::Key& key) const {
+    return parent_.find(key) != parent_.end();
+  }
+  inline size_t NumComponents() const { return num_components_; }
+  inline size_t NumKeys() const { return parent_.size(); }
+
+  void Clear();
+
+ private:
+  std::unordered_map<gtsam::Key, gtsam::Key> parent_;
+  std::unordered_map<gtsam::Key, size_t> rank_;
+  size_t num_components_;
+};
+
+#endif  // KEY_UNION_FIND_H_
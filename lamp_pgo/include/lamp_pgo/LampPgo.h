@@ -7,8 +7,17 @@ Interface for ROS and KimeraRPGO
 #ifndef LAMP_PGO_H_
 #define LAMP_PGO_H_
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 
+#include <gtsam/nonlinear/GaussNewtonOptimizer.h>
+#include <gtsam/nonlinear/ISAM2.h>
+#include <gtsam/nonlinear/LevenbergMarquardtOptimizer.h>
 #include <gtsam/nonlinear/Marginals.h>
 #include <gtsam/nonlinear/NonlinearFactorGraph.h>
 #include <gtsam/nonlinear/Values.h>
@@ -24,6 +33,8 @@ Interface for ROS and KimeraRPGO
 #include <lamp_utils/PrefixHandling.h>
 
 #include "KimeraRPGO/RobustSolver.h"
+#include "lamp_pgo/KeyUnionFind.h"
+#include "lamp_pgo/LampPgoCheckpoint.h"
 
 class LampPgo {
  public:
@@ -33,6 +44,10 @@ class LampPgo {
 
   bool Initialize(const ros::NodeHandle& n);
 
+  // Optimize an input graph right away, as the optimizer thread does for the
+  // subscribed graphs (used by the latency benchmark)
+  void OptimizeGraph(const pose_graph_msgs::PoseGraph::ConstPtr& graph_msg);
+
  private:
   // define publishers and subscribers
   ros::Publisher optimized_pub_;
@@ -49,11 +64,58 @@ class LampPgo {
   ros::Subscriber remove_lc_by_id_sub_;
   // reset subscriber
   ros::Subscriber reset_sub_;
+  // request a full (non-delta) publish of the optimized graph
+  ros::Subscriber request_full_graph_sub_;
+
+  // Publish optimized graph, only nodes that moved beyond the delta
+  // thresholds if delta publishing is on
+  void PublishValues();
 
-  void PublishValues() const;
+  void RequestFullGraphCallback(const std_msgs::Bool::ConstPtr& msg);
 
+  // Only enqueues the graph, the optimizer thread does the actual work
   void InputCallback(const pose_graph_msgs::PoseGraph::ConstPtr& graph_msg);
 
+  // Optimizer thread: waits for input, coalesces and optimizes
+  void OptimizerLoop();
+
+  // Merge all pending input graphs (oldest first) into one graph where
+  // newer nodes and edges replace older ones
+  static pose_graph_msgs::PoseGraph::ConstPtr MergeInputGraphs(
+      const std::deque<pose_graph_msgs::PoseGraph::ConstPtr>& graphs);
+
+  // Add new factors and values from graph to the solver and publish
+  void ProcessInput(const pose_graph_msgs::PoseGraph::ConstPtr& graph_msg);
+
+  // Rebuild the iSAM2 backend from the current inlier factors and estimate
+  void ResetIncrementalSolver();
+
+  // Bring iSAM2 up to date after a batch update: new inliers are added to it,
+  // it is only rebuilt if outlier rejection dropped a factor it already has
+  void UpdateIncrementalSolver();
+
+  // Factors the robust solver currently considers inliers
+  gtsam::NonlinearFactorGraph InlierFactors() const;
+
+  // Odometry edges and priors can go through iSAM2, anything else needs the
+  // robust solver
+  static bool IsOdometryOrPrior(const gtsam::NonlinearFactor::shared_ptr& f);
+
+  // Bring the connected components up to date with the solver's inlier
+  // factors. Returns true if they had to be rebuilt because factors were
+  // removed.
+  bool UpdateComponents();
+
+  // Optimize (in parallel, on num_component_threads_ threads) only the
+  // connected components containing the touched keys, keeping the previous
+  // estimate for all other components
+  void OptimizeComponents(const gtsam::Values& new_values,
+                          const gtsam::KeySet& touched_keys);
+
+  // Optimize a single component with the configured nonlinear solver
+  gtsam::Values OptimizeComponent(const gtsam::NonlinearFactorGraph& nfg,
+                                  const gtsam::Values& initial) const;
+
   void RemoveLCByIdCallback(const std_msgs::String::ConstPtr& msg);
 
   void RemoveLCCallback(const std_msgs::Bool::ConstPtr& msg);
@@ -70,14 +132,44 @@ class LampPgo {
 
   void PublishIgnoredList() const;
 
+  // Periodically write the solver state to checkpoint_path_
+  void CheckpointTimerCallback(const ros::TimerEvent& event);
+
+  // Copy the current state (caller holds solver_mutex_)
+  LampPgoCheckpoint MakeCheckpoint() const;
+
+  // Restore the solver state from a checkpoint file, returns false if there
+  // is no usable checkpoint
+  bool RestoreCheckpoint(const std::string& filename);
+
  private:
   // Optimizer parameters
   KimeraRPGO::RobustSolverParams rpgo_params_;
   std::unique_ptr<KimeraRPGO::RobustSolver> pgo_solver_;  // actual solver
 
+  // Optional incremental backend for odometry-only updates
+  bool b_use_isam2_;
+  gtsam::ISAM2Params isam2_params_;
+  std::unique_ptr<gtsam::ISAM2> isam2_;
+  // Factors currently in iSAM2
+  std::set<gtsam::NonlinearFactor::shared_ptr> isam2_factors_;
+
+  // Optimize disjoint components of the graph separately
+  bool b_partition_components_;
+  KeyUnionFind components_;
+  // Factor (front, back) keys already merged into components_
+  std::set<std::pair<gtsam::Key, gtsam::Key>> component_edges_;
+  // Threads used to optimize components (0 for the number of cores)
+  int num_component_threads_;
+  // Nonlinear solver parameters for the components, from rpgo_params_
+  gtsam::LevenbergMarquardtParams component_lm_params_;
+  gtsam::GaussNewtonParams component_gn_params_;
+
   gtsam::Values values_;
   gtsam::NonlinearFactorGraph nfg_;
-  gtsam::NonlinearFactorGraph nfg_all_;
+  // Keys of all the added factors (including rejected ones), to only pass
+  // new factors to the solver
+  std::set<gtsam::KeyVector> added_factor_keys_;
 
   // Parameter namespace ("robot" or "base")
   std::string param_ns_;
@@ -92,6 +184,36 @@ class LampPgo {
 
   // Max loop closure factor error
   double max_lc_error_;
+
+  // Delta publishing of optimized values
+  bool b_publish_delta_;
+  double delta_translation_threshold_;
+  double delta_rotation_threshold_;
+  // Send a full snapshot every n publishes (0 to only send on request)
+  int full_publish_period_;
+  int publishes_since_full_;
+  bool b_force_full_publish_;
+  // Poses and edges as of the last publish
+  std::unordered_map<gtsam::Key, gtsam::Pose3> published_poses_;
+  std::set<std::tuple<gtsam::Key, gtsam::Key, int32_t>> published_edges_;
+
+  // Checkpointing (disabled if the path is empty)
+  std::string checkpoint_path_;
+  ros::Timer checkpoint_timer_;
+  bool b_checkpoint_dirty_;
+  // Start time, to report restart-to-first-publish
+  ros::WallTime init_time_;
+  bool b_published_once_;
+
+  // Input graphs received since the last optimization
+  std::deque<pose_graph_msgs::PoseGraph::ConstPtr> input_queue_;
+  std::mutex input_mutex_;
+  std::condition_variable input_cv_;
+  bool b_stop_optimizer_;
+
+  // Guards the solver and the tracked graph state above
+  std::mutex solver_mutex_;
+  std::thread optimizer_thread_;
 };
 
 #endif  // LAMP_PGO_H_
@@ -0,0 +1,50 @@
+/*
+LampPgoCheckpoint.h
+Snapshot of the LampPgo state that is written to disk periodically so that a
+restarted node can resume without re-solving the whole history
+*/
+
+#ifndef LAMP_PGO_CHECKPOINT_H_
+#define LAMP_PGO_CHECKPOINT_H_
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <gtsam/nonlinear/Values.h>
+
+struct LampPgoCheckpoint {
+  // Bump when the layout below changes, older files are then rejected
+  static const uint32_t kVersion = 1;
+
+  // Factors the solver considered inliers, and the matching estimate
+  gtsam::NonlinearFactorGraph inlier_factors;
+  gtsam::Values values;
+
+  // Robots whose loop closures are ignored
+  std::vector<char> ignored_prefixes;
+  std::vector<std::string> ignored_list;
+
+  std::unordered_map<gtsam::Key, std::string> key_to_id_map;
+  std::map<std::pair<gtsam::Key, gtsam::Key>, int32_t> edge_to_type;
+
+  // Keys of every factor already received (including rejected ones)
+  std::set<gtsam::KeyVector> added_factor_keys;
+};
+
+// Write checkpoint to a binary file. The file is written next to the target
+// and renamed, so a crash never leaves a partial checkpoint behind.
+bool WriteCheckpoint(const std::string& filename,
+                     const LampPgoCheckpoint& checkpoint);
+
+// Read checkpoint from a binary file. Returns false if the file does not
+// exist, is corrupt or has a different version.
+bool ReadCheckpoint(const std::string& filename,
+                    LampPgoCheckpoint* checkpoint);
+
+#endif  // LAMP_PGO_CHECKPOINT_H_
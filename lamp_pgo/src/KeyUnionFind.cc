@@ -0,0 +1,54 @@
+/*
+KeyUnionFind.cc
+Author: Yun Chang
+Union-find over gtsam keys to track connected components of a factor graph
+*/
+
+#include "lamp_pgo/KeyUnionFind.h"
+
+#include <utility>
+
+KeyUnionFind::KeyUnionFind() : num_components_(0) {}
+KeyUnionFind::~KeyUnionFind() {}
+
+void KeyUnionFind::AddKey(const gtsam::Key& key) {
+  if (parent_.emplace(key, key).second) {
+    rank_[key] = 0;
+    num_components_++;
+  }
+}
+
+gtsam::Key KeyUnionFind::Find(const gtsam::Key& key) {
+  AddKey(key);
+  // Find root
+  gtsam::Key root = key;
+  while (parent_[root] != root) {
+    root = parent_[root];
+  }
+  // Path compression
+  gtsam::Key current = key;
+  while (parent_[current] != root) {
+    gtsam::Key next = parent_[current];
+    parent_[current] = root;
+    current = next;
+  }
+  return root;
+}
+
+void KeyUnionFind::Union(const gtsam::Key& a, const gtsam::Key& b) {
+  gtsam::Key root_a = Find(a);
+  gtsam::Key root_b = Find(b);
+  if (root_a == root_b) return;
+
+  // Union by rank
+  if (rank_[root_a] < rank_[root_b]) std::swap(root_a, root_b);
+  parent_[root_b] = root_a;
+  if (rank_[root_a] == rank_[root_b]) rank_[root_a]++;
+  num_components_--;
+}
+
+void KeyUnionFind::Clear() {
+  parent_.clear();
+  rank_.clear();
+  num_components_ = 0;
+}
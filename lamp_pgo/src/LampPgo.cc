@@ -9,6 +9,9 @@ Interface for ROS and KimeraRPGO
 #include <string>
 #include <vector>
 
+#include <algorithm>
+#include <atomic>
+
 #include <gtsam/geometry/Point3.h>
 #include <gtsam/geometry/Pose3.h>
 #include <gtsam/geometry/Rot3.h>
@@ -23,10 +26,31 @@ using gtsam::Values;
 
 namespace pu = parameter_utils;
 
-LampPgo::LampPgo() {}
-LampPgo::~LampPgo() {}
+LampPgo::LampPgo()
+    : b_use_isam2_(false),
+      b_partition_components_(false),
+      num_component_threads_(0),
+      b_publish_delta_(false),
+      delta_translation_threshold_(0.01),
+      delta_rotation_threshold_(0.005),
+      full_publish_period_(10),
+      publishes_since_full_(0),
+      b_force_full_publish_(true),
+      b_checkpoint_dirty_(false),
+      b_published_once_(false),
+      b_stop_optimizer_(false) {}
+LampPgo::~LampPgo() {
+  {
+    std::lock_guard<std::mutex> lock(input_mutex_);
+    b_stop_optimizer_ = true;
+  }
+  input_cv_.notify_all();
+  if (optimizer_thread_.joinable()) optimizer_thread_.join();
+}
 
 bool LampPgo::Initialize(const ros::NodeHandle& n) {
+  init_time_ = ros::WallTime::now();
+
   // Create subscriber and publisher
   ros::NodeHandle nl(n);  // Nodehandle for subscription/publishing
 
@@ -38,9 +62,9 @@ bool LampPgo::Initialize(const ros::NodeHandle& n) {
   ignored_list_pub_ =
       nl.advertise<std_msgs::String>("ignored_robots", 10, true);
 
-  // Subscriber
+  // Subscriber (callback only enqueues, so a deeper queue is cheap)
   input_sub_ = nl.subscribe<pose_graph_msgs::PoseGraph>(
-      "pose_graph_to_optimize", 1, &LampPgo::InputCallback, this);
+      "pose_graph_to_optimize", 10, &LampPgo::InputCallback, this);
   remove_lc_sub_ = nl.subscribe<std_msgs::Bool>(
       "remove_loop_closure", 1, &LampPgo::RemoveLCCallback, this);
   remove_lc_by_id_sub_ = nl.subscribe<std_msgs::String>(
@@ -51,6 +75,8 @@ bool LampPgo::Initialize(const ros::NodeHandle& n) {
       "revive_loop_closures", 1, &LampPgo::ReviveRobotLoopClosures, this);
   reset_sub_ =
       nl.subscribe<std_msgs::Bool>("reset", 1, &LampPgo::ResetCallback, this);
+  request_full_graph_sub_ = nl.subscribe<std_msgs::Bool>(
+      "request_full_graph", 1, &LampPgo::RequestFullGraphCallback, this);
 
   // Parse parameters
   // Optimizer backend
@@ -61,6 +87,7 @@ bool LampPgo::Initialize(const ros::NodeHandle& n) {
   bool b_use_outlier_rejection;
   if (!pu::Get(param_ns_ + "/b_use_outlier_rejection", b_use_outlier_rejection))
     return false;
+  bool b_use_gnc = false;
   if (b_use_outlier_rejection) {
     // outlier rejection on: set up PCM params
     double trans_threshold, rot_threshold, gnc_alpha;
@@ -75,6 +102,7 @@ bool LampPgo::Initialize(const ros::NodeHandle& n) {
     rpgo_params_.setPcmSimple3DParams(
         trans_threshold, rot_threshold, KimeraRPGO::Verbosity::VERBOSE);
     if (gnc_alpha > 0 && gnc_alpha < 1) {
+      b_use_gnc = true;
       rpgo_params_.setGncInlierCostThresholdsAtProbability(gnc_alpha);
       if (b_gnc_bias_odom)
         rpgo_params_.gncBiasOdom();
@@ -111,22 +139,80 @@ bool LampPgo::Initialize(const ros::NodeHandle& n) {
     rpgo_params_.logOutput(log_path);
     ROS_INFO("Enabled logging in Kimera-RPGO");
   }
+  // Incremental backend (optional, off by default)
+  pu::Get(param_ns_ + "/b_use_isam2", b_use_isam2_);
+  if (b_use_isam2_) {
+    double relinearize_threshold = 0.1;
+    int relinearize_skip = 1;
+    pu::Get(param_ns_ + "/isam2_relinearize_threshold", relinearize_threshold);
+    pu::Get(param_ns_ + "/isam2_relinearize_skip", relinearize_skip);
+    isam2_params_.relinearizeThreshold = relinearize_threshold;
+    isam2_params_.relinearizeSkip = relinearize_skip;
+    ROS_INFO("Using iSAM2 for odometry-only updates in LampPgo");
+  }
+
+  // Delta publishing (optional, off by default)
+  pu::Get(param_ns_ + "/b_publish_delta", b_publish_delta_);
+  pu::Get(param_ns_ + "/delta_translation_threshold",
+          delta_translation_threshold_);
+  pu::Get(param_ns_ + "/delta_rotation_threshold", delta_rotation_threshold_);
+  pu::Get(param_ns_ + "/full_publish_period", full_publish_period_);
+
+  // Partitioned optimization (optional, off by default). GNC decides inliers
+  // during the joint solve, so it cannot be combined with partitioning.
+  pu::Get(param_ns_ + "/b_partition_components", b_partition_components_);
+  if (b_partition_components_ && b_use_gnc) {
+    ROS_WARN("Component partitioning is not supported with GNC, disabling");
+    b_partition_components_ = false;
+  }
+  pu::Get(param_ns_ + "/num_component_threads", num_component_threads_);
+  if (num_component_threads_ <= 0) {
+    num_component_threads_ =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+  // Components are solved the way the robust solver solves the whole graph
+  component_lm_params_.diagonalDamping = rpgo_params_.lm_diagonal_damping;
+
+  // Checkpointing (optional, off if no path is given)
+  double checkpoint_period = 60.0;
+  pu::Get(param_ns_ + "/checkpoint_path", checkpoint_path_);
+  pu::Get(param_ns_ + "/checkpoint_period", checkpoint_period);
+
   // Initialize solver
   pgo_solver_.reset(new KimeraRPGO::RobustSolver(rpgo_params_));
+  ResetIncrementalSolver();
+
+  if (!checkpoint_path_.empty()) {
+    if (!RestoreCheckpoint(checkpoint_path_)) {
+      ROS_INFO_STREAM("No PGO checkpoint restored from " << checkpoint_path_);
+    }
+    if (checkpoint_period > 0) {
+      checkpoint_timer_ =
+          nl.createTimer(ros::Duration(checkpoint_period),
+                         &LampPgo::CheckpointTimerCallback,
+                         this);
+    }
+  }
 
   // Publish ignored list once
   PublishIgnoredList();
 
+  // Start optimizer thread
+  optimizer_thread_ = std::thread(&LampPgo::OptimizerLoop, this);
+
   return true;
 }
 
 void LampPgo::RemoveLastLoopClosure(char prefix_1, char prefix_2) {
+  std::lock_guard<std::mutex> lock(solver_mutex_);
   KimeraRPGO::EdgePtr removed_edge =
       pgo_solver_->removeLastLoopClosure(prefix_1, prefix_2);
   if (removed_edge != NULL) {
     // Extract the optimized values
     values_ = pgo_solver_->calculateEstimate();
     nfg_ = pgo_solver_->getFactorsUnsafe();
+    ResetIncrementalSolver();
+    b_checkpoint_dirty_ = true;
 
     ROS_INFO_STREAM("Removed last loop closure between "
                     << gtsam::DefaultKeyFormatter(removed_edge->from_key)
@@ -141,11 +227,14 @@ void LampPgo::RemoveLastLoopClosure(char prefix_1, char prefix_2) {
 }
 
 void LampPgo::RemoveLastLoopClosure() {
+  std::lock_guard<std::mutex> lock(solver_mutex_);
   KimeraRPGO::EdgePtr removed_edge = pgo_solver_->removeLastLoopClosure();
   if (removed_edge != NULL) {
     // Extract the optimized values
     values_ = pgo_solver_->calculateEstimate();
     nfg_ = pgo_solver_->getFactorsUnsafe();
+    ResetIncrementalSolver();
+    b_checkpoint_dirty_ = true;
 
     ROS_INFO_STREAM("Removed last loop closure between "
                     << gtsam::DefaultKeyFormatter(removed_edge->from_key)
@@ -174,17 +263,290 @@ void LampPgo::RemoveLCCallback(const std_msgs::Bool::ConstPtr& msg) {
 
 void LampPgo::ResetCallback(const std_msgs::Bool::ConstPtr& msg) {
   if (msg->data) {
+    // Drop inputs that were meant for the old graph
+    {
+      std::lock_guard<std::mutex> lock(input_mutex_);
+      input_queue_.clear();
+    }
+    std::lock_guard<std::mutex> lock(solver_mutex_);
     // Re-initialize solver
     pgo_solver_.reset(new KimeraRPGO::RobustSolver(rpgo_params_));
     values_ = Values();
     nfg_ = NonlinearFactorGraph();
-    nfg_all_ = NonlinearFactorGraph();
+    added_factor_keys_.clear();
+    components_.Clear();
+    component_edges_.clear();
+    published_poses_.clear();
+    published_edges_.clear();
+    b_force_full_publish_ = true;
+    b_checkpoint_dirty_ = true;
+    ResetIncrementalSolver();
+  }
+}
+
+bool LampPgo::IsOdometryOrPrior(const gtsam::NonlinearFactor::shared_ptr& f) {
+  if (f->size() == 1) return true;
+  return (lamp_utils::IsRobotPrefix(gtsam::Symbol(f->front()).chr()) &&
+          f->back() == f->front() + 1);
+}
+
+bool LampPgo::UpdateComponents() {
+  std::set<std::pair<gtsam::Key, gtsam::Key>> current_edges;
+  for (const auto& f : nfg_) {
+    if (f->size() > 1) {
+      current_edges.insert(std::make_pair(f->front(), f->back()));
+    }
+  }
+
+  // Union-find cannot split components, rebuild if any factor was removed
+  bool b_rebuild = false;
+  for (const auto& e : component_edges_) {
+    if (!current_edges.count(e)) {
+      b_rebuild = true;
+      break;
+    }
   }
+  if (b_rebuild) {
+    components_.Clear();
+    component_edges_.clear();
+  }
+
+  for (const auto& f : nfg_) {
+    if (f->size() > 1 &&
+        !component_edges_.insert(std::make_pair(f->front(), f->back()))
+             .second) {
+      continue;  // already merged
+    }
+    for (const auto& k : f->keys()) {
+      components_.Union(f->front(), k);
+    }
+  }
+  return b_rebuild;
+}
+
+void LampPgo::OptimizeComponents(const gtsam::Values& new_values,
+                                 const gtsam::KeySet& touched_keys) {
+  bool b_rebuilt = UpdateComponents();
+
+  // Previous estimate for existing keys, initial guess for new ones
+  Values initial = values_;
+  for (const auto& k : new_values.keys()) {
+    if (!initial.exists(k)) initial.insert(k, new_values.at(k));
+  }
+  for (const auto& k : initial.keys()) {
+    components_.AddKey(k);
+  }
+
+  // After a rebuild all components are optimized
+  gtsam::KeyVector keys_to_optimize =
+      b_rebuilt ? initial.keys()
+                : gtsam::KeyVector(touched_keys.begin(), touched_keys.end());
+  std::map<gtsam::Key, size_t> root_to_idx;
+  for (const auto& k : keys_to_optimize) {
+    if (!initial.exists(k)) continue;
+    gtsam::Key root = components_.Find(k);
+    if (!root_to_idx.count(root)) {
+      size_t idx = root_to_idx.size();
+      root_to_idx[root] = idx;
+    }
+  }
+
+  std::vector<NonlinearFactorGraph> component_nfgs(root_to_idx.size());
+  std::vector<Values> component_values(root_to_idx.size());
+  for (const auto& f : nfg_) {
+    auto it = root_to_idx.find(components_.Find(f->front()));
+    if (it != root_to_idx.end()) component_nfgs[it->second].add(f);
+  }
+  for (const auto& k : initial.keys()) {
+    auto it = root_to_idx.find(components_.Find(k));
+    if (it != root_to_idx.end()) {
+      component_values[it->second].insert(k, initial.at(k));
+    }
+  }
+
+  ROS_DEBUG_STREAM("PGO optimizing " << root_to_idx.size() << " of "
+                                     << components_.NumComponents()
+                                     << " components");
+
+  // Disjoint components are independent problems, solve them concurrently
+  // on at most num_component_threads_ threads
+  std::vector<Values> results(component_nfgs.size());
+  std::atomic<size_t> next_component(0);
+  auto worker = [&]() {
+    for (size_t i = next_component++; i < component_nfgs.size();
+         i = next_component++) {
+      results[i] = OptimizeComponent(component_nfgs[i], component_values[i]);
+    }
+  };
+  size_t num_threads = std::min(component_nfgs.size(),
+                                static_cast<size_t>(num_component_threads_));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Untouched components keep their previous estimate
+  values_ = initial;
+  for (const auto& result : results) {
+    values_.update(result);
+  }
+}
+
+gtsam::Values LampPgo::OptimizeComponent(
+    const gtsam::NonlinearFactorGraph& nfg,
+    const gtsam::Values& initial) const {
+  try {
+    if (rpgo_params_.solver == KimeraRPGO::Solver::GN) {
+      return gtsam::GaussNewtonOptimizer(nfg, initial, component_gn_params_)
+          .optimize();
+    }
+    return gtsam::LevenbergMarquardtOptimizer(
+               nfg, initial, component_lm_params_)
+        .optimize();
+  } catch (const std::exception& e) {
+    ROS_WARN_STREAM("Failed to optimize graph component: " << e.what());
+  }
+  return initial;
+}
+
+void LampPgo::ResetIncrementalSolver() {
+  if (!b_use_isam2_) return;
+  isam2_.reset(new gtsam::ISAM2(isam2_params_));
+  isam2_factors_.clear();
+  if (values_.empty()) return;
+
+  // Only seed with factors the robust solver currently considers inliers
+  NonlinearFactorGraph inliers = InlierFactors();
+  try {
+    isam2_->update(inliers, values_);
+    isam2_factors_.insert(inliers.begin(), inliers.end());
+  } catch (const std::exception& e) {
+    ROS_WARN_STREAM("Failed to initialize iSAM2 (" << e.what()
+                                                   << "), using batch solver");
+    isam2_.reset();
+  }
+}
+
+void LampPgo::UpdateIncrementalSolver() {
+  if (!b_use_isam2_) return;
+  if (isam2_ == nullptr) {
+    ResetIncrementalSolver();
+    return;
+  }
+
+  NonlinearFactorGraph inliers = InlierFactors();
+  std::set<gtsam::NonlinearFactor::shared_ptr> inlier_set(inliers.begin(),
+                                                          inliers.end());
+  for (const auto& f : isam2_factors_) {
+    if (!inlier_set.count(f)) {
+      ROS_DEBUG("PGO outlier rejection changed the factor set, reseeding iSAM2");
+      ResetIncrementalSolver();
+      return;
+    }
+  }
+
+  NonlinearFactorGraph new_inliers;
+  for (const auto& f : inliers) {
+    if (!isam2_factors_.count(f)) new_inliers.add(f);
+  }
+  Values new_values;
+  for (const auto& key_value : values_) {
+    if (!isam2_->valueExists(key_value.key)) {
+      new_values.insert(key_value.key, key_value.value);
+    }
+  }
+  try {
+    isam2_->update(new_inliers, new_values);
+    isam2_factors_.insert(new_inliers.begin(), new_inliers.end());
+  } catch (const std::exception& e) {
+    ROS_WARN_STREAM("iSAM2 update failed (" << e.what() << "), reseeding");
+    ResetIncrementalSolver();
+  }
+}
+
+NonlinearFactorGraph LampPgo::InlierFactors() const {
+  gtsam::Vector weights = pgo_solver_->getGncWeights();
+  NonlinearFactorGraph inliers;
+  for (size_t i = 0; i < nfg_.size(); i++) {
+    if (weights.size() == static_cast<int>(nfg_.size()) && weights[i] < 0.5)
+      continue;
+    inliers.add(nfg_[i]);
+  }
+  return inliers;
 }
 
 void LampPgo::InputCallback(
     const pose_graph_msgs::PoseGraph::ConstPtr& graph_msg) {
   // Callback for the input posegraph
+  {
+    std::lock_guard<std::mutex> lock(input_mutex_);
+    input_queue_.push_back(graph_msg);
+  }
+  input_cv_.notify_one();
+}
+
+void LampPgo::OptimizerLoop() {
+  while (true) {
+    std::deque<pose_graph_msgs::PoseGraph::ConstPtr> pending;
+    {
+      std::unique_lock<std::mutex> lock(input_mutex_);
+      input_cv_.wait(
+          lock, [this] { return b_stop_optimizer_ || !input_queue_.empty(); });
+      if (b_stop_optimizer_) return;
+      pending.swap(input_queue_);
+    }
+
+    if (pending.size() > 1) {
+      ROS_DEBUG_STREAM("PGO coalescing " << pending.size() << " input graphs");
+    }
+
+    std::lock_guard<std::mutex> lock(solver_mutex_);
+    ProcessInput(MergeInputGraphs(pending));
+  }
+}
+
+void LampPgo::OptimizeGraph(
+    const pose_graph_msgs::PoseGraph::ConstPtr& graph_msg) {
+  std::lock_guard<std::mutex> lock(solver_mutex_);
+  ProcessInput(graph_msg);
+}
+
+pose_graph_msgs::PoseGraph::ConstPtr LampPgo::MergeInputGraphs(
+    const std::deque<pose_graph_msgs::PoseGraph::ConstPtr>& graphs) {
+  if (graphs.size() == 1) {
+    return graphs.front();
+  }
+
+  // Later graphs take precedence for nodes and edges that appear twice
+  std::map<gtsam::Key, pose_graph_msgs::PoseGraphNode> nodes;
+  EdgeSet edges;
+  for (const auto& g : graphs) {
+    for (const auto& n : g->nodes) {
+      nodes[n.key] = n;
+    }
+    for (const auto& e : g->edges) {
+      auto it = edges.find(e);
+      if (it != edges.end()) edges.erase(it);
+      edges.insert(e);
+    }
+  }
+
+  pose_graph_msgs::PoseGraph::Ptr merged(new pose_graph_msgs::PoseGraph);
+  merged->header = graphs.back()->header;
+  merged->nodes.reserve(nodes.size());
+  for (const auto& n : nodes) {
+    merged->nodes.push_back(n.second);
+  }
+  merged->edges.assign(edges.begin(), edges.end());
+  return merged;
+}
+
+void LampPgo::ProcessInput(
+    const pose_graph_msgs::PoseGraph::ConstPtr& graph_msg) {
   NonlinearFactorGraph all_factors, new_factors;
   Values all_values, new_values;
 
@@ -221,14 +583,7 @@ void LampPgo::InputCallback(
 
   // Extract the new factors
   for (size_t i = 0; i < all_factors.size(); i++) {
-    bool factor_exists = false;
-    for (size_t j = 0; j < nfg_all_.size(); j++) {
-      if (nfg_all_[j]->keys() == all_factors[i]->keys()) {
-        factor_exists = true;
-        break;
-      }
-    }
-    if (!factor_exists) {
+    if (!added_factor_keys_.count(all_factors[i]->keys())) {
       // this factor does not exist before
       bool loop_closure =
           (lamp_utils::IsRobotPrefix(gtsam::Symbol(all_factors[i]->back()).chr()) &&
@@ -256,23 +611,61 @@ void LampPgo::InputCallback(
 
   ROS_DEBUG_STREAM("FACTORS BEFORE");
 
-  // Run the optimizer
-  pgo_solver_->update(new_factors, new_values);
+  // Odometry-only updates go through iSAM2 when enabled
+  bool b_incremental = b_use_isam2_ && isam2_ != nullptr;
+  for (const auto& f : new_factors) {
+    if (!b_incremental) break;
+    b_incremental = IsOdometryOrPrior(f);
+  }
+  if (b_incremental) {
+    try {
+      isam2_->update(new_factors, new_values);
+      isam2_factors_.insert(new_factors.begin(), new_factors.end());
+    } catch (const std::exception& e) {
+      ROS_WARN_STREAM("iSAM2 update failed (" << e.what()
+                                              << "), running batch solver");
+      b_incremental = false;
+    }
+  }
+
+  // Run the optimizer (robust solver only does outlier rejection when the
+  // update is incremental or the graph is optimized by component)
+  pgo_solver_->update(
+      new_factors, new_values, !b_incremental && !b_partition_components_);
   // Track all the added factors (including rejected ones)
-  nfg_all_.add(new_factors);
+  for (const auto& f : new_factors) {
+    added_factor_keys_.insert(f->keys());
+  }
+  b_checkpoint_dirty_ = true;
 
   // Extract the optimized values
-  values_ = pgo_solver_->calculateEstimate();
   nfg_ = pgo_solver_->getFactorsUnsafe();
+  if (b_incremental) {
+    values_ = isam2_->calculateEstimate();
+  } else if (b_partition_components_) {
+    gtsam::KeySet touched_keys;
+    for (const auto& k : new_values.keys()) touched_keys.insert(k);
+    for (const auto& f : new_factors) {
+      touched_keys.insert(f->keys().begin(), f->keys().end());
+    }
+    OptimizeComponents(new_values, touched_keys);
+    UpdateIncrementalSolver();
+  } else {
+    values_ = pgo_solver_->calculateEstimate();
+    UpdateIncrementalSolver();
+  }
 
   ROS_DEBUG_STREAM("FACTORS AFTER");
   std::vector<double> bad_errors;
-  for (auto f : nfg_) {
-    // f->printKeys();
-    double error = f->error(values_);
-    ROS_DEBUG_STREAM("Error: " << error);
-    if (error > 10.0){
-      bad_errors.push_back(error);
+  // Skip the O(n) error check on the incremental path
+  if (!b_incremental) {
+    for (auto f : nfg_) {
+      // f->printKeys();
+      double error = f->error(values_);
+      ROS_DEBUG_STREAM("Error: " << error);
+      if (error > 10.0){
+        bad_errors.push_back(error);
+      }
     }
   }
 
@@ -290,19 +683,79 @@ void LampPgo::InputCallback(
 }
 
 // TODO - check that this is ok including just the positions in the message
-void LampPgo::PublishValues() const {
+void LampPgo::PublishValues() {
   pose_graph_msgs::PoseGraph pose_graph_msg;
-  int iter_debug = 0;
-  // Then store the values as nodes
-  gtsam::KeyVector key_list = values_.keys();
-  // Extract the marginal/covariances of the optimized values
 
-  // gtsam::Marginals marginal(nfg_, values_);
-  // marginal.print();
-  // marginal.bayesTree_.print("Bayes Tree: ");
+  // Edges first, a change in the (inlier) edge set forces a full publish
+  std::set<std::tuple<gtsam::Key, gtsam::Key, int32_t>> edge_ids;
+  for (const auto& factor : nfg_) {
+    if (boost::dynamic_pointer_cast<gtsam::BetweenFactor<gtsam::Pose3>>(factor)) {
+      pose_graph_msgs::PoseGraphEdge edge;
+      edge.key_from = factor->front();
+      edge.key_to = factor->back();
+      lamp_utils::UpdateCovariance(
+          edge,
+          boost::dynamic_pointer_cast<gtsam::BetweenFactor<gtsam::Pose3>>(
+              factor)
+              ->noiseModel());
 
+      // TODO this makes the assumption that any two nodes has at most one edge
+      // which may not be true in the case of e.g. multiple loop closure
+      // modalities
+      auto it1 = edge_to_type_.find(std::make_pair(edge.key_to, edge.key_from));
+      auto it2 = edge_to_type_.find(std::make_pair(edge.key_from, edge.key_to));
+      if (it1 != edge_to_type_.end()) {
+        edge.type = it1->second;
+      } else if (it2 != edge_to_type_.end()) {
+        edge.type = it2->second;
+      } else {
+        ROS_ERROR_STREAM("Couldn't find edge type for edge from: "
+                         << edge.key_from << ", to: " << edge.key_to);
+        edge.type = pose_graph_msgs::PoseGraphEdge::LOOPCLOSE;
+      }
+      edge_ids.insert(std::make_tuple(edge.key_from, edge.key_to, edge.type));
+      pose_graph_msg.edges.push_back(edge);
+    }
+  }
+
+  // Decide between a full snapshot and a delta
+  bool b_full = !b_publish_delta_ || b_force_full_publish_ ||
+      edge_ids != published_edges_ ||
+      (full_publish_period_ > 0 &&
+       publishes_since_full_ + 1 >= full_publish_period_);
+  if (b_full) {
+    published_poses_.clear();
+    publishes_since_full_ = 0;
+    b_force_full_publish_ = false;
+  } else {
+    // Edges are unchanged, downstream keeps the ones from the last snapshot
+    pose_graph_msg.edges.clear();
+    publishes_since_full_++;
+  }
+  published_edges_.swap(edge_ids);
+  pose_graph_msg.incremental = !b_full;
+
+  // Then store the values as nodes
+  gtsam::KeyVector key_list;
+  key_list.reserve(values_.size());
+  for (const auto& key_value : values_) {
+    const gtsam::Key key = key_value.key;
+    // Single lookup and quaternion conversion per node
+    const gtsam::Pose3& pose = key_value.value.cast<gtsam::Pose3>();
+
+    if (!b_full) {
+      auto last = published_poses_.find(key);
+      if (last != published_poses_.end() &&
+          (pose.translation() - last->second.translation()).norm() <
+              delta_translation_threshold_ &&
+          gtsam::Rot3::Logmap(last->second.rotation().between(pose.rotation()))
+                  .norm() < delta_rotation_threshold_) {
+        continue;  // not moved enough to be republished
+      }
+    }
+    published_poses_[key] = pose;
+    key_list.push_back(key);
 
-  for (const auto& key : key_list) {
     pose_graph_msgs::PoseGraphNode node;
     node.key = key;
     if (key_to_id_map_.count(key)) {
@@ -311,25 +764,21 @@ void LampPgo::PublishValues() const {
       ROS_ERROR_STREAM("PGO: ID not found for node key");
     }
     // pose - translation
-    node.pose.position.x = values_.at<gtsam::Pose3>(key).translation().x();
-    node.pose.position.y = values_.at<gtsam::Pose3>(key).translation().y();
-    node.pose.position.z = values_.at<gtsam::Pose3>(key).translation().z();
+    const gtsam::Point3& t = pose.translation();
+    node.pose.position.x = t.x();
+    node.pose.position.y = t.y();
+    node.pose.position.z = t.z();
     // pose - rotation (to quaternion)
-    node.pose.orientation.x =
-        values_.at<gtsam::Pose3>(key).rotation().toQuaternion().x();
-    node.pose.orientation.y =
-        values_.at<gtsam::Pose3>(key).rotation().toQuaternion().y();
-    node.pose.orientation.z =
-        values_.at<gtsam::Pose3>(key).rotation().toQuaternion().z();
-    node.pose.orientation.w =
-        values_.at<gtsam::Pose3>(key).rotation().toQuaternion().w();
-
-
-
-    // ROS_WARN_STREAM("Debug get covariance");
+    const gtsam::Quaternion q = pose.rotation().toQuaternion();
+    node.pose.orientation.x = q.x();
+    node.pose.orientation.y = q.y();
+    node.pose.orientation.z = q.z();
+    node.pose.orientation.w = q.w();
 
     pose_graph_msg.nodes.push_back(node);
   }
+
+  // Extract the marginal/covariances of the optimized values
   try {
     gtsam::Marginals marginal(nfg_, values_);
     for (size_t k = 0 ; k < key_list.size(); ++k) {
@@ -360,41 +809,35 @@ void LampPgo::PublishValues() const {
           node.covariance = default_covariance;
         }
   }
-  for (const auto& factor : nfg_) {
-    if (boost::dynamic_pointer_cast<gtsam::BetweenFactor<gtsam::Pose3>>(factor)) {
-      pose_graph_msgs::PoseGraphEdge edge;
-      edge.key_from = factor->front();
-      edge.key_to = factor->back();
-      lamp_utils::UpdateCovariance(
-          edge,
-          boost::dynamic_pointer_cast<gtsam::BetweenFactor<gtsam::Pose3>>(
-              factor)
-              ->noiseModel());
 
-      // TODO this makes the assumption that any two nodes has at most one edge
-      // which may not be true in the case of e.g. multiple loop closure
-      // modalities
-      auto it1 = edge_to_type_.find(std::make_pair(edge.key_to, edge.key_from));
-      auto it2 = edge_to_type_.find(std::make_pair(edge.key_from, edge.key_to));
-      if (it1 != edge_to_type_.end()) {
-        edge.type = it1->second;
-      } else if (it2 != edge_to_type_.end()) {
-        edge.type = it2->second;
-      } else {
-        ROS_ERROR_STREAM("Couldn't find edge type for edge from: "
-                         << edge.key_from << ", to: " << edge.key_to);
-        edge.type = pose_graph_msgs::PoseGraphEdge::LOOPCLOSE;
-      }
-      pose_graph_msg.edges.push_back(edge);
-    }
+  if (!b_full && pose_graph_msg.nodes.empty()) {
+    ROS_DEBUG("PGO: no node moved beyond the delta thresholds");
+    return;
   }
 
-  ROS_DEBUG_STREAM("PGO publishing graph with " << pose_graph_msg.nodes.size()
-                                                << " values");
+  ROS_DEBUG_STREAM("PGO publishing " << (b_full ? "full" : "delta")
+                                     << " graph with "
+                                     << pose_graph_msg.nodes.size()
+                                     << " values");
   optimized_pub_.publish(pose_graph_msg);
+
+  if (!b_published_once_) {
+    b_published_once_ = true;
+    ROS_INFO_STREAM("PGO first publish "
+                    << (ros::WallTime::now() - init_time_).toSec()
+                    << " s after start (" << values_.size() << " values)");
+  }
+}
+
+void LampPgo::RequestFullGraphCallback(const std_msgs::Bool::ConstPtr& msg) {
+  if (!msg->data) return;
+  std::lock_guard<std::mutex> lock(solver_mutex_);
+  b_force_full_publish_ = true;
+  if (!values_.empty()) PublishValues();
 }
 
 void LampPgo::IgnoreRobotLoopClosures(const std_msgs::String::ConstPtr& msg) {
+  std::lock_guard<std::mutex> lock(solver_mutex_);
   // First convert string "huskyn" to char prefix
   char prefix = lamp_utils::GetRobotPrefix(msg->data);
 
@@ -403,6 +846,8 @@ void LampPgo::IgnoreRobotLoopClosures(const std_msgs::String::ConstPtr& msg) {
   // Extract the optimized values
   values_ = pgo_solver_->calculateEstimate();
   nfg_ = pgo_solver_->getFactorsUnsafe();
+  ResetIncrementalSolver();
+  b_checkpoint_dirty_ = true;
 
   // Double check that it is actually ignored
   std::vector<char> ignored_prefixes = pgo_solver_->getIgnoredPrefixes();
@@ -426,6 +871,7 @@ void LampPgo::IgnoreRobotLoopClosures(const std_msgs::String::ConstPtr& msg) {
 }
 
 void LampPgo::ReviveRobotLoopClosures(const std_msgs::String::ConstPtr& msg) {
+  std::lock_guard<std::mutex> lock(solver_mutex_);
   // First convert string "huskyn" to char prefix
   char prefix = lamp_utils::GetRobotPrefix(msg->data);
 
@@ -434,6 +880,8 @@ void LampPgo::ReviveRobotLoopClosures(const std_msgs::String::ConstPtr& msg) {
   // Extract the optimized values
   values_ = pgo_solver_->calculateEstimate();
   nfg_ = pgo_solver_->getFactorsUnsafe();
+  ResetIncrementalSolver();
+  b_checkpoint_dirty_ = true;
 
   // Double check that it is actually revived
   std::vector<char> ignored_prefixes = pgo_solver_->getIgnoredPrefixes();
@@ -470,3 +918,70 @@ void LampPgo::PublishIgnoredList() const {
   ignored_list_pub_.publish(msg);
   return;
 }
+
+void LampPgo::CheckpointTimerCallback(const ros::TimerEvent& event) {
+  LampPgoCheckpoint checkpoint;
+  {
+    std::lock_guard<std::mutex> lock(solver_mutex_);
+    if (!b_checkpoint_dirty_) return;
+    checkpoint = MakeCheckpoint();
+    b_checkpoint_dirty_ = false;
+  }
+
+  // Serialize outside the lock so the optimizer is not held up
+  ros::WallTime start = ros::WallTime::now();
+  if (!WriteCheckpoint(checkpoint_path_, checkpoint)) {
+    std::lock_guard<std::mutex> lock(solver_mutex_);
+    b_checkpoint_dirty_ = true;  // retry next period
+    return;
+  }
+  ROS_DEBUG_STREAM("PGO wrote checkpoint with "
+                   << checkpoint.values.size() << " values in "
+                   << (ros::WallTime::now() - start).toSec() << " s");
+}
+
+LampPgoCheckpoint LampPgo::MakeCheckpoint() const {
+  LampPgoCheckpoint checkpoint;
+  // Only inliers are stored, they are not checked for consistency on restore
+  checkpoint.inlier_factors = InlierFactors();
+  checkpoint.values = values_;
+  checkpoint.ignored_prefixes = pgo_solver_->getIgnoredPrefixes();
+  checkpoint.ignored_list = ignored_list_;
+  checkpoint.key_to_id_map = key_to_id_map_;
+  checkpoint.edge_to_type = edge_to_type_;
+  checkpoint.added_factor_keys = added_factor_keys_;
+  return checkpoint;
+}
+
+bool LampPgo::RestoreCheckpoint(const std::string& filename) {
+  ros::WallTime start = ros::WallTime::now();
+  LampPgoCheckpoint checkpoint;
+  if (!ReadCheckpoint(filename, &checkpoint)) return false;
+  if (checkpoint.values.empty()) return false;
+
+  std::lock_guard<std::mutex> lock(solver_mutex_);
+  // Only inliers were stored, so they are loaded without outlier rejection
+  // (PCM is skipped, GNC still weighs the stored inliers when enabled). The
+  // checkpointed estimate is the initial guess, so the solve converges right
+  // away.
+  pgo_solver_->forceUpdate(checkpoint.inlier_factors, checkpoint.values);
+  for (const auto& prefix : checkpoint.ignored_prefixes) {
+    pgo_solver_->ignorePrefix(prefix);
+  }
+  values_ = pgo_solver_->calculateEstimate();
+  nfg_ = pgo_solver_->getFactorsUnsafe();
+  ignored_list_ = checkpoint.ignored_list;
+  key_to_id_map_ = std::move(checkpoint.key_to_id_map);
+  edge_to_type_ = std::move(checkpoint.edge_to_type);
+  added_factor_keys_ = std::move(checkpoint.added_factor_keys);
+  ResetIncrementalSolver();
+
+  ROS_INFO_STREAM("PGO restored checkpoint " << filename << " with "
+                                             << values_.size() << " values and "
+                                             << nfg_.size() << " factors in "
+                                             << (ros::WallTime::now() - start)
+                                                    .toSec()
+                                             << " s");
+  PublishValues();
+  return true;
+}
@@ -0,0 +1,123 @@
+/*
+LampPgoCheckpoint.cc
+Binary (de)serialization of the LampPgo state
+*/
+
+#include "lamp_pgo/LampPgoCheckpoint.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/export.hpp>
+#include <boost/serialization/map.hpp>
+#include <boost/serialization/set.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/unordered_map.hpp>
+#include <boost/serialization/utility.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include <gtsam/geometry/Pose3.h>
+#include <gtsam/linear/NoiseModel.h>
+#include <gtsam/navigation/AttitudeFactor.h>
+#include <gtsam/sam/RangeFactor.h>
+#include <gtsam/slam/BetweenFactor.h>
+#include <gtsam/slam/PriorFactor.h>
+
+#include <ros/console.h>
+
+// Every polymorphic type that can end up in the LampPgo graph
+// (see lamp_utils::PoseGraphMsgToGtsam)
+BOOST_CLASS_EXPORT_GUID(gtsam::noiseModel::Constrained,
+                        "gtsam_noiseModel_Constrained");
+BOOST_CLASS_EXPORT_GUID(gtsam::noiseModel::Diagonal,
+                        "gtsam_noiseModel_Diagonal");
+BOOST_CLASS_EXPORT_GUID(gtsam::noiseModel::Gaussian,
+                        "gtsam_noiseModel_Gaussian");
+BOOST_CLASS_EXPORT_GUID(gtsam::noiseModel::Unit, "gtsam_noiseModel_Unit");
+BOOST_CLASS_EXPORT_GUID(gtsam::noiseModel::Isotropic,
+                        "gtsam_noiseModel_Isotropic");
+GTSAM_VALUE_EXPORT(gtsam::Pose3);
+BOOST_CLASS_EXPORT_GUID(gtsam::BetweenFactor<gtsam::Pose3>,
+                        "gtsam_BetweenFactor_Pose3");
+BOOST_CLASS_EXPORT_GUID(gtsam::PriorFactor<gtsam::Pose3>,
+                        "gtsam_PriorFactor_Pose3");
+typedef gtsam::RangeFactor<gtsam::Pose3, gtsam::Pose3> RangeFactorPose3;
+BOOST_CLASS_EXPORT_GUID(RangeFactorPose3, "gtsam_RangeFactor_Pose3");
+BOOST_CLASS_EXPORT_GUID(gtsam::Pose3AttitudeFactor,
+                        "gtsam_Pose3AttitudeFactor");
+
+namespace boost {
+namespace serialization {
+
+template <class Archive>
+void serialize(Archive& ar,
+               LampPgoCheckpoint& checkpoint,
+               const unsigned int version) {
+  ar& checkpoint.inlier_factors;
+  ar& checkpoint.values;
+  ar& checkpoint.ignored_prefixes;
+  ar& checkpoint.ignored_list;
+  ar& checkpoint.key_to_id_map;
+  ar& checkpoint.edge_to_type;
+  ar& checkpoint.added_factor_keys;
+}
+
+}  // namespace serialization
+}  // namespace boost
+
+bool WriteCheckpoint(const std::string& filename,
+                     const LampPgoCheckpoint& checkpoint) {
+  const std::string tmp_filename = filename + ".tmp";
+  try {
+    std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      ROS_ERROR_STREAM("Could not open checkpoint file " << tmp_filename);
+      return false;
+    }
+    boost::archive::binary_oarchive archive(out);
+    uint32_t version = LampPgoCheckpoint::kVersion;
+    archive << version;
+    archive << checkpoint;
+    out.flush();
+    if (!out.good()) {
+      ROS_ERROR_STREAM("Failed to write checkpoint file " << tmp_filename);
+      return false;
+    }
+  } catch (const std::exception& e) {
+    ROS_ERROR_STREAM("Failed to serialize checkpoint: " << e.what());
+    return false;
+  }
+
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    ROS_ERROR_STREAM("Could not move checkpoint to " << filename);
+    return false;
+  }
+  return true;
+}
+
+bool ReadCheckpoint(const std::string& filename,
+                    LampPgoCheckpoint* checkpoint) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in.is_open()) {
+    return false;
+  }
+  try {
+    boost::archive::binary_iarchive archive(in);
+    uint32_t version = 0;
+    archive >> version;
+    if (version != LampPgoCheckpoint::kVersion) {
+      ROS_WARN_STREAM("Checkpoint " << filename << " has version " << version
+                                    << ", expected "
+                                    << LampPgoCheckpoint::kVersion);
+      return false;
+    }
+    archive >> *checkpoint;
+  } catch (const std::exception& e) {
+    ROS_WARN_STREAM("Failed to read checkpoint " << filename << ": "
+                                                 << e.what());
+    return false;
+  }
+  return true;
+}
@@ -14,6 +14,7 @@
 #include <sensor_msgs/PointCloud2.h>
 #include <lamp_utils/CommonFunctions.h>
 #include <lamp_utils/PointCloudTypes.h>
+#include <lamp_utils/PointCloudUtils.h>
 #include <lamp_utils/PrefixHandling.h>
 #include <visualization_msgs/Marker.h>
 
@@ -59,28 +60,20 @@ void inputG2oFile(const std::string& filename,
            values->size());
 }
 
-PointCloud transformCloudToWorld(const gtsam::Key& key,
-                                 const gtsam::Values& values,
-                                 const PointCloud& cloud) {
-  PointCloud output_cloud;
-  gtsam::Pose3 pose = values.at<gtsam::Pose3>(key);
-  Eigen::Matrix4d b2w = pose.matrix();
-  pcl::transformPointCloud(cloud, output_cloud, b2w);
-  return output_cloud;
-}
-
 PointCloud
 buildCloudMap(const gtsam::Values& values,
               const std::unordered_map<gtsam::Key, PointCloud>& keyed_scans,
               const double& grid_size) {
-  PointCloud::Ptr map_cloud(new PointCloud);
+  std::vector<lamp_utils::PosedScan> posed_scans;
+  posed_scans.reserve(keyed_scans.size());
   for (const auto& ks : keyed_scans) {
     if (values.exists(ks.first)) {
-      PointCloud transformed_scan =
-          transformCloudToWorld(ks.first, values, ks.second);
-      *map_cloud += transformed_scan;
+      posed_scans.push_back(lamp_utils::PosedScan{
+          &ks.second, values.at<gtsam::Pose3>(ks.first)});
     }
   }
+  PointCloud::Ptr map_cloud(new PointCloud);
+  lamp_utils::TransformAndCombineScans(posed_scans, map_cloud.get());
   pcl::VoxelGrid<Point> grid;
   grid.setLeafSize(grid_size, grid_size, grid_size);
   grid.setInputCloud(map_cloud);
@@ -96,18 +89,19 @@ PointCloud buildCloudMapByRobot(
     const double& grid_size) {
   const char prefix = lamp_utils::ROBOT_PREFIXES.at(robot_name);
 
-  PointCloud::Ptr map_cloud(new PointCloud);
+  std::vector<lamp_utils::PosedScan> posed_scans;
   for (const auto& ks : keyed_scans) {
     if (gtsam::Symbol(ks.first).chr() != prefix) {
       continue;
     }
 
     if (values.exists(ks.first)) {
-      PointCloud transformed_scan =
-          transformCloudToWorld(ks.first, values, ks.second);
-      *map_cloud += transformed_scan;
+      posed_scans.push_back(lamp_utils::PosedScan{
+          &ks.second, values.at<gtsam::Pose3>(ks.first)});
     }
   }
+  PointCloud::Ptr map_cloud(new PointCloud);
+  lamp_utils::TransformAndCombineScans(posed_scans, map_cloud.get());
   pcl::VoxelGrid<Point> grid;
   grid.setLeafSize(grid_size, grid_size, grid_size);
   grid.setInputCloud(map_cloud);
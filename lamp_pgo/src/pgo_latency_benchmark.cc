@@ -0,0 +1,131 @@
+// pgo_latency_benchmark.cc
+// Replay a g2o file (e.g. the ones loaded by lamp_g2o) one node at a time
+// through LampPgo and record the latency of every update. Parameters are read
+// as for lamp_pgo, so run it once with b_use_isam2 false and once with it true
+// to compare the batch robust solver with the iSAM2 incremental path.
+// Output is csv: num_nodes, num_factors, loop_closure, update_ms
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <gtsam/nonlinear/Values.h>
+#include <gtsam/slam/BetweenFactor.h>
+#include <gtsam/slam/dataset.h>
+
+#include <ros/ros.h>
+
+#include <lamp_pgo/LampPgo.h>
+#include <lamp_utils/CommonFunctions.h>
+#include <lamp_utils/PrefixHandling.h>
+
+namespace {
+
+bool IsOdometry(const gtsam::NonlinearFactor::shared_ptr& f) {
+  return (lamp_utils::IsRobotPrefix(gtsam::Symbol(f->front()).chr()) &&
+          f->back() == f->front() + 1);
+}
+
+double ElapsedMs(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // usage: rosrun lamp_pgo pgo_latency_benchmark g2o_file [output_csv]
+  // (in a namespace with the lamp_pgo parameters loaded, e.g. /base)
+  ros::init(argc, argv, "pgo_latency_benchmark");
+  if (argc < 2) {
+    std::cout << "usage: rosrun lamp_pgo pgo_latency_benchmark g2o_file "
+                 "[output_csv]"
+              << std::endl;
+    return 1;
+  }
+  ros::NodeHandle n("~");
+
+  LampPgo pgo;
+  if (!pgo.Initialize(n)) {
+    ROS_ERROR("Failed to initialize LAMP PGO, are the parameters loaded?");
+    return 1;
+  }
+
+  gtsam::GraphAndValues graph_and_values = gtsam::load3D(argv[1]);
+  const gtsam::NonlinearFactorGraph& all_factors = *graph_and_values.first;
+  const gtsam::Values& all_values = *graph_and_values.second;
+  std::cout << "Loaded " << all_factors.size() << " factors and "
+            << all_values.size() << " values from " << argv[1] << std::endl;
+
+  std::ofstream file_out;
+  if (argc > 2) file_out.open(argv[2]);
+  std::ostream& out = file_out.is_open() ? file_out : std::cout;
+  out << "num_nodes,num_factors,loop_closure,update_ms" << std::endl;
+
+  // Factors that become available once a given key has been added
+  std::map<gtsam::Key, gtsam::NonlinearFactorGraph> factors_at_key;
+  for (const auto& f : all_factors) {
+    gtsam::Key last = *std::max_element(f->keys().begin(), f->keys().end());
+    factors_at_key[last].add(f);
+  }
+
+  const gtsam::SharedNoiseModel node_noise =
+      gtsam::noiseModel::Isotropic::Sigma(6, 0.1);
+  const gtsam::SharedNoiseModel prior_noise =
+      gtsam::noiseModel::Isotropic::Sigma(6, 0.01);
+
+  std::set<char> seen_prefixes;
+  size_t num_nodes = 0, num_factors = 0;
+  for (const auto& key : all_values.keys()) {
+    const gtsam::Pose3& pose = all_values.at<gtsam::Pose3>(key);
+    pose_graph_msgs::PoseGraph::Ptr graph_msg(new pose_graph_msgs::PoseGraph);
+    pose_graph_msgs::PoseGraphNode node = lamp_utils::GtsamToRosMsg(
+        ros::Time(0), "world", gtsam::Symbol(key), pose, node_noise);
+    node.ID = "odom_node";
+    graph_msg->nodes.push_back(node);
+
+    // Anchor the first node of every robot, as LAMP does
+    if (seen_prefixes.insert(gtsam::Symbol(key).chr()).second) {
+      graph_msg->edges.push_back(
+          lamp_utils::GtsamToRosMsg(gtsam::Symbol(key),
+                                    gtsam::Symbol(key),
+                                    pose_graph_msgs::PoseGraphEdge::PRIOR,
+                                    pose,
+                                    prior_noise));
+    }
+
+    bool b_loop_closure = false;
+    for (const auto& f : factors_at_key[key]) {
+      auto between =
+          boost::dynamic_pointer_cast<gtsam::BetweenFactor<gtsam::Pose3>>(f);
+      if (!between) continue;
+      const bool b_odometry = IsOdometry(f);
+      b_loop_closure = b_loop_closure || !b_odometry;
+      graph_msg->edges.push_back(lamp_utils::GtsamToRosMsg(
+          gtsam::Symbol(f->front()),
+          gtsam::Symbol(f->back()),
+          b_odometry ? pose_graph_msgs::PoseGraphEdge::ODOM
+                     : pose_graph_msgs::PoseGraphEdge::LOOPCLOSE,
+          between->measured(),
+          between->noiseModel()));
+    }
+    num_nodes++;
+    num_factors += graph_msg->edges.size();
+
+    auto start = std::chrono::steady_clock::now();
+    pgo.OptimizeGraph(graph_msg);
+    double update_ms = ElapsedMs(start);
+
+    out << num_nodes << "," << num_factors << "," << b_loop_closure << ","
+        << update_ms << std::endl;
+  }
+
+  std::cout << "Done replaying " << all_values.size() << " nodes" << std::endl;
+  return 0;
+}
@@ -0,0 +1,115 @@
+/*
+BoundedQueue.h
+First in first out queue shared between threads. Producers block while the
+queue is full so a slow consumer applies back pressure instead of letting
+the queue grow, consumers block until there is something to take.
+*/
+
+#ifndef BOUNDED_QUEUE_H_
+#define BOUNDED_QUEUE_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace lamp_utils {
+
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity = 1)
+      : capacity_(std::max<size_t>(1, capacity)), closed_(false) {}
+
+  // Blocks while the queue is full. Returns false if the queue was closed.
+  bool Push(T value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock,
+                   [this] { return closed_ || queue_.size() < capacity_; });
+    if (closed_) return false;
+    queue_.push_back(std::move(value));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Non blocking Push. Returns false if the queue is full or closed.
+  bool TryPush(T value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (closed_ || queue_.size() >= capacity_) return false;
+    queue_.push_back(std::move(value));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Blocks until there is a value. Returns false once the queue is closed
+  // and empty, values pushed before closing are still handed out.
+  bool Pop(T& value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+    if (queue_.empty()) return false;
+    value = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // Non blocking Pop
+  bool TryPop(T& value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.empty()) return false;
+    value = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // Wake every waiting thread; Push fails from now on
+  void Close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+  inline void SetCapacity(size_t capacity) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      capacity_ = std::max<size_t>(1, capacity);
+    }
+    not_full_.notify_all();
+  }
+
+  // Accept values again (the queue keeps what it holds)
+  void Reopen() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = false;
+  }
+
+  inline size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+  }
+  inline size_t capacity() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacity_;
+  }
+
+ private:
+  size_t capacity_;
+  bool closed_;
+  std::deque<T> queue_;
+  mutable std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+};
+
+} // namespace lamp_utils
+
+#endif // BOUNDED_QUEUE_H_
@@ -153,7 +153,8 @@ struct AprilTagFactor {
 struct OdometryFactor {
   std::pair<ros::Time, ros::Time> stamps;
 
-  pcl::PointCloud<Point>::Ptr point_cloud;
+  // Shared with the odometry handler buffer, not to be modified
+  pcl::PointCloud<Point>::ConstPtr point_cloud;
   bool b_has_point_cloud;
 
   gtsam::Pose3 transform;
@@ -226,6 +227,8 @@ public:
   virtual ~OdomData(){};
 
   std::vector<OdometryFactor> factors;
+  // Arrival of the odometry message that triggered the factors (latency)
+  ros::WallTime arrival_time;
 };
 
 class ArtifactData : public FactorData {
@@ -258,7 +261,8 @@ public:
   virtual ~PoseGraphData(){};
 
   std::vector<pose_graph_msgs::PoseGraph::ConstPtr> graphs;
-  std::vector<pose_graph_msgs::KeyedScan::ConstPtr> scans;
+  // Keyed scans already deserialized (with normals), shared, not copied
+  std::vector<std::pair<gtsam::Symbol, PointCloud::ConstPtr>> clouds;
 };
 
 class RobotPoseData : public FactorData {
@@ -0,0 +1,122 @@
+/*
+KeyedScanTransfer.h
+Bulk transfer of keyed scans: scans are sent in batches (optionally
+compressed with ScanCompression.h) and the sender is paced by the
+acknowledgements of the receivers rather than by fixed sleeps.
+*/
+
+#ifndef KEYED_SCAN_TRANSFER_H_
+#define KEYED_SCAN_TRANSFER_H_
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/function.hpp>
+#include <ros/callback_queue.h>
+#include <ros/ros.h>
+#include <std_msgs/UInt32.h>
+
+#include <pose_graph_msgs/KeyedScan.h>
+#include <pose_graph_msgs/KeyedScanBatch.h>
+
+#include <lamp_utils/KeyedScans.h>
+
+namespace lamp_utils {
+
+struct KeyedScanTransferParams {
+  // Scans per message
+  int batch_size = 50;
+  // Send quantized scans (lossy, ~10 bytes/point)
+  bool compressed = false;
+  // Deflate the quantized scans as well
+  bool entropy_coding = false;
+  // Batches sent ahead of the slowest receiver
+  int window = 4;
+  // Stop waiting for acknowledgements after this long without progress (s)
+  double ack_timeout = 5.0;
+};
+
+class KeyedScanBatchPublisher {
+ public:
+  KeyedScanBatchPublisher() : sequence_(0), b_stop_transfer_(false) {}
+  ~KeyedScanBatchPublisher();
+
+  // Advertises topic and listens to topic + "_ack"
+  void Advertise(ros::NodeHandle& nh,
+                 const std::string& topic,
+                 const KeyedScanTransferParams& params);
+
+  inline void SetParams(const KeyedScanTransferParams& params) {
+    params_ = params;
+  }
+  inline const KeyedScanTransferParams& GetParams() const { return params_; }
+
+  // Send all the scans, blocks until the receivers acknowledged the last
+  // batch (or timed out). Returns false if nothing was sent.
+  bool Publish(const KeyedScans& scans);
+
+  // Send the scans with Publish on the publisher's own thread and return
+  // right away. If a transfer is running, the scans are sent after it (a
+  // snapshot that is still waiting is replaced). Do not mix with Publish.
+  void PublishAsync(KeyedScans scans);
+
+  inline uint32_t GetNumSubscribers() const {
+    return batch_pub_.getNumSubscribers();
+  }
+  // Subscribers that acknowledge batches
+  inline uint32_t GetNumReceivers() const {
+    return ack_sub_.getNumPublishers();
+  }
+
+ private:
+  void AckCallback(const ros::MessageEvent<std_msgs::UInt32 const>& event);
+
+  // Wait until every receiver acknowledged sequence, false on timeout
+  bool WaitForAcks(uint32_t sequence);
+
+  // Transfer thread: sends the snapshots passed to PublishAsync
+  void TransferLoop();
+
+  KeyedScanTransferParams params_;
+  ros::Publisher batch_pub_;
+  ros::Subscriber ack_sub_;
+  // Acknowledgements are processed here so Publish can block in a callback
+  ros::CallbackQueue ack_queue_;
+  // Last sequence acknowledged per receiver
+  std::map<std::string, uint32_t> acked_;
+  uint32_t sequence_;
+
+  // Next snapshot to send from PublishAsync
+  std::unique_ptr<KeyedScans> pending_scans_;
+  std::mutex transfer_mutex_;
+  std::condition_variable transfer_cv_;
+  bool b_stop_transfer_;
+  std::thread transfer_thread_;
+};
+
+class KeyedScanBatchSubscriber {
+ public:
+  typedef boost::function<void(const pose_graph_msgs::KeyedScan::ConstPtr&)>
+      Callback;
+
+  // Calls callback for every scan of the batches received on topic, as if
+  // they had been received one by one, then acknowledges the batch
+  void Subscribe(ros::NodeHandle& nh,
+                 const std::string& topic,
+                 const Callback& callback);
+
+ private:
+  void BatchCallback(const pose_graph_msgs::KeyedScanBatch::ConstPtr& msg);
+
+  Callback callback_;
+  ros::Subscriber batch_sub_;
+  ros::Publisher ack_pub_;
+};
+
+} // namespace lamp_utils
+
+#endif // KEYED_SCAN_TRANSFER_H_
@@ -0,0 +1,193 @@
+/*
+ * Copyright Notes
+ *
+ * Authors:
+ * Alex Stephens       (alex.stephens@jpl.nasa.gov)
+ * Benjamin Morrell    (benjamin.morrell@jpl.nasa.gov)
+ */
+
+#ifndef KEYED_SCANS_H
+#define KEYED_SCANS_H
+
+#include <functional>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <gtsam/inference/Symbol.h>
+
+#include <lamp_utils/PointCloudTypes.h>
+#include <lamp_utils/ScanCompression.h>
+
+struct KeyedScanCompressionParams {
+  // Store scans quantized (see ScanCompression.h) and decode them on access
+  bool enabled{false};
+  // Deflate the quantized scans
+  bool entropy_coding{false};
+  // Number of decoded scans kept around for repeated access
+  size_t cache_size{32};
+};
+
+// Map from key to keyed scan that behaves like the std::map it replaces, but
+// can also hold scans that are only decoded (e.g. from a pose graph archive)
+// the first time they are accessed, and can keep scans compressed in memory.
+// Not thread safe, like std::map.
+//
+// With compression enabled only the most recently accessed scans stay
+// decoded: copy the returned ConstPtr rather than holding a reference to the
+// map entry across other accesses.
+class KeyedScans {
+ public:
+  typedef std::map<gtsam::Symbol, PointCloud::ConstPtr> Map;
+  typedef Map::value_type value_type;
+  typedef std::function<PointCloud::ConstPtr()> Loader;
+
+  // Iterator that decodes pending scans on dereference
+  class const_iterator {
+   public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef KeyedScans::value_type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef const value_type& reference;
+
+    const_iterator() : owner_(nullptr) {}
+    const_iterator(const KeyedScans* owner, Map::iterator it)
+        : owner_(owner), it_(it) {}
+
+    inline reference operator*() const {
+      owner_->Decode(it_);
+      return *it_;
+    }
+    inline pointer operator->() const {
+      return &operator*();
+    }
+    // Key of the entry, without decoding the scan
+    inline const gtsam::Symbol& key() const {
+      return it_->first;
+    }
+    inline const_iterator& operator++() {
+      ++it_;
+      return *this;
+    }
+    inline const_iterator operator++(int) {
+      const_iterator tmp = *this;
+      ++it_;
+      return tmp;
+    }
+    inline const_iterator& operator--() {
+      --it_;
+      return *this;
+    }
+    inline const_iterator operator--(int) {
+      const_iterator tmp = *this;
+      --it_;
+      return tmp;
+    }
+    inline bool operator==(const const_iterator& other) const {
+      return it_ == other.it_;
+    }
+    inline bool operator!=(const const_iterator& other) const {
+      return it_ != other.it_;
+    }
+
+   private:
+    const KeyedScans* owner_;
+    Map::iterator it_;
+  };
+  typedef const_iterator iterator;
+
+  inline const_iterator begin() const {
+    return const_iterator(this, scans_.begin());
+  }
+  inline const_iterator end() const {
+    return const_iterator(this, scans_.end());
+  }
+  inline const_iterator find(const gtsam::Symbol& key) const {
+    return const_iterator(this, scans_.find(key));
+  }
+
+  inline size_t size() const { return scans_.size(); }
+  inline bool empty() const { return scans_.empty(); }
+  inline size_t count(const gtsam::Symbol& key) const {
+    return scans_.count(key);
+  }
+
+  // Throws std::out_of_range if the key does not exist, like std::map::at.
+  inline const PointCloud::ConstPtr& at(const gtsam::Symbol& key) const {
+    auto it = scans_.find(key);
+    if (it == scans_.end()) {
+      throw std::out_of_range("KeyedScans::at: key not found");
+    }
+    Decode(it);
+    return it->second;
+  }
+
+  // Inserts an empty scan if the key does not exist, like std::map. The
+  // caller may overwrite the scan, so it is kept decoded from now on: use
+  // at() or find() for read access.
+  PointCloud::ConstPtr& operator[](const gtsam::Symbol& key);
+
+  std::pair<const_iterator, bool> insert(const value_type& value);
+
+  // Insert a scan that is only decoded by loader on first access.
+  inline bool InsertLazy(const gtsam::Symbol& key, const Loader& loader) {
+    if (!scans_.insert(value_type(key, PointCloud::ConstPtr())).second) {
+      return false;
+    }
+    pending_[key] = loader;
+    return true;
+  }
+
+  // Number of scans not decoded yet
+  inline size_t NumPending() const { return pending_.size(); }
+
+  size_t erase(const gtsam::Symbol& key);
+
+  inline void clear() {
+    scans_.clear();
+    pending_.clear();
+    compressed_.clear();
+    cache_.clear();
+  }
+
+  // Enabling compresses the scans held so far, disabling decodes them all.
+  void SetCompression(const KeyedScanCompressionParams& params);
+  inline const KeyedScanCompressionParams& GetCompression() const {
+    return params_;
+  }
+
+  // Compressed copy of the scan, nullptr if it is not held compressed
+  inline const lamp_utils::QuantizedScan*
+  FindCompressed(const gtsam::Symbol& key) const {
+    auto it = compressed_.find(key);
+    return it == compressed_.end() ? nullptr : &it->second;
+  }
+
+  // Memory held by the scans (decoded and compressed), excluding pending
+  // scans and the map itself
+  size_t MemoryBytes() const;
+
+ private:
+  // Make sure the scan at it is decoded
+  void Decode(Map::iterator it) const;
+  // Keep a scan, compressed if enabled
+  void Store(Map::iterator it, const PointCloud::ConstPtr& scan) const;
+  // Mark a compressed scan as most recently used, evicting the least
+  // recently used decoded scans beyond the cache size
+  void Touch(gtsam::Key key) const;
+  void Uncache(gtsam::Key key) const;
+
+  KeyedScanCompressionParams params_;
+  mutable Map scans_;
+  mutable std::unordered_map<gtsam::Key, Loader> pending_;
+  mutable std::unordered_map<gtsam::Key, lamp_utils::QuantizedScan>
+      compressed_;
+  // Decoded compressed scans, least recently used first. Small, so a vector
+  // is faster than a linked list (and copies safely).
+  mutable std::vector<gtsam::Key> cache_;
+};
+
+#endif
@@ -10,6 +10,10 @@
 #include <lamp_utils/CommonStructs.h>
 #include <lamp_utils/PointCloudUtils.h>
 
+#include <random>
+#include <unordered_map>
+#include <vector>
+
 struct LampPcldFilterParams {
   bool random_filter = true;
   // Percentage of points to discard. Must be between 0.0 and 1.0;
@@ -22,16 +26,23 @@ struct LampPcldFilterParams {
   double adaptive_max_grid = 1.0;
   double adaptive_min_grid = 0.1;
   bool observability_check = false;
+  // Voxelize, decimate and compute the observability in a single pass over
+  // the input instead of pcl::VoxelGrid, ComputeIcpObservability and
+  // pcl::RandomSample one after the other
+  bool fused_filter = false;
 };
 
 class LampPcldFilter {
 public:
-  LampPcldFilter(){};
+  LampPcldFilter() : LampPcldFilter(LampPcldFilterParams()){};
   LampPcldFilter(const LampPcldFilterParams& params);
   ~LampPcldFilter() = default;
 
+  // new_cloud is overwritten (its allocation is reused)
   void Filter(const PointCloud& original_cloud, PointCloud::Ptr new_cloud);
 
+  inline double GetGridLeafSize() const { return grid_leaf_size_; }
+
 private:
   void AdaptiveGridFilter(const double& target_pt_size,
                           const double& min_leaf_size,
@@ -39,10 +50,37 @@ private:
                           const PointCloud& original_cloud,
                           PointCloud::Ptr new_cloud);
 
+  void FusedFilter(const PointCloud& original_cloud, PointCloud::Ptr new_cloud);
+
+  // Adaptive leaf size feedback from the size (and observability) of the
+  // grid filtered cloud
+  void UpdateGridLeafSize(size_t grid_size, double observability);
+
+  // Pick count of the num_points in order (selection sampling)
+  std::vector<bool>& SelectRandom(size_t num_points, size_t count);
+
+  // Accumulated points of one voxel
+  struct Voxel {
+    uint32_t count;
+    float x, y, z, intensity;
+    float normal_x, normal_y, normal_z, curvature;
+    // Scatter of the points around the first one, for a normal when the
+    // input has none
+    float x0, y0, z0;
+    float dx, dy, dz;
+    float xx, xy, xz, yy, yz, zz;
+  };
+
   LampPcldFilterParams params_;
   double grid_leaf_size_;
   double prev_observability_;
   bool processed_first_cloud_;
+
+  // Reused between scans by the fused filter
+  std::unordered_map<uint64_t, uint32_t> voxel_index_;
+  std::vector<Voxel> voxels_;
+  std::vector<bool> selected_;
+  std::mt19937 random_;
 };
 
 #endif
\ No newline at end of file
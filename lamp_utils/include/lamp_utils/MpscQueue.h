@@ -0,0 +1,78 @@
+/*
+MpscQueue.h
+Unbounded lock-free queue for many producer threads and a single consumer
+thread (Vyukov's intrusive-free MPSC queue). Push never blocks and values
+are moved in and out, not copied.
+*/
+
+#ifndef MPSC_QUEUE_H_
+#define MPSC_QUEUE_H_
+
+#include <atomic>
+#include <utility>
+
+namespace lamp_utils {
+
+template <typename T>
+class MpscQueue {
+ public:
+  MpscQueue() {
+    Node* stub = new Node;
+    head_.store(stub);
+    tail_ = stub;
+  }
+
+  ~MpscQueue() {
+    T value;
+    while (Pop(value)) {
+    }
+    delete tail_;
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  // Any thread
+  void Push(T value) {
+    Node* node = new Node;
+    node->value = std::move(value);
+    Node* previous = head_.exchange(node, std::memory_order_acq_rel);
+    // Until this store the value is not visible to Pop
+    previous->next.store(node, std::memory_order_release);
+  }
+
+  // Consumer thread only. False if the queue is empty (or the only push in
+  // progress is not linked yet).
+  bool Pop(T& value) {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr) return false;
+    value = std::move(next->value);
+    // next becomes the stub
+    next->value = T();
+    tail_ = next;
+    delete tail;
+    return true;
+  }
+
+  // Consumer thread only
+  inline bool Empty() const {
+    return tail_->next.load(std::memory_order_acquire) == nullptr;
+  }
+
+ private:
+  struct Node {
+    Node() : next(nullptr) {}
+    std::atomic<Node*> next;
+    T value;
+  };
+
+  // Newest node, producers append here
+  std::atomic<Node*> head_;
+  // Stub before the oldest value, consumer only
+  Node* tail_;
+};
+
+} // namespace lamp_utils
+
+#endif // MPSC_QUEUE_H_
@@ -118,5 +118,20 @@ void AddNormals(const PointXyziCloud::ConstPtr& point_normal_cloud,
                 const NormalComputeParams& params,
                 PointCloud::Ptr point_cloud);
 
+struct PosedScan {
+  // Not owned, must outlive the call
+  const PointCloud* scan;
+  gtsam::Pose3 pose;
+};
+
+// Transform each scan (positions only, like pcl::transformPointCloud) by its
+// pose and concatenate the results into output. The output is allocated
+// once from a prefix sum over the scan sizes and the scans are transformed
+// straight into their slices in parallel. num_threads <= 0 uses the hardware
+// concurrency.
+void TransformAndCombineScans(const std::vector<PosedScan>& scans,
+                              PointCloud* output,
+                              int num_threads = 0);
+
 } // namespace lamp_utils
 #endif
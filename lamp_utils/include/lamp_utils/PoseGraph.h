@@ -10,7 +10,15 @@
 #ifndef POSE_GRAPH_H
 #define POSE_GRAPH_H
 
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
 #include <lamp_utils/CommonStructs.h>
+#include <lamp_utils/KeyedScans.h>
 #include <lamp_utils/PrefixHandling.h>
 
 // Pose graph structure storing values, factors and meta data.
@@ -19,12 +27,21 @@ class PoseGraph {
   bool b_first_;
   inline const gtsam::Values& GetValues() const { return values_; }
   inline const gtsam::Values& GetNewValues() const { return values_new_; }
-  inline const gtsam::NonlinearFactorGraph& GetNfg() const { return nfg_; }
+  // The factor graph is assembled from the factor partitions on access.
+  inline const gtsam::NonlinearFactorGraph& GetNfg() const {
+    if (b_nfg_dirty_) AssembleNfg();
+    return nfg_;
+  }
 
   // Modifiable references to pose graph data structures.
   inline gtsam::Values& GetValues() { return values_; }
   inline gtsam::Values& GetNewValues() { return values_new_; }
-  inline gtsam::NonlinearFactorGraph& GetNfg() { return nfg_; }
+  // Changes made through this reference are lost on the next assembly, use
+  // the Track* functions to add factors.
+  inline gtsam::NonlinearFactorGraph& GetNfg() {
+    if (b_nfg_dirty_) AssembleNfg();
+    return nfg_;
+  }
 
   // Function that maps gtsam::Symbol to std::string (internal identifier for
   // node messages).
@@ -32,8 +49,9 @@ class PoseGraph {
 
   std::string fixed_frame_id;
 
-  // Keep a list of keyed laser scans and keyed timestamps.
-  std::map<gtsam::Symbol, PointCloud::ConstPtr> keyed_scans;
+  // Keep a list of keyed laser scans and keyed timestamps. Scans loaded from
+  // an archive are decoded on first access.
+  KeyedScans keyed_scans;
   std::map<gtsam::Symbol, ros::Time> keyed_stamps;  // All nodes
   std::map<double, gtsam::Symbol> stamp_to_odom_key;
 
@@ -54,6 +72,8 @@ class PoseGraph {
   inline bool HasScan(const gtsam::Symbol& key) const {
     return keyed_scans.find(key) != keyed_scans.end();
   }
+  // Check if the graph has values with the given prefix.
+  bool HasPrefix(unsigned char prefix) const;
 
   // Message filters (if any)
   std::string prefix{""};
@@ -169,14 +189,18 @@ class PoseGraph {
     return std::abs(time - target.toSec()) <= time_threshold;
   }
 
-  // Saves pose graph and accompanying point clouds to a zip file.
-  bool Save(const std::string& zipFilename) const;
+  // Saves pose graph and accompanying point clouds to a zip file, or to an
+  // indexed archive (see PoseGraphArchive.h) if the filename ends in .pga.
+  bool Save(const std::string& filename) const;
 
-  // Loads pose graph and accompanying point clouds from a zip file.
-  bool Load(const std::string& zipFilename,
+  // Loads pose graph and accompanying point clouds from an archive or a
+  // legacy zip file. Scans from an archive are decoded lazily.
+  bool Load(const std::string& filename,
             const std::string& pose_graph_topic_name = "pose_graph");
 
-  // Convert entire pose graph to message.
+  // Convert entire pose graph to message. The message is a shared snapshot
+  // that is only rebuilt after the graph changed, its stamp is the time it
+  // was built.
   GraphMsgPtr ToMsg() const;
 
   // Generates message from factors and values that were modified since the
@@ -186,6 +210,11 @@ class PoseGraph {
   // Incremental update from pose graph message.
   void UpdateFromMsg(const GraphMsgPtr& msg);
 
+  // Incremental update from edges and (merged) nodes, applied in place
+  // without building a message.
+  void UpdateFromDelta(const std::vector<NodeMessage>& nodes,
+                       const std::vector<EdgeMessage>& edges);
+
   // Update all values_new_ so the incremental publisher republishes the whole
   // graph
   void AddAllValuesToNew();
@@ -204,10 +233,13 @@ class PoseGraph {
     nodes_.clear();
     priors_.clear();
     values_.clear();
-    nfg_ = gtsam::NonlinearFactorGraph();
+    factors_.clear();
+    b_nfg_dirty_ = true;
     keyed_scans.clear();
     keyed_stamps.clear();
     stamp_to_odom_key.clear();
+    index_.Clear();
+    msg_cache_.reset();
   }
 
   inline const EdgeSet& GetEdges() const { return edges_; }
@@ -227,14 +259,108 @@ class PoseGraph {
   const EdgeMessage* FindEdge(const gtsam::Key& key_from,
                               const gtsam::Key& key_to) const;
   const EdgeMessage* FindEdgeKeyTo(const gtsam::Key& key_to) const;
+  // Retrieves all edges of the given type (unordered).
+  std::vector<const EdgeMessage*> FindEdgesOfType(int type) const;
 
   // Retrieves prior of the given key, returns nullptr otherwise.
   // Returns const ptr because std::set only has const_iterators.
   const EdgeMessage* FindPrior(const gtsam::Key& key) const;
 
  private:
+  struct KeyPairHash {
+    size_t operator()(const std::pair<gtsam::Key, gtsam::Key>& p) const {
+      return std::hash<gtsam::Key>()(p.first) ^
+          (std::hash<gtsam::Key>()(p.second) + 0x9e3779b97f4a7c15ULL +
+           (p.first << 6) + (p.first >> 2));
+    }
+  };
+
+  // Hash indices for the lookup functions. They point into the sets below
+  // (std::set never moves its elements), so a copied graph drops them and
+  // rebuilds them on first use.
+  struct Indices {
+    Indices() = default;
+    Indices(const Indices&) : stale(true) {}
+    Indices(Indices&&) = default;
+    Indices& operator=(const Indices&) {
+      Clear();
+      stale = true;
+      return *this;
+    }
+    Indices& operator=(Indices&&) = default;
+
+    inline void Clear() {
+      nodes.clear();
+      edges.clear();
+      edges_to.clear();
+      priors.clear();
+      edges_by_prefix.clear();
+      edges_by_type.clear();
+      latest_keys.clear();
+      stale = false;
+    }
+
+    bool stale{false};
+    std::unordered_map<gtsam::Key, const NodeMessage*> nodes;
+    // Edges between two keys (one per edge type)
+    std::unordered_map<std::pair<gtsam::Key, gtsam::Key>,
+                       std::vector<const EdgeMessage*>,
+                       KeyPairHash>
+        edges;
+    std::unordered_map<gtsam::Key, std::vector<const EdgeMessage*>> edges_to;
+    std::unordered_map<gtsam::Key, const EdgeMessage*> priors;
+    // Edges touching each prefix (either end), and edges of each type
+    std::unordered_map<unsigned char,
+                       std::unordered_set<const EdgeMessage*>>
+        edges_by_prefix;
+    std::unordered_map<int, std::unordered_set<const EdgeMessage*>>
+        edges_by_type;
+    // Latest key in values_ for each prefix
+    std::unordered_map<unsigned char, gtsam::Key> latest_keys;
+  };
+  mutable Indices index_;
+
+  // Rebuild the indices if they were dropped by a copy.
+  inline void EnsureIndices() const {
+    if (index_.stale) RebuildIndices();
+  }
+  void RebuildIndices() const;
+
+  // Modify edges_, nodes_, priors_ and values_ keys while keeping the
+  // indices consistent.
+  void InsertEdge(const EdgeMessage& msg);
+  void EraseEdge(EdgeSet::const_iterator it);
+  // Inserts the node, or replaces the existing node with the same key.
+  void InsertNode(const NodeMessage& msg);
+  void InsertPrior(const EdgeMessage& msg);
+  void EraseNode(NodeSet::const_iterator it);
+  void IndexValueKey(gtsam::Key key) const;
+
+  // Cached full graph message returned by ToMsg(). The helpers above patch
+  // it in place while nobody else holds a reference, otherwise it is dropped
+  // and rebuilt on the next ToMsg().
+  mutable pose_graph_msgs::PoseGraph::Ptr msg_cache_;
+  pose_graph_msgs::PoseGraph* MutableMsgCache();
+
   gtsam::Values values_;
-  gtsam::NonlinearFactorGraph nfg_;
+
+  // Factors partitioned by (prefix of first key, prefix of last key, edge
+  // type), so that removing a robot or replacing the loop closures only
+  // touches the affected partitions. Factors added without a type use -1.
+  typedef std::tuple<unsigned char, unsigned char, int> FactorPartition;
+  std::map<FactorPartition, gtsam::NonlinearFactorGraph> factors_;
+  void AddFactor(int type, const gtsam::NonlinearFactor::shared_ptr& factor);
+  template <class FactorType>
+  inline void AddFactor(int type, const FactorType& factor) {
+    AddFactor(type, gtsam::NonlinearFactor::shared_ptr(new FactorType(factor)));
+  }
+  // Remove the factors between the two keys from the partition of the type
+  void RemoveFactors(int type, gtsam::Key key_from, gtsam::Key key_to);
+
+  // Concatenation of all partitions, rebuilt on access after a change
+  mutable gtsam::NonlinearFactorGraph nfg_;
+  mutable bool b_nfg_dirty_{false};
+  void AssembleNfg() const;
 
   // Cached messages for edges, nodes and priors to reduce publishing overhead.
   EdgeSet edges_;
@@ -247,11 +373,19 @@ class PoseGraph {
   NodeSet nodes_new_;
   EdgeSet priors_new_;
 
+  bool SaveArchive_(const std::string& filename) const;
+  // Writes the archive in place, SaveArchive_ moves it over the target
+  bool WriteArchive_(const std::string& filename) const;
+  bool SaveZip_(const std::string& zipFilename) const;
+  bool LoadArchive_(const std::string& filename);
+  bool LoadZip_(const std::string& zipFilename,
+                const std::string& pose_graph_topic_name);
+
   // Convert incremental pose graph with given values, edges and priors to
   // message.
-  GraphMsgPtr ToMsg_(const EdgeSet& edges,
-                     const NodeSet& nodes,
-                     const EdgeSet& priors) const;
+  pose_graph_msgs::PoseGraph::Ptr ToMsg_(const EdgeSet& edges,
+                                         const NodeSet& nodes,
+                                         const EdgeSet& priors) const;
 };
 
 #endif
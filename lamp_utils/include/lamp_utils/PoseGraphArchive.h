@@ -0,0 +1,106 @@
+/*
+PoseGraphArchive.h
+Indexed single-file archive for a pose graph and its keyed scans.
+
+Layout (host byte order):
+  magic
+  compressed scans, one zlib stream per scan
+  serialized pose graph message
+  index: scan count, one ArchiveScanEntry per scan, graph offset and size
+  footer: index offset, magic
+
+Scans are compressed in parallel and appended directly to the file. The
+reader memory-maps the file and decodes a scan only when it is requested.
+*/
+
+#ifndef POSE_GRAPH_ARCHIVE_H_
+#define POSE_GRAPH_ARCHIVE_H_
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtsam/inference/Key.h>
+#include <pose_graph_msgs/PoseGraph.h>
+#include <ros/time.h>
+
+#include <lamp_utils/PointCloudTypes.h>
+
+namespace lamp_utils {
+
+struct ArchiveScanEntry {
+  gtsam::Key key;
+  int64_t stamp_nsec;
+  // Position and size of the compressed scan in the file
+  uint64_t offset;
+  uint64_t size;
+  uint32_t width;
+  uint32_t height;
+  uint8_t is_dense;
+};
+
+struct ArchiveScan {
+  gtsam::Key key;
+  ros::Time stamp;
+  PointCloud::ConstPtr scan;
+};
+
+class PoseGraphArchiveWriter {
+ public:
+  // num_threads <= 0 uses the hardware concurrency
+  explicit PoseGraphArchiveWriter(const std::string& filename,
+                                  int num_threads = 0);
+
+  inline bool IsOpen() const { return out_.is_open() && out_.good(); }
+
+  // Compress a batch of scans in parallel and append them in order
+  bool AppendScans(const std::vector<ArchiveScan>& scans);
+
+  // Write the pose graph, the index and the footer and close the file
+  bool Finish(const pose_graph_msgs::PoseGraph& msg);
+
+ private:
+  std::ofstream out_;
+  uint64_t offset_;
+  int num_threads_;
+  std::vector<ArchiveScanEntry> entries_;
+};
+
+class PoseGraphArchiveReader {
+ public:
+  ~PoseGraphArchiveReader();
+
+  // Map the file and read its index, returns nullptr if the file is not a
+  // valid archive
+  static std::shared_ptr<PoseGraphArchiveReader> Open(
+      const std::string& filename);
+
+  // Check the magic at the start of the file
+  static bool IsArchive(const std::string& filename);
+
+  inline const std::vector<ArchiveScanEntry>& GetScanEntries() const {
+    return entries_;
+  }
+
+  // Decompress one scan, returns nullptr on a corrupt entry. Thread safe.
+  PointCloud::ConstPtr DecodeScan(const ArchiveScanEntry& entry) const;
+
+  bool ReadPoseGraph(pose_graph_msgs::PoseGraph* msg) const;
+
+ private:
+  PoseGraphArchiveReader() = default;
+  PoseGraphArchiveReader(const PoseGraphArchiveReader&) = delete;
+  PoseGraphArchiveReader& operator=(const PoseGraphArchiveReader&) = delete;
+
+  const uint8_t* data_{nullptr};
+  size_t size_{0};
+  uint64_t graph_offset_{0};
+  uint64_t graph_size_{0};
+  std::vector<ArchiveScanEntry> entries_;
+};
+
+} // namespace lamp_utils
+
+#endif // POSE_GRAPH_ARCHIVE_H_
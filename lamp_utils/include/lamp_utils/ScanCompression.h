@@ -0,0 +1,58 @@
+/*
+ScanCompression.h
+Lossy compact representation of keyed scans held in memory.
+
+Per point: positions quantized to 16 bits per axis within the scan's bounding
+box, normals oct-encoded in 2 x 8 bits, 8-bit intensity and curvature
+(10 bytes instead of sizeof(Point) = 48). The quantized arrays can
+additionally be deflated (zlib) as an entropy coder.
+*/
+
+#ifndef SCAN_COMPRESSION_H_
+#define SCAN_COMPRESSION_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <lamp_utils/PointCloudTypes.h>
+
+namespace lamp_utils {
+
+struct QuantizedScan {
+  // point = min + q * scale
+  float min[3];
+  float scale[3];
+  float intensity_min;
+  float intensity_scale;
+  float curvature_scale;
+  uint32_t width;
+  uint32_t height;
+  bool is_dense;
+  bool entropy_coded;
+  // Size of the quantized arrays before entropy coding
+  uint32_t raw_size;
+  std::vector<uint8_t> data;
+
+  inline size_t MemoryBytes() const {
+    return sizeof(QuantizedScan) + data.capacity();
+  }
+};
+
+// Bytes per point before entropy coding
+const size_t kQuantizedPointBytes = 10;
+
+bool QuantizeScan(const PointCloud& scan,
+                  bool entropy_code,
+                  QuantizedScan* out);
+
+// Returns nullptr if the data is corrupt
+PointCloud::Ptr DequantizeScan(const QuantizedScan& in);
+
+// Flat byte representation, e.g. to send a quantized scan in a message
+void SerializeQuantizedScan(const QuantizedScan& in, std::vector<uint8_t>* out);
+bool DeserializeQuantizedScan(const std::vector<uint8_t>& in,
+                              QuantizedScan* out);
+
+} // namespace lamp_utils
+
+#endif // SCAN_COMPRESSION_H_
@@ -0,0 +1,117 @@
+/*
+StampedRingBuffer.h
+Fixed-capacity buffer of time stamped values kept in time order. The storage
+is allocated once, so inserting at sensor rate does not allocate (store
+shared pointers to avoid copying large values), and lookups by time are
+binary searches.
+*/
+
+#ifndef STAMPED_RING_BUFFER_H_
+#define STAMPED_RING_BUFFER_H_
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace lamp_utils {
+
+template <typename T>
+class StampedRingBuffer {
+ public:
+  explicit StampedRingBuffer(size_t capacity = 1) : head_(0), size_(0) {
+    SetCapacity(capacity);
+  }
+
+  // Change the capacity, keeping the newest entries
+  void SetCapacity(size_t capacity) {
+    capacity = std::max<size_t>(1, capacity);
+    if (capacity == data_.size()) return;
+    const size_t keep = std::min(size_, capacity);
+    std::vector<std::pair<double, T>> data(capacity);
+    for (size_t i = 0; i < keep; i++) {
+      data[i] = std::move(At(size_ - keep + i));
+    }
+    data_.swap(data);
+    head_ = 0;
+    size_ = keep;
+  }
+
+  inline size_t capacity() const { return data_.size(); }
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+
+  // Insert in time order. When full the oldest entry is dropped, or the new
+  // one if it is older than everything stored. Entries with a stamp already
+  // in the buffer are not inserted. Returns false if value was not stored.
+  // O(1) for values arriving in order.
+  bool Insert(double stamp, const T& value) {
+    size_t index = size_;
+    if (size_ > 0 && stamp <= Stamp(size_ - 1)) {
+      index = LowerBound(stamp);
+      if (index < size_ && Stamp(index) == stamp) return false;
+    }
+    if (size_ == capacity()) {
+      if (index == 0) return false;
+      // Drop the oldest
+      head_ = Physical(1);
+      size_--;
+      index--;
+    }
+    // Make room at index by moving the newer entries up by one
+    size_++;
+    for (size_t i = size_ - 1; i > index; i--) {
+      At(i) = std::move(At(i - 1));
+    }
+    At(index).first = stamp;
+    At(index).second = value;
+    return true;
+  }
+
+  // Index of the first entry not older than stamp, size() if there is none
+  size_t LowerBound(double stamp) const {
+    size_t first = 0;
+    size_t count = size_;
+    while (count > 0) {
+      const size_t step = count / 2;
+      if (Stamp(first + step) < stamp) {
+        first += step + 1;
+        count -= step + 1;
+      } else {
+        count = step;
+      }
+    }
+    return first;
+  }
+
+  // Entries by index, 0 is the oldest
+  inline double Stamp(size_t i) const { return At(i).first; }
+  inline const T& Value(size_t i) const { return At(i).second; }
+
+  // Drop the count oldest entries
+  void EraseOldest(size_t count) {
+    count = std::min(count, size_);
+    for (size_t i = 0; i < count; i++) {
+      At(i).second = T();
+    }
+    head_ = Physical(count);
+    size_ -= count;
+  }
+
+  inline void Clear() { EraseOldest(size_); }
+
+ private:
+  inline size_t Physical(size_t i) const { return (head_ + i) % data_.size(); }
+  inline std::pair<double, T>& At(size_t i) { return data_[Physical(i)]; }
+  inline const std::pair<double, T>& At(size_t i) const {
+    return data_[Physical(i)];
+  }
+
+  std::vector<std::pair<double, T>> data_;
+  // Physical index of the oldest entry
+  size_t head_;
+  size_t size_;
+};
+
+} // namespace lamp_utils
+
+#endif // STAMPED_RING_BUFFER_H_
@@ -0,0 +1,108 @@
+/*
+Submaps.h
+Map made of submaps anchored to pose graph nodes. Each submap holds the
+voxelized points of a few consecutive keyed scans in the frame of its anchor
+node, so after an optimization only the anchor poses change and the world
+map is a composition of one transform per submap. The open submap of each
+robot collects its scans as they are and is voxelized once when it closes.
+*/
+
+#ifndef SUBMAPS_H_
+#define SUBMAPS_H_
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <lamp_utils/CommonStructs.h>
+#include <lamp_utils/PointCloudTypes.h>
+
+namespace lamp_utils {
+
+struct SubmapParams {
+  // A new submap is started after this many scans...
+  int max_scans = 10;
+  // ...or when the scan is further than this from the anchor (m)
+  double max_distance = 5.0;
+  // Voxel size of the submap points (m), 0 to keep all points
+  double leaf_size = 0.1;
+  // Anchor motion below these is not reported as a change
+  double translation_threshold = 0.05;
+  double rotation_threshold = 0.01;
+};
+
+struct Submap {
+  gtsam::Key anchor;
+  // Anchor pose the submap was last placed with
+  gtsam::Pose3 anchor_pose;
+  // Points in the anchor frame
+  PointCloud::Ptr points;
+  // Keyed scans merged into this submap
+  std::vector<gtsam::Key> keys;
+  // No more scans are added, the points do not change anymore
+  bool b_closed = false;
+};
+
+// Submap points (shared) at their anchor pose
+struct PosedSubmap {
+  gtsam::Key anchor;
+  gtsam::Pose3 pose;
+  PointCloud::ConstPtr points;
+};
+
+class Submaps {
+ public:
+  explicit Submaps(const SubmapParams& params = SubmapParams())
+      : params_(params) {}
+
+  inline void SetParams(const SubmapParams& params) { params_ = params; }
+  inline const SubmapParams& GetParams() const { return params_; }
+
+  // Add a body frame scan taken at pose to the open submap of the robot
+  // (prefix of key), or close it and start a new submap anchored at key. A
+  // submap is closed as soon as it holds max_scans scans. Returns the anchor
+  // of the submap the scan went to.
+  gtsam::Key AddScan(const gtsam::Symbol& key,
+                     const gtsam::Pose3& pose,
+                     const PointCloud& scan);
+
+  // Move the anchors to their poses in values and drop submaps whose anchor
+  // left the graph. Returns the anchors that moved beyond the thresholds.
+  // O(number of submaps).
+  std::vector<gtsam::Key> UpdateAnchors(const gtsam::Values& values);
+
+  // Anchors of the submaps closed since the last call
+  std::vector<gtsam::Key> TakeClosedSubmaps();
+  inline bool HasClosedSubmaps() const { return !closed_.empty(); }
+
+  // The submaps at their anchor poses, sharing their points. The points of
+  // closed submaps can be used without holding on to the Submaps.
+  std::vector<PosedSubmap> GetPosedSubmaps(bool b_closed_only = false) const;
+
+  // Compose the world map from the submaps at their anchor poses
+  void BuildWorldMap(PointCloud* points) const;
+  static void BuildWorldMap(const std::vector<PosedSubmap>& submaps,
+                            PointCloud* points);
+
+  const Submap* Find(gtsam::Key anchor) const;
+  inline size_t size() const { return submaps_.size(); }
+
+  inline void Clear() {
+    submaps_.clear();
+    open_.clear();
+    closed_.clear();
+  }
+
+ private:
+  void Close(Submap* submap);
+
+  SubmapParams params_;
+  std::map<gtsam::Key, Submap> submaps_;
+  // Submap currently being filled, per robot prefix
+  std::unordered_map<unsigned char, gtsam::Key> open_;
+  std::vector<gtsam::Key> closed_;
+};
+
+} // namespace lamp_utils
+
+#endif // SUBMAPS_H_
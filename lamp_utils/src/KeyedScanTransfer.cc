@@ -0,0 +1,219 @@
+/*
+KeyedScanTransfer.cc
+Batched, acknowledged bulk transfer of keyed scans
+*/
+
+#include "lamp_utils/KeyedScanTransfer.h"
+
+#include <algorithm>
+
+#include <boost/make_shared.hpp>
+#include <pcl_conversions/pcl_conversions.h>
+
+#include "lamp_utils/ScanCompression.h"
+
+namespace lamp_utils {
+
+void KeyedScanBatchPublisher::Advertise(ros::NodeHandle& nh,
+                                        const std::string& topic,
+                                        const KeyedScanTransferParams& params) {
+  params_ = params;
+  batch_pub_ =
+      nh.advertise<pose_graph_msgs::KeyedScanBatch>(topic, 100, false);
+
+  ros::SubscribeOptions ops;
+  ops.initByFullCallbackType<
+      const ros::MessageEvent<std_msgs::UInt32 const>&>(
+      nh.resolveName(topic) + "_ack",
+      1000,
+      boost::bind(&KeyedScanBatchPublisher::AckCallback, this, _1));
+  ops.callback_queue = &ack_queue_;
+  ack_sub_ = nh.subscribe(ops);
+}
+
+KeyedScanBatchPublisher::~KeyedScanBatchPublisher() {
+  {
+    std::lock_guard<std::mutex> lock(transfer_mutex_);
+    b_stop_transfer_ = true;
+  }
+  transfer_cv_.notify_all();
+  if (transfer_thread_.joinable()) transfer_thread_.join();
+}
+
+void KeyedScanBatchPublisher::PublishAsync(KeyedScans scans) {
+  {
+    std::lock_guard<std::mutex> lock(transfer_mutex_);
+    pending_scans_.reset(new KeyedScans(std::move(scans)));
+    if (!transfer_thread_.joinable()) {
+      transfer_thread_ =
+          std::thread(&KeyedScanBatchPublisher::TransferLoop, this);
+    }
+  }
+  transfer_cv_.notify_one();
+}
+
+void KeyedScanBatchPublisher::TransferLoop() {
+  while (true) {
+    std::unique_ptr<KeyedScans> scans;
+    {
+      std::unique_lock<std::mutex> lock(transfer_mutex_);
+      transfer_cv_.wait(lock, [this] {
+        return b_stop_transfer_ || pending_scans_ != nullptr;
+      });
+      if (b_stop_transfer_) return;
+      scans.swap(pending_scans_);
+    }
+    Publish(*scans);
+  }
+}
+
+bool KeyedScanBatchPublisher::Publish(const KeyedScans& scans) {
+  if (scans.empty()) {
+    return false;
+  }
+
+  const size_t batch_size = std::max(1, params_.batch_size);
+  const uint32_t num_batches = (scans.size() + batch_size - 1) / batch_size;
+  const uint32_t window = std::max(1, params_.window);
+
+  // Without receivers that acknowledge, rely on the publisher queue
+  ack_queue_.callAvailable();
+  bool b_flow_control = ack_sub_.getNumPublishers() > 0;
+
+  ros::WallTime start = ros::WallTime::now();
+  size_t num_scans = 0;
+  size_t num_bytes = 0;
+  auto it = scans.begin();
+  for (uint32_t batch = 0; batch < num_batches; ++batch) {
+    pose_graph_msgs::KeyedScanBatch::Ptr msg(
+        new pose_graph_msgs::KeyedScanBatch);
+    msg->header.stamp = ros::Time::now();
+    msg->sequence = ++sequence_;
+    msg->remaining = num_batches - batch - 1;
+
+    for (size_t i = 0; i < batch_size && it != scans.end(); ++i, ++it) {
+      const gtsam::Symbol key = it.key();
+      if (params_.compressed) {
+        // Reuse the in-memory compressed copy when there is one
+        QuantizedScan quantized;
+        const QuantizedScan* stored = scans.FindCompressed(key);
+        bool b_quantized = stored != nullptr;
+        if (!b_quantized && it->second) {
+          b_quantized =
+              QuantizeScan(*it->second, params_.entropy_coding, &quantized);
+        }
+        if (b_quantized) {
+          pose_graph_msgs::CompressedKeyedScan compressed;
+          compressed.key = key;
+          SerializeQuantizedScan(stored ? *stored : quantized,
+                                 &compressed.data);
+          msg->compressed_scans.push_back(std::move(compressed));
+          num_scans++;
+          continue;
+        }
+      }
+      const PointCloud::ConstPtr scan = it->second;
+      if (!scan) {
+        ROS_WARN_STREAM("KeyedScanBatchPublisher: No scan for key "
+                        << gtsam::DefaultKeyFormatter(key));
+        continue;
+      }
+      pose_graph_msgs::KeyedScan keyed_scan;
+      keyed_scan.key = key;
+      pcl::toROSMsg(*scan, keyed_scan.scan);
+      msg->scans.push_back(std::move(keyed_scan));
+      num_scans++;
+    }
+
+    if (b_flow_control && msg->sequence > window) {
+      b_flow_control = WaitForAcks(msg->sequence - window);
+    }
+    num_bytes += ros::serialization::serializationLength(*msg);
+    batch_pub_.publish(msg);
+  }
+
+  // The transfer is done when the receivers have everything
+  if (b_flow_control) {
+    WaitForAcks(sequence_);
+  }
+  const double elapsed = (ros::WallTime::now() - start).toSec();
+  ROS_INFO_STREAM("Sent " << num_scans << " keyed scans in " << num_batches
+                          << " batches (" << num_bytes / 1e6 << " MB) in "
+                          << elapsed << " s"
+                          << (b_flow_control ? "" : " (not acknowledged)"));
+  return true;
+}
+
+void KeyedScanBatchPublisher::AckCallback(
+    const ros::MessageEvent<std_msgs::UInt32 const>& event) {
+  uint32_t& acked = acked_[event.getPublisherName()];
+  acked = std::max(acked, event.getMessage()->data);
+}
+
+bool KeyedScanBatchPublisher::WaitForAcks(uint32_t sequence) {
+  ros::WallTime last_progress = ros::WallTime::now();
+  size_t num_done = 0;
+  while (ros::ok()) {
+    ack_queue_.callAvailable(ros::WallDuration(0.005));
+
+    // Receivers that went away keep their entry, count the ones done
+    size_t done = 0;
+    for (const auto& receiver : acked_) {
+      if (receiver.second >= sequence) done++;
+    }
+    if (done >= ack_sub_.getNumPublishers()) {
+      return true;
+    }
+    if (done != num_done) {
+      num_done = done;
+      last_progress = ros::WallTime::now();
+    }
+    if ((ros::WallTime::now() - last_progress).toSec() > params_.ack_timeout) {
+      ROS_WARN_STREAM("KeyedScanBatchPublisher: No acknowledgement of batch "
+                      << sequence << " after " << params_.ack_timeout
+                      << " s, sending the rest without flow control");
+      return false;
+    }
+  }
+  return false;
+}
+
+void KeyedScanBatchSubscriber::Subscribe(ros::NodeHandle& nh,
+                                         const std::string& topic,
+                                         const Callback& callback) {
+  callback_ = callback;
+  batch_sub_ = nh.subscribe(
+      topic, 1000, &KeyedScanBatchSubscriber::BatchCallback, this);
+  ack_pub_ = nh.advertise<std_msgs::UInt32>(
+      nh.resolveName(topic) + "_ack", 100, false);
+}
+
+void KeyedScanBatchSubscriber::BatchCallback(
+    const pose_graph_msgs::KeyedScanBatch::ConstPtr& msg) {
+  for (const auto& keyed_scan : msg->scans) {
+    callback_(boost::make_shared<pose_graph_msgs::KeyedScan>(keyed_scan));
+  }
+
+  for (const auto& compressed : msg->compressed_scans) {
+    QuantizedScan quantized;
+    PointCloud::Ptr scan;
+    if (DeserializeQuantizedScan(compressed.data, &quantized)) {
+      scan = DequantizeScan(quantized);
+    }
+    if (!scan) {
+      ROS_ERROR_STREAM("KeyedScanBatchSubscriber: Corrupt scan for key "
+                       << gtsam::DefaultKeyFormatter(compressed.key));
+      continue;
+    }
+    pose_graph_msgs::KeyedScan::Ptr keyed_scan(new pose_graph_msgs::KeyedScan);
+    keyed_scan->key = compressed.key;
+    pcl::toROSMsg(*scan, keyed_scan->scan);
+    callback_(keyed_scan);
+  }
+
+  std_msgs::UInt32 ack;
+  ack.data = msg->sequence;
+  ack_pub_.publish(ack);
+}
+
+} // namespace lamp_utils
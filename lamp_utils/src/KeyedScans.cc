@@ -0,0 +1,142 @@
+/*
+ * Copyright Notes
+ *
+ * Authors:
+ * Alex Stephens       (alex.stephens@jpl.nasa.gov)
+ * Benjamin Morrell    (benjamin.morrell@jpl.nasa.gov)
+ */
+
+#include "lamp_utils/KeyedScans.h"
+
+#include <algorithm>
+
+#include <ros/console.h>
+
+PointCloud::ConstPtr& KeyedScans::operator[](const gtsam::Symbol& key) {
+  auto it = scans_.insert(value_type(key, PointCloud::ConstPtr())).first;
+  Decode(it);
+  pending_.erase(key);
+  if (compressed_.erase(key)) {
+    Uncache(key);
+  }
+  return it->second;
+}
+
+std::pair<KeyedScans::const_iterator, bool>
+KeyedScans::insert(const value_type& value) {
+  auto result = scans_.insert(value_type(value.first, PointCloud::ConstPtr()));
+  if (result.second) {
+    Store(result.first, value.second);
+  }
+  return std::make_pair(const_iterator(this, result.first), result.second);
+}
+
+size_t KeyedScans::erase(const gtsam::Symbol& key) {
+  pending_.erase(key);
+  if (compressed_.erase(key)) {
+    Uncache(key);
+  }
+  return scans_.erase(key);
+}
+
+void KeyedScans::SetCompression(const KeyedScanCompressionParams& params) {
+  const bool was_enabled = params_.enabled;
+  params_ = params;
+  params_.cache_size = std::max<size_t>(1, params_.cache_size);
+
+  if (params_.enabled && !was_enabled) {
+    for (auto it = scans_.begin(); it != scans_.end(); ++it) {
+      if (!it->second || compressed_.count(it->first)) continue;
+      auto scan = it->second;
+      Store(it, scan);
+    }
+  } else if (!params_.enabled && was_enabled) {
+    // Decode without going through the cache, which would evict
+    for (const auto& entry : compressed_) {
+      auto it = scans_.find(entry.first);
+      if (!it->second) it->second = lamp_utils::DequantizeScan(entry.second);
+    }
+    compressed_.clear();
+    cache_.clear();
+  } else {
+    // Shrink to the new cache size
+    while (cache_.size() > params_.cache_size) {
+      scans_.find(cache_.front())->second.reset();
+      cache_.erase(cache_.begin());
+    }
+  }
+}
+
+size_t KeyedScans::MemoryBytes() const {
+  size_t bytes = 0;
+  for (const auto& entry : scans_) {
+    if (entry.second) bytes += entry.second->size() * sizeof(Point);
+  }
+  for (const auto& entry : compressed_) {
+    bytes += entry.second.MemoryBytes();
+  }
+  return bytes;
+}
+
+void KeyedScans::Decode(Map::iterator it) const {
+  if (it->second) {
+    if (!compressed_.empty()) Touch(it->first);
+    return;
+  }
+  if (!pending_.empty()) {
+    auto pending = pending_.find(it->first);
+    if (pending != pending_.end()) {
+      auto scan = pending->second();
+      pending_.erase(pending);
+      Store(it, scan);
+      return;
+    }
+  }
+  auto compressed = compressed_.find(it->first);
+  if (compressed == compressed_.end()) return;
+  it->second = lamp_utils::DequantizeScan(compressed->second);
+  if (!it->second) {
+    ROS_ERROR_STREAM("KeyedScans: Failed to decode scan for key "
+                     << gtsam::DefaultKeyFormatter(it->first));
+    return;
+  }
+  Touch(it->first);
+}
+
+void KeyedScans::Store(Map::iterator it,
+                       const PointCloud::ConstPtr& scan) const {
+  it->second = scan;
+  if (!params_.enabled || !scan) return;
+
+  lamp_utils::QuantizedScan compressed;
+  if (!lamp_utils::QuantizeScan(*scan, params_.entropy_coding, &compressed)) {
+    ROS_WARN_STREAM("KeyedScans: Failed to compress scan for key "
+                    << gtsam::DefaultKeyFormatter(it->first)
+                    << ", keeping it uncompressed");
+    return;
+  }
+  compressed_[it->first] = std::move(compressed);
+  // The scan just stored is likely to be used right away
+  Touch(it->first);
+}
+
+void KeyedScans::Touch(gtsam::Key key) const {
+  auto cached = std::find(cache_.begin(), cache_.end(), key);
+  if (cached != cache_.end()) {
+    if (cached + 1 == cache_.end()) return;
+    cache_.erase(cached);
+  } else if (!compressed_.count(key)) {
+    // Not compressed, always decoded
+    return;
+  }
+  cache_.push_back(key);
+  while (cache_.size() > params_.cache_size) {
+    scans_.find(cache_.front())->second.reset();
+    cache_.erase(cache_.begin());
+  }
+}
+
+void KeyedScans::Uncache(gtsam::Key key) const {
+  auto cached = std::find(cache_.begin(), cache_.end(), key);
+  if (cached != cache_.end()) cache_.erase(cached);
+}
@@ -4,18 +4,45 @@
  * Authors: Yun Chang (yunchang@mit.edu)
  */
 
+#include <cmath>
+
+#include <Eigen/Eigenvalues>
 #include <pcl/filters/filter.h>
 #include <pcl/filters/random_sample.h>
 #include <pcl/filters/voxel_grid.h>
 #include <lamp_utils/LampPcldFilter.h>
 
+namespace {
+
+// Voxel of a point on the grid aligned with the origin (the same cells
+// pcl::VoxelGrid uses), 21 bits per axis
+inline uint64_t VoxelKey(const Point& p, float inverse_leaf_size) {
+  const uint64_t mask = (1ULL << 21) - 1;
+  const uint64_t x = static_cast<uint64_t>(
+      static_cast<int64_t>(std::floor(p.x * inverse_leaf_size)) + (1LL << 20));
+  const uint64_t y = static_cast<uint64_t>(
+      static_cast<int64_t>(std::floor(p.y * inverse_leaf_size)) + (1LL << 20));
+  const uint64_t z = static_cast<uint64_t>(
+      static_cast<int64_t>(std::floor(p.z * inverse_leaf_size)) + (1LL << 20));
+  return (x & mask) << 42 | (y & mask) << 21 | (z & mask);
+}
+
+} // namespace
+
 LampPcldFilter::LampPcldFilter(const LampPcldFilterParams& params)
-  : params_(params), processed_first_cloud_(false) {
+  : params_(params),
+    processed_first_cloud_(false),
+    random_(std::random_device()()) {
   grid_leaf_size_ = (params.adaptive_max_grid + params.adaptive_min_grid) / 2.0;
 }
 
 void LampPcldFilter::Filter(const PointCloud& original_cloud,
                             PointCloud::Ptr new_cloud) {
+  if (params_.fused_filter) {
+    FusedFilter(original_cloud, new_cloud);
+    return;
+  }
+
   AdaptiveGridFilter(params_.adaptive_grid_target,
                      params_.adaptive_min_grid,
                      params_.adaptive_max_grid,
@@ -49,14 +76,22 @@ void LampPcldFilter::AdaptiveGridFilter(const double& target_pt_size,
   grid.setInputCloud(new_cloud);
   grid.filter(*new_cloud);
 
-  double size_factor = static_cast<double>(new_cloud->size()) /
-      static_cast<double>(target_pt_size);
-  double obs_factor = 0.0;
+  double observability = 0.0;
   if (params_.observability_check) {
     Eigen::Matrix<double, 3, 1> obs_eigenv;
     lamp_utils::ComputeIcpObservability(new_cloud, &obs_eigenv);
-    double observability =
+    observability =
         obs_eigenv.minCoeff() / static_cast<double>(new_cloud->size());
+  }
+  UpdateGridLeafSize(new_cloud->size(), observability);
+}
+
+void LampPcldFilter::UpdateGridLeafSize(size_t grid_size,
+                                        double observability) {
+  double size_factor = static_cast<double>(grid_size) /
+      static_cast<double>(params_.adaptive_grid_target);
+  double obs_factor = 0.0;
+  if (params_.observability_check) {
     if (!processed_first_cloud_)
       prev_observability_ = observability;
 
@@ -65,8 +100,160 @@ void LampPcldFilter::AdaptiveGridFilter(const double& target_pt_size,
   }
 
   grid_leaf_size_ =
-      std::min(max_leaf_size,
-               std::max(min_leaf_size,
+      std::min(params_.adaptive_max_grid,
+               std::max(params_.adaptive_min_grid,
                         grid_leaf_size_ *
                             (size_factor - abs(size_factor - 1) * obs_factor)));
+}
+
+void LampPcldFilter::FusedFilter(const PointCloud& original_cloud,
+                                 PointCloud::Ptr new_cloud) {
+  new_cloud->header = original_cloud.header;
+  new_cloud->points.clear();
+
+  // Small scans are not grid filtered, only decimated
+  if (static_cast<double>(original_cloud.size()) <
+      params_.adaptive_grid_target) {
+    if (!params_.random_filter) {
+      *new_cloud = original_cloud;
+      return;
+    }
+    const int n_points = static_cast<int>((1.0 - params_.decimate_percentage) *
+                                          original_cloud.size());
+    const std::vector<bool>& keep =
+        SelectRandom(original_cloud.size(), std::max(0, n_points));
+    new_cloud->points.reserve(std::max(0, n_points));
+    for (size_t i = 0; i < original_cloud.size(); i++) {
+      if (keep[i]) new_cloud->points.push_back(original_cloud.points[i]);
+    }
+    new_cloud->width = new_cloud->points.size();
+    new_cloud->height = 1;
+    new_cloud->is_dense = original_cloud.is_dense;
+    return;
+  }
+
+  // Same check as lamp_utils::ExtractNormals
+  const bool b_has_normals = !original_cloud.empty() &&
+      (original_cloud.points[0].normal_x != 0 ||
+       original_cloud.points[0].normal_y != 0 ||
+       original_cloud.points[0].normal_z != 0);
+  const bool b_scatter = params_.observability_check && !b_has_normals;
+
+  // Single pass over the input: accumulate the points of each voxel
+  const float inverse_leaf_size = 1.0f / static_cast<float>(grid_leaf_size_);
+  voxel_index_.clear();
+  voxels_.clear();
+  for (const Point& p : original_cloud.points) {
+    if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) {
+      continue;
+    }
+    auto inserted = voxel_index_.emplace(VoxelKey(p, inverse_leaf_size),
+                                         static_cast<uint32_t>(voxels_.size()));
+    if (inserted.second) {
+      voxels_.push_back(Voxel());
+      voxels_.back().x0 = p.x;
+      voxels_.back().y0 = p.y;
+      voxels_.back().z0 = p.z;
+    }
+    Voxel& voxel = voxels_[inserted.first->second];
+    voxel.count++;
+    voxel.x += p.x;
+    voxel.y += p.y;
+    voxel.z += p.z;
+    voxel.intensity += p.intensity;
+    voxel.normal_x += p.normal_x;
+    voxel.normal_y += p.normal_y;
+    voxel.normal_z += p.normal_z;
+    voxel.curvature += p.curvature;
+    if (b_scatter) {
+      const float dx = p.x - voxel.x0;
+      const float dy = p.y - voxel.y0;
+      const float dz = p.z - voxel.z0;
+      voxel.dx += dx;
+      voxel.dy += dy;
+      voxel.dz += dz;
+      voxel.xx += dx * dx;
+      voxel.xy += dx * dy;
+      voxel.xz += dx * dz;
+      voxel.yy += dy * dy;
+      voxel.yz += dy * dz;
+      voxel.zz += dz * dz;
+    }
+  }
+
+  // Centroids of the voxels picked by the random decimation, and the
+  // translation block of the point to plane information of all the voxels
+  const size_t grid_size = voxels_.size();
+  size_t n_points = grid_size;
+  if (params_.random_filter) {
+    n_points = std::max(0,
+                        static_cast<int>((1.0 - params_.decimate_percentage) *
+                                         grid_size));
+  }
+  const std::vector<bool>& keep = SelectRandom(grid_size, n_points);
+  new_cloud->points.reserve(n_points);
+  Eigen::Matrix3d information = Eigen::Matrix3d::Zero();
+  for (size_t i = 0; i < grid_size; i++) {
+    const Voxel& voxel = voxels_[i];
+    const float inverse_count = 1.0f / static_cast<float>(voxel.count);
+    Point p;
+    p.x = voxel.x * inverse_count;
+    p.y = voxel.y * inverse_count;
+    p.z = voxel.z * inverse_count;
+    p.intensity = voxel.intensity * inverse_count;
+    p.normal_x = voxel.normal_x * inverse_count;
+    p.normal_y = voxel.normal_y * inverse_count;
+    p.normal_z = voxel.normal_z * inverse_count;
+    p.curvature = voxel.curvature * inverse_count;
+
+    if (params_.observability_check) {
+      if (b_has_normals) {
+        const Eigen::Vector3d n(p.normal_x, p.normal_y, p.normal_z);
+        information += n * n.transpose();
+      } else if (voxel.count >= 3) {
+        // Normal of the points in the voxel
+        const Eigen::Vector3d mean =
+            Eigen::Vector3d(voxel.dx, voxel.dy, voxel.dz) * inverse_count;
+        Eigen::Matrix3d scatter;
+        scatter << voxel.xx, voxel.xy, voxel.xz, voxel.xy, voxel.yy, voxel.yz,
+            voxel.xz, voxel.yz, voxel.zz;
+        scatter = scatter * inverse_count - mean * mean.transpose();
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+        solver.computeDirect(scatter);
+        const Eigen::Vector3d n = solver.eigenvectors().col(0);
+        information += n * n.transpose();
+      }
+    }
+
+    if (keep[i]) new_cloud->points.push_back(p);
+  }
+  new_cloud->width = new_cloud->points.size();
+  new_cloud->height = 1;
+  new_cloud->is_dense = true;
+
+  double observability = 0.0;
+  if (params_.observability_check && grid_size > 0) {
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+    solver.computeDirect(information, Eigen::EigenvaluesOnly);
+    observability =
+        solver.eigenvalues().minCoeff() / static_cast<double>(grid_size);
+  }
+  UpdateGridLeafSize(grid_size, observability);
+}
+
+std::vector<bool>& LampPcldFilter::SelectRandom(size_t num_points,
+                                                size_t count) {
+  selected_.assign(num_points, count >= num_points);
+  if (count >= num_points) {
+    return selected_;
+  }
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  size_t needed = count;
+  for (size_t i = 0; i < num_points && needed > 0; i++) {
+    if (uniform(random_) * (num_points - i) < needed) {
+      selected_[i] = true;
+      needed--;
+    }
+  }
+  return selected_;
 }
\ No newline at end of file
@@ -5,6 +5,9 @@ Some utility functions for wokring with Point Clouds
 */
 #include "lamp_utils/PointCloudUtils.h"
 
+#include <future>
+#include <thread>
+
 #include <geometry_utils/Transform3.h>
 #include <pcl/features/fpfh_omp.h>
 #include <pcl/filters/voxel_grid.h>
@@ -241,4 +244,59 @@ void AddNormals(const PointXyziCloud::ConstPtr& point_cloud,
   return;
 }
 
-} // namespace lamp_utils
\ No newline at end of file
+void TransformAndCombineScans(const std::vector<PosedScan>& scans,
+                              PointCloud* output,
+                              int num_threads) {
+  // Offset of each scan in the output
+  std::vector<size_t> offsets(scans.size() + 1, 0);
+  for (size_t i = 0; i < scans.size(); ++i) {
+    offsets[i + 1] = offsets[i] + scans[i].scan->size();
+  }
+  const size_t total = offsets.back();
+  output->points.resize(total);
+  output->width = total;
+  output->height = 1;
+  output->is_dense = true;
+  for (const auto& s : scans) output->is_dense &= s.scan->is_dense;
+  if (total == 0) return;
+
+  auto transform_range = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const Eigen::Matrix3f R = scans[i].pose.rotation().matrix().cast<float>();
+      const Eigen::Vector3f t = scans[i].pose.translation().cast<float>();
+      Point* out = &output->points[offsets[i]];
+      for (const auto& p : scans[i].scan->points) {
+        *out = p;
+        out->getVector3fMap() = R * p.getVector3fMap() + t;
+        ++out;
+      }
+    }
+  };
+
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min<size_t>(num_threads, scans.size());
+  if (num_threads <= 1) {
+    transform_range(0, scans.size());
+    return;
+  }
+
+  // Split the scans so each thread gets about the same number of points
+  std::vector<std::future<void>> results;
+  size_t begin = 0;
+  for (int t = 1; t <= num_threads && begin < scans.size(); ++t) {
+    const size_t target = total * t / num_threads;
+    size_t end =
+        std::lower_bound(offsets.begin() + begin + 1, offsets.end(), target) -
+        offsets.begin();
+    end = std::min(end, scans.size());
+    if (t == num_threads) end = scans.size();
+    results.push_back(
+        std::async(std::launch::async, transform_range, begin, end));
+    begin = end;
+  }
+  for (auto& result : results) result.get();
+}
+
+} // namespace lamp_utils
@@ -0,0 +1,308 @@
+/*
+PoseGraphArchive.cc
+Writer and memory-mapped reader for the indexed pose graph archive
+*/
+
+#include "lamp_utils/PoseGraphArchive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ros/console.h>
+#include <ros/serialization.h>
+#include <zlib.h>
+
+namespace lamp_utils {
+
+namespace {
+
+const char kMagic[8] = {'L', 'A', 'M', 'P', 'P', 'G', 'A', '1'};
+// Fields stored per point: x, y, z, intensity, normal_x/y/z, curvature
+const size_t kFloatsPerPoint = 8;
+const size_t kPointBytes = kFloatsPerPoint * sizeof(float);
+// Size of one serialized index entry
+const size_t kEntryBytes = 4 * sizeof(uint64_t) + 2 * sizeof(uint32_t) + 1;
+const size_t kFooterBytes = sizeof(uint64_t) + sizeof(kMagic);
+
+template <typename T>
+void Put(std::string* buf, const T& value) {
+  buf->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T Get(const uint8_t*& ptr) {
+  T value;
+  std::memcpy(&value, ptr, sizeof(T));
+  ptr += sizeof(T);
+  return value;
+}
+
+bool CompressScan(const PointCloud& scan, std::string* out) {
+  std::vector<float> packed(scan.size() * kFloatsPerPoint);
+  float* p = packed.data();
+  for (const auto& pt : scan.points) {
+    *p++ = pt.x;
+    *p++ = pt.y;
+    *p++ = pt.z;
+    *p++ = pt.intensity;
+    *p++ = pt.normal_x;
+    *p++ = pt.normal_y;
+    *p++ = pt.normal_z;
+    *p++ = pt.curvature;
+  }
+  const uLong raw_size = packed.size() * sizeof(float);
+  uLongf size = compressBound(raw_size);
+  out->resize(size);
+  if (compress2(reinterpret_cast<Bytef*>(&(*out)[0]),
+                &size,
+                reinterpret_cast<const Bytef*>(packed.data()),
+                raw_size,
+                Z_BEST_SPEED) != Z_OK) {
+    return false;
+  }
+  out->resize(size);
+  return true;
+}
+
+} // namespace
+
+PoseGraphArchiveWriter::PoseGraphArchiveWriter(const std::string& filename,
+                                               int num_threads)
+    : out_(filename, std::ios::binary | std::ios::trunc),
+      offset_(0),
+      num_threads_(num_threads > 0
+                       ? num_threads
+                       : std::max(1u, std::thread::hardware_concurrency())) {
+  if (!out_.is_open()) {
+    ROS_ERROR_STREAM("PoseGraphArchiveWriter: Could not open " << filename);
+    return;
+  }
+  out_.write(kMagic, sizeof(kMagic));
+  offset_ = sizeof(kMagic);
+}
+
+bool PoseGraphArchiveWriter::AppendScans(const std::vector<ArchiveScan>& scans) {
+  if (!IsOpen()) return false;
+
+  // Each thread compresses a contiguous range of the batch
+  std::vector<std::string> blobs(scans.size());
+  const size_t num_threads =
+      std::min<size_t>(num_threads_, std::max<size_t>(1, scans.size()));
+  const size_t chunk = (scans.size() + num_threads - 1) / num_threads;
+  std::vector<std::future<bool>> results;
+  for (size_t start = 0; start < scans.size(); start += chunk) {
+    const size_t end = std::min(scans.size(), start + chunk);
+    results.push_back(std::async(std::launch::async, [&, start, end]() {
+      for (size_t i = start; i < end; ++i) {
+        if (!CompressScan(*scans[i].scan, &blobs[i])) return false;
+      }
+      return true;
+    }));
+  }
+  bool success = true;
+  for (auto& result : results) success &= result.get();
+  if (!success) {
+    ROS_ERROR("PoseGraphArchiveWriter: Failed to compress scan.");
+    return false;
+  }
+
+  for (size_t i = 0; i < scans.size(); ++i) {
+    const auto& scan = *scans[i].scan;
+    ArchiveScanEntry entry;
+    entry.key = scans[i].key;
+    entry.stamp_nsec = scans[i].stamp.toNSec();
+    entry.offset = offset_;
+    entry.size = blobs[i].size();
+    entry.width = scan.width;
+    entry.height = scan.height;
+    entry.is_dense = scan.is_dense;
+    // Unorganized clouds built by hand may not have width set
+    if (static_cast<size_t>(entry.width) * entry.height != scan.size()) {
+      entry.width = scan.size();
+      entry.height = 1;
+    }
+    out_.write(blobs[i].data(), blobs[i].size());
+    offset_ += blobs[i].size();
+    entries_.push_back(entry);
+  }
+  return out_.good();
+}
+
+bool PoseGraphArchiveWriter::Finish(const pose_graph_msgs::PoseGraph& msg) {
+  if (!IsOpen()) return false;
+
+  const uint32_t msg_size = ros::serialization::serializationLength(msg);
+  std::vector<uint8_t> msg_buf(msg_size);
+  ros::serialization::OStream stream(msg_buf.data(), msg_size);
+  ros::serialization::serialize(stream, msg);
+  const uint64_t graph_offset = offset_;
+  out_.write(reinterpret_cast<const char*>(msg_buf.data()), msg_size);
+  offset_ += msg_size;
+
+  std::string index;
+  index.reserve(sizeof(uint64_t) * 3 + entries_.size() * kEntryBytes +
+                kFooterBytes);
+  Put<uint64_t>(&index, entries_.size());
+  for (const auto& entry : entries_) {
+    Put<uint64_t>(&index, entry.key);
+    Put<int64_t>(&index, entry.stamp_nsec);
+    Put<uint64_t>(&index, entry.offset);
+    Put<uint64_t>(&index, entry.size);
+    Put<uint32_t>(&index, entry.width);
+    Put<uint32_t>(&index, entry.height);
+    Put<uint8_t>(&index, entry.is_dense);
+  }
+  Put<uint64_t>(&index, graph_offset);
+  Put<uint64_t>(&index, msg_size);
+  Put<uint64_t>(&index, offset_);
+  index.append(kMagic, sizeof(kMagic));
+  out_.write(index.data(), index.size());
+  out_.close();
+  return !out_.fail();
+}
+
+PoseGraphArchiveReader::~PoseGraphArchiveReader() {
+  if (data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+}
+
+bool PoseGraphArchiveReader::IsArchive(const std::string& filename) {
+  std::ifstream in(filename, std::ios::binary);
+  char magic[sizeof(kMagic)];
+  if (!in.read(magic, sizeof(magic))) return false;
+  return std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+std::shared_ptr<PoseGraphArchiveReader> PoseGraphArchiveReader::Open(
+    const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    ROS_ERROR_STREAM("PoseGraphArchiveReader: Could not open " << filename);
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(kMagic) + kFooterBytes) {
+    ROS_ERROR_STREAM("PoseGraphArchiveReader: " << filename
+                                                << " is too small.");
+    close(fd);
+    return nullptr;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    ROS_ERROR_STREAM("PoseGraphArchiveReader: Could not map " << filename);
+    return nullptr;
+  }
+
+  std::shared_ptr<PoseGraphArchiveReader> reader(new PoseGraphArchiveReader);
+  reader->data_ = static_cast<const uint8_t*>(data);
+  reader->size_ = st.st_size;
+
+  const uint8_t* end = reader->data_ + reader->size_;
+  const uint8_t* footer = end - kFooterBytes;
+  if (std::memcmp(reader->data_, kMagic, sizeof(kMagic)) != 0 ||
+      std::memcmp(footer + sizeof(uint64_t), kMagic, sizeof(kMagic)) != 0) {
+    ROS_ERROR_STREAM("PoseGraphArchiveReader: " << filename
+                                                << " is not a pose graph "
+                                                   "archive.");
+    return nullptr;
+  }
+  const uint8_t* ptr = footer;
+  const uint64_t index_offset = Get<uint64_t>(ptr);
+  if (index_offset + sizeof(uint64_t) > reader->size_ - kFooterBytes) {
+    ROS_ERROR_STREAM("PoseGraphArchiveReader: Corrupt index in " << filename);
+    return nullptr;
+  }
+  ptr = reader->data_ + index_offset;
+  const uint64_t num_scans = Get<uint64_t>(ptr);
+  if (num_scans * kEntryBytes + 2 * sizeof(uint64_t) !=
+      static_cast<uint64_t>(footer - ptr)) {
+    ROS_ERROR_STREAM("PoseGraphArchiveReader: Corrupt index in " << filename);
+    return nullptr;
+  }
+  reader->entries_.resize(num_scans);
+  for (auto& entry : reader->entries_) {
+    entry.key = Get<uint64_t>(ptr);
+    entry.stamp_nsec = Get<int64_t>(ptr);
+    entry.offset = Get<uint64_t>(ptr);
+    entry.size = Get<uint64_t>(ptr);
+    entry.width = Get<uint32_t>(ptr);
+    entry.height = Get<uint32_t>(ptr);
+    entry.is_dense = Get<uint8_t>(ptr);
+    if (entry.offset + entry.size > index_offset) {
+      ROS_ERROR_STREAM("PoseGraphArchiveReader: Scan entry out of range in "
+                       << filename);
+      return nullptr;
+    }
+  }
+  reader->graph_offset_ = Get<uint64_t>(ptr);
+  reader->graph_size_ = Get<uint64_t>(ptr);
+  if (reader->graph_offset_ + reader->graph_size_ > index_offset) {
+    ROS_ERROR_STREAM("PoseGraphArchiveReader: Graph out of range in "
+                     << filename);
+    return nullptr;
+  }
+  // Scans are read in key order, which is roughly file order
+  madvise(data, st.st_size, MADV_WILLNEED);
+  return reader;
+}
+
+PointCloud::ConstPtr PoseGraphArchiveReader::DecodeScan(
+    const ArchiveScanEntry& entry) const {
+  const size_t num_points = static_cast<size_t>(entry.width) * entry.height;
+  std::vector<float> packed(num_points * kFloatsPerPoint);
+  uLongf raw_size = num_points * kPointBytes;
+  if (uncompress(reinterpret_cast<Bytef*>(packed.data()),
+                 &raw_size,
+                 data_ + entry.offset,
+                 entry.size) != Z_OK ||
+      raw_size != num_points * kPointBytes) {
+    ROS_ERROR_STREAM("PoseGraphArchiveReader: Corrupt scan for key "
+                     << gtsam::DefaultKeyFormatter(entry.key));
+    return nullptr;
+  }
+
+  PointCloud::Ptr scan(new PointCloud);
+  scan->points.resize(num_points);
+  const float* p = packed.data();
+  for (auto& pt : scan->points) {
+    pt.x = *p++;
+    pt.y = *p++;
+    pt.z = *p++;
+    pt.intensity = *p++;
+    pt.normal_x = *p++;
+    pt.normal_y = *p++;
+    pt.normal_z = *p++;
+    pt.curvature = *p++;
+  }
+  scan->width = entry.width;
+  scan->height = entry.height;
+  scan->is_dense = entry.is_dense;
+  return scan;
+}
+
+bool PoseGraphArchiveReader::ReadPoseGraph(
+    pose_graph_msgs::PoseGraph* msg) const {
+  try {
+    ros::serialization::IStream stream(const_cast<uint8_t*>(data_) +
+                                           graph_offset_,
+                                       graph_size_);
+    ros::serialization::deserialize(stream, *msg);
+  } catch (const ros::Exception& e) {
+    ROS_ERROR_STREAM("PoseGraphArchiveReader: Failed to read pose graph: "
+                     << e.what());
+    return false;
+  }
+  return true;
+}
+
+} // namespace lamp_utils
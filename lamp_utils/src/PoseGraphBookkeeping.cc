@@ -71,7 +71,7 @@ bool PoseGraph::TrackFactor(const EdgeMessage& msg) {
   }
 
   if (success) {
-    edges_.insert(msg);
+    InsertEdge(msg);
     edges_new_.insert(msg);
   }
   return success;
@@ -104,7 +104,7 @@ bool PoseGraph::TrackFactor(const gtsam::Symbol& key_from,
                                        << " already exists.");
       return false;
     }
-    edges_.insert(msg);
+    InsertEdge(msg);
     edges_new_.insert(msg);
   }
 
@@ -113,20 +113,23 @@ bool PoseGraph::TrackFactor(const gtsam::Symbol& key_from,
     ROS_DEBUG_STREAM("Adding Odom edge for key "
                      << gtsam::DefaultKeyFormatter(key_from) << " to key "
                      << gtsam::DefaultKeyFormatter(key_to));
-    nfg_.add(gtsam::BetweenFactor<gtsam::Pose3>(
-        key_from, key_to, transform, covariance));
+    AddFactor(type,
+              gtsam::BetweenFactor<gtsam::Pose3>(
+                  key_from, key_to, transform, covariance));
   } else if (type == pose_graph_msgs::PoseGraphEdge::LOOPCLOSE) {
     ROS_DEBUG_STREAM("Adding loop closure edge for key "
                      << gtsam::DefaultKeyFormatter(key_from) << " to key "
                      << gtsam::DefaultKeyFormatter(key_to));
-    nfg_.add(gtsam::BetweenFactor<gtsam::Pose3>(
-        key_from, key_to, transform, covariance));
+    AddFactor(type,
+              gtsam::BetweenFactor<gtsam::Pose3>(
+                  key_from, key_to, transform, covariance));
   } else if (type == pose_graph_msgs::PoseGraphEdge::ARTIFACT) {
     ROS_DEBUG_STREAM("Adding artifact edge for key "
                      << gtsam::DefaultKeyFormatter(key_from) << " to key "
                      << gtsam::DefaultKeyFormatter(key_to));
-    nfg_.add(gtsam::BetweenFactor<gtsam::Pose3>(
-        key_from, key_to, transform, covariance));
+    AddFactor(type,
+              gtsam::BetweenFactor<gtsam::Pose3>(
+                  key_from, key_to, transform, covariance));
   } else if (type == pose_graph_msgs::PoseGraphEdge::UWB_RANGE) {
     ROS_ERROR_STREAM("Cannot track UWB range factor for key "
                      << gtsam::DefaultKeyFormatter(key_from) << " to key "
@@ -138,8 +141,9 @@ bool PoseGraph::TrackFactor(const gtsam::Symbol& key_from,
     ROS_DEBUG_STREAM("Adding UWB between factor for key "
                      << gtsam::DefaultKeyFormatter(key_from) << " to key "
                      << gtsam::DefaultKeyFormatter(key_to));
-    nfg_.add(gtsam::BetweenFactor<gtsam::Pose3>(
-        key_from, key_to, transform, covariance));
+    AddFactor(type,
+              gtsam::BetweenFactor<gtsam::Pose3>(
+                  key_from, key_to, transform, covariance));
   } else if (type == pose_graph_msgs::PoseGraphEdge::IMU) {
     ROS_ERROR_STREAM("Cannot track IMU range factor for key "
                      << gtsam::DefaultKeyFormatter(key_from) << " to key "
@@ -179,12 +183,13 @@ bool PoseGraph::TrackUWBFactor(const gtsam::Symbol& key_from,
     }
     msg.range = range;
     msg.range_error = range_error;
-    edges_.insert(msg);
+    InsertEdge(msg);
     edges_new_.insert(msg);
   }
 
-  nfg_.add(gtsam::RangeFactor<gtsam::Pose3, gtsam::Pose3>(
-      key_from, key_to, range, noise));
+  AddFactor(pose_graph_msgs::PoseGraphEdge::UWB_RANGE,
+            gtsam::RangeFactor<gtsam::Pose3, gtsam::Pose3>(
+                key_from, key_to, range, noise));
   return true;
 }
 
@@ -217,11 +222,11 @@ bool PoseGraph::TrackIMUFactor(const gtsam::Symbol& key_to,
     }
     msg.pose.position = meas;
     // msg.covariance[0] =
-    edges_.insert(msg);
+    InsertEdge(msg);
     edges_new_.insert(msg);
   }
 
-  nfg_.add(factor);
+  AddFactor(pose_graph_msgs::PoseGraphEdge::IMU, factor);
   return true;
 }
 
@@ -274,7 +279,7 @@ bool PoseGraph::TrackArtifactFactor(const gtsam::Symbol& key_from,
     if (loopclose_msg_found != edges_.end()) {
       ROS_DEBUG_STREAM(
           "TrackArtifactFactor: Found and Removing Loop CLosure Edge (Hack)");
-      edges_.erase(loopclose_msg_found);
+      EraseEdge(loopclose_msg_found);
     }
 
     if (!diff_position && !diff_covariance) {
@@ -285,7 +290,7 @@ bool PoseGraph::TrackArtifactFactor(const gtsam::Symbol& key_from,
 
 
     // Remove existing artifact edge message in edge_
-    edges_.erase(msg_found);
+    EraseEdge(msg_found);
 
     // Remove existing artifact edge message in edges_new
     auto new_msg_found = edges_new_.find(msg);
@@ -293,33 +298,20 @@ bool PoseGraph::TrackArtifactFactor(const gtsam::Symbol& key_from,
       edges_new_.erase(new_msg_found);
     }
 
-    // Remove edge factor
-    gtsam::NonlinearFactorGraph new_nfg;
-    auto f = nfg_.begin();
-    while (f != nfg_.end()) {
-      auto factor = *f;
-      // TODO check if we really need gtsam::DefaultKeyFormatter
-      if (gtsam::DefaultKeyFormatter(factor->keys()[0]) ==
-              gtsam::DefaultKeyFormatter(key_from) &&
-          gtsam::DefaultKeyFormatter(factor->keys()[1]) ==
-              gtsam::DefaultKeyFormatter(key_to)) {
-        // ROS_DEBUG_STREAM("Skipping a factor");
-      } else {
-        new_nfg.add(factor);
-      }
-      f++;
-    }
-    nfg_ = new_nfg;
+    // Remove edge factor (and the loop closure factor, see above)
+    RemoveFactors(type, key_from, key_to);
+    RemoveFactors(pose_graph_msgs::PoseGraphEdge::LOOPCLOSE, key_from, key_to);
   }
 
   if (create_msg) {
-    edges_.insert(msg);
+    InsertEdge(msg);
     edges_new_.insert(msg);
   }
 
   // Add the updated edge factor
-  nfg_.add(gtsam::BetweenFactor<gtsam::Pose3>(
-      key_from, key_to, transform, covariance));
+  AddFactor(type,
+            gtsam::BetweenFactor<gtsam::Pose3>(
+                key_from, key_to, transform, covariance));
 
   return true;
 }
@@ -337,16 +329,14 @@ bool PoseGraph::TrackNode(const NodeMessage& msg) {
     return false;
 
   // make copy to modify ID
-  auto msg_found = nodes_.find(msg);
-  if (msg_found == nodes_.end()) {
+  if (FindNode(msg.key) == nullptr) {
     NodeMessage m = msg;
     if (m.ID.empty() && !symbol_id_map.empty())
       m.ID = symbol_id_map(msg.key);
-    nodes_.insert(m);
+    InsertNode(m);
     nodes_new_.insert(m);
   } else {
-    nodes_.erase(msg_found);
-    nodes_.insert(msg);
+    InsertNode(msg);
   }
   return true;
 }
@@ -363,6 +353,8 @@ bool PoseGraph::TrackNode(const ros::Time& stamp,
     values_.update(key, pose);
   } else {
     values_.insert(key, pose);
+    EnsureIndices();
+    IndexValueKey(key);
   }
   if (values_new_.exists(key)) {
     values_new_.update(key, pose);
@@ -379,15 +371,10 @@ bool PoseGraph::TrackNode(const ros::Time& stamp,
       msg.ID = symbol_id_map(msg.key);
 
     // make copy to modify ID
-    auto msg_found = nodes_.find(msg);
-    if (msg_found == nodes_.end()) {
-      NodeMessage m = msg;
-      nodes_.insert(m);
-      nodes_new_.insert(m);
-    } else {
-      nodes_.erase(msg_found);
-      nodes_.insert(msg);
+    if (FindNode(msg.key) == nullptr) {
+      nodes_new_.insert(msg);
     }
+    InsertNode(msg);
   }
 
   return true;
@@ -420,7 +407,7 @@ bool PoseGraph::TrackPrior(const EdgeMessage& msg) {
     return false;
 
   priors_new_.insert(msg);
-  priors_.insert(msg);
+  InsertPrior(msg);
   return true;
 }
 
@@ -447,12 +434,12 @@ bool PoseGraph::TrackPrior(const gtsam::Symbol& key,
       return false;
     }
     priors_new_.insert(msg);
-    priors_.insert(msg);
+    InsertPrior(msg);
   }
   ROS_DEBUG_STREAM("Adding prior factor for key "
                    << gtsam::DefaultKeyFormatter(key));
   gtsam::PriorFactor<gtsam::Pose3> factor(key, pose, covariance);
-  nfg_.add(factor);
+  AddFactor(pose_graph_msgs::PoseGraphEdge::PRIOR, factor);
   return true;
 }
 
@@ -476,125 +463,113 @@ void PoseGraph::RemoveRobotFromGraph(std::string robot_name){
 
 void PoseGraph::UpdateLoopClosures(const GraphMsgPtr& msg) {
   ROS_DEBUG("Update loop closures to reflect inliers");
+  EnsureIndices();
+  // Rebuilding the cached message once is cheaper than patching it for every
+  // loop closure
+  msg_cache_.reset();
+
   // Remove edge loop closure messages
-  EdgeSet new_edges;
-  auto e = edges_.begin();
-  while (e != edges_.end()) {
-    if (e->type != pose_graph_msgs::PoseGraphEdge::LOOPCLOSE) {
-      new_edges.insert(*e);
-    }
-    e++;
+  const auto lc_edges =
+      index_.edges_by_type[pose_graph_msgs::PoseGraphEdge::LOOPCLOSE];
+  for (const auto* edge : lc_edges) {
+    EraseEdge(edges_.find(*edge));
   }
 
   // Remove edge loop closure factors
-  gtsam::NonlinearFactorGraph new_nfg;
-  for (const auto& factor : nfg_) {
-    if (boost::dynamic_pointer_cast<gtsam::BetweenFactor<gtsam::Pose3>>(
-            factor)) {
-      if (factor->front() + 1 == factor->back()) {
-        new_nfg.add(factor);
-      }
+  for (auto it = factors_.begin(); it != factors_.end();) {
+    if (std::get<2>(it->first) == pose_graph_msgs::PoseGraphEdge::LOOPCLOSE) {
+      it = factors_.erase(it);
     } else {
-      new_nfg.add(factor);
+      ++it;
     }
   }
+  b_nfg_dirty_ = true;
+
   // Insert the inlier loop closures
   for (const auto& edge : msg->edges) {
     if (edge.type == pose_graph_msgs::PoseGraphEdge::LOOPCLOSE) {
-      new_edges.insert(edge);
-      new_nfg.add(
+      InsertEdge(edge);
+      AddFactor(
+          edge.type,
           gtsam::BetweenFactor<gtsam::Pose3>(gtsam::Symbol(edge.key_from),
                                              gtsam::Symbol(edge.key_to),
                                              lamp_utils::MessageToPose(edge),
                                              lamp_utils::MessageToCovariance(edge)));
     }
   }
-
-  edges_ = new_edges;
-  nfg_ = new_nfg;
 }
 
 void PoseGraph::RemoveEdgesWithPrefix(unsigned char prefix){
   ROS_DEBUG("Removing edges msg");
-  // Remove edge messages
-  EdgeSet new_edges;
-  auto e = edges_.begin();
-  while (e != edges_.end()) {
-    if (gtsam::Symbol(e->key_from).chr() != prefix &&
-        gtsam::Symbol(e->key_to).chr() != prefix) {
-      // Is an edge to remove
-      new_edges.insert(*e);
-    }
-    e++;
-  }
-  edges_ = new_edges;
-
-  // Remove prior messages
-  EdgeSet new_priors;
-  auto p = priors_.begin();
-  while (p != priors_.end()) {
-    if (gtsam::Symbol(p->key_from).chr() != prefix &&
-        gtsam::Symbol(p->key_to).chr() != prefix) {
-      // Is an edge to remove
-      new_priors.insert(*p);
-    }
-    p++;
+  EnsureIndices();
+  msg_cache_.reset();
+
+  // Remove edge messages (either end has the prefix)
+  const auto prefix_edges = index_.edges_by_prefix[prefix];
+  for (const auto* edge : prefix_edges) {
+    EraseEdge(edges_.find(*edge));
+  }
+  index_.edges_by_prefix.erase(prefix);
+
+  // Remove prior messages, these are contiguous since they are sorted by key
+  EdgeMessage first;
+  first.key_from = gtsam::Symbol(prefix, 0);
+  first.key_to = 0;
+  first.type = 0;
+  auto p = priors_.lower_bound(first);
+  while (p != priors_.end() && gtsam::Symbol(p->key_from).chr() == prefix) {
+    index_.priors.erase(p->key_from);
+    p = priors_.erase(p);
   }
-  priors_ = new_priors;
 
   ROS_DEBUG("Removing edges gtsam");
-  // Remove edge factors
-  gtsam::NonlinearFactorGraph new_nfg;
-  auto f = nfg_.begin();
-  while (f != nfg_.end()) {
-    auto factor = *f;
-    if (gtsam::Symbol(factor->front()).chr() != prefix &&
-        gtsam::Symbol(factor->back()).chr() != prefix) {
-      // If this factor does not connect to nodes with prefix
-      // Add to new nonlinear factor graph
-      new_nfg.add(factor);
+  // Remove the factor partitions that connect to nodes with prefix
+  for (auto it = factors_.begin(); it != factors_.end();) {
+    if (std::get<0>(it->first) == prefix || std::get<1>(it->first) == prefix) {
+      it = factors_.erase(it);
+    } else {
+      ++it;
     }
-    f++;
   }
-  nfg_ = new_nfg;
+  b_nfg_dirty_ = true;
 }
 
 void PoseGraph::RemoveValuesWithPrefix(unsigned char prefix){
   ROS_DEBUG("Removing values msg");
-  // Remove edge messages
-
-  NodeSet new_nodes;
-  auto n = nodes_.begin();
-
-  while (n != nodes_.end()) {
-    if (gtsam::Symbol(n->key).chr() != prefix){
-      // Is an edge to keep
-      new_nodes.insert(*n);
-    }
-    n++;
+  EnsureIndices();
+  msg_cache_.reset();
+
+  // Nodes and values are sorted by key, so the ones of a prefix are
+  // contiguous
+  NodeMessage first;
+  first.key = gtsam::Symbol(prefix, 0);
+  auto n = nodes_.lower_bound(first);
+  while (n != nodes_.end() && gtsam::Symbol(n->key).chr() == prefix) {
+    auto next = std::next(n);
+    EraseNode(n);
+    n = next;
   }
 
-  nodes_ = new_nodes;
-
   ROS_DEBUG("Removing values gtsam");
-  // Remove gtsam values
-  gtsam::Values new_values;
-  auto v = values_.begin();
-
-  while (v != values_.end()) {
-    auto value = *v;
-    if (gtsam::Symbol(value.key).chr() != prefix){
-      // Is an edge to keep
-      new_values.insert(value.key, value.value);
-
-      // Update the latest key
-      key = value.key;
-    }
-    v++;
+  gtsam::KeyVector keys_to_remove;
+  for (auto v = values_.lower_bound(gtsam::Symbol(prefix, 0));
+       v != values_.end() && gtsam::Symbol((*v).key).chr() == prefix;
+       ++v) {
+    keys_to_remove.push_back((*v).key);
   }
+  for (const auto& k : keys_to_remove) {
+    values_.erase(k);
+  }
+  index_.latest_keys.erase(prefix);
 
-  values_ = new_values;
-
+  // Update the latest key (largest remaining key)
+  if (!index_.latest_keys.empty()) {
+    gtsam::Key latest_key = 0;
+    for (const auto& latest : index_.latest_keys) {
+      latest_key = std::max(latest_key, latest.second);
+    }
+    key = latest_key;
+  }
 }
 
 // DEPRECATED!!
@@ -603,6 +578,9 @@ void PoseGraph::AddNewValues(const gtsam::Values& new_values) {
   for (auto v : new_values) {
     if (!values_.tryInsert(v.key, v.value).second) {
       values_.update(v.key, v.value);
+    } else {
+      EnsureIndices();
+      IndexValueKey(v.key);
     }
     if (!values_new_.tryInsert(v.key, v.value).second) {
       values_new_.update(v.key, v.value);
@@ -612,14 +590,18 @@ void PoseGraph::AddNewValues(const gtsam::Values& new_values) {
 
 // DEPRECATED!!
 void PoseGraph::AddNewFactors(const gtsam::NonlinearFactorGraph& nfg) {
-  nfg_.add(nfg);
+  for (const auto& factor : nfg) {
+    AddFactor(-1, factor);
+  }
 }
 
 void PoseGraph::Initialize(const gtsam::Symbol& initial_key,
                            const gtsam::Pose3& pose,
                            const Diagonal::shared_ptr& covariance) {
-  nfg_ = gtsam::NonlinearFactorGraph();
+  factors_.clear();
+  b_nfg_dirty_ = true;
   values_ = gtsam::Values();
+  RebuildIndices();
 
   b_first_ = true;
 
@@ -664,3 +646,46 @@ bool PoseGraph::CheckGraphValid() const {
   }
   return true;
 }
+
+void PoseGraph::AddFactor(int type,
+                          const gtsam::NonlinearFactor::shared_ptr& factor) {
+  FactorPartition partition(gtsam::Symbol(factor->front()).chr(),
+                            gtsam::Symbol(factor->back()).chr(),
+                            type);
+  factors_[partition].push_back(factor);
+  if (!b_nfg_dirty_) {
+    nfg_.push_back(factor);
+  }
+}
+
+void PoseGraph::RemoveFactors(int type,
+                              gtsam::Key key_from,
+                              gtsam::Key key_to) {
+  auto it = factors_.find(FactorPartition(
+      gtsam::Symbol(key_from).chr(), gtsam::Symbol(key_to).chr(), type));
+  if (it == factors_.end()) return;
+
+  gtsam::NonlinearFactorGraph remaining;
+  for (const auto& factor : it->second) {
+    if (factor->front() != key_from || factor->back() != key_to) {
+      remaining.push_back(factor);
+    }
+  }
+  if (remaining.size() != it->second.size()) {
+    it->second = remaining;
+    b_nfg_dirty_ = true;
+  }
+}
+
+void PoseGraph::AssembleNfg() const {
+  nfg_ = gtsam::NonlinearFactorGraph();
+  size_t num_factors = 0;
+  for (const auto& partition : factors_) {
+    num_factors += partition.second.size();
+  }
+  nfg_.reserve(num_factors);
+  for (const auto& partition : factors_) {
+    nfg_.push_back(partition.second);
+  }
+  b_nfg_dirty_ = false;
+}
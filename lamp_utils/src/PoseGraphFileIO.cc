@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdio>
 #include <fstream>
 
 #include <minizip/unzip.h>
@@ -10,6 +11,18 @@
 #include <rosbag/view.h>
 
 #include "lamp_utils/PoseGraph.h"
+#include "lamp_utils/PoseGraphArchive.h"
+
+namespace {
+// Scans handed to the archive writer at once, bounds the memory used for
+// compressed scans while saving
+const size_t kArchiveBatchSize = 64;
+
+bool EndsWith(const std::string& str, const std::string& suffix) {
+  return str.size() >= suffix.size() &&
+      str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+} // namespace
 
 std::string absPath(const std::string& relPath) {
   return boost::filesystem::canonical(boost::filesystem::path(relPath))
@@ -74,7 +87,112 @@ bool writeFileToZip(zipFile& zip, const std::string& filename) {
   return true;
 }
 
-bool PoseGraph::Save(const std::string& zipFilename) const {
+bool PoseGraph::Save(const std::string& filename) const {
+  if (EndsWith(filename, ".pga")) {
+    return SaveArchive_(filename);
+  }
+  return SaveZip_(filename);
+}
+
+bool PoseGraph::Load(const std::string& filename,
+                     const std::string& pose_graph_topic_name) {
+  if (lamp_utils::PoseGraphArchiveReader::IsArchive(filename)) {
+    return LoadArchive_(filename);
+  }
+  return LoadZip_(filename, pose_graph_topic_name);
+}
+
+bool PoseGraph::SaveArchive_(const std::string& filename) const {
+  // Lazily loaded scans may still be mapped from the target file, so write
+  // to a temporary file and move it over the target once it is complete
+  const std::string tmp_filename = filename + ".tmp";
+  if (!WriteArchive_(tmp_filename)) {
+    std::remove(tmp_filename.c_str());
+    return false;
+  }
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    ROS_ERROR_STREAM("PoseGraph::Save: Could not move " << tmp_filename
+                                                        << " to " << filename);
+    std::remove(tmp_filename.c_str());
+    return false;
+  }
+  ROS_INFO_STREAM("Successfully saved pose graph with "
+                  << keyed_scans.size() << " point clouds to "
+                  << absPath(filename) << ".");
+  return true;
+}
+
+bool PoseGraph::WriteArchive_(const std::string& filename) const {
+  lamp_utils::PoseGraphArchiveWriter writer(filename);
+  if (!writer.IsOpen()) {
+    ROS_ERROR_STREAM("PoseGraph::Save: Failed to open " << filename);
+    return false;
+  }
+
+  std::vector<lamp_utils::ArchiveScan> batch;
+  batch.reserve(kArchiveBatchSize);
+  for (const auto& entry : keyed_scans) {
+    if (!values_.exists(entry.first)) {
+      ROS_WARN("PoseGraph::Save: Key %lu associated with a scan does not exist "
+               "in values.",
+               gtsam::Key(entry.first));
+      return false;
+    }
+    if (!entry.second) {
+      ROS_ERROR_STREAM("PoseGraph::Save: Scan for key "
+                       << gtsam::DefaultKeyFormatter(entry.first)
+                       << " is empty.");
+      return false;
+    }
+    batch.push_back(lamp_utils::ArchiveScan{
+        entry.first, keyed_stamps.at(entry.first), entry.second});
+    if (batch.size() == kArchiveBatchSize) {
+      if (!writer.AppendScans(batch)) return false;
+      batch.clear();
+    }
+  }
+  if (!writer.AppendScans(batch) || !writer.Finish(*ToMsg())) {
+    ROS_ERROR_STREAM("PoseGraph::Save: Failed to write " << filename);
+    return false;
+  }
+  return true;
+}
+
+bool PoseGraph::LoadArchive_(const std::string& filename) {
+  auto reader = lamp_utils::PoseGraphArchiveReader::Open(filename);
+  if (!reader) {
+    return false;
+  }
+
+  // Scans keep the mapped file alive until they are all decoded
+  for (const auto& entry : reader->GetScanEntries()) {
+    key = gtsam::Symbol(entry.key);
+    keyed_scans.erase(key);
+    keyed_scans.InsertLazy(key, [reader, entry]() {
+      return reader->DecodeScan(entry);
+    });
+    ros::Time t;
+    t.fromNSec(entry.stamp_nsec);
+    keyed_stamps[key] = t;
+  }
+  // Increment key to be ready for more scans
+  key = key + 1;
+
+  pose_graph_msgs::PoseGraph::Ptr pg_msg(new pose_graph_msgs::PoseGraph);
+  if (!reader->ReadPoseGraph(pg_msg.get())) {
+    ROS_ERROR_STREAM("Could not read pose graph message from " << filename);
+    return false;
+  }
+  this->UpdateFromMsg(pg_msg);
+
+  ROS_INFO_STREAM("Successfully loaded pose graph with "
+                  << reader->GetScanEntries().size()
+                  << " point clouds (decoded on access) from "
+                  << absPath(filename) << ".");
+  return true;
+}
+
+bool PoseGraph::SaveZip_(const std::string& zipFilename) const {
   const std::string path = "pose_graph";
   const boost::filesystem::path directory(path);
   boost::filesystem::create_directory(directory);
@@ -129,8 +247,8 @@ bool PoseGraph::Save(const std::string& zipFilename) const {
   return true;
 }
 
-bool PoseGraph::Load(const std::string& zipFilename,
-                     const std::string& pose_graph_topic_name) {
+bool PoseGraph::LoadZip_(const std::string& zipFilename,
+                         const std::string& pose_graph_topic_name) {
   const std::string absFilename = absPath(zipFilename);
   auto zipFile = unzOpen64(zipFilename.c_str());
   // TODO: Storing current key before loading graph to set key to this after
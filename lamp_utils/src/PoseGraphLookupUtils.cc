@@ -1,6 +1,8 @@
 #include "lamp_utils/PoseGraph.h"
 #include "lamp_utils/PrefixHandling.h"
 
+#include <algorithm>
+
 double PoseGraph::time_threshold = 1.0;
 
 gtsam::Symbol PoseGraph::GetKeyAtTime(const ros::Time& stamp) const {
@@ -76,61 +78,216 @@ gtsam::Symbol PoseGraph::GetClosestKeyAtTime(const ros::Time& stamp,
 }
 
 gtsam::Pose3 PoseGraph::LastPose(char c) const {
-  gtsam::Key latest = lamp_utils::GTSAM_ERROR_SYMBOL;
+  EnsureIndices();
 
   // Get the most recent pose from the given robot
-  for (auto v : values_) {
-    if (gtsam::Symbol(v.key).chr() != c) {
-      continue;
-    }
-    if (latest == lamp_utils::GTSAM_ERROR_SYMBOL) {
-      latest = v.key;
-    } else {
-      latest = std::max(latest, v.key);
-    }
-    }
+  auto latest = index_.latest_keys.find(c);
+  if (latest == index_.latest_keys.end() || !values_.exists(latest->second)) {
+    ROS_WARN_STREAM("Could not get latest pose for robot with prefix " << c);
+    return gtsam::Pose3();
+  }
+
+  return values_.at<gtsam::Pose3>(latest->second);
+}
 
-    if (latest == lamp_utils::GTSAM_ERROR_SYMBOL) {
-      ROS_WARN_STREAM("Could not get latest pose for robot with prefix " << c);
-      return gtsam::Pose3();
+namespace {
+
+// First edge in EdgeSet order, to match iterating over the set.
+const EdgeMessage* FirstEdge(const std::vector<const EdgeMessage*>& edges) {
+  const EdgeMessage* first = nullptr;
+  EdgeMessageComparator less;
+  for (const auto* edge : edges) {
+    if (first == nullptr || less(*edge, *first)) {
+      first = edge;
     }
+  }
+  return first;
+}
 
-    return values_.at<gtsam::Pose3>(latest);;
+void RemoveFromIndex(std::vector<const EdgeMessage*>* edges,
+                     const EdgeMessage* edge) {
+  edges->erase(std::remove(edges->begin(), edges->end(), edge), edges->end());
 }
 
+}  // namespace
+
 const NodeMessage* PoseGraph::FindNode(const gtsam::Key& key) const {
-  for (const auto& node : nodes_) {
-    if (node.key == key) {
-      return &node;
-    }
-  }
-  return nullptr;
+  EnsureIndices();
+  auto it = index_.nodes.find(key);
+  return it == index_.nodes.end() ? nullptr : it->second;
 }
 
 const EdgeMessage* PoseGraph::FindEdge(const gtsam::Key& key_from,
                                        const gtsam::Key& key_to) const {
+  EnsureIndices();
+  auto it = index_.edges.find(std::make_pair(key_from, key_to));
+  return it == index_.edges.end() ? nullptr : FirstEdge(it->second);
+}
+
+const EdgeMessage* PoseGraph::FindEdgeKeyTo(const gtsam::Key& key_to) const {
+  EnsureIndices();
+  auto it = index_.edges_to.find(key_to);
+  return it == index_.edges_to.end() ? nullptr : FirstEdge(it->second);
+}
+
+std::vector<const EdgeMessage*> PoseGraph::FindEdgesOfType(int type) const {
+  EnsureIndices();
+  auto it = index_.edges_by_type.find(type);
+  if (it == index_.edges_by_type.end()) {
+    return std::vector<const EdgeMessage*>();
+  }
+  return std::vector<const EdgeMessage*>(it->second.begin(), it->second.end());
+}
+
+bool PoseGraph::HasPrefix(unsigned char prefix) const {
+  EnsureIndices();
+  return index_.latest_keys.count(prefix) > 0;
+}
+
+const EdgeMessage* PoseGraph::FindPrior(const gtsam::Key& key) const {
+  EnsureIndices();
+  auto it = index_.priors.find(key);
+  return it == index_.priors.end() ? nullptr : it->second;
+}
+
+void PoseGraph::RebuildIndices() const {
+  index_.Clear();
+  for (const auto& node : nodes_) {
+    index_.nodes[node.key] = &node;
+  }
   for (const auto& edge : edges_) {
-    if (edge.key_from == key_from && edge.key_to == key_to) {
-      return &edge;
+    index_.edges[std::make_pair(edge.key_from, edge.key_to)].push_back(&edge);
+    index_.edges_to[edge.key_to].push_back(&edge);
+    index_.edges_by_prefix[gtsam::Symbol(edge.key_from).chr()].insert(&edge);
+    index_.edges_by_prefix[gtsam::Symbol(edge.key_to).chr()].insert(&edge);
+    index_.edges_by_type[edge.type].insert(&edge);
+  }
+  for (const auto& prior : priors_) {
+    index_.priors[prior.key_from] = &prior;
+  }
+  for (const auto& key : values_.keys()) {
+    IndexValueKey(key);
+  }
+}
+
+pose_graph_msgs::PoseGraph* PoseGraph::MutableMsgCache() {
+  if (msg_cache_ && !msg_cache_.unique()) {
+    // Someone still holds the snapshot, leave it alone
+    msg_cache_.reset();
+  }
+  return msg_cache_.get();
+}
+
+void PoseGraph::InsertEdge(const EdgeMessage& msg) {
+  EnsureIndices();
+  auto result = edges_.insert(msg);
+  if (!result.second) return;
+  const EdgeMessage* edge = &*result.first;
+  index_.edges[std::make_pair(edge->key_from, edge->key_to)].push_back(edge);
+  index_.edges_to[edge->key_to].push_back(edge);
+  index_.edges_by_prefix[gtsam::Symbol(edge->key_from).chr()].insert(edge);
+  index_.edges_by_prefix[gtsam::Symbol(edge->key_to).chr()].insert(edge);
+  index_.edges_by_type[edge->type].insert(edge);
+
+  // Cached message holds the edges (sorted) followed by the priors
+  if (auto* cache = MutableMsgCache()) {
+    auto end = cache->edges.begin() + (edges_.size() - 1);
+    auto pos = std::lower_bound(
+        cache->edges.begin(), end, *edge, EdgeMessageComparator());
+    cache->edges.insert(pos, *edge);
+  }
+}
+
+void PoseGraph::EraseEdge(EdgeSet::const_iterator it) {
+  EnsureIndices();
+  const EdgeMessage* edge = &*it;
+  auto pair_it = index_.edges.find(std::make_pair(edge->key_from, edge->key_to));
+  if (pair_it != index_.edges.end()) {
+    RemoveFromIndex(&pair_it->second, edge);
+    if (pair_it->second.empty()) index_.edges.erase(pair_it);
+  }
+  auto to_it = index_.edges_to.find(edge->key_to);
+  if (to_it != index_.edges_to.end()) {
+    RemoveFromIndex(&to_it->second, edge);
+    if (to_it->second.empty()) index_.edges_to.erase(to_it);
+  }
+  index_.edges_by_prefix[gtsam::Symbol(edge->key_from).chr()].erase(edge);
+  index_.edges_by_prefix[gtsam::Symbol(edge->key_to).chr()].erase(edge);
+  index_.edges_by_type[edge->type].erase(edge);
+
+  if (auto* cache = MutableMsgCache()) {
+    auto end = cache->edges.begin() + edges_.size();
+    auto pos = std::lower_bound(
+        cache->edges.begin(), end, *edge, EdgeMessageComparator());
+    if (pos != end && !EdgeMessageComparator()(*edge, *pos)) {
+      cache->edges.erase(pos);
+    } else {
+      msg_cache_.reset();
     }
   }
-  return nullptr;
+  edges_.erase(it);
 }
 
-const EdgeMessage* PoseGraph::FindEdgeKeyTo(const gtsam::Key& key_to) const {
-  for (const auto& edge : edges_) {
-    if (edge.key_to == key_to) {
-      return &edge;
+void PoseGraph::InsertNode(const NodeMessage& msg) {
+  EnsureIndices();
+  auto msg_found = nodes_.find(msg);
+  bool b_replace = msg_found != nodes_.end();
+  if (b_replace) {
+    nodes_.erase(msg_found);
+  }
+  index_.nodes[msg.key] = &*nodes_.insert(msg).first;
+
+  if (auto* cache = MutableMsgCache()) {
+    auto pos = std::lower_bound(cache->nodes.begin(),
+                                cache->nodes.end(),
+                                msg,
+                                NodeMessageComparator());
+    if (b_replace) {
+      *pos = msg;
+    } else {
+      cache->nodes.insert(pos, msg);
     }
   }
-  return nullptr;
 }
 
-const EdgeMessage* PoseGraph::FindPrior(const gtsam::Key& key) const {
-  for (const auto& edge : priors_) {
-    if (edge.key_from == key) {
-      return &edge;
+void PoseGraph::EraseNode(NodeSet::const_iterator it) {
+  EnsureIndices();
+  index_.nodes.erase(it->key);
+
+  if (auto* cache = MutableMsgCache()) {
+    auto pos = std::lower_bound(cache->nodes.begin(),
+                                cache->nodes.end(),
+                                *it,
+                                NodeMessageComparator());
+    if (pos != cache->nodes.end() && pos->key == it->key) {
+      cache->nodes.erase(pos);
+    } else {
+      msg_cache_.reset();
     }
   }
-  return nullptr;
+  nodes_.erase(it);
+}
+
+void PoseGraph::InsertPrior(const EdgeMessage& msg) {
+  EnsureIndices();
+  auto result = priors_.insert(msg);
+  if (!result.second) return;
+  index_.priors[msg.key_from] = &*result.first;
+
+  if (auto* cache = MutableMsgCache()) {
+    auto begin = cache->edges.begin() + edges_.size();
+    auto pos = std::lower_bound(
+        begin, cache->edges.end(), msg, EdgeMessageComparator());
+    cache->edges.insert(pos, msg);
+  }
+}
+
+void PoseGraph::IndexValueKey(gtsam::Key key) const {
+  unsigned char c = gtsam::Symbol(key).chr();
+  auto latest = index_.latest_keys.find(c);
+  if (latest == index_.latest_keys.end()) {
+    index_.latest_keys[c] = key;
+  } else {
+    latest->second = std::max(latest->second, key);
+  }
 }
@@ -9,16 +9,19 @@ namespace gu = geometry_utils;
 namespace gr = gu::ros;
 
 GraphMsgPtr PoseGraph::ToMsg() const {
-  return ToMsg_(edges_, nodes_, priors_);
+  if (!msg_cache_ || msg_cache_->header.frame_id != fixed_frame_id) {
+    msg_cache_ = ToMsg_(edges_, nodes_, priors_);
+  }
+  return msg_cache_;
 }
 
 GraphMsgPtr PoseGraph::ToIncrementalMsg() const {
   return ToMsg_(edges_new_, nodes_new_, priors_new_);
 }
 
-GraphMsgPtr PoseGraph::ToMsg_(const EdgeSet& edges,
-                              const NodeSet& nodes,
-                              const EdgeSet& priors) const {
+pose_graph_msgs::PoseGraph::Ptr PoseGraph::ToMsg_(const EdgeSet& edges,
+                                                  const NodeSet& nodes,
+                                                  const EdgeSet& priors) const {
   // Create the Pose Graph Message
   auto* msg = new pose_graph_msgs::PoseGraph;
   msg->header.frame_id = fixed_frame_id;
@@ -45,7 +48,7 @@ GraphMsgPtr PoseGraph::ToMsg_(const EdgeSet& edges,
   for (const auto& prior : priors)
     msg->edges.emplace_back(prior);
 
-  return GraphMsgPtr(msg);
+  return pose_graph_msgs::PoseGraph::Ptr(msg);
 }
 
 void PoseGraph::UpdateFromMsg(const GraphMsgPtr& msg) {
@@ -57,6 +60,16 @@ void PoseGraph::UpdateFromMsg(const GraphMsgPtr& msg) {
   }
 }
 
+void PoseGraph::UpdateFromDelta(const std::vector<NodeMessage>& nodes,
+                                const std::vector<EdgeMessage>& edges) {
+  for (const auto& edge : edges) {
+    TrackFactor(edge);
+  }
+  for (const auto& node : nodes) {
+    TrackNode(node);
+  }
+}
+
 void PoseGraph::AddAllValuesToNew() {
   values_new_ = values_;
 }
@@ -0,0 +1,299 @@
+/*
+ScanCompression.cc
+Quantization and oct-encoding of keyed scans
+*/
+
+#include "lamp_utils/ScanCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <zlib.h>
+
+namespace lamp_utils {
+
+namespace {
+
+// Position code reserved for non-finite coordinates
+const uint16_t kInvalidPosition = 65535;
+const float kPositionLevels = 65534.0f;
+// Normal code reserved for non-finite normals
+const uint8_t kInvalidNormal = 0;
+const float kNormalLevels = 254.0f;
+
+inline uint8_t QuantizeUnit(float v) {
+  // [-1, 1] -> [1, 255]
+  return static_cast<uint8_t>(
+      std::lround((std::min(1.0f, std::max(-1.0f, v)) + 1.0f) * 0.5f *
+                  kNormalLevels) +
+      1);
+}
+
+inline float DequantizeUnit(uint8_t q) {
+  return (q - 1) / kNormalLevels * 2.0f - 1.0f;
+}
+
+inline float SignNotZero(float v) {
+  return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+// Octahedral normal encoding (Cigolle et al. 2014)
+inline void OctEncode(float x, float y, float z, uint8_t* u, uint8_t* v) {
+  const float l1 = std::abs(x) + std::abs(y) + std::abs(z);
+  if (!std::isfinite(l1) || l1 == 0.0f) {
+    *u = *v = kInvalidNormal;
+    return;
+  }
+  x /= l1;
+  y /= l1;
+  if (z < 0.0f) {
+    const float ox = (1.0f - std::abs(y)) * SignNotZero(x);
+    const float oy = (1.0f - std::abs(x)) * SignNotZero(y);
+    x = ox;
+    y = oy;
+  }
+  *u = QuantizeUnit(x);
+  *v = QuantizeUnit(y);
+}
+
+inline void OctDecode(uint8_t u, uint8_t v, float* n) {
+  if (u == kInvalidNormal || v == kInvalidNormal) {
+    n[0] = n[1] = n[2] = std::numeric_limits<float>::quiet_NaN();
+    return;
+  }
+  float x = DequantizeUnit(u);
+  float y = DequantizeUnit(v);
+  const float z = 1.0f - std::abs(x) - std::abs(y);
+  if (z < 0.0f) {
+    const float ox = (1.0f - std::abs(y)) * SignNotZero(x);
+    const float oy = (1.0f - std::abs(x)) * SignNotZero(y);
+    x = ox;
+    y = oy;
+  }
+  const float norm = std::sqrt(x * x + y * y + z * z);
+  n[0] = x / norm;
+  n[1] = y / norm;
+  n[2] = z / norm;
+}
+
+} // namespace
+
+bool QuantizeScan(const PointCloud& scan,
+                  bool entropy_code,
+                  QuantizedScan* out) {
+  const size_t n = scan.size();
+
+  // Bounding box and value ranges over the finite points
+  float min[3], max[3];
+  float intensity_min = std::numeric_limits<float>::max();
+  float intensity_max = std::numeric_limits<float>::lowest();
+  float curvature_max = 0.0f;
+  for (int k = 0; k < 3; ++k) {
+    min[k] = std::numeric_limits<float>::max();
+    max[k] = std::numeric_limits<float>::lowest();
+  }
+  for (const auto& p : scan.points) {
+    const float xyz[3] = {p.x, p.y, p.z};
+    for (int k = 0; k < 3; ++k) {
+      if (!std::isfinite(xyz[k])) continue;
+      min[k] = std::min(min[k], xyz[k]);
+      max[k] = std::max(max[k], xyz[k]);
+    }
+    if (std::isfinite(p.intensity)) {
+      intensity_min = std::min(intensity_min, p.intensity);
+      intensity_max = std::max(intensity_max, p.intensity);
+    }
+    if (std::isfinite(p.curvature)) {
+      curvature_max = std::max(curvature_max, p.curvature);
+    }
+  }
+  for (int k = 0; k < 3; ++k) {
+    if (min[k] > max[k]) min[k] = max[k] = 0.0f;
+    out->min[k] = min[k];
+    out->scale[k] = (max[k] - min[k]) / kPositionLevels;
+  }
+  if (intensity_min > intensity_max) intensity_min = intensity_max = 0.0f;
+  out->intensity_min = intensity_min;
+  out->intensity_scale = (intensity_max - intensity_min) / 255.0f;
+  out->curvature_scale = curvature_max / 255.0f;
+  out->width = scan.width;
+  out->height = scan.height;
+  if (static_cast<size_t>(out->width) * out->height != n) {
+    out->width = n;
+    out->height = 1;
+  }
+  out->is_dense = scan.is_dense;
+
+  // Structure of arrays, which the entropy coder compresses better
+  std::vector<uint8_t> raw(n * kQuantizedPointBytes);
+  uint16_t* qxyz[3];
+  for (int k = 0; k < 3; ++k) {
+    qxyz[k] = reinterpret_cast<uint16_t*>(raw.data() + k * n * 2);
+  }
+  uint8_t* qu = raw.data() + 6 * n;
+  uint8_t* qv = qu + n;
+  uint8_t* qi = qv + n;
+  uint8_t* qc = qi + n;
+  for (size_t i = 0; i < n; ++i) {
+    const auto& p = scan.points[i];
+    const float xyz[3] = {p.x, p.y, p.z};
+    for (int k = 0; k < 3; ++k) {
+      uint16_t q = kInvalidPosition;
+      if (std::isfinite(xyz[k])) {
+        q = out->scale[k] > 0.0f
+            ? static_cast<uint16_t>(std::min<long>(
+                  std::lround((xyz[k] - min[k]) / out->scale[k]),
+                  kInvalidPosition - 1))
+            : 0;
+      }
+      std::memcpy(qxyz[k] + i, &q, sizeof(q));
+    }
+    OctEncode(p.normal_x, p.normal_y, p.normal_z, qu + i, qv + i);
+    qi[i] = (std::isfinite(p.intensity) && out->intensity_scale > 0.0f)
+        ? static_cast<uint8_t>(std::min<long>(
+              std::lround((p.intensity - intensity_min) /
+                          out->intensity_scale),
+              255))
+        : 0;
+    qc[i] = (std::isfinite(p.curvature) && out->curvature_scale > 0.0f)
+        ? static_cast<uint8_t>(std::min<long>(
+              std::lround(std::max(0.0f, p.curvature) /
+                          out->curvature_scale),
+              255))
+        : 0;
+  }
+
+  out->raw_size = raw.size();
+  out->entropy_coded = entropy_code && !raw.empty();
+  if (!out->entropy_coded) {
+    out->data.swap(raw);
+    return true;
+  }
+  uLongf size = compressBound(raw.size());
+  out->data.resize(size);
+  if (compress2(out->data.data(), &size, raw.data(), raw.size(),
+                Z_BEST_SPEED) != Z_OK) {
+    return false;
+  }
+  out->data.resize(size);
+  out->data.shrink_to_fit();
+  return true;
+}
+
+PointCloud::Ptr DequantizeScan(const QuantizedScan& in) {
+  const size_t n = static_cast<size_t>(in.width) * in.height;
+  if (in.raw_size != n * kQuantizedPointBytes) {
+    return nullptr;
+  }
+
+  std::vector<uint8_t> inflated;
+  const uint8_t* raw = in.data.data();
+  if (in.entropy_coded) {
+    inflated.resize(in.raw_size);
+    uLongf size = inflated.size();
+    if (uncompress(inflated.data(), &size, in.data.data(), in.data.size()) !=
+            Z_OK ||
+        size != in.raw_size) {
+      return nullptr;
+    }
+    raw = inflated.data();
+  } else if (in.data.size() != in.raw_size) {
+    return nullptr;
+  }
+
+  const uint8_t* qu = raw + 6 * n;
+  const uint8_t* qv = qu + n;
+  const uint8_t* qi = qv + n;
+  const uint8_t* qc = qi + n;
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+
+  PointCloud::Ptr scan(new PointCloud);
+  scan->points.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    auto& p = scan->points[i];
+    float xyz[3];
+    for (int k = 0; k < 3; ++k) {
+      uint16_t q;
+      std::memcpy(&q, raw + k * n * 2 + i * 2, sizeof(q));
+      xyz[k] = q == kInvalidPosition ? nan : in.min[k] + q * in.scale[k];
+    }
+    p.x = xyz[0];
+    p.y = xyz[1];
+    p.z = xyz[2];
+    float normal[3];
+    OctDecode(qu[i], qv[i], normal);
+    p.normal_x = normal[0];
+    p.normal_y = normal[1];
+    p.normal_z = normal[2];
+    p.intensity = in.intensity_min + qi[i] * in.intensity_scale;
+    p.curvature = qc[i] * in.curvature_scale;
+  }
+  scan->width = in.width;
+  scan->height = in.height;
+  scan->is_dense = in.is_dense;
+  return scan;
+}
+
+namespace {
+
+// Fixed size fields of a serialized QuantizedScan
+const size_t kQuantizedHeaderBytes =
+    9 * sizeof(float) + 3 * sizeof(uint32_t) + 2;
+
+template <typename T>
+inline uint8_t* Put(uint8_t* out, const T& value) {
+  std::memcpy(out, &value, sizeof(T));
+  return out + sizeof(T);
+}
+
+template <typename T>
+inline const uint8_t* Take(const uint8_t* in, T* value) {
+  std::memcpy(value, in, sizeof(T));
+  return in + sizeof(T);
+}
+
+} // namespace
+
+void SerializeQuantizedScan(const QuantizedScan& in,
+                            std::vector<uint8_t>* out) {
+  out->resize(kQuantizedHeaderBytes + in.data.size());
+  uint8_t* p = out->data();
+  for (int k = 0; k < 3; ++k) p = Put(p, in.min[k]);
+  for (int k = 0; k < 3; ++k) p = Put(p, in.scale[k]);
+  p = Put(p, in.intensity_min);
+  p = Put(p, in.intensity_scale);
+  p = Put(p, in.curvature_scale);
+  p = Put(p, in.width);
+  p = Put(p, in.height);
+  p = Put(p, in.raw_size);
+  p = Put(p, static_cast<uint8_t>(in.is_dense));
+  p = Put(p, static_cast<uint8_t>(in.entropy_coded));
+  if (!in.data.empty()) std::memcpy(p, in.data.data(), in.data.size());
+}
+
+bool DeserializeQuantizedScan(const std::vector<uint8_t>& in,
+                              QuantizedScan* out) {
+  if (in.size() < kQuantizedHeaderBytes) {
+    return false;
+  }
+  const uint8_t* p = in.data();
+  for (int k = 0; k < 3; ++k) p = Take(p, &out->min[k]);
+  for (int k = 0; k < 3; ++k) p = Take(p, &out->scale[k]);
+  p = Take(p, &out->intensity_min);
+  p = Take(p, &out->intensity_scale);
+  p = Take(p, &out->curvature_scale);
+  p = Take(p, &out->width);
+  p = Take(p, &out->height);
+  p = Take(p, &out->raw_size);
+  uint8_t is_dense, entropy_coded;
+  p = Take(p, &is_dense);
+  p = Take(p, &entropy_coded);
+  out->is_dense = is_dense;
+  out->entropy_coded = entropy_coded;
+  out->data.assign(p, in.data() + in.size());
+  return true;
+}
+
+} // namespace lamp_utils
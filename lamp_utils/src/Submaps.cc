@@ -0,0 +1,140 @@
+/*
+Submaps.cc
+Pose-anchored submaps
+*/
+
+#include "lamp_utils/Submaps.h"
+
+#include <algorithm>
+
+#include <pcl/common/transforms.h>
+#include <pcl/filters/voxel_grid.h>
+
+#include "lamp_utils/PointCloudUtils.h"
+
+namespace lamp_utils {
+
+gtsam::Key Submaps::AddScan(const gtsam::Symbol& key,
+                            const gtsam::Pose3& pose,
+                            const PointCloud& scan) {
+  Submap* submap = nullptr;
+  auto open = open_.find(key.chr());
+  if (open != open_.end()) {
+    auto it = submaps_.find(open->second);
+    if (it != submaps_.end() && !it->second.b_closed) {
+      if (static_cast<int>(it->second.keys.size()) < params_.max_scans &&
+          (pose.translation() - it->second.anchor_pose.translation()).norm() <
+              params_.max_distance) {
+        submap = &it->second;
+      } else {
+        Close(&it->second);
+      }
+    }
+  }
+  if (submap == nullptr) {
+    submap = &submaps_[key];
+    submap->anchor = key;
+    submap->anchor_pose = pose;
+    submap->points.reset(new PointCloud);
+    open_[key.chr()] = key;
+  }
+
+  // Into the anchor frame, voxelized when the submap closes
+  PointCloud scan_anchor;
+  const gtsam::Pose3 relative = submap->anchor_pose.between(pose);
+  pcl::transformPointCloud(scan, scan_anchor, relative.matrix());
+  *submap->points += scan_anchor;
+  submap->keys.push_back(key);
+
+  const gtsam::Key anchor = submap->anchor;
+  if (static_cast<int>(submap->keys.size()) >= params_.max_scans) {
+    Close(submap);
+  }
+  return anchor;
+}
+
+void Submaps::Close(Submap* submap) {
+  if (submap->b_closed) return;
+  if (params_.leaf_size > 0.0) {
+    PointCloud::Ptr merged = submap->points;
+    submap->points.reset(new PointCloud);
+    pcl::VoxelGrid<Point> grid;
+    grid.setLeafSize(params_.leaf_size, params_.leaf_size, params_.leaf_size);
+    grid.setInputCloud(merged);
+    grid.filter(*submap->points);
+  }
+  submap->b_closed = true;
+  closed_.push_back(submap->anchor);
+
+  auto open = open_.find(gtsam::Symbol(submap->anchor).chr());
+  if (open != open_.end() && open->second == submap->anchor) {
+    open_.erase(open);
+  }
+}
+
+std::vector<gtsam::Key> Submaps::UpdateAnchors(const gtsam::Values& values) {
+  std::vector<gtsam::Key> moved;
+  for (auto it = submaps_.begin(); it != submaps_.end();) {
+    if (!values.exists(it->first)) {
+      // Anchor removed from the graph (e.g. robot removed)
+      auto open = open_.find(gtsam::Symbol(it->first).chr());
+      if (open != open_.end() && open->second == it->first) open_.erase(open);
+      it = submaps_.erase(it);
+      continue;
+    }
+    const gtsam::Pose3 pose = values.at<gtsam::Pose3>(it->first);
+    const gtsam::Pose3 delta = it->second.anchor_pose.between(pose);
+    if (delta.translation().norm() > params_.translation_threshold ||
+        delta.rotation().axisAngle().second > params_.rotation_threshold) {
+      it->second.anchor_pose = pose;
+      moved.push_back(it->first);
+    }
+    ++it;
+  }
+  return moved;
+}
+
+std::vector<gtsam::Key> Submaps::TakeClosedSubmaps() {
+  std::vector<gtsam::Key> closed;
+  closed.swap(closed_);
+  // Drop anchors removed since they closed
+  closed.erase(std::remove_if(closed.begin(),
+                              closed.end(),
+                              [this](gtsam::Key key) {
+                                return submaps_.count(key) == 0;
+                              }),
+               closed.end());
+  return closed;
+}
+
+std::vector<PosedSubmap> Submaps::GetPosedSubmaps(bool b_closed_only) const {
+  std::vector<PosedSubmap> posed_submaps;
+  posed_submaps.reserve(submaps_.size());
+  for (const auto& entry : submaps_) {
+    if (b_closed_only && !entry.second.b_closed) continue;
+    posed_submaps.push_back(PosedSubmap{
+        entry.first, entry.second.anchor_pose, entry.second.points});
+  }
+  return posed_submaps;
+}
+
+void Submaps::BuildWorldMap(PointCloud* points) const {
+  BuildWorldMap(GetPosedSubmaps(), points);
+}
+
+void Submaps::BuildWorldMap(const std::vector<PosedSubmap>& submaps,
+                            PointCloud* points) {
+  std::vector<PosedScan> posed_scans;
+  posed_scans.reserve(submaps.size());
+  for (const auto& submap : submaps) {
+    posed_scans.push_back(PosedScan{submap.points.get(), submap.pose});
+  }
+  TransformAndCombineScans(posed_scans, points);
+}
+
+const Submap* Submaps::Find(gtsam::Key anchor) const {
+  auto it = submaps_.find(anchor);
+  return it == submaps_.end() ? nullptr : &it->second;
+}
+
+} // namespace lamp_utils
@@ -0,0 +1,32 @@
+/*
+ * Copyright Notes
+ *
+ * Converts a saved pose graph between the legacy zip format and the indexed
+ * archive format (see lamp_utils/PoseGraphArchive.h).
+ *
+ * Usage: convert_pose_graph_archive <input> <output>
+ * The output format follows the output filename (.pga for the archive format).
+ */
+
+#include <lamp_utils/PoseGraph.h>
+#include <ros/ros.h>
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    ROS_ERROR("Usage: %s <input> <output>", argv[0]);
+    return EXIT_FAILURE;
+  }
+  // Save stamps the graph message, but no node is needed
+  ros::Time::init();
+
+  PoseGraph graph;
+  if (!graph.Load(argv[1])) {
+    ROS_ERROR("Failed to load pose graph from %s.", argv[1]);
+    return EXIT_FAILURE;
+  }
+  if (!graph.Save(argv[2])) {
+    ROS_ERROR("Failed to save pose graph to %s.", argv[2]);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
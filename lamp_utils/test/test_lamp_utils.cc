@@ -19,6 +19,10 @@
 
 #include <lamp_utils/CommonFunctions.h>
 #include <lamp_utils/CommonStructs.h>
+#include <lamp_utils/MpscQueue.h>
+
+#include <memory>
+#include <thread>
 
 class TestUtils : public ::testing::Test {
   public:
@@ -172,6 +176,41 @@ TEST(TestCommonFunctions, TestGtsamToRosPoseCovar) {
   EXPECT_NEAR(ros_pose.covariance[0], 1.0, 1e-7);
 }
 
+TEST(TestMpscQueue, ProducersKeepTheirOrder) {
+  lamp_utils::MpscQueue<std::unique_ptr<int>> queue;
+  const int num_producers = 4;
+  const int num_values = 10000;
+  std::vector<std::thread> producers;
+  for (int p = 0; p < num_producers; p++) {
+    producers.emplace_back([&queue, p, num_values]() {
+      for (int i = 0; i < num_values; i++) {
+        queue.Push(std::unique_ptr<int>(new int(p * num_values + i)));
+      }
+    });
+  }
+
+  // Values of each producer come out in the order they went in
+  std::vector<int> last(num_producers, -1);
+  int num_popped = 0;
+  std::unique_ptr<int> value;
+  while (num_popped < num_producers * num_values) {
+    if (!queue.Pop(value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    const int producer = *value / num_values;
+    const int index = *value % num_values;
+    EXPECT_GT(index, last[producer]);
+    last[producer] = index;
+    num_popped++;
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_FALSE(queue.Pop(value));
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   ros::init(argc, argv, "test_utils");
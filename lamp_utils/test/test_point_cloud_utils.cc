@@ -10,7 +10,13 @@
 #include <pcl/io/pcd_io.h>
 #include <ros/ros.h>
 
+#include <chrono>
+#include <limits>
+#include <random>
+
+#include <lamp_utils/LampPcldFilter.h>
 #include <lamp_utils/PointCloudUtils.h>
+#include <lamp_utils/Submaps.h>
 
 #include "test_artifacts.h"
 
@@ -230,6 +236,237 @@ TEST_F(TestPointCloudUtils, ComputeAp_ForPoint2PlaneICP) {
   EXPECT_NEAR(Ap(5, 5), 100, tolerance_);
 }
 
+TEST_F(TestPointCloudUtils, TransformAndCombineScans) {
+  PointCloud::Ptr plane = GeneratePlane();
+  PointCloud::Ptr box = GenerateBox();
+  std::vector<gtsam::Pose3> poses{
+      gtsam::Pose3(gtsam::Rot3::Ypr(0.3, 0.1, -0.2), gtsam::Point3(1, 2, 3)),
+      gtsam::Pose3(gtsam::Rot3::Ypr(-1.0, 0.0, 0.5), gtsam::Point3(-4, 0, 1)),
+      gtsam::Pose3()};
+  std::vector<PosedScan> scans{PosedScan{plane.get(), poses[0]},
+                               PosedScan{box.get(), poses[1]},
+                               PosedScan{plane.get(), poses[2]}};
+
+  // Reference: transform each scan and append
+  PointCloud expected;
+  for (const auto& s : scans) {
+    PointCloud transformed;
+    pcl::transformPointCloud(*s.scan, transformed, s.pose.matrix());
+    expected += transformed;
+  }
+
+  for (int num_threads : {1, 2, 8}) {
+    PointCloud combined;
+    TransformAndCombineScans(scans, &combined, num_threads);
+    ASSERT_EQ(expected.size(), combined.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+      EXPECT_NEAR(expected.points[i].x, combined.points[i].x, 1e-4);
+      EXPECT_NEAR(expected.points[i].y, combined.points[i].y, 1e-4);
+      EXPECT_NEAR(expected.points[i].z, combined.points[i].z, 1e-4);
+      EXPECT_EQ(expected.points[i].normal_z, combined.points[i].normal_z);
+    }
+  }
+}
+
+TEST_F(TestPointCloudUtils, Submaps) {
+  PointCloud::Ptr plane = GeneratePlane();
+  SubmapParams params;
+  params.max_scans = 2;
+  params.leaf_size = 0.0;
+  Submaps submaps(params);
+
+  gtsam::Values values;
+  for (int i = 0; i < 3; i++) {
+    gtsam::Symbol key('a', i);
+    values.insert(key, gtsam::Pose3(gtsam::Rot3::Yaw(0.1 * i),
+                                    gtsam::Point3(i, 0, 0)));
+    submaps.AddScan(key, values.at<gtsam::Pose3>(key), *plane);
+  }
+  // a0 holds a0 and a1 and is closed, a2 starts a new submap
+  ASSERT_EQ(2u, submaps.size());
+  EXPECT_EQ(2u, submaps.Find(gtsam::Symbol('a', 0))->keys.size());
+  EXPECT_TRUE(submaps.Find(gtsam::Symbol('a', 0))->b_closed);
+  EXPECT_FALSE(submaps.Find(gtsam::Symbol('a', 2))->b_closed);
+  EXPECT_EQ(1u, submaps.TakeClosedSubmaps().size());
+  EXPECT_TRUE(submaps.TakeClosedSubmaps().empty());
+  EXPECT_EQ(1u, submaps.GetPosedSubmaps(true).size());
+  EXPECT_TRUE(submaps.UpdateAnchors(values).empty());
+
+  // Move everything, only the anchors change
+  gtsam::Pose3 correction(gtsam::Rot3::Roll(0.2), gtsam::Point3(0, 1, 0));
+  gtsam::Values corrected;
+  for (const auto& keyed_pose : values) {
+    corrected.insert(keyed_pose.key,
+                     correction * values.at<gtsam::Pose3>(keyed_pose.key));
+  }
+  EXPECT_EQ(2u, submaps.UpdateAnchors(corrected).size());
+
+  PointCloud expected;
+  for (const auto& keyed_pose : corrected) {
+    PointCloud transformed;
+    pcl::transformPointCloud(
+        *plane,
+        transformed,
+        corrected.at<gtsam::Pose3>(keyed_pose.key).matrix());
+    expected += transformed;
+  }
+  PointCloud world;
+  submaps.BuildWorldMap(&world);
+  ASSERT_EQ(expected.size(), world.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_NEAR(expected.points[i].x, world.points[i].x, 1e-4);
+    EXPECT_NEAR(expected.points[i].y, world.points[i].y, 1e-4);
+    EXPECT_NEAR(expected.points[i].z, world.points[i].z, 1e-4);
+  }
+
+  // Anchor removed from the graph
+  corrected.erase(gtsam::Symbol('a', 2));
+  submaps.UpdateAnchors(corrected);
+  EXPECT_EQ(1u, submaps.size());
+}
+
+namespace {
+// Lidar like scan of a 20 x 10 x 4 m room seen from near its center
+PointCloud::Ptr MakeRoomScan(size_t num_points, int seed, bool normals) {
+  const Eigen::Vector3d half_size(10.0, 5.0, 2.0);
+  std::mt19937 random(seed);
+  std::normal_distribution<double> noise(0.0, 0.01);
+  const size_t num_rings = 16;
+  const size_t per_ring = num_points / num_rings;
+  PointCloud::Ptr scan(new PointCloud);
+  scan->reserve(num_rings * per_ring);
+  for (size_t ring = 0; ring < num_rings; ring++) {
+    const double elevation = (-15.0 + 2.0 * ring) * M_PI / 180.0;
+    for (size_t j = 0; j < per_ring; j++) {
+      const double azimuth = 2.0 * M_PI * j / per_ring + 0.01 * seed;
+      const Eigen::Vector3d dir(cos(elevation) * cos(azimuth),
+                                cos(elevation) * sin(azimuth),
+                                sin(elevation));
+      // First wall hit
+      double range = std::numeric_limits<double>::max();
+      int axis = 0;
+      for (int i = 0; i < 3; i++) {
+        if (std::abs(dir(i)) < 1e-9) continue;
+        const double t = (dir(i) > 0 ? half_size(i) : -half_size(i)) / dir(i);
+        if (t < range) {
+          range = t;
+          axis = i;
+        }
+      }
+      const Eigen::Vector3d hit = dir * (range + noise(random));
+      Point p;
+      p.x = hit.x();
+      p.y = hit.y();
+      p.z = hit.z();
+      p.intensity = j % 100;
+      p.normal_x = p.normal_y = p.normal_z = 0.0f;
+      if (normals) {
+        Eigen::Vector3d n = Eigen::Vector3d::Zero();
+        n(axis) = dir(axis) > 0 ? -1.0 : 1.0;
+        p.normal_x = n.x();
+        p.normal_y = n.y();
+        p.normal_z = n.z();
+      }
+      p.curvature = 0.0f;
+      scan->push_back(p);
+    }
+  }
+  return scan;
+}
+} // namespace
+
+TEST_F(TestPointCloudUtils, FusedFilterMatchesVoxelGrid) {
+  LampPcldFilterParams params;
+  params.adaptive_grid_target = 3000;
+  params.adaptive_min_grid = 0.1;
+  params.adaptive_max_grid = 0.8;
+  params.random_filter = false;
+  params.fused_filter = true;
+  LampPcldFilter fused(params);
+  params.fused_filter = false;
+  LampPcldFilter multi_pass(params);
+
+  // Same grid cells, so the same voxels and leaf size feedback
+  for (int i = 0; i < 5; i++) {
+    PointCloud::Ptr scan = MakeRoomScan(50000, i, true);
+    PointCloud::Ptr fused_out(new PointCloud);
+    PointCloud::Ptr multi_pass_out(new PointCloud);
+    fused.Filter(*scan, fused_out);
+    multi_pass.Filter(*scan, multi_pass_out);
+    EXPECT_EQ(multi_pass_out->size(), fused_out->size());
+    EXPECT_NEAR(multi_pass.GetGridLeafSize(), fused.GetGridLeafSize(), 1e-9);
+  }
+
+  // Random decimation keeps the requested share of the voxels
+  params.fused_filter = true;
+  params.random_filter = true;
+  params.decimate_percentage = 0.8;
+  LampPcldFilter decimating(params);
+  params.random_filter = false;
+  LampPcldFilter grid_only(params);
+  PointCloud::Ptr scan = MakeRoomScan(50000, 0, true);
+  PointCloud::Ptr decimated(new PointCloud);
+  PointCloud::Ptr grid(new PointCloud);
+  decimating.Filter(*scan, decimated);
+  grid_only.Filter(*scan, grid);
+  EXPECT_EQ(static_cast<size_t>((1.0 - 0.8) * grid->size()), decimated->size());
+
+  // Small scans are not grid filtered
+  PointCloud::Ptr small = MakeRoomScan(1600, 0, true);
+  grid_only.Filter(*small, grid);
+  EXPECT_EQ(small->size(), grid->size());
+}
+
+// Fused vs multi pass filter timing (run with --gtest_also_run_disabled_tests)
+TEST_F(TestPointCloudUtils, DISABLED_FusedFilterBenchmark) {
+  // Recorded scans can be given as a list of pcd files
+  std::vector<PointCloud::Ptr> scans;
+  std::vector<std::string> files;
+  ros::param::get("~filter_benchmark_scans", files);
+  for (const auto& file : files) {
+    PointCloud::Ptr scan(new PointCloud);
+    if (pcl::io::loadPCDFile<Point>(file, *scan) == 0) {
+      scans.push_back(scan);
+    }
+  }
+  if (scans.empty()) {
+    for (int i = 0; i < 20; i++) {
+      scans.push_back(MakeRoomScan(60000, i, i % 2 == 0));
+    }
+  }
+
+  for (bool observability : {false, true}) {
+    double time[2];
+    size_t points[2] = {0, 0};
+    for (bool b_fused : {false, true}) {
+      LampPcldFilterParams params;
+      params.adaptive_grid_target = 3000;
+      params.adaptive_min_grid = 0.1;
+      params.adaptive_max_grid = 0.8;
+      params.decimate_percentage = 0.8;
+      params.observability_check = observability;
+      params.fused_filter = b_fused;
+      LampPcldFilter filter(params);
+      PointCloud::Ptr filtered(new PointCloud);
+      auto start = std::chrono::steady_clock::now();
+      for (const auto& scan : scans) {
+        filter.Filter(*scan, filtered);
+        points[b_fused] += filtered->size();
+      }
+      time[b_fused] = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    }
+    EXPECT_GT(points[1], 0u);
+    std::cout << "Keyed scan filter (observability check "
+              << (observability ? "on" : "off") << ") on " << scans.size()
+              << " scans: multi pass " << 1e3 * time[0] / scans.size()
+              << " ms/scan, fused " << 1e3 * time[1] / scans.size()
+              << " ms/scan (" << points[0] << " / " << points[1]
+              << " points kept)" << std::endl;
+  }
+}
+
 } // namespace lamp_utils
 
 int main(int argc, char** argv) {
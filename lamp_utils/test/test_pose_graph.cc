@@ -6,6 +6,11 @@
 #include <gtest/gtest.h>
 
 #include <math.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <ros/ros.h>
 
 #include <pose_graph_msgs/KeyedScan.h>
@@ -13,12 +18,15 @@
 #include <pose_graph_msgs/PoseGraphEdge.h>
 #include <pose_graph_msgs/PoseGraphNode.h>
 
+#include <pcl_conversions/pcl_conversions.h>
+
 #include <gtsam/inference/Key.h>
 #include <gtsam/inference/Symbol.h>
 #include <gtsam/linear/NoiseModel.h>
 
 #include <lamp_utils/CommonFunctions.h>
 #include <lamp_utils/CommonStructs.h>
+#include <lamp_utils/KeyedScanTransfer.h>
 #include <lamp_utils/PoseGraph.h>
 
 class TestPoseGraphClass : public ::testing::Test {
@@ -57,6 +65,57 @@ class TestPoseGraphClass : public ::testing::Test {
 
   protected:
 
+    // Single robot graph a0 ... a(num_nodes - 1), 1 m apart along x
+    void AddOdometryChain(size_t num_nodes) {
+      ros::Time::init();
+      gtsam::noiseModel::Diagonal::shared_ptr covariance(
+        gtsam::noiseModel::Diagonal::Sigmas(initial_noise_));
+
+      static const gtsam::SharedNoiseModel& noise =
+          gtsam::noiseModel::Isotropic::Variance(6, 0.1);
+
+      pose_graph_.Initialize(initial_key_, gtsam::Pose3(), covariance);
+      for (size_t i = 1; i < num_nodes; i++) {
+        gtsam::Pose3 pose(gtsam::Rot3(), gtsam::Point3(i, 0.0, 0.0));
+        pose_graph_.TrackNode(ros::Time(i), gtsam::Symbol('a', i), pose, noise);
+        pose_graph_.TrackFactor(gtsam::Symbol('a', i - 1), gtsam::Symbol('a', i), pose_graph_msgs::PoseGraphEdge::ODOM, gtsam::Pose3(gtsam::Rot3(),gtsam::Point3(1.0, 0.0, 0.0) ), noise);
+      }
+    }
+
+    // Nodes a1 ... a(num_nodes) where ai has a scan of 100 * i points
+    void AddScannedNodes(int num_nodes) {
+      ros::Time::init();
+      gtsam::noiseModel::Diagonal::shared_ptr covariance(
+        gtsam::noiseModel::Diagonal::Sigmas(initial_noise_));
+
+      static const gtsam::SharedNoiseModel& noise =
+          gtsam::noiseModel::Isotropic::Variance(6, 0.1);
+
+      pose_graph_.Initialize(initial_key_, gtsam::Pose3(), covariance);
+      for (int i = 1; i <= num_nodes; ++i) {
+        gtsam::Symbol key('a', i);
+        pose_graph_.TrackNode(ros::Time(i), key, gtsam::Pose3(), noise);
+        PointCloud::Ptr scan(new PointCloud);
+        for (int j = 0; j < 100 * i; ++j) {
+          Point p;
+          p.x = j;
+          p.y = i;
+          p.z = -j;
+          p.intensity = 0.5 * j;
+          p.normal_z = 1.0;
+          scan->push_back(p);
+        }
+        pose_graph_.InsertKeyedScan(key, scan);
+      }
+    }
+
+    // Per process path in the temporary directory
+    static std::string TempFilename(const std::string& name) {
+      const char* tmp_dir = std::getenv("TMPDIR");
+      return std::string(tmp_dir ? tmp_dir : "/tmp") + "/" +
+          std::to_string(getpid()) + "_" + name;
+    }
+
     double tolerance_ = 1e-5;
   private:
 };
@@ -243,6 +302,427 @@ TEST_F(TestPoseGraphClass, RemoveRobotFromGraph){
   EXPECT_EQ(pose_graph_back.GetPriors().size(), 1);
 }
 
+TEST_F(TestPoseGraphClass, LookupIndicesStayConsistent) {
+  ros::Time::init();
+  gtsam::noiseModel::Diagonal::shared_ptr covariance(
+    gtsam::noiseModel::Diagonal::Sigmas(initial_noise_));
+
+  static const gtsam::SharedNoiseModel& noise =
+      gtsam::noiseModel::Isotropic::Variance(6, 0.1);
+
+  pose_graph_.Initialize(initial_key_, gtsam::Pose3(), covariance);
+  pose_graph_.TrackNode(n0);
+  pose_graph_.TrackNode(n1);
+  pose_graph_.TrackNode(ros::Time(1.0), gtsam::Symbol('b', 0), gtsam::Pose3(), noise);
+  pose_graph_.TrackNode(ros::Time(3.0), gtsam::Symbol('b', 1), gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(2.0, 0.0, 0.0)), noise);
+  pose_graph_.TrackFactor(e0);
+  pose_graph_.TrackPrior(gtsam::Symbol('b', 0), gtsam::Pose3(), noise);
+  pose_graph_.TrackFactor(gtsam::Symbol('b', 0), gtsam::Symbol('b', 1), pose_graph_msgs::PoseGraphEdge::ODOM, gtsam::Pose3(gtsam::Rot3(),gtsam::Point3(2.0, 0.0, 0.0) ), noise);
+  pose_graph_.TrackFactor(gtsam::Symbol('a', 2), gtsam::Symbol('b', 1), pose_graph_msgs::PoseGraphEdge::LOOPCLOSE, gtsam::Pose3(), noise);
+
+  ASSERT_NE(pose_graph_.FindNode(gtsam::Symbol('b', 1)), nullptr);
+  EXPECT_EQ(pose_graph_.FindNode(gtsam::Symbol('b', 1))->key, gtsam::Key(gtsam::Symbol('b', 1)));
+  EXPECT_EQ(pose_graph_.FindNode(gtsam::Symbol('c', 0)), nullptr);
+  ASSERT_NE(pose_graph_.FindEdge(n0.key, n1.key), nullptr);
+  EXPECT_EQ(pose_graph_.FindEdge(n1.key, n0.key), nullptr);
+  ASSERT_NE(pose_graph_.FindEdgeKeyTo(gtsam::Symbol('b', 1)), nullptr);
+  EXPECT_EQ(pose_graph_.FindEdgeKeyTo(gtsam::Symbol('b', 1))->key_from, gtsam::Key(gtsam::Symbol('a', 2)));
+  ASSERT_NE(pose_graph_.FindPrior(gtsam::Symbol('b', 0)), nullptr);
+  EXPECT_EQ(pose_graph_.FindPrior(gtsam::Symbol('b', 1)), nullptr);
+  EXPECT_NEAR(pose_graph_.LastPose('b').translation().x(), 2.0, tolerance_);
+
+  // Loop closures rejected by the optimizer are dropped from the index
+  pose_graph_msgs::PoseGraph::Ptr inliers(new pose_graph_msgs::PoseGraph);
+  pose_graph_.UpdateLoopClosures(inliers);
+  EXPECT_EQ(pose_graph_.FindEdge(gtsam::Symbol('a', 2), gtsam::Symbol('b', 1)), nullptr);
+  ASSERT_NE(pose_graph_.FindEdgeKeyTo(gtsam::Symbol('b', 1)), nullptr);
+  EXPECT_EQ(pose_graph_.FindEdgeKeyTo(gtsam::Symbol('b', 1))->key_from, gtsam::Key(gtsam::Symbol('b', 0)));
+
+  // A copy has its own index
+  PoseGraph pose_graph_copy = pose_graph_;
+
+  pose_graph_.RemoveRobotFromGraph("husky2");
+  EXPECT_EQ(pose_graph_.FindNode(gtsam::Symbol('b', 1)), nullptr);
+  EXPECT_EQ(pose_graph_.FindPrior(gtsam::Symbol('b', 0)), nullptr);
+  EXPECT_EQ(pose_graph_.FindEdgeKeyTo(gtsam::Symbol('b', 1)), nullptr);
+  ASSERT_NE(pose_graph_.FindEdge(n0.key, n1.key), nullptr);
+
+  ASSERT_NE(pose_graph_copy.FindNode(gtsam::Symbol('b', 1)), nullptr);
+  ASSERT_NE(pose_graph_copy.FindPrior(gtsam::Symbol('b', 0)), nullptr);
+  EXPECT_NEAR(pose_graph_copy.LastPose('b').translation().x(), 2.0, tolerance_);
+
+  pose_graph_.Reset();
+  EXPECT_EQ(pose_graph_.FindNode(n0.key), nullptr);
+  EXPECT_EQ(pose_graph_.FindEdge(n0.key, n1.key), nullptr);
+}
+
+TEST_F(TestPoseGraphClass, UpdateLoopClosuresOnlyReplacesLoopClosures) {
+  ros::Time::init();
+  gtsam::noiseModel::Diagonal::shared_ptr covariance(
+    gtsam::noiseModel::Diagonal::Sigmas(initial_noise_));
+
+  static const gtsam::SharedNoiseModel& noise =
+      gtsam::noiseModel::Isotropic::Variance(6, 0.1);
+
+  pose_graph_.Initialize(initial_key_, gtsam::Pose3(), covariance);
+  pose_graph_.TrackFactor(gtsam::Symbol('a', 0), gtsam::Symbol('a', 1), pose_graph_msgs::PoseGraphEdge::ODOM, gtsam::Pose3(), noise);
+  pose_graph_.TrackFactor(gtsam::Symbol('a', 1), gtsam::Symbol('a', 2), pose_graph_msgs::PoseGraphEdge::ODOM, gtsam::Pose3(), noise);
+  pose_graph_.TrackFactor(gtsam::Symbol('a', 0), gtsam::Symbol('a', 2), pose_graph_msgs::PoseGraphEdge::LOOPCLOSE, gtsam::Pose3(), noise);
+  pose_graph_.TrackFactor(gtsam::Symbol('a', 2), gtsam::Symbol('l', 0), pose_graph_msgs::PoseGraphEdge::ARTIFACT, gtsam::Pose3(), noise);
+  EXPECT_EQ(pose_graph_.GetNfg().size(), 5);
+
+  // Optimizer kept a different loop closure
+  pose_graph_msgs::PoseGraph::Ptr inliers(new pose_graph_msgs::PoseGraph);
+  pose_graph_msgs::PoseGraphEdge lc;
+  lc.key_from = gtsam::Symbol('a', 1);
+  lc.key_to = gtsam::Symbol('a', 2);
+  lc.type = pose_graph_msgs::PoseGraphEdge::LOOPCLOSE;
+  lc.pose.orientation.w = 1.0;
+  for (size_t i = 0; i < 6; i++) lc.covariance[7 * i] = 0.1;
+  inliers->edges.push_back(lc);
+  pose_graph_.UpdateLoopClosures(inliers);
+
+  EXPECT_EQ(pose_graph_.GetNfg().size(), 5);
+  EXPECT_EQ(pose_graph_.GetEdges().size(), 4);
+  EXPECT_EQ(pose_graph_.FindEdge(gtsam::Symbol('a', 0), gtsam::Symbol('a', 2)), nullptr);
+  EXPECT_NE(pose_graph_.FindEdge(gtsam::Symbol('a', 2), gtsam::Symbol('l', 0)), nullptr);
+}
+
+TEST_F(TestPoseGraphClass, SaveLoadArchiveDecodesLazily) {
+  AddScannedNodes(3);
+  const std::string filename = TempFilename("test_pose_graph.pga");
+  ASSERT_TRUE(pose_graph_.Save(filename));
+
+  PoseGraph loaded;
+  ASSERT_TRUE(loaded.Load(filename));
+  EXPECT_EQ(loaded.GetNodes().size(), pose_graph_.GetNodes().size());
+  EXPECT_EQ(loaded.keyed_scans.size(), 3u);
+  EXPECT_EQ(loaded.keyed_scans.NumPending(), 3u);
+  EXPECT_TRUE(loaded.HasScan(gtsam::Symbol('a', 2)));
+  EXPECT_EQ(loaded.keyed_scans.NumPending(), 3u);
+
+  auto scan = loaded.keyed_scans.at(gtsam::Symbol('a', 2));
+  EXPECT_EQ(loaded.keyed_scans.NumPending(), 2u);
+  ASSERT_EQ(scan->size(), 200u);
+  EXPECT_NEAR(scan->points[10].x, 10.0, tolerance_);
+  EXPECT_NEAR(scan->points[10].y, 2.0, tolerance_);
+  EXPECT_NEAR(scan->points[10].intensity, 5.0, tolerance_);
+  EXPECT_NEAR(scan->points[10].normal_z, 1.0, tolerance_);
+  EXPECT_EQ(loaded.keyed_stamps.at(gtsam::Symbol('a', 2)), ros::Time(2));
+
+  size_t total = 0;
+  for (const auto& entry : loaded.keyed_scans) total += entry.second->size();
+  EXPECT_EQ(total, 600u);
+  EXPECT_EQ(loaded.keyed_scans.NumPending(), 0u);
+
+  std::remove(filename.c_str());
+}
+
+TEST_F(TestPoseGraphClass, SaveLazilyLoadedGraphToItsOwnFile) {
+  AddScannedNodes(3);
+  const std::string filename = TempFilename("test_pose_graph_resave.pga");
+  ASSERT_TRUE(pose_graph_.Save(filename));
+
+  // The scans are still mapped from the file that is overwritten
+  PoseGraph loaded;
+  ASSERT_TRUE(loaded.Load(filename));
+  ASSERT_EQ(loaded.keyed_scans.NumPending(), 3u);
+  ASSERT_TRUE(loaded.Save(filename));
+
+  PoseGraph reloaded;
+  ASSERT_TRUE(reloaded.Load(filename));
+  EXPECT_EQ(reloaded.GetNodes().size(), pose_graph_.GetNodes().size());
+  size_t total = 0;
+  for (const auto& entry : reloaded.keyed_scans) total += entry.second->size();
+  EXPECT_EQ(total, 600u);
+  EXPECT_NEAR(reloaded.keyed_scans.at(gtsam::Symbol('a', 3))->points[5].x,
+              5.0,
+              tolerance_);
+
+  std::remove(filename.c_str());
+}
+
+namespace {
+// Synthetic scan: points on a 40 m wide ring with upward-tilted normals
+PointCloud::Ptr MakeTestScan(size_t num_points, float offset) {
+  PointCloud::Ptr scan(new PointCloud);
+  for (size_t j = 0; j < num_points; ++j) {
+    const float angle = 2.0 * M_PI * j / num_points;
+    Point p;
+    p.x = offset + 20.0 * cos(angle);
+    p.y = 20.0 * sin(angle);
+    p.z = 0.001 * j;
+    p.intensity = j % 100;
+    p.normal_x = -cos(angle) * 0.8;
+    p.normal_y = -sin(angle) * 0.8;
+    p.normal_z = 0.6;
+    p.curvature = 0.01;
+    scan->push_back(p);
+  }
+  return scan;
+}
+} // namespace
+
+TEST_F(TestPoseGraphClass, CompressedKeyedScans) {
+  KeyedScanCompressionParams params;
+  params.enabled = true;
+  params.cache_size = 1;
+  pose_graph_.keyed_scans.SetCompression(params);
+
+  for (int i = 0; i < 4; ++i) {
+    pose_graph_.InsertKeyedScan(gtsam::Symbol('a', i), MakeTestScan(1000, i));
+  }
+  EXPECT_TRUE(pose_graph_.HasScan(gtsam::Symbol('a', 0)));
+  EXPECT_LT(pose_graph_.keyed_scans.MemoryBytes(),
+            4 * 1000 * sizeof(Point) / 2);
+
+  auto original = MakeTestScan(1000, 1);
+  auto scan = pose_graph_.keyed_scans.at(gtsam::Symbol('a', 1));
+  ASSERT_EQ(scan->size(), original->size());
+  for (size_t j = 0; j < scan->size(); ++j) {
+    const auto& p = scan->points[j];
+    const auto& q = original->points[j];
+    // 16 bits over a 40 m box
+    EXPECT_NEAR(p.x, q.x, 1e-3);
+    EXPECT_NEAR(p.y, q.y, 1e-3);
+    EXPECT_NEAR(p.z, q.z, 1e-3);
+    EXPECT_NEAR(p.intensity, q.intensity, 0.5);
+    EXPECT_NEAR(p.curvature, q.curvature, 1e-4);
+    // 8-bit oct encoding is within ~1 degree
+    EXPECT_GT(p.normal_x * q.normal_x + p.normal_y * q.normal_y +
+                  p.normal_z * q.normal_z,
+              cos(1.5 * M_PI / 180.0));
+  }
+
+  // Entries are writable through operator[] and iterable
+  pose_graph_.keyed_scans[gtsam::Symbol('a', 0)] = MakeTestScan(10, 0);
+  EXPECT_EQ(pose_graph_.keyed_scans.at(gtsam::Symbol('a', 0))->size(), 10u);
+  size_t total = 0;
+  for (const auto& entry : pose_graph_.keyed_scans) {
+    total += entry.second->size();
+  }
+  EXPECT_EQ(total, 3010u);
+
+  // Disabling decodes everything again
+  params.enabled = false;
+  pose_graph_.keyed_scans.SetCompression(params);
+  EXPECT_EQ(pose_graph_.keyed_scans.MemoryBytes(), 3010 * sizeof(Point));
+}
+
+TEST_F(TestPoseGraphClass, CompressedKeyedScansEntropyCoding) {
+  // Entropy coding is lossless on top of the quantization
+  KeyedScans quantized, coded;
+  KeyedScanCompressionParams params;
+  params.enabled = true;
+  params.cache_size = 1;
+  quantized.SetCompression(params);
+  params.entropy_coding = true;
+  coded.SetCompression(params);
+  for (int i = 0; i < 3; ++i) {
+    quantized.insert(
+        std::make_pair(gtsam::Symbol('a', i), MakeTestScan(1000, i)));
+    coded.insert(std::make_pair(gtsam::Symbol('a', i), MakeTestScan(1000, i)));
+  }
+  EXPECT_LT(coded.MemoryBytes(), quantized.MemoryBytes());
+
+  for (int i = 0; i < 3; ++i) {
+    auto p = quantized.at(gtsam::Symbol('a', i));
+    auto q = coded.at(gtsam::Symbol('a', i));
+    ASSERT_EQ(p->size(), q->size());
+    for (size_t j = 0; j < p->size(); ++j) {
+      EXPECT_EQ(p->points[j].x, q->points[j].x);
+      EXPECT_EQ(p->points[j].normal_z, q->points[j].normal_z);
+      EXPECT_EQ(p->points[j].intensity, q->points[j].intensity);
+    }
+  }
+}
+
+// Memory and decode throughput of the keyed scan compression (run with
+// --gtest_also_run_disabled_tests)
+TEST_F(TestPoseGraphClass, DISABLED_CompressedKeyedScansBenchmark) {
+  const size_t num_scans = 50;
+  const size_t num_points = 20000;
+  for (bool entropy_coding : {false, true}) {
+    KeyedScans scans;
+    KeyedScanCompressionParams params;
+    params.enabled = true;
+    params.entropy_coding = entropy_coding;
+    params.cache_size = 1;
+    scans.SetCompression(params);
+    for (size_t i = 0; i < num_scans; ++i) {
+      scans.insert(std::make_pair(gtsam::Symbol('a', i),
+                                  MakeTestScan(num_points, i)));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t decoded = 0;
+    for (const auto& entry : scans) decoded += entry.second->size();
+    double decode_s = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    EXPECT_EQ(decoded, num_scans * num_points);
+
+    std::cout << "Keyed scan compression (entropy coding "
+              << (entropy_coding ? "on" : "off") << "): "
+              << static_cast<double>(scans.MemoryBytes()) /
+                     (num_scans * num_points)
+              << " bytes/point incl. one cached scan (uncompressed "
+              << sizeof(Point)
+              << "), decode " << decoded / decode_s / 1e6 << " Mpoints/s"
+              << std::endl;
+  }
+}
+
+namespace {
+// Wait (up to 5 s) until the publisher sees a subscriber that acknowledges
+bool WaitForReceivers(const lamp_utils::KeyedScanBatchPublisher& publisher) {
+  ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(5.0);
+  while ((publisher.GetNumSubscribers() == 0 ||
+          publisher.GetNumReceivers() == 0) &&
+         ros::WallTime::now() < deadline) {
+    ros::WallDuration(0.01).sleep();
+  }
+  return publisher.GetNumReceivers() > 0;
+}
+} // namespace
+
+TEST_F(TestPoseGraphClass, KeyedScanBatchTransfer) {
+  const size_t num_scans = 120;
+  const size_t num_points = 200;
+  KeyedScans scans;
+  for (size_t i = 0; i < num_scans; ++i) {
+    scans.insert(
+        std::make_pair(gtsam::Symbol('a', i), MakeTestScan(num_points, i)));
+  }
+
+  ros::NodeHandle nh("~");
+  lamp_utils::KeyedScanBatchPublisher publisher;
+  publisher.Advertise(
+      nh, "keyed_scan_transfer", lamp_utils::KeyedScanTransferParams());
+
+  std::atomic<size_t> received(0);
+  std::atomic<size_t> received_points(0);
+  std::atomic<size_t> mismatches(0);
+  lamp_utils::KeyedScanBatchSubscriber subscriber;
+  subscriber.Subscribe(
+      nh,
+      "keyed_scan_transfer",
+      [&](const pose_graph_msgs::KeyedScan::ConstPtr& msg) {
+        received++;
+        received_points += msg->scan.width * msg->scan.height;
+        // Lossless by default
+        PointCloud scan;
+        pcl::fromROSMsg(msg->scan, scan);
+        auto original = MakeTestScan(num_points, gtsam::Symbol(msg->key).index());
+        if (scan.size() != original->size() ||
+            scan.points[7].x != original->points[7].x ||
+            scan.points[7].normal_y != original->points[7].normal_y) {
+          mismatches++;
+        }
+      });
+
+  ros::AsyncSpinner spinner(1);
+  spinner.start();
+  ASSERT_TRUE(WaitForReceivers(publisher));
+
+  // Returns once the last batch is acknowledged
+  EXPECT_TRUE(publisher.Publish(scans));
+  EXPECT_EQ(received.load(), num_scans);
+  EXPECT_EQ(received_points.load(), num_scans * num_points);
+  EXPECT_EQ(mismatches.load(), 0u);
+
+  // Returns right away, the snapshot is sent on the publisher's thread
+  publisher.PublishAsync(scans);
+  scans.clear();
+  ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(10.0);
+  while (received.load() < 2 * num_scans && ros::WallTime::now() < deadline) {
+    ros::WallDuration(0.01).sleep();
+  }
+  EXPECT_EQ(received.load(), 2 * num_scans);
+  EXPECT_EQ(mismatches.load(), 0u);
+}
+
+// Time of a bulk transfer (run with --gtest_also_run_disabled_tests)
+TEST_F(TestPoseGraphClass, DISABLED_KeyedScanBatchTransferBenchmark) {
+  const size_t num_scans = 1000;
+  const size_t num_points = 2000;
+  KeyedScans scans;
+  for (size_t i = 0; i < num_scans; ++i) {
+    scans.insert(
+        std::make_pair(gtsam::Symbol('a', i), MakeTestScan(num_points, i)));
+  }
+
+  ros::NodeHandle nh("~");
+  lamp_utils::KeyedScanBatchPublisher publisher;
+  publisher.Advertise(
+      nh, "keyed_scan_batches", lamp_utils::KeyedScanTransferParams());
+
+  std::atomic<size_t> received(0);
+  lamp_utils::KeyedScanBatchSubscriber subscriber;
+  subscriber.Subscribe(
+      nh,
+      "keyed_scan_batches",
+      [&](const pose_graph_msgs::KeyedScan::ConstPtr& msg) { received++; });
+
+  ros::AsyncSpinner spinner(1);
+  spinner.start();
+  ASSERT_TRUE(WaitForReceivers(publisher));
+
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(publisher.Publish(scans));
+  double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  EXPECT_EQ(received.load(), num_scans);
+
+  std::cout << "Keyed scan bulk transfer: " << num_scans << " scans of "
+            << num_points << " points in " << elapsed
+            << " s (one by one with 10 ms sleeps: > " << num_scans * 0.01
+            << " s)" << std::endl;
+}
+
+TEST_F(TestPoseGraphClass, LookupsOnLongGraph) {
+  const size_t num_nodes = 2000;
+  AddOdometryChain(num_nodes);
+
+  for (size_t i = 1; i < num_nodes; i++) {
+    EXPECT_NE(pose_graph_.FindNode(gtsam::Symbol('a', i)), nullptr);
+    EXPECT_NE(pose_graph_.FindEdge(gtsam::Symbol('a', i - 1), gtsam::Symbol('a', i)), nullptr);
+    EXPECT_NE(pose_graph_.FindEdgeKeyTo(gtsam::Symbol('a', i)), nullptr);
+  }
+  EXPECT_EQ(pose_graph_.FindNode(gtsam::Symbol('a', num_nodes)), nullptr);
+  EXPECT_NEAR(pose_graph_.LastPose('a').translation().x(), num_nodes - 1, tolerance_);
+}
+
+// Microbenchmark of the lookup functions on a large single robot graph (run
+// with --gtest_also_run_disabled_tests)
+TEST_F(TestPoseGraphClass, DISABLED_LookupBenchmark) {
+  const size_t num_nodes = 20000;
+  AddOdometryChain(num_nodes);
+
+  auto start = std::chrono::steady_clock::now();
+  size_t found = 0;
+  for (size_t i = 1; i < num_nodes; i++) {
+    if (pose_graph_.FindNode(gtsam::Symbol('a', i))) found++;
+    if (pose_graph_.FindEdge(gtsam::Symbol('a', i - 1), gtsam::Symbol('a', i))) found++;
+    if (pose_graph_.FindEdgeKeyTo(gtsam::Symbol('a', i))) found++;
+  }
+  double lookup_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+  EXPECT_EQ(found, 3 * (num_nodes - 1));
+
+  start = std::chrono::steady_clock::now();
+  double x = 0.0;
+  for (size_t i = 0; i < 1000; i++) {
+    x += pose_graph_.LastPose('a').translation().x();
+  }
+  double last_pose_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+  EXPECT_NEAR(x, 1000.0 * (num_nodes - 1), tolerance_);
+
+  std::cout << "PoseGraph lookups on " << num_nodes << " nodes: "
+            << 3 * (num_nodes - 1) << " Find* calls in " << lookup_ms
+            << " ms, 1000 LastPose(char) calls in " << last_pose_ms << " ms"
+            << std::endl;
+}
 
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
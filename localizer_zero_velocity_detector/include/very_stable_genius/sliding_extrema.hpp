@@ -0,0 +1,77 @@
+#ifndef __SLIDING_EXTREMA_H__
+#define __SLIDING_EXTREMA_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <very_stable_genius/vec3.hpp>
+
+namespace very_stable_genius {
+
+  /// Per axis minimum and maximum over a sliding window of a Vec3 stream.
+  /// Each axis keeps a monotonic queue of (sample index, value): a new sample
+  /// drops the queued values it dominates, so the front is always the
+  /// extremum and every sample is pushed and popped once (amortized O(1)).
+  class SlidingExtrema {
+  public:
+    /// Add the sample with the given index (indices must increase)
+    void push(uint64_t index, const Vec3 &value) {
+      for (int axis = 0; axis < 3; ++axis) {
+        const double v = get(value, axis);
+        while (!min_[axis].empty() && min_[axis].back().second >= v) {
+          min_[axis].pop_back();
+        }
+        min_[axis].emplace_back(index, v);
+        while (!max_[axis].empty() && max_[axis].back().second <= v) {
+          max_[axis].pop_back();
+        }
+        max_[axis].emplace_back(index, v);
+      }
+    }
+
+    /// Forget the samples with an index lower than first_index
+    void evictBefore(uint64_t first_index) {
+      for (int axis = 0; axis < 3; ++axis) {
+        while (!min_[axis].empty() && min_[axis].front().first < first_index) {
+          min_[axis].pop_front();
+        }
+        while (!max_[axis].empty() && max_[axis].front().first < first_index) {
+          max_[axis].pop_front();
+        }
+      }
+    }
+
+    /// Only valid if a sample is in the window
+    Vec3 min() const {
+      return Vec3(min_[0].front().second,
+                  min_[1].front().second,
+                  min_[2].front().second);
+    }
+
+    Vec3 max() const {
+      return Vec3(max_[0].front().second,
+                  max_[1].front().second,
+                  max_[2].front().second);
+    }
+
+    void clear() {
+      for (int axis = 0; axis < 3; ++axis) {
+        min_[axis].clear();
+        max_[axis].clear();
+      }
+    }
+
+  private:
+    static double get(const Vec3 &value, int axis) {
+      return axis == 0 ? value.x : (axis == 1 ? value.y : value.z);
+    }
+
+    std::deque<std::pair<uint64_t, double> > min_[3];
+    std::deque<std::pair<uint64_t, double> > max_[3];
+  };
+
+}
+
+#endif // __SLIDING_EXTREMA_H__
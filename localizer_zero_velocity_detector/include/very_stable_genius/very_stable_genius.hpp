@@ -2,10 +2,12 @@
 #define __VERY_STABLE_GENIUS_H__
 
 #include <iostream>
+#include <vector>
 #include <boost/circular_buffer.hpp>
 #include <yaml-cpp/yaml.h>
 #include <sensor_msgs/Imu.h>
 #include <very_stable_genius/vec3.hpp>
+#include <very_stable_genius/sliding_extrema.hpp>
 
 namespace very_stable_genius {
   
@@ -38,6 +40,8 @@ namespace very_stable_genius {
     void addImuMeasurement(const sensor_msgs::Imu::ConstPtr &msg); /// Add an IMU measurement to the circular buffer
     int getStatus(); /// Compute and return a Status code
     int getStatus(Vec3 *accel_avg_in); /// Compute and return a Status code and an averaged accelerometer reading
+    std::vector<int> classifyImuMeasurements(const std::vector<ImuMeasurement> &measurements); /// Add each measurement in turn and return the Status code after each one (full IMU rate detection, e.g. on a recorded stream)
+    void reset(); /// Drop all measurements, e.g. before classifying another stream
 
   private:
     double imu_rate_hz_;          /// IMU message publishing rate, in Hz. Currently 50Hz on Husky2
@@ -49,6 +53,15 @@ namespace very_stable_genius {
     double imu_max_accel_y_;      /// Maximum allowed difference between measurement and average until considered moving
     double imu_max_accel_z_;      /// Maximum allowed difference between measurement and average until considered moving
     boost::circular_buffer<ImuMeasurement> imu_circular_buffer_;  /// Circular buffer where IMU messages are stored
+
+    // Window statistics, updated as measurements come in and leave the buffer
+    void resumWindow();           /// Recompute the sums from the buffer so rounding errors do not build up
+    Vec3 accel_sum_;              /// Sum of the accelerometer readings in the buffer
+    Vec3 gyro_sum_;               /// Sum of the gyro readings in the buffer
+    SlidingExtrema accel_extrema_; /// Min and max accelerometer readings in the buffer
+    SlidingExtrema gyro_extrema_;  /// Min and max gyro readings in the buffer
+    uint64_t num_measurements_;   /// Measurements added since the last reset, the index of the next one
+    size_t num_since_resum_;      /// Measurements added since the sums were last recomputed
   };
 
 }
@@ -7,13 +7,15 @@
 
 namespace very_stable_genius {
   
-  VeryStableGenius::VeryStableGenius(const std::string &yaml_cfg_filename) {
+  VeryStableGenius::VeryStableGenius(const std::string &yaml_cfg_filename)
+    : num_measurements_(0), num_since_resum_(0) {
     // Read parameters from yaml file
     parseConfig(yaml_cfg_filename);
     imu_circular_buffer_.set_capacity(imu_rate_hz_ * observation_period_s_);
   }
 
-  VeryStableGenius::VeryStableGenius() {
+  VeryStableGenius::VeryStableGenius()
+    : num_measurements_(0), num_since_resum_(0) {
     // Default parameters if a yaml file is not provided
     imu_rate_hz_ = 50.0; 
     observation_period_s_ = 3.0; 
@@ -46,17 +48,67 @@ namespace very_stable_genius {
   }
 
   void VeryStableGenius::addImuMeasurement(const ImuMeasurement &measurement) {
+    if (imu_circular_buffer_.full()) {
+      // The oldest measurement leaves the window
+      accel_sum_ = accel_sum_ - imu_circular_buffer_.front().accel;
+      gyro_sum_ = gyro_sum_ - imu_circular_buffer_.front().gyro;
+    }
     imu_circular_buffer_.push_back(measurement);
+    accel_sum_ += measurement.accel;
+    gyro_sum_ += measurement.gyro;
+
+    // Measurement i is in the window while i >= num_measurements_ - size
+    accel_extrema_.push(num_measurements_, measurement.accel);
+    gyro_extrema_.push(num_measurements_, measurement.gyro);
+    num_measurements_++;
+    const uint64_t first_index = num_measurements_ - imu_circular_buffer_.size();
+    accel_extrema_.evictBefore(first_index);
+    gyro_extrema_.evictBefore(first_index);
+
+    // Once per window, so still O(1) amortized
+    if (++num_since_resum_ >= imu_circular_buffer_.capacity()) {
+      resumWindow();
+    }
   }
   
   void VeryStableGenius::addImuMeasurement(const sensor_msgs::Imu::ConstPtr &msg) {
-    imu_circular_buffer_.push_back(ImuMeasurement(msg->header.stamp.toSec(),
-                                                  Vec3(msg->linear_acceleration.x,
-                                                       msg->linear_acceleration.y,
-                                                       msg->linear_acceleration.z),
-                                                  Vec3(msg->angular_velocity.x,
-                                                       msg->angular_velocity.y,
-                                                       msg->angular_velocity.z)));
+    addImuMeasurement(ImuMeasurement(msg->header.stamp.toSec(),
+                                     Vec3(msg->linear_acceleration.x,
+                                          msg->linear_acceleration.y,
+                                          msg->linear_acceleration.z),
+                                     Vec3(msg->angular_velocity.x,
+                                          msg->angular_velocity.y,
+                                          msg->angular_velocity.z)));
+  }
+
+  void VeryStableGenius::resumWindow() {
+    accel_sum_ = Vec3();
+    gyro_sum_ = Vec3();
+    for (auto &measurement : imu_circular_buffer_) {
+      accel_sum_ += measurement.accel;
+      gyro_sum_ += measurement.gyro;
+    }
+    num_since_resum_ = 0;
+  }
+
+  void VeryStableGenius::reset() {
+    imu_circular_buffer_.clear();
+    accel_extrema_.clear();
+    gyro_extrema_.clear();
+    accel_sum_ = Vec3();
+    gyro_sum_ = Vec3();
+    num_measurements_ = 0;
+    num_since_resum_ = 0;
+  }
+
+  std::vector<int> VeryStableGenius::classifyImuMeasurements(const std::vector<ImuMeasurement> &measurements) {
+    std::vector<int> statuses;
+    statuses.reserve(measurements.size());
+    for (const auto &measurement : measurements) {
+      addImuMeasurement(measurement);
+      statuses.push_back(getStatus());
+    }
+    return statuses;
   }
   
   int VeryStableGenius::getStatus() {
@@ -69,27 +121,16 @@ namespace very_stable_genius {
       // ROS_INFO_STREAM("Buffer has " << imu_circular_buffer_.size() << " elements out of " << imu_circular_buffer_.capacity());
       return INITIALIZING;
     } else {
-      // Take average of all measurements in the circular buffer
+      // Average of all measurements in the circular buffer, from the running sums
       // Determine maximum difference from average. If any measurement exceeds our difference threshold, we consider the robot to be moving (nonstationary)
-      Vec3 accel_avg;
-      Vec3 accel_max = imu_circular_buffer_[0].accel;
-      Vec3 accel_min = imu_circular_buffer_[0].accel;
+      Vec3 accel_avg = accel_sum_ / static_cast<double>(imu_circular_buffer_.size());
+      Vec3 accel_max = accel_extrema_.max();
+      Vec3 accel_min = accel_extrema_.min();
       Vec3 accel_max_diff;
-      Vec3 gyro_avg;
-      Vec3 gyro_max = imu_circular_buffer_[0].gyro;
-      Vec3 gyro_min = imu_circular_buffer_[0].gyro;
+      Vec3 gyro_avg = gyro_sum_ / static_cast<double>(imu_circular_buffer_.size());
+      Vec3 gyro_max = gyro_extrema_.max();
+      Vec3 gyro_min = gyro_extrema_.min();
       Vec3 gyro_max_diff;
-      
-      for (auto &measurement : imu_circular_buffer_) {
-        accel_avg += measurement.accel;
-        gyro_avg += measurement.gyro;
-        accel_max = Vec3::max(accel_max, measurement.accel);
-        accel_min = Vec3::min(accel_min, measurement.accel);
-        gyro_max = Vec3::max(gyro_max, measurement.gyro);
-        gyro_min = Vec3::min(gyro_min, measurement.gyro);
-      }
-      accel_avg = accel_avg / static_cast<double>(imu_circular_buffer_.size());
-      gyro_avg = gyro_avg / static_cast<double>(imu_circular_buffer_.size());
 
       accel_max_diff = Vec3::max(Vec3::abs(accel_max - accel_avg),
                                  Vec3::abs(accel_avg - accel_min));
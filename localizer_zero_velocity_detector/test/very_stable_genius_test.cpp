@@ -1,36 +1,136 @@
 #include <ros/ros.h>
 #include <rosbag/bag.h>
+#include <rosbag/view.h>
 #include <very_stable_genius/very_stable_genius.hpp>
 
 #include <boost/foreach.hpp>
 #define foreach BOOST_FOREACH
 
+#include <chrono>
+#include <cmath>
+#include <random>
+
 using namespace very_stable_genius;
 
+// Status the detector had before the running window statistics: walks the
+// whole window for every measurement
+std::vector<int> classifyByWalkingWindow(const std::vector<ImuMeasurement> &measurements,
+                                         size_t window) {
+  const double imu_max_rate = 0.025;
+  const Vec3 imu_max_accel(0.75, 0.5, 0.5);
+  std::vector<int> statuses;
+  for (size_t i = 0; i < measurements.size(); ++i) {
+    if (i + 1 < window) {
+      statuses.push_back(INITIALIZING);
+      continue;
+    }
+    Vec3 accel_avg, gyro_avg;
+    Vec3 accel_max = measurements[i + 1 - window].accel;
+    Vec3 accel_min = accel_max;
+    Vec3 gyro_max = measurements[i + 1 - window].gyro;
+    Vec3 gyro_min = gyro_max;
+    for (size_t j = i + 1 - window; j <= i; ++j) {
+      accel_avg += measurements[j].accel;
+      gyro_avg += measurements[j].gyro;
+      accel_max = Vec3::max(accel_max, measurements[j].accel);
+      accel_min = Vec3::min(accel_min, measurements[j].accel);
+      gyro_max = Vec3::max(gyro_max, measurements[j].gyro);
+      gyro_min = Vec3::min(gyro_min, measurements[j].gyro);
+    }
+    accel_avg = accel_avg / static_cast<double>(window);
+    gyro_avg = gyro_avg / static_cast<double>(window);
+    Vec3 accel_max_diff = Vec3::max(Vec3::abs(accel_max - accel_avg),
+                                    Vec3::abs(accel_avg - accel_min));
+    Vec3 gyro_max_diff = Vec3::max(Vec3::abs(gyro_max - gyro_avg),
+                                   Vec3::abs(gyro_avg - gyro_min));
+    if ((accel_max_diff.x > imu_max_accel.x) ||
+        (accel_max_diff.y > imu_max_accel.y) ||
+        (accel_max_diff.z > imu_max_accel.z) ||
+        (gyro_max_diff.x > imu_max_rate) ||
+        (gyro_max_diff.y > imu_max_rate) ||
+        (gyro_max_diff.z > imu_max_rate)) {
+      statuses.push_back(NONSTATIONARY);
+    } else {
+      statuses.push_back(STATIONARY);
+    }
+  }
+  return statuses;
+}
+
+// 50 Hz stream alternating between standing still and driving every 10 s
+std::vector<ImuMeasurement> makeImuStream(size_t n) {
+  std::mt19937 generator(42);
+  std::normal_distribution<double> noise(0.0, 0.005);
+  std::vector<ImuMeasurement> measurements;
+  for (size_t i = 0; i < n; ++i) {
+    const double t = i / 50.0;
+    const double motion = (static_cast<int>(t / 10.0) % 2) ? 0.3 * std::sin(3.0 * t) : 0.0;
+    measurements.push_back(ImuMeasurement(t,
+                                          Vec3(motion + noise(generator),
+                                               noise(generator),
+                                               9.81 + noise(generator)),
+                                          Vec3(noise(generator),
+                                               noise(generator),
+                                               0.1 * motion + noise(generator))));
+  }
+  return measurements;
+}
+
 int main() {
-  // open benchmark data
-  
-  // open rosbag
-  rosbag::Bag bag;
-  bag.open("benchmark.bag", rosbag::bagmode::Read);
+  // Recorded stream if the benchmark bag is there, synthetic otherwise
+  std::vector<ImuMeasurement> measurements;
+  try {
+    rosbag::Bag bag;
+    bag.open("benchmark.bag", rosbag::bagmode::Read);
 
-  VeryStableGenius vsg;
-  
-  std::vector<std::string> topics;
-  topics.push_back(std::string("/husky2/vn100/imu"));
-  /*
-  rosbag::View view(bag, rosbag::TopicQuery(topics));
-  
-  foreach(rosbag::MessageInstance const m, view) {
-    sensor_msgs::Imu::ConstPtr msg = m.instantiate<sensor_msgs::Imu>();
-    if (msg == NULL) { continue; }
-    vsg.addImuMeasurement(msg);
-    vsg.getStatus();
+    std::vector<std::string> topics;
+    topics.push_back(std::string("/husky2/vn100/imu"));
+    rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+    foreach(rosbag::MessageInstance const m, view) {
+      sensor_msgs::Imu::ConstPtr msg = m.instantiate<sensor_msgs::Imu>();
+      if (msg == NULL) { continue; }
+      measurements.push_back(ImuMeasurement(msg->header.stamp.toSec(),
+                                            Vec3(msg->linear_acceleration.x,
+                                                 msg->linear_acceleration.y,
+                                                 msg->linear_acceleration.z),
+                                            Vec3(msg->angular_velocity.x,
+                                                 msg->angular_velocity.y,
+                                                 msg->angular_velocity.z)));
+    }
+    bag.close();
+  } catch (const rosbag::BagException &e) {
+    std::cout << "No benchmark.bag (" << e.what() << "), using a synthetic stream" << std::endl;
+  }
+  if (measurements.empty()) {
+    measurements = makeImuStream(50 * 600);
   }
-  */
-  bag.close();
 
+  // Default parameters: 50 Hz, 3 s window
+  VeryStableGenius vsg;
+  const size_t window = 150;
 
-}
+  auto start = std::chrono::steady_clock::now();
+  std::vector<int> statuses = vsg.classifyImuMeasurements(measurements);
+  double incremental_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
+  start = std::chrono::steady_clock::now();
+  std::vector<int> reference = classifyByWalkingWindow(measurements, window);
+  double walking_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
+  size_t num_stationary = 0;
+  size_t num_mismatches = 0;
+  for (size_t i = 0; i < statuses.size(); ++i) {
+    num_stationary += (statuses[i] == STATIONARY);
+    num_mismatches += (statuses[i] != reference[i]);
+  }
+
+  std::cout << measurements.size() << " measurements, " << num_stationary << " stationary" << std::endl;
+  std::cout << "Running window statistics: " << incremental_s * 1e6 / measurements.size()
+            << " us per measurement" << std::endl;
+  std::cout << "Walking the window:        " << walking_s * 1e6 / measurements.size()
+            << " us per measurement" << std::endl;
+  std::cout << num_mismatches << " statuses differ from walking the window" << std::endl;
+
+  return num_mismatches == 0 ? 0 : 1;
+}
@@ -13,6 +13,7 @@
 #include <ros/ros.h>
 #include <unordered_map>
 #include <lamp_utils/CommonStructs.h>
+#include <lamp_utils/KeyedScanTransfer.h>
 
 #include "loop_closure/LoopPrioritization.h"
 
@@ -51,6 +52,7 @@ protected:
 
   // Define subscriber
   ros::Subscriber keyed_scans_sub_;
+  lamp_utils::KeyedScanBatchSubscriber keyed_scan_batches_sub_;
 
   // Timer
   ros::Timer update_timer_;
@@ -16,6 +16,7 @@
 #include <pose_graph_msgs/KeyedScan.h>
 #include <unordered_map>
 #include <lamp_utils/CommonStructs.h>
+#include <lamp_utils/KeyedScanTransfer.h>
 
 #include "loop_closure/LoopComputation.h"
 
@@ -88,6 +89,7 @@ public:
 protected:
   // Define subscriber
   ros::Subscriber keyed_scans_sub_;
+  lamp_utils::KeyedScanBatchSubscriber keyed_scan_batches_sub_;
   ros::Subscriber keyed_poses_sub_;
 
   // Timer
@@ -28,6 +28,7 @@ Lidar pointcloud based loop closure
 
 #include <map>
 #include <lamp_utils/CommonStructs.h>
+#include <lamp_utils/KeyedScanTransfer.h>
 
 class LaserLoopClosure : public LoopClosure {
 public:
@@ -101,6 +102,7 @@ private:
 
 private:
   ros::Subscriber keyed_scans_sub_;
+  lamp_utils::KeyedScanBatchSubscriber keyed_scan_batches_sub_;
   ros::Subscriber loop_closure_seed_sub_;
   ros::Subscriber pc_gt_trigger_sub_;
 
@@ -13,6 +13,7 @@
 #include <ros/console.h>
 #include <ros/ros.h>
 #include <lamp_utils/CommonStructs.h>
+#include <lamp_utils/KeyedScanTransfer.h>
 
 #include "loop_closure/LoopPrioritization.h"
 
@@ -59,6 +60,7 @@ protected:
 
   // Define subscriber
   ros::Subscriber keyed_scans_sub_;
+  lamp_utils::KeyedScanBatchSubscriber keyed_scan_batches_sub_;
 
   // Timer
   ros::Timer update_timer_;
@@ -14,6 +14,7 @@
 #include <pose_graph_msgs/KeyedScan.h>
 #include <queue>
 #include <lamp_utils/CommonStructs.h>
+#include <lamp_utils/KeyedScanTransfer.h>
 #include <vector>
 
 namespace lamp_loop_closure {
@@ -55,6 +56,8 @@ class ObservabilityQueue : public LoopCandidateQueue  {
 
   ros::Subscriber keyed_scans_sub_;
 
+  lamp_utils::KeyedScanBatchSubscriber keyed_scan_batches_sub_;
+
   // Store keyed scans
   std::map<gtsam::Key, PointCloudConstPtr> keyed_scans_;
 
@@ -80,6 +80,11 @@ bool GenericLoopPrioritization::RegisterCallbacks(const ros::NodeHandle& n) {
   ros::NodeHandle nl(n);
   keyed_scans_sub_ = nl.subscribe<pose_graph_msgs::KeyedScan>(
       "keyed_scans", 100000, &GenericLoopPrioritization::KeyedScanCallback, this);
+  // Bulk re-sends of all the keyed scans
+  keyed_scan_batches_sub_.Subscribe(
+      nl,
+      "keyed_scan_batches",
+      boost::bind(&GenericLoopPrioritization::KeyedScanCallback, this, _1));
 
   update_timer_ =
       nl.createTimer(ros::Duration(0.1),
@@ -179,6 +179,11 @@ bool IcpLoopComputation::RegisterCallbacks(const ros::NodeHandle& n) {
   ros::NodeHandle nl(n);
   keyed_scans_sub_ = nl.subscribe<pose_graph_msgs::KeyedScan>(
       "keyed_scans", 100000, &IcpLoopComputation::KeyedScanCallback, this);
+  // Bulk re-sends of all the keyed scans
+  keyed_scan_batches_sub_.Subscribe(
+      nl,
+      "keyed_scan_batches",
+      boost::bind(&IcpLoopComputation::KeyedScanCallback, this, _1));
 
   keyed_poses_sub_ = nl.subscribe<pose_graph_msgs::PoseGraph>(
       "pose_graph_incremental",
@@ -43,6 +43,11 @@ bool LaserLoopClosure::Initialize(const ros::NodeHandle& n) {
   // Subscribers
   keyed_scans_sub_ = nl.subscribe<pose_graph_msgs::KeyedScan>(
       "keyed_scans", 100000, &LaserLoopClosure::KeyedScanCallback, this);
+  // Bulk re-sends of all the keyed scans
+  keyed_scan_batches_sub_.Subscribe(
+      nl,
+      "keyed_scan_batches",
+      boost::bind(&LaserLoopClosure::KeyedScanCallback, this, _1));
   loop_closure_seed_sub_ = nl.subscribe<pose_graph_msgs::PoseGraph>(
       "seed_loop_closure", 100000, &LaserLoopClosure::SeedCallback, this);
 
@@ -89,6 +89,11 @@ bool ObservabilityLoopPrioritization::RegisterCallbacks(
       100000,
       &ObservabilityLoopPrioritization::KeyedScanCallback,
       this);
+  // Bulk re-sends of all the keyed scans
+  keyed_scan_batches_sub_.Subscribe(
+      nl,
+      "keyed_scan_batches",
+      boost::bind(&ObservabilityLoopPrioritization::KeyedScanCallback, this, _1));
 
   update_timer_ =
       nl.createTimer(ros::Duration(1.0),
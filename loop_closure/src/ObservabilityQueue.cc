@@ -21,6 +21,11 @@ bool ObservabilityQueue::RegisterCallbacks(const ros::NodeHandle& n) {
       100,
       &ObservabilityQueue::KeyedScanCallback,
       this);
+  // Bulk re-sends of all the keyed scans
+  keyed_scan_batches_sub_.Subscribe(
+      nl,
+      "keyed_scan_batches",
+      boost::bind(&ObservabilityQueue::KeyedScanCallback, this, _1));
   return true;
 }
 
@@ -54,6 +54,7 @@
 #include <pcl_conversions/pcl_conversions.h>
 #include <lamp_utils/ColorHandling.h>
 #include <lamp_utils/CommonFunctions.h>
+#include <lamp_utils/PointCloudUtils.h>
 #include <lamp_utils/PrefixHandling.h>
 
 #include <tf_conversions/tf_eigen.h>
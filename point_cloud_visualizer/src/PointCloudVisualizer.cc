@@ -322,10 +322,37 @@ bool PointCloudVisualizer::GetTransformedPointCloudWorld(
   quat.normalize();
   b2w.block(0, 0, 3, 3) = quat.matrix();
 
-  pcl::transformPointCloud(*pose_graph_.keyed_scans[key], *points, b2w);
+  pcl::transformPointCloud(*pose_graph_.keyed_scans.at(key), *points, b2w);
 
   return true;
 }
+
+bool PointCloudVisualizer::CombineKeyedScansWorld(PointCloud* points) {
+  if (points == NULL) {
+    ROS_ERROR("Output point cloud container is null.");
+    return false;
+  }
+
+  std::vector<PointCloud::ConstPtr> scans;
+  std::vector<lamp_utils::PosedScan> posed_scans;
+  scans.reserve(pose_graph_.keyed_scans.size());
+  posed_scans.reserve(pose_graph_.keyed_scans.size());
+  for (const auto& keyed_pose : pose_graph_.GetValues()) {
+    const gtsam::Symbol key = keyed_pose.key;
+    if (!pose_graph_.HasScan(key)) {
+      continue;
+    }
+    scans.push_back(pose_graph_.keyed_scans.at(key));
+    if (!scans.back()) {
+      scans.pop_back();
+      continue;
+    }
+    posed_scans.push_back(
+        lamp_utils::PosedScan{scans.back().get(), pose_graph_.GetPose(key)});
+  }
+  lamp_utils::TransformAndCombineScans(posed_scans, points);
+  return true;
+}
 int id = 0;
 
 double base_height = 9999.0;      // 50.0;
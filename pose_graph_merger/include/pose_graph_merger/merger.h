@@ -19,9 +19,14 @@
 
 #include <gtsam/inference/Symbol.h>
 
+#include <lamp_utils/PoseGraph.h>
 #include <lamp_utils/PrefixHandling.h>
 
+#include <functional>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 #include <Eigen/Eigen>
 #include <eigen_conversions/eigen_msg.h>
@@ -45,7 +50,9 @@ public:
   // Insertion, deletion and tracking
   void InsertNode(const pose_graph_msgs::PoseGraphNode& node);
   void ClearNodes();
-  void InsertNewEdges(const pose_graph_msgs::PoseGraphConstPtr& msg);
+  // Edges of fast graphs also update the fast graph adjacency
+  void InsertNewEdges(const pose_graph_msgs::PoseGraphConstPtr& msg,
+                      bool b_fast = false);
   bool IsEdgeNew(const pose_graph_msgs::PoseGraphEdge& msg);
 
 
@@ -53,11 +60,36 @@ public:
 
   // Utility functions
   void CleanUpMap(const ros::Time& stamp);
-  pose_graph_msgs::PoseGraph GetCurrentGraph();
+  // Shared snapshot of the merged graph. It is never modified: the merger
+  // copies the graph before the next change if the snapshot is still held.
+  pose_graph_msgs::PoseGraphConstPtr GetCurrentGraph() const;
   void NormalizeNodeOrientation(pose_graph_msgs::PoseGraphNode & msg);
 
   geometry_utils::Transform3 GetPoseAtTime(const ros::Time& stamp);
 
+  // Delta interface: the merged graph is the caller's PoseGraph, and only the
+  // nodes whose merged pose changed are returned, to be applied with
+  // PoseGraph::UpdateFromDelta together with the edges of the delta.
+
+  // Merge a slow (optimized) graph, full or incremental, into graph. Returns
+  // the slow nodes that moved, and the nodes the slow graph does not have yet
+  // (odometry after its last key, re-observed artifacts) chained onto them.
+  std::vector<GraphNode>
+  MergeSlowDelta(const pose_graph_msgs::PoseGraph& slow, const PoseGraph& graph);
+
+  // Merge a fast (robot) graph increment into graph. Returns the new nodes
+  // chained onto the merged graph, re-observed artifacts, and existing nodes
+  // with a newer stamp.
+  std::vector<GraphNode>
+  MergeFastDelta(const pose_graph_msgs::PoseGraph& fast, const PoseGraph& graph);
+
+  // Combine queued fast graph increments into one increment per robot, in
+  // the order the robots first appear. Later nodes and artifact edges
+  // replace earlier ones, and repeated edges are dropped, so merging the
+  // combined increment gives the same graph as merging them one by one.
+  static std::vector<pose_graph_msgs::PoseGraph> CombineFastDeltas(
+      const std::vector<pose_graph_msgs::PoseGraphConstPtr>& graphs);
+
 private:
   pose_graph_msgs::PoseGraph current_graph_;
   pose_graph_msgs::PoseGraphConstPtr lastSlow;
@@ -81,16 +113,39 @@ private:
   ros::Publisher mergedGraphPub;
   ros::Publisher mergedPosePub;
 
-  // unique edges stored in the graph, tracked by <key_from, key_to, type>
-  std::set< std::tuple<gtsam::Key, gtsam::Key, int> > unique_edges_;
+  // Edges are identified by <key_from, key_to, type>
+  typedef std::tuple<gtsam::Key, gtsam::Key, int> EdgeId;
+  struct EdgeIdHash {
+    size_t operator()(const EdgeId& id) const {
+      size_t seed = std::hash<gtsam::Key>()(std::get<0>(id));
+      seed ^= std::hash<gtsam::Key>()(std::get<1>(id)) + 0x9e3779b97f4a7c15ULL +
+          (seed << 6) + (seed >> 2);
+      seed ^= std::hash<int>()(std::get<2>(id)) + 0x9e3779b97f4a7c15ULL +
+          (seed << 6) + (seed >> 2);
+      return seed;
+    }
+  };
+
+  // unique edges stored in the graph, mapped to their index in the edges
+  std::unordered_map<EdgeId, size_t, EdgeIdHash> edge_index_;
+
+  // Latest edge to each key of the merged graph in the fast graphs
+  std::unordered_map<gtsam::Key, EdgeId> fast_in_edges_;
+  const GraphEdge* FindFastInEdge(gtsam::Key key) const;
 
   // Robots included in the merged graph, specified by prefix char
   std::set<char> robots_;
 
   // Storing map from key to the index in the nodes vector
-  std::map<long unsigned int, int> merged_graph_KeyToIndex_;
+  std::unordered_map<gtsam::Key, size_t> merged_graph_KeyToIndex_;
+
+  // Merged graph, shared with the holders of GetCurrentGraph snapshots
+  pose_graph_msgs::PoseGraph::Ptr merged_graph_;
+  // Merged graph to modify, copied first if a snapshot is held
+  pose_graph_msgs::PoseGraph& MutableGraph();
 
-  pose_graph_msgs::PoseGraph merged_graph_;
+  // Latest key of each robot in the slow graphs given to MergeSlowDelta
+  std::unordered_map<unsigned char, gtsam::Key> last_slow_key_;
 
   // Test class fixtures
   friend class TestMerger;
@@ -118,12 +118,11 @@ void TwoPoseGraphMerge::ProcessRobotGraph(const pose_graph_msgs::PoseGraphConstP
   // Add new posegraph
   merger_.OnFastGraphMsg(msg);
 
-  // Get the fused graph
-  pose_graph_msgs::PoseGraphConstPtr fused_graph(
-    new pose_graph_msgs::PoseGraph(merger_.GetCurrentGraph()));
+  // Get the fused graph (shared snapshot, not copied)
+  pose_graph_msgs::PoseGraphConstPtr fused_graph = merger_.GetCurrentGraph();
 
   // Publish the graph
-  merged_graph_pub_.publish(*fused_graph);
+  merged_graph_pub_.publish(fused_graph);
 
   // Poses from the robot-only graph and the merged graph
   robot_pose_ = GetLatestOdomPose(msg, robot_prefix_);
@@ -156,7 +155,7 @@ void TwoPoseGraphMerge::ProcessRobotPose(const geometry_msgs::PoseStampedConstPt
 }
 
 pose_graph_msgs::PoseGraph TwoPoseGraphMerge::GetMergedGraph(){
-  return merger_.GetCurrentGraph();
+  return *merger_.GetCurrentGraph();
 }
 
 void TwoPoseGraphMerge::PublishPoses(){
@@ -1,88 +1,98 @@
 #include <pose_graph_merger/merger.h>
 
+#include <algorithm>
+
+#include <lamp_utils/CommonFunctions.h>
+
 namespace gu = geometry_utils;
 
+namespace {
+
+// Slow poses closer than this to the merged ones are not reported as changed
+const double kPoseTolerance = 1e-9;
+
+} // namespace
+
 Merger::Merger()
   : b_received_first_fast_pose_(false),
     b_received_first_slow_pose_(false),
     b_block_slow_pose_update(false),
-    lastSlow(nullptr) {}
+    lastSlow(nullptr),
+    merged_graph_(new pose_graph_msgs::PoseGraph) {}
+
+pose_graph_msgs::PoseGraph& Merger::MutableGraph() {
+  if (!merged_graph_.unique()) {
+    merged_graph_.reset(new pose_graph_msgs::PoseGraph(*merged_graph_));
+  }
+  return *merged_graph_;
+}
+
+const GraphEdge* Merger::FindFastInEdge(gtsam::Key key) const {
+  auto id = fast_in_edges_.find(key);
+  if (id == fast_in_edges_.end()) {
+    return nullptr;
+  }
+  auto index = edge_index_.find(id->second);
+  if (index == edge_index_.end()) {
+    return nullptr;
+  }
+  return &merged_graph_->edges[index->second];
+}
 
-void Merger::InsertNewEdges(const pose_graph_msgs::PoseGraphConstPtr& msg) {
+void Merger::InsertNewEdges(const pose_graph_msgs::PoseGraphConstPtr& msg,
+                            bool b_fast) {
 
   if (msg->edges.size() == 0){
     // No edges - nothing to add
     return;
   }
 
-  // New edges that we want to update with
-  std::map<std::tuple<gtsam::Key, gtsam::Key, int>,
-           pose_graph_msgs::PoseGraphEdge>
-      updated_artifact_edges;
+  pose_graph_msgs::PoseGraph& merged_graph = MutableGraph();
 
   // Add new edges and skip existing edges
   for (const GraphEdge& edge : msg->edges) {
-    std::tuple<gtsam::Key, gtsam::Key, int> id =
-        std::make_tuple(edge.key_from, edge.key_to, edge.type);
-    if (IsEdgeNew(edge)){
-      // Add to the merged graph
-      merged_graph_.edges.push_back(edge);
-
-      // Add to stored set of edges
-      unique_edges_.insert(id);
+    EdgeId id = std::make_tuple(edge.key_from, edge.key_to, edge.type);
+    auto index = edge_index_.find(id);
+    if (index == edge_index_.end()) {
+      // Add to the merged graph and to the stored edges
+      edge_index_[id] = merged_graph.edges.size();
+      merged_graph.edges.push_back(edge);
     } else if (edge.type == pose_graph_msgs::PoseGraphEdge::ARTIFACT) {
+      // Replace the existing artifact edge with the updated one
       ROS_DEBUG_STREAM("\nMerger: Repeated artifact edge with key to "
                        << gtsam::DefaultKeyFormatter(edge.key_to));
-      updated_artifact_edges[id] = edge;
+      merged_graph.edges[index->second] = edge;
     }
-  }
 
-  // Replace the existing artifact edges with updated_artifact_edges
-  pose_graph_msgs::PoseGraph new_graph;
-
-  auto e = merged_graph_.edges.begin();
-  while (e != merged_graph_.edges.end()) {
-    auto edge_itr = *e;
-    if (edge_itr.type == pose_graph_msgs::PoseGraphEdge::ARTIFACT) {
-      std::tuple<gtsam::Key, gtsam::Key, int> id =
-          std::make_tuple(edge_itr.key_from, edge_itr.key_to, edge_itr.type);
-      if (updated_artifact_edges.find(id) != updated_artifact_edges.end()) {
-        e++;
-        continue;
-      }
+    if (b_fast) {
+      // The latest edge to the key wins
+      fast_in_edges_[edge.key_to] = id;
     }
-    new_graph.edges.push_back(edge_itr);
-    e++;
-  }
-
-  auto itr = updated_artifact_edges.begin();
-  while (itr != updated_artifact_edges.end()) {
-    new_graph.edges.push_back(itr->second);
-    itr++;
   }
-  merged_graph_.edges = new_graph.edges;
 }
 
 void Merger::InsertNode(const pose_graph_msgs::PoseGraphNode& node) {
+  pose_graph_msgs::PoseGraph& merged_graph = MutableGraph();
+
   // Just update the node if it is already exist
-  if (merged_graph_KeyToIndex_.find(node.key) !=
-      merged_graph_KeyToIndex_.end()) {
-    merged_graph_.nodes[merged_graph_KeyToIndex_[node.key]] = node;
+  auto index = merged_graph_KeyToIndex_.find(node.key);
+  if (index != merged_graph_KeyToIndex_.end()) {
+    merged_graph.nodes[index->second] = node;
     ROS_DEBUG_STREAM(
         "\n[Insert Node] key to index mapping already exists, with key: "
         << gtsam::DefaultKeyFormatter(node.key) << " and index "
-        << merged_graph_KeyToIndex_[node.key]);
+        << index->second);
     return;
   }
 
   // Track the index at which the node was inserted
   ROS_DEBUG_STREAM("\nAdding new key to index mapping, with key: "
                    << gtsam::DefaultKeyFormatter(node.key) << " and index "
-                   << merged_graph_.nodes.size());
-  merged_graph_KeyToIndex_[node.key] = merged_graph_.nodes.size();
+                   << merged_graph.nodes.size());
+  merged_graph_KeyToIndex_[node.key] = merged_graph.nodes.size();
 
   // Add the node to the graph
-  merged_graph_.nodes.push_back(node);
+  merged_graph.nodes.push_back(node);
 
   // If the node is from a new robot, add it to the set of robots in the merged graph
   auto prefix = gtsam::Symbol(node.key).chr();
@@ -92,14 +102,21 @@ void Merger::InsertNode(const pose_graph_msgs::PoseGraphNode& node) {
 }
 
 void Merger::ClearNodes() {
-  merged_graph_.nodes.clear();
+  if (!merged_graph_.unique()) {
+    // Snapshot held, no need to copy the nodes
+    pose_graph_msgs::PoseGraph::Ptr graph(new pose_graph_msgs::PoseGraph);
+    graph->header = merged_graph_->header;
+    graph->edges = merged_graph_->edges;
+    merged_graph_ = graph;
+  }
+  merged_graph_->nodes.clear();
   merged_graph_KeyToIndex_.clear();
 }
 
 bool Merger::IsEdgeNew(const pose_graph_msgs::PoseGraphEdge& msg) {
   // Checks to see if an edge is new
-  std::tuple<gtsam::Key, gtsam::Key, int> id = std::make_tuple(msg.key_from, msg.key_to, msg.type);
-  return unique_edges_.count(id) == 0;
+  EdgeId id = std::make_tuple(msg.key_from, msg.key_to, msg.type);
+  return edge_index_.count(id) == 0;
 }
 
 std::set<char> Merger::GetNewRobots(const pose_graph_msgs::PoseGraphConstPtr& msg) {
@@ -128,11 +145,22 @@ void Merger::OnSlowGraphMsg(const pose_graph_msgs::PoseGraphConstPtr& msg) {
   ClearNodes();
 
   // Insert all Nodes - slow graph should be the most accurate and up to date
+  MutableGraph().nodes.reserve(msg->nodes.size());
+  merged_graph_KeyToIndex_.reserve(msg->nodes.size());
   for (const GraphNode& node : msg->nodes) {
     InsertNode(node);
   }
 
   InsertNewEdges(msg);
+
+  // Forget the fast edges to nodes that are gone (e.g. removed robots)
+  for (auto it = fast_in_edges_.begin(); it != fast_in_edges_.end();) {
+    if (merged_graph_KeyToIndex_.count(it->first)) {
+      ++it;
+    } else {
+      it = fast_in_edges_.erase(it);
+    }
+  }
 }
 
 void Merger::OnFastGraphMsg(const pose_graph_msgs::PoseGraphConstPtr& msg) {
@@ -144,70 +172,74 @@ void Merger::OnFastGraphMsg(const pose_graph_msgs::PoseGraphConstPtr& msg) {
 
   // If no slow graph (or an empty slow graph only) has been received, merged
   // graph is the fast graph only
-  if (merged_graph_.nodes.size() == 0 || new_robots.size() > 0) {
+  if (merged_graph_->nodes.size() == 0 || new_robots.size() > 0) {
     ROS_DEBUG_STREAM("Fast graph callback without any slow graphs");
 
     for (const GraphNode& node : msg->nodes) {
       InsertNode(node);
     }
 
-    InsertNewEdges(msg);
+    InsertNewEdges(msg, true);
     return;
   }
 
-  // Add new edges
-  InsertNewEdges(msg);
+  // Add new edges (updates the fast adjacency)
+  InsertNewEdges(msg, true);
 
-  // Get header from the fastGraph - most recent graph
-  merged_graph_.header = msg->header;
+  pose_graph_msgs::PoseGraph& merged_graph = MutableGraph();
 
-  std::map<long unsigned int, std::set<const GraphEdge*>> fastOutAdjList;
-  std::map<long unsigned int, std::set<const GraphEdge*>> fastInAdjList;
-  for (const GraphEdge& edge : msg->edges) {
-    fastOutAdjList[edge.key_from].insert(&edge);
-    fastInAdjList[edge.key_to].insert(&edge);
-  }
+  // Get header from the fastGraph - most recent graph
+  merged_graph.header = msg->header;
 
-  // use map to order the new fast nodes by the order they were created in
-  // std::map<unsigned int, const GraphNode*> newFastNodes;
-  std::map<long unsigned int, const GraphNode*> fastKeyToNode;
+  // New fast nodes, ordered by key (the order they were created in)
+  std::vector<const GraphNode*> newFastNodes;
 
   for (const GraphNode& node : msg->nodes) {
-    if (merged_graph_KeyToIndex_.count(node.key) != 0) {
+    auto index = merged_graph_KeyToIndex_.find(node.key);
+    if (index != merged_graph_KeyToIndex_.end()) {
       // Replace the stamp with the fast graph stamp (most correct)
-      merged_graph_.nodes[merged_graph_KeyToIndex_[node.key]].header =
-          node.header;
+      merged_graph.nodes[index->second].header = node.header;
       // TODO 1: we want to add the artifact anyway
       // if artifact node -> add that
 
-      if (fastInAdjList.find(node.key) != fastInAdjList.end()) {
-        const GraphEdge* edge_to_check = *fastInAdjList[node.key].begin();
-        if (edge_to_check->type == pose_graph_msgs::PoseGraphEdge::ARTIFACT) {
-          ROS_DEBUG_STREAM(
-              "\nDebug Merger: Adding the reobserved artifact to newfastnode "
-              << gtsam::DefaultKeyFormatter(node.key));
-          // newFastNodes[node.header.seq] = &node;
-          fastKeyToNode[node.key] = &node;
-        }
+      const GraphEdge* edge_to_check = FindFastInEdge(node.key);
+      if (edge_to_check != nullptr &&
+          edge_to_check->type == pose_graph_msgs::PoseGraphEdge::ARTIFACT) {
+        ROS_DEBUG_STREAM(
+            "\nDebug Merger: Adding the reobserved artifact to newfastnode "
+            << gtsam::DefaultKeyFormatter(node.key));
+        newFastNodes.push_back(&node);
       }
       //
       continue; // Then skip
     }
 
-    // newFastNodes[node.header.seq] = &node;
-    fastKeyToNode[node.key] = &node;
-    // ROS_INFO_STREAM("Added new fast node, key " << node.key);
+    newFastNodes.push_back(&node);
   }
+  std::sort(newFastNodes.begin(),
+            newFastNodes.end(),
+            [](const GraphNode* a, const GraphNode* b) {
+              return a->key < b->key;
+            });
+  newFastNodes.erase(std::unique(newFastNodes.begin(),
+                                 newFastNodes.end(),
+                                 [](const GraphNode* a, const GraphNode* b) {
+                                   return a->key == b->key;
+                                 }),
+                     newFastNodes.end());
 
   // for each node in the fast graph which is not in the graph
-  for (auto kv : fastKeyToNode) {
-    // ROS_INFO_STREAM("Adding new node");
-    // the fast node to add to the merged_graph_
-    const GraphNode* fastNode = kv.second;
-    // TODO 2: we skip the artifact edge if there is no edge. Find == end
-
+  for (const GraphNode* fastNode : newFastNodes) {
     // edge in the fast graph to this fast node
-    const GraphEdge* edgeToFastNode = *fastInAdjList[fastNode->key].begin();
+    const GraphEdge* edgeToFastNode = FindFastInEdge(fastNode->key);
+    if (edgeToFastNode == nullptr) {
+      // TODO 2: no edge to the node, use the robot-graph value
+      ROS_WARN_STREAM("[FastGraph] No edge to node "
+                      << gtsam::DefaultKeyFormatter(fastNode->key)
+                      << ". Using current robot-graph value.");
+      InsertNode(*fastNode);
+      continue;
+    }
 
     // create a copy of the fast node and edge to add to the merged_graph_
     GraphNode new_merged_graph_node = *fastNode;
@@ -217,7 +249,8 @@ void Merger::OnFastGraphMsg(const pose_graph_msgs::PoseGraphConstPtr& msg) {
     // graph
     long unsigned int prevFastKey = edgeToFastNode->key_from;
     // Check if the prior node exists
-    if (merged_graph_KeyToIndex_.count(prevFastKey) == 0) {
+    auto prevIndex = merged_graph_KeyToIndex_.find(prevFastKey);
+    if (prevIndex == merged_graph_KeyToIndex_.end()) {
       // Prior node doesn't exist - don't adjust
       ROS_WARN_STREAM("[FastGraph] Have missing node with an edge-from. Key: "
                       << gtsam::DefaultKeyFormatter(prevFastKey)
@@ -234,20 +267,17 @@ void Merger::OnFastGraphMsg(const pose_graph_msgs::PoseGraphConstPtr& msg) {
     }
 
     const GraphNode* merged_graph_PrevNode =
-        &merged_graph_.nodes[merged_graph_KeyToIndex_[prevFastKey]];
+        &merged_graph.nodes[prevIndex->second];
 
     // calculate the pose of the new merged graph node by applying the edge
     // transformation to the previous node
     Eigen::Affine3d new_merged_graph_edge_tf;
     tf::poseMsgToEigen(new_merged_graph_edge.pose, new_merged_graph_edge_tf);
-    // ROS_INFO_STREAM("edge tf is " << new_merged_graph_edge_tf.matrix());
 
     Eigen::Affine3d merged_graph_PrevNodeTf;
     tf::poseMsgToEigen(merged_graph_PrevNode->pose, merged_graph_PrevNodeTf);
-    // ROS_INFO_STREAM("prev node tf is " << merged_graph_PrevNodeTf.matrix());
 
     Eigen::Affine3d currGraphNodeTf = merged_graph_PrevNodeTf * new_merged_graph_edge_tf;
-    // ROS_INFO_STREAM("Resulting tf is " << currGraphNodeTf.matrix());
     tf::poseEigenToMsg(currGraphNodeTf, new_merged_graph_node.pose);
 
     // normalise pose rotation
@@ -262,7 +292,7 @@ void Merger::OnFastGraphMsg(const pose_graph_msgs::PoseGraphConstPtr& msg) {
   }
 
   ROS_DEBUG_STREAM("Finished merging graph, size "
-                  << merged_graph_.nodes.size());
+                  << merged_graph.nodes.size());
 }
 
 void Merger::NormalizeNodeOrientation(pose_graph_msgs::PoseGraphNode & msg){
@@ -379,6 +409,262 @@ void Merger::CleanUpMap(const ros::Time& stamp) {
                   << timestamped_poses_.size());
 }
 
-pose_graph_msgs::PoseGraph Merger::GetCurrentGraph() {
+pose_graph_msgs::PoseGraphConstPtr Merger::GetCurrentGraph() const {
   return merged_graph_;
 }
+
+std::vector<GraphNode>
+Merger::MergeSlowDelta(const pose_graph_msgs::PoseGraph& slow,
+                       const PoseGraph& graph) {
+  if (!slow.incremental) {
+    last_slow_key_.clear();
+  }
+
+  std::vector<GraphNode> changed;
+  // Merged pose and index in changed of every node that moved
+  std::unordered_map<gtsam::Key, std::pair<gtsam::Pose3, size_t>> moved;
+  std::set<unsigned char> moved_robots;
+
+  auto merged_pose = [&](gtsam::Key key, gtsam::Pose3* pose) {
+    auto it = moved.find(key);
+    if (it != moved.end()) {
+      *pose = it->second.first;
+      return true;
+    }
+    if (!graph.HasKey(key)) {
+      return false;
+    }
+    *pose = graph.GetPose(key);
+    return true;
+  };
+  auto set_pose = [&](gtsam::Key key,
+                      const gtsam::Pose3& pose,
+                      const GraphNode& node) {
+    auto it = moved.find(key);
+    if (it == moved.end() && graph.HasKey(key) &&
+        graph.GetPose(key).equals(pose, kPoseTolerance)) {
+      return;
+    }
+    if (it != moved.end()) {
+      it->second.first = pose;
+      changed[it->second.second].pose = lamp_utils::GtsamToRosMsg(pose);
+      return;
+    }
+    moved[key] = std::make_pair(pose, changed.size());
+    changed.push_back(node);
+    changed.back().pose = lamp_utils::GtsamToRosMsg(pose);
+    moved_robots.insert(gtsam::Symbol(key).chr());
+  };
+
+  // Slow nodes replace the merged ones
+  for (const GraphNode& node : slow.nodes) {
+    const gtsam::Symbol key(node.key);
+    if (lamp_utils::IsRobotPrefix(key.chr())) {
+      auto last = last_slow_key_.find(key.chr());
+      if (last == last_slow_key_.end()) {
+        last_slow_key_[key.chr()] = key;
+      } else {
+        last->second = std::max<gtsam::Key>(last->second, key);
+      }
+    }
+
+    GraphNode merged_node = node;
+    // Keep the stamp of the fast graph (most correct)
+    const GraphNode* existing = graph.FindNode(key);
+    if (existing != nullptr) {
+      merged_node.header = existing->header;
+    }
+    set_pose(key, lamp_utils::ToGtsam(node.pose), merged_node);
+  }
+
+  // Nodes after the last slow key of a robot that moved are chained onto it
+  for (unsigned char prefix : moved_robots) {
+    auto last = last_slow_key_.find(prefix);
+    if (last == last_slow_key_.end()) {
+      continue;
+    }
+    for (gtsam::Key key = last->second + 1; graph.HasKey(key); ++key) {
+      const GraphEdge* edge = graph.FindEdgeKeyTo(key);
+      gtsam::Pose3 prev_pose;
+      if (edge == nullptr || !merged_pose(edge->key_from, &prev_pose)) {
+        break;
+      }
+      const GraphNode* node = graph.FindNode(key);
+      if (node == nullptr) {
+        break;
+      }
+      set_pose(key, prev_pose * lamp_utils::MessageToPose(*edge), *node);
+    }
+  }
+
+  // Artifacts are placed from the edge of their first observation
+  for (const GraphEdge* edge :
+       graph.FindEdgesOfType(pose_graph_msgs::PoseGraphEdge::ARTIFACT)) {
+    if (graph.FindEdgeKeyTo(edge->key_to) != edge ||
+        (moved.count(edge->key_from) == 0 && moved.count(edge->key_to) == 0)) {
+      continue;
+    }
+    gtsam::Pose3 prev_pose;
+    const GraphNode* node = graph.FindNode(edge->key_to);
+    if (node == nullptr || !merged_pose(edge->key_from, &prev_pose)) {
+      continue;
+    }
+    ROS_DEBUG_STREAM("\n[Slow Graph Delta] Re-chaining artifact "
+                     << gtsam::DefaultKeyFormatter(edge->key_to));
+    set_pose(
+        edge->key_to, prev_pose * lamp_utils::MessageToPose(*edge), *node);
+  }
+
+  ROS_DEBUG_STREAM("Merged slow graph delta with " << slow.nodes.size()
+                                                   << " nodes, "
+                                                   << changed.size()
+                                                   << " nodes changed");
+  return changed;
+}
+
+std::vector<GraphNode>
+Merger::MergeFastDelta(const pose_graph_msgs::PoseGraph& fast,
+                       const PoseGraph& graph) {
+  // If the graph is empty or the increment brings a new robot, the merged
+  // graph takes the fast poses as they are
+  bool b_take_as_is = graph.GetValues().size() == 0;
+  for (const GraphNode& node : fast.nodes) {
+    const unsigned char prefix = gtsam::Symbol(node.key).chr();
+    if (lamp_utils::IsRobotPrefix(prefix) && !graph.HasPrefix(prefix)) {
+      b_take_as_is = true;
+      break;
+    }
+  }
+  if (b_take_as_is) {
+    return fast.nodes;
+  }
+
+  // Edge to each node of the increment, first in message order
+  std::unordered_map<gtsam::Key, const GraphEdge*> in_edges;
+  for (const GraphEdge& edge : fast.edges) {
+    in_edges.emplace(edge.key_to, &edge);
+  }
+
+  std::vector<GraphNode> merged;
+  std::vector<const GraphNode*> new_nodes;
+  for (const GraphNode& node : fast.nodes) {
+    if (!graph.HasKey(node.key)) {
+      new_nodes.push_back(&node);
+      continue;
+    }
+    auto in_edge = in_edges.find(node.key);
+    if (in_edge != in_edges.end() &&
+        in_edge->second->type == pose_graph_msgs::PoseGraphEdge::ARTIFACT) {
+      ROS_DEBUG_STREAM("\nDebug Merger: Adding the reobserved artifact "
+                       << gtsam::DefaultKeyFormatter(node.key));
+      new_nodes.push_back(&node);
+      continue;
+    }
+    // Replace the stamp with the fast graph stamp (most correct)
+    const GraphNode* existing = graph.FindNode(node.key);
+    if (existing != nullptr && existing->header.stamp != node.header.stamp) {
+      merged.push_back(*existing);
+      merged.back().header = node.header;
+    }
+  }
+
+  // Chain in the order the nodes were created
+  std::sort(new_nodes.begin(),
+            new_nodes.end(),
+            [](const GraphNode* a, const GraphNode* b) {
+              return a->key < b->key;
+            });
+  std::unordered_map<gtsam::Key, gtsam::Pose3> new_poses;
+  for (const GraphNode* node : new_nodes) {
+    GraphNode merged_node = *node;
+    auto in_edge = in_edges.find(node->key);
+    gtsam::Pose3 prev_pose;
+    bool b_has_prev = false;
+    if (in_edge != in_edges.end()) {
+      const gtsam::Key prev_key = in_edge->second->key_from;
+      auto prev = new_poses.find(prev_key);
+      if (prev != new_poses.end()) {
+        prev_pose = prev->second;
+        b_has_prev = true;
+      } else if (graph.HasKey(prev_key)) {
+        prev_pose = graph.GetPose(prev_key);
+        b_has_prev = true;
+      } else {
+        ROS_WARN_STREAM("[FastGraph] Have missing node with an edge-from. Key: "
+                        << gtsam::DefaultKeyFormatter(prev_key)
+                        << ", edge to: "
+                        << gtsam::DefaultKeyFormatter(node->key)
+                        << ". Using current robot-graph value.");
+      }
+    }
+
+    gtsam::Pose3 pose = lamp_utils::ToGtsam(node->pose);
+    if (b_has_prev) {
+      pose = prev_pose * lamp_utils::MessageToPose(*in_edge->second);
+      merged_node.pose = lamp_utils::GtsamToRosMsg(pose);
+    }
+    new_poses[node->key] = pose;
+    merged.push_back(merged_node);
+  }
+
+  ROS_DEBUG_STREAM("Merged fast graph delta with "
+                   << fast.nodes.size() << " nodes, " << merged.size()
+                   << " nodes changed");
+  return merged;
+}
+
+std::vector<pose_graph_msgs::PoseGraph> Merger::CombineFastDeltas(
+    const std::vector<pose_graph_msgs::PoseGraphConstPtr>& graphs) {
+  std::vector<pose_graph_msgs::PoseGraph> combined;
+  // Per combined graph: index of each node and edge already added
+  std::vector<std::unordered_map<gtsam::Key, size_t>> node_index;
+  std::vector<std::unordered_map<EdgeId, size_t, EdgeIdHash>> edge_index;
+  std::unordered_map<unsigned char, size_t> robot_index;
+
+  for (const auto& g : graphs) {
+    if (!g) continue;
+
+    // Increments are from one robot, identified by its first robot node
+    unsigned char robot = 0;
+    for (const GraphNode& node : g->nodes) {
+      const unsigned char prefix = gtsam::Symbol(node.key).chr();
+      if (lamp_utils::IsRobotPrefix(prefix)) {
+        robot = prefix;
+        break;
+      }
+    }
+    if (robot == 0 && !g->edges.empty()) {
+      robot = gtsam::Symbol(g->edges.front().key_from).chr();
+    }
+
+    auto robot_it = robot_index.find(robot);
+    if (robot_it == robot_index.end()) {
+      robot_it = robot_index.emplace(robot, combined.size()).first;
+      combined.emplace_back();
+      node_index.emplace_back();
+      edge_index.emplace_back();
+    }
+    const size_t i = robot_it->second;
+    pose_graph_msgs::PoseGraph& delta = combined[i];
+    delta.header = g->header;
+
+    for (const GraphNode& node : g->nodes) {
+      auto index = node_index[i].emplace(node.key, delta.nodes.size());
+      if (index.second) {
+        delta.nodes.push_back(node);
+      } else {
+        delta.nodes[index.first->second] = node;
+      }
+    }
+    for (const GraphEdge& edge : g->edges) {
+      EdgeId id = std::make_tuple(edge.key_from, edge.key_to, edge.type);
+      auto index = edge_index[i].emplace(id, delta.edges.size());
+      if (index.second) {
+        delta.edges.push_back(edge);
+      } else if (edge.type == pose_graph_msgs::PoseGraphEdge::ARTIFACT) {
+        delta.edges[index.first->second] = edge;
+      }
+    }
+  }
+  return combined;
+}
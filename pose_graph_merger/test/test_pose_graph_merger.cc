@@ -6,6 +6,8 @@
 #include <gtest/gtest.h>
 
 #include <math.h>
+#include <chrono>
+#include <iostream>
 #include <ros/ros.h>
 
 #include <pose_graph_msgs/KeyedScan.h>
@@ -16,6 +18,8 @@
 #include <gtsam/inference/Key.h>
 #include <gtsam/inference/Symbol.h>
 
+#include <lamp_utils/CommonFunctions.h>
+#include <lamp_utils/PoseGraph.h>
 #include <pose_graph_merger/merger.h>
 
 class TestMerger : public ::testing::Test {
@@ -31,6 +35,183 @@ protected:
   // Tolerance on EXPECT_NEAR assertions
   double tolerance_ = 1e-5;
 
+  GraphNode MakeNode(gtsam::Key key, double x, double y, double yaw) {
+    GraphNode node;
+    node.key = key;
+    node.header.stamp = ros::Time(gtsam::Symbol(key).index() + 1);
+    node.pose = lamp_utils::GtsamToRosMsg(
+        gtsam::Pose3(gtsam::Rot3::Yaw(yaw), gtsam::Point3(x, y, 0)));
+    for (size_t i = 0; i < 6; i++) node.covariance[7 * i] = 0.01;
+    return node;
+  }
+
+  GraphEdge MakeEdge(gtsam::Key from,
+                     gtsam::Key to,
+                     double x,
+                     double y,
+                     double yaw,
+                     int type = pose_graph_msgs::PoseGraphEdge::ODOM) {
+    GraphEdge edge;
+    edge.key_from = from;
+    edge.key_to = to;
+    edge.type = type;
+    edge.pose = lamp_utils::GtsamToRosMsg(
+        gtsam::Pose3(gtsam::Rot3::Yaw(yaw), gtsam::Point3(x, y, 0)));
+    for (size_t i = 0; i < 6; i++) edge.covariance[7 * i] = 0.01;
+    return edge;
+  }
+
+  // Every node of expected has the same pose in graph
+  void ExpectSamePoses(const pose_graph_msgs::PoseGraph& expected,
+                       const PoseGraph& graph) {
+    for (const GraphNode& node : expected.nodes) {
+      ASSERT_TRUE(graph.HasKey(node.key));
+      gtsam::Pose3 pose = graph.GetPose(node.key);
+      EXPECT_TRUE(pose.equals(lamp_utils::ToGtsam(node.pose), tolerance_))
+          << gtsam::DefaultKeyFormatter(node.key);
+    }
+  }
+
+  // Robot graph growing by 10 nodes per message, optimized graph lagging
+  // behind by 100 nodes, as on the base station. Returns the time spent in
+  // the merges (ms).
+  double MergeGrowingGraph(size_t num_nodes, size_t num_merges) {
+    const size_t step = 10;
+    const size_t lag = 100;
+    pose_graph_msgs::PoseGraph::Ptr fast(new pose_graph_msgs::PoseGraph);
+    for (size_t i = 0; i < num_nodes; i++) {
+      fast->nodes.push_back(MakeNode(gtsam::Symbol('a', i), i, 0, 0));
+      if (i > 0) {
+        fast->edges.push_back(MakeEdge(
+            gtsam::Symbol('a', i - 1), gtsam::Symbol('a', i), 1, 0, 0));
+      }
+    }
+    pose_graph_msgs::PoseGraph::Ptr slow(new pose_graph_msgs::PoseGraph);
+    slow->nodes.assign(fast->nodes.begin(), fast->nodes.end() - lag);
+    slow->edges.assign(fast->edges.begin(), fast->edges.end() - lag);
+    for (GraphNode& node : slow->nodes) {
+      node.pose.position.y = 0.5;
+    }
+
+    Merger bench_merger;
+    size_t num_merged = 0;
+    double merge_ms = 0.0;
+    for (size_t i = 0; i < num_merges; i++) {
+      auto start = std::chrono::steady_clock::now();
+      bench_merger.OnSlowGraphMsg(slow);
+      bench_merger.OnFastGraphMsg(fast);
+      // Hold the snapshot like a publisher would
+      pose_graph_msgs::PoseGraphConstPtr merged =
+          bench_merger.GetCurrentGraph();
+      merge_ms += std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start).count();
+      num_merged += merged->nodes.size();
+      for (size_t j = 0; j < step; j++) {
+        const size_t index = fast->nodes.size();
+        fast->nodes.push_back(
+            MakeNode(gtsam::Symbol('a', index), index, 0, 0));
+        fast->edges.push_back(MakeEdge(gtsam::Symbol('a', index - 1),
+                                       gtsam::Symbol('a', index),
+                                       1,
+                                       0,
+                                       0));
+      }
+    }
+
+    // Every fast node was merged, chained onto the optimized poses
+    pose_graph_msgs::PoseGraphConstPtr merged = bench_merger.GetCurrentGraph();
+    EXPECT_EQ(fast->nodes.size() - step, merged->nodes.size());
+    EXPECT_NEAR(0.5, merged->nodes.back().pose.position.y, tolerance_);
+    EXPECT_GT(num_merged, 0u);
+    return merge_ms;
+  }
+
+  // Five robots reconnect with num_increments queued increments of 5 nodes
+  // each, on top of a base graph where their first nodes have been optimized.
+  // Checks that merging them combined per robot matches merging them one by
+  // one and returns the time taken by both (ms).
+  void IngestAfterBlackout(size_t num_increments,
+                           double& sequential_ms,
+                           double& batched_ms) {
+    const std::string robots = "abcde";
+    const size_t increment_size = 5;
+
+    pose_graph_msgs::PoseGraph base;
+    for (char robot : robots) {
+      base.nodes.push_back(MakeNode(gtsam::Symbol(robot, 0), 0, 0.5, 0));
+    }
+
+    // Increments interleaved across robots, each repeating its previous node
+    std::vector<pose_graph_msgs::PoseGraphConstPtr> queued;
+    for (size_t k = 0; k < num_increments; k++) {
+      for (char robot : robots) {
+        pose_graph_msgs::PoseGraph::Ptr increment(
+            new pose_graph_msgs::PoseGraph);
+        const size_t first = k * increment_size;
+        for (size_t i = first; i <= first + increment_size; i++) {
+          increment->nodes.push_back(
+              MakeNode(gtsam::Symbol(robot, i), i, 0, 0));
+          if (i > first) {
+            increment->edges.push_back(MakeEdge(gtsam::Symbol(robot, i - 1),
+                                                gtsam::Symbol(robot, i),
+                                                1,
+                                                0,
+                                                0));
+          }
+        }
+        queued.push_back(increment);
+      }
+    }
+
+    // One by one
+    PoseGraph sequential;
+    sequential.UpdateFromDelta(base.nodes, base.edges);
+    Merger sequential_merger;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& increment : queued) {
+      sequential.UpdateFromDelta(
+          sequential_merger.MergeFastDelta(*increment, sequential),
+          increment->edges);
+    }
+    sequential_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    // Combined per robot and applied once
+    PoseGraph batched;
+    batched.UpdateFromDelta(base.nodes, base.edges);
+    Merger batched_merger;
+    start = std::chrono::steady_clock::now();
+    std::vector<pose_graph_msgs::PoseGraph> combined =
+        Merger::CombineFastDeltas(queued);
+    std::vector<GraphNode> nodes;
+    std::vector<GraphEdge> edges;
+    for (const pose_graph_msgs::PoseGraph& g : combined) {
+      std::vector<GraphNode> merged = batched_merger.MergeFastDelta(g, batched);
+      nodes.insert(nodes.end(), merged.begin(), merged.end());
+      edges.insert(edges.end(), g.edges.begin(), g.edges.end());
+    }
+    batched.UpdateFromDelta(nodes, edges);
+    batched_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    ASSERT_EQ(robots.size(), combined.size());
+    EXPECT_EQ(num_increments * increment_size + 1, combined[0].nodes.size());
+    EXPECT_EQ(num_increments * increment_size, combined[0].edges.size());
+    EXPECT_EQ(sequential.GetValues().size(), batched.GetValues().size());
+    EXPECT_EQ(sequential.GetEdges().size(), batched.GetEdges().size());
+    ExpectSamePoses(*sequential.ToMsg(), batched);
+    // Chained onto the optimized first nodes
+    const gtsam::Symbol last('e', num_increments * increment_size);
+    EXPECT_NEAR(0.5, batched.GetPose(last).translation().y(), tolerance_);
+  }
+
+  size_t NumFastInEdges() const {
+    return merger.fast_in_edges_.size();
+  }
+  const GraphEdge* FastInEdge(gtsam::Key key) const {
+    return merger.FindFastInEdge(key);
+  }
+
 private:
 };
 
@@ -117,7 +298,7 @@ TEST_F(TestMerger, BasicMerge) {
   merger.OnFastGraphMsg(fast_graph);
 
   // Get the result
-  pose_graph_msgs::PoseGraph current_graph = merger.GetCurrentGraph();
+  pose_graph_msgs::PoseGraph current_graph = *merger.GetCurrentGraph();
 
   // Check for correct number of nodes and edges
   EXPECT_EQ(3, current_graph.nodes.size());
@@ -197,7 +378,7 @@ TEST_F(TestMerger, FastGraphOnly) {
   merger.OnFastGraphMsg(fast_graph);
 
   // Get the result
-  pose_graph_msgs::PoseGraph current_graph = merger.GetCurrentGraph();
+  pose_graph_msgs::PoseGraph current_graph = *merger.GetCurrentGraph();
 
   // Check for correct number of nodes and edges
   EXPECT_EQ(3, current_graph.nodes.size());
@@ -297,7 +478,7 @@ TEST_F(TestMerger, MergeWithValuesOnlyInSlowGraph) {
   merger.OnFastGraphMsg(fast_graph);
 
   // Get the result
-  pose_graph_msgs::PoseGraph current_graph = merger.GetCurrentGraph();
+  pose_graph_msgs::PoseGraph current_graph = *merger.GetCurrentGraph();
 
   // Check for correct number of nodes and edges
   EXPECT_EQ(3, current_graph.nodes.size());
@@ -381,7 +562,7 @@ TEST_F(TestMerger, MergeWithEmptySlowGraph) {
   merger.OnFastGraphMsg(fast_graph);
 
   // Get the result
-  pose_graph_msgs::PoseGraph current_graph = merger.GetCurrentGraph();
+  pose_graph_msgs::PoseGraph current_graph = *merger.GetCurrentGraph();
 
   // Check for correct number of nodes and edges
   EXPECT_EQ(3, current_graph.nodes.size());
@@ -542,7 +723,7 @@ TEST_F(TestMerger, DoubleMerge) {
   merger.OnFastGraphMsg(fast_graph_1);
   merger.OnSlowGraphMsg(slow_graph_1);
   merger.OnFastGraphMsg(fast_graph_2);
-  pose_graph_msgs::PoseGraph current_graph = merger.GetCurrentGraph();
+  pose_graph_msgs::PoseGraph current_graph = *merger.GetCurrentGraph();
 
   // Check for correct number of nodes and edges
   EXPECT_EQ(4, current_graph.nodes.size());
@@ -571,7 +752,7 @@ TEST_F(TestMerger, DoubleMerge) {
   // Send remaining graphs and get the final result
   merger.OnSlowGraphMsg(slow_graph_2);
   merger.OnFastGraphMsg(fast_graph_3);
-  current_graph = merger.GetCurrentGraph();
+  current_graph = *merger.GetCurrentGraph();
 
   // Check the last node (a4)
   found = false;
@@ -697,7 +878,7 @@ TEST_F(TestMerger, MergeWithArtifactInFastGraph) {
   merger.OnFastGraphMsg(fast_graph);
 
   // Get the result
-  pose_graph_msgs::PoseGraph current_graph = merger.GetCurrentGraph();
+  pose_graph_msgs::PoseGraph current_graph = *merger.GetCurrentGraph();
 
   // Check for correct number of nodes and edges
   EXPECT_EQ(5, current_graph.nodes.size());
@@ -728,6 +909,180 @@ TEST_F(TestMerger, MergeWithArtifactInFastGraph) {
   EXPECT_NEAR(0.0, z, tolerance_);
 }
 
+TEST_F(TestMerger, DeltaMergeMatchesFullMerge) {
+  // Robot graph: odometry a0..a4 and an artifact observed from a2
+  pose_graph_msgs::PoseGraph fast;
+  for (int i = 0; i < 5; i++) {
+    fast.nodes.push_back(MakeNode(gtsam::Symbol('a', i), i, 0, 0.1 * i));
+  }
+  for (int i = 0; i < 4; i++) {
+    fast.edges.push_back(MakeEdge(
+        gtsam::Symbol('a', i), gtsam::Symbol('a', i + 1), 1, 0, 0.1));
+  }
+  fast.nodes.push_back(MakeNode(gtsam::Symbol('A', 0), 2, 2, 0));
+  fast.edges.push_back(MakeEdge(gtsam::Symbol('a', 2),
+                                gtsam::Symbol('A', 0),
+                                0,
+                                2,
+                                0,
+                                pose_graph_msgs::PoseGraphEdge::ARTIFACT));
+
+  // Optimizer only knows a0..a2, and moved a1 and a2
+  pose_graph_msgs::PoseGraph slow;
+  slow.nodes.push_back(fast.nodes[0]);
+  slow.nodes.push_back(MakeNode(gtsam::Symbol('a', 1), 1, 0.5, 0.2));
+  slow.nodes.push_back(MakeNode(gtsam::Symbol('a', 2), 2, 1, 0.3));
+  slow.nodes.push_back(MakeNode(gtsam::Symbol('A', 0), 2, 3, 0));
+  slow.edges = fast.edges;
+
+  merger.OnSlowGraphMsg(
+      pose_graph_msgs::PoseGraphConstPtr(new pose_graph_msgs::PoseGraph(slow)));
+  merger.OnFastGraphMsg(
+      pose_graph_msgs::PoseGraphConstPtr(new pose_graph_msgs::PoseGraph(fast)));
+  pose_graph_msgs::PoseGraph expected = *merger.GetCurrentGraph();
+
+  PoseGraph graph;
+  graph.UpdateFromMsg(
+      pose_graph_msgs::PoseGraphConstPtr(new pose_graph_msgs::PoseGraph(fast)));
+  Merger delta_merger;
+  std::vector<GraphNode> changed = delta_merger.MergeSlowDelta(slow, graph);
+  // a0 did not move
+  EXPECT_EQ(5u, changed.size());
+  graph.UpdateFromDelta(changed, slow.edges);
+  ExpectSamePoses(expected, graph);
+
+  // Optimizer delta: only a2 moved
+  pose_graph_msgs::PoseGraph slow_delta;
+  slow_delta.incremental = true;
+  slow_delta.nodes.push_back(MakeNode(gtsam::Symbol('a', 2), 2, 1.5, 0.3));
+  slow.nodes[2] = slow_delta.nodes[0];
+  merger.OnSlowGraphMsg(
+      pose_graph_msgs::PoseGraphConstPtr(new pose_graph_msgs::PoseGraph(slow)));
+  merger.OnFastGraphMsg(
+      pose_graph_msgs::PoseGraphConstPtr(new pose_graph_msgs::PoseGraph(fast)));
+  expected = *merger.GetCurrentGraph();
+
+  changed = delta_merger.MergeSlowDelta(slow_delta, graph);
+  // a2, a3, a4 and the artifact
+  EXPECT_EQ(4u, changed.size());
+  graph.UpdateFromDelta(changed, slow_delta.edges);
+  ExpectSamePoses(expected, graph);
+
+  // Robot increment on top of the merged graph
+  pose_graph_msgs::PoseGraph increment;
+  increment.nodes.push_back(MakeNode(gtsam::Symbol('a', 5), 5, 0, 0.5));
+  increment.nodes.push_back(MakeNode(gtsam::Symbol('a', 6), 6, 0, 0.6));
+  increment.edges.push_back(
+      MakeEdge(gtsam::Symbol('a', 4), gtsam::Symbol('a', 5), 1, 0, 0.1));
+  increment.edges.push_back(
+      MakeEdge(gtsam::Symbol('a', 5), gtsam::Symbol('a', 6), 1, 0, 0.1));
+
+  Merger full_merger;
+  full_merger.OnSlowGraphMsg(graph.ToMsg());
+  full_merger.OnFastGraphMsg(pose_graph_msgs::PoseGraphConstPtr(
+      new pose_graph_msgs::PoseGraph(increment)));
+  expected = *full_merger.GetCurrentGraph();
+
+  changed = delta_merger.MergeFastDelta(increment, graph);
+  EXPECT_EQ(2u, changed.size());
+  graph.UpdateFromDelta(changed, increment.edges);
+  ExpectSamePoses(expected, graph);
+}
+
+TEST_F(TestMerger, SnapshotIsNotModified) {
+  pose_graph_msgs::PoseGraph::Ptr fast(new pose_graph_msgs::PoseGraph);
+  fast->nodes.push_back(MakeNode(gtsam::Symbol('a', 0), 0, 0, 0));
+  merger.OnFastGraphMsg(fast);
+  pose_graph_msgs::PoseGraphConstPtr snapshot = merger.GetCurrentGraph();
+
+  fast->nodes.push_back(MakeNode(gtsam::Symbol('a', 1), 1, 0, 0));
+  fast->edges.push_back(
+      MakeEdge(gtsam::Symbol('a', 0), gtsam::Symbol('a', 1), 1, 0, 0));
+  merger.OnFastGraphMsg(fast);
+
+  // The merger copied the graph instead of changing the snapshot
+  EXPECT_EQ(1u, snapshot->nodes.size());
+  EXPECT_EQ(0u, snapshot->edges.size());
+  EXPECT_EQ(2u, merger.GetCurrentGraph()->nodes.size());
+  EXPECT_EQ(1u, merger.GetCurrentGraph()->edges.size());
+  // Without a snapshot held, the graph is not copied
+  const pose_graph_msgs::PoseGraph* current = merger.GetCurrentGraph().get();
+  merger.OnFastGraphMsg(fast);
+  EXPECT_EQ(current, merger.GetCurrentGraph().get());
+}
+
+TEST_F(TestMerger, FastInEdgesFollowTheGraph) {
+  pose_graph_msgs::PoseGraph::Ptr fast(new pose_graph_msgs::PoseGraph);
+  fast->nodes.push_back(MakeNode(gtsam::Symbol('a', 0), 0, 0, 0));
+  fast->nodes.push_back(MakeNode(gtsam::Symbol('a', 1), 1, 0, 0));
+  fast->edges.push_back(
+      MakeEdge(gtsam::Symbol('a', 0), gtsam::Symbol('a', 1), 1, 0, 0));
+  merger.OnFastGraphMsg(fast);
+
+  // Artifact observed from a2, then observed again from a3
+  for (size_t i = 2; i <= 3; i++) {
+    fast.reset(new pose_graph_msgs::PoseGraph);
+    fast->nodes.push_back(MakeNode(gtsam::Symbol('a', i - 1), i - 1, 0, 0));
+    fast->nodes.push_back(MakeNode(gtsam::Symbol('a', i), i, 0, 0));
+    fast->nodes.push_back(MakeNode(gtsam::Symbol('l', 0), i, 1, 0));
+    fast->edges.push_back(
+        MakeEdge(gtsam::Symbol('a', i - 1), gtsam::Symbol('a', i), 1, 0, 0));
+    fast->edges.push_back(MakeEdge(gtsam::Symbol('a', i),
+                                   gtsam::Symbol('l', 0),
+                                   0,
+                                   1,
+                                   0,
+                                   pose_graph_msgs::PoseGraphEdge::ARTIFACT));
+    merger.OnFastGraphMsg(fast);
+  }
+  ASSERT_NE(nullptr, FastInEdge(gtsam::Symbol('l', 0)));
+  EXPECT_EQ(gtsam::Key(gtsam::Symbol('a', 3)),
+            FastInEdge(gtsam::Symbol('l', 0))->key_from);
+  EXPECT_EQ(4u, NumFastInEdges());
+
+  // Nodes missing from the optimized graph take their fast edges with them
+  pose_graph_msgs::PoseGraph::Ptr slow(new pose_graph_msgs::PoseGraph);
+  slow->nodes.push_back(MakeNode(gtsam::Symbol('a', 0), 0, 0, 0));
+  slow->nodes.push_back(MakeNode(gtsam::Symbol('a', 1), 1, 0, 0));
+  slow->edges.push_back(
+      MakeEdge(gtsam::Symbol('a', 0), gtsam::Symbol('a', 1), 1, 0, 0));
+  merger.OnSlowGraphMsg(slow);
+  EXPECT_EQ(1u, NumFastInEdges());
+  EXPECT_NE(nullptr, FastInEdge(gtsam::Symbol('a', 1)));
+  EXPECT_EQ(nullptr, FastInEdge(gtsam::Symbol('l', 0)));
+}
+
+TEST_F(TestMerger, MergeGrowingGraphs) {
+  MergeGrowingGraph(200, 5);
+}
+
+// Merge latency on growing graphs (run with --gtest_also_run_disabled_tests)
+TEST_F(TestMerger, DISABLED_MergeLatencyBenchmark) {
+  const size_t num_merges = 20;
+  for (size_t num_nodes : {1000, 5000, 20000}) {
+    double merge_ms = MergeGrowingGraph(num_nodes, num_merges);
+    std::cout << "Merge of " << num_nodes << " node graphs: "
+              << merge_ms / num_merges << " ms per slow + fast merge"
+              << std::endl;
+  }
+}
+
+TEST_F(TestMerger, BatchedIngestionAfterBlackout) {
+  double sequential_ms, batched_ms;
+  IngestAfterBlackout(20, sequential_ms, batched_ms);
+}
+
+// Catch-up after a blackout (run with --gtest_also_run_disabled_tests)
+TEST_F(TestMerger, DISABLED_BatchedIngestionBenchmark) {
+  const size_t num_increments = 200;
+  double sequential_ms, batched_ms;
+  IngestAfterBlackout(num_increments, sequential_ms, batched_ms);
+  std::cout << "Catch-up on " << num_increments
+            << " queued increments from 5 robots: " << sequential_ms
+            << " ms one by one, " << batched_ms << " ms combined"
+            << std::endl;
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   ros::init(argc, argv, "test_pose_graph_merger");